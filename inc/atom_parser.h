@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libxml/xpath.h>
 #include "gcal.h"
 #include "gcontact.h"
+#include "xml_aux.h"
 
 /** Normalizes the edit url of an event (replaces "useraccount@address"
  * for "default".
@@ -157,13 +158,14 @@ int extract_and_check_alarms(xmlDoc *doc, const unsigned int recurrent,
  *
  * @param doc Pointer to a libxml document.
  *
- * @param xpath_expression Pointer to a xpath_expression string.
+ * @param query Which fixed expression selects the 'gd:who' elements
+ * (e.g. \ref XPATH_ATTENDEES, see \ref xpath_query).
  *
  * @param attendees Pointer to an array of attendees (see \ref gcal_event_attendees).
  *
  * @return 0 on sucess, -1 otherwise.
  */
-int extract_and_check_attendees(xmlDoc *doc, const char *xpath_expression,
+int extract_and_check_attendees(xmlDoc *doc, enum xpath_query query,
 				struct gcal_event_attendees **attendees);
 
 #endif
@@ -63,6 +63,20 @@ typedef enum {
 	/** Code for HTTP PUT */
 	PUT } HTTP_CMD;
 
+/** Application callback giving the bytes of a streamed upload (e.g. see
+ * \ref gcal_contact_set_photo_stream).
+ *
+ * @param buffer Where to copy the bytes.
+ *
+ * @param size Maximum number of bytes to copy.
+ *
+ * @param data Application data given with the callback.
+ *
+ * @return Number of bytes copied, 0 at the end of the data or -1 on error
+ * (which aborts the upload).
+ */
+typedef long (*gcal_read_cb)(char *buffer, size_t size, void *data);
+
 /** Really weird timestamp from RFC 3339 is
  * 1937-01-01T12:00:27.87+00:20
  * so 30 bytes is enough to have milisecond precision
@@ -108,6 +122,47 @@ struct gcal_resource_array {
 	size_t	length;
 };
 
+/** Transfer statistics of a gcal object, see \ref gcal_get_stats. */
+struct gcal_stats {
+	/** Number of HTTP requests */
+	size_t requests;
+	/** Bytes of answers received from network (compressed, see
+	 * \ref gcal_set_compression).
+	 */
+	size_t wire_bytes;
+	/** Bytes of answers after decompression (i.e. parsed ones) */
+	size_t decoded_bytes;
+};
+
+/** Operation on an entry of a batch request (see \ref gcal_batch_events
+ * and \ref gcal_batch_contacts).
+ */
+typedef enum {
+	/** Creates the entry. */
+	GCAL_BATCH_INSERT,
+	/** Updates the entry (it must have ID, edit URL and ETag). */
+	GCAL_BATCH_UPDATE,
+	/** Deletes the entry (it must have ID, edit URL and ETag). */
+	GCAL_BATCH_DELETE } gcal_batch_op;
+
+/** Outcome of each entry of a batch request, free it with
+ * \ref gcal_batch_results_cleanup.
+ */
+struct gcal_batch_result {
+	/** HTTP code of the operation (e.g. 201 for inserts, 409 for
+	 * conflicts), 0 if the server didn't process it.
+	 */
+	int status;
+	/** Reason given by server for the status */
+	char *reason;
+	/** The entry ID */
+	char *id;
+	/** The entry new ETag */
+	char *etag;
+	/** The entry edit URL */
+	char *edit_uri;
+};
+
 /** Library structure destructor (use it free its internal resources properly).
  */
 void gcal_destroy(struct gcal_resource *gcal_obj);
@@ -120,6 +175,35 @@ void gcal_destroy(struct gcal_resource *gcal_obj);
  */
 void clean_buffer(struct gcal_resource *gcal_obj);
 
+/** Internal use function, appends data to the internal buffer.
+ *
+ * It is binary safe and keeps track of the buffer fill length, growing the
+ * buffer geometrically (so downloading a big feed in small chunks costs
+ * linear time). The data is always followed by a '\0'.
+ *
+ * @param gcal_obj Library resource structure pointer.
+ *
+ * @param data Pointer to the data to be appended.
+ *
+ * @param size Data length in bytes.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_buffer_append(struct gcal_resource *gcal_obj, const void *data,
+		       size_t size);
+
+/** Internal use function, makes the internal buffer ready to be parsed
+ * after a transfer.
+ *
+ * For in memory answers this is a no-op, spooled answers are mapped
+ * in memory (see \ref gcal_set_spool).
+ *
+ * @param gcal_obj Library resource structure pointer.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_buffer_finish(struct gcal_resource *gcal_obj);
+
 
 /** Library structure constructor, the user can only have pointers to the
  * library \ref gcal_resource structure.
@@ -176,7 +260,9 @@ int gcal_get_authentication(struct gcal_resource *gcalobj,
  *
  * @param gdata_version Version of Data API.
  *
- * @return Returns 0 on success, -1 otherwise.
+ * @return Returns 0 on success, 1 if the feed has not changed (see
+ * \ref gcal_set_conditional), -1 otherwise. An unchanged feed leaves the
+ * buffer as it was before the call (i.e. holding the previous answer).
  */
 int gcal_dump(struct gcal_resource *gcalobj, const char *gdata_version);
 
@@ -271,6 +357,29 @@ int gcal_entry_number(struct gcal_resource *gcalobj);
 struct gcal_event *gcal_get_entries(struct gcal_resource *gcalobj,
 				    size_t *length);
 
+/** Downloads the calendar events and parses them page by page, see
+ * \ref gcal_set_page_size (in pipeline mode, each entry is extracted as
+ * soon it arrives, see \ref gcal_set_pipeline).
+ *
+ * The result is the same of \ref gcal_dump followed by
+ * \ref gcal_get_entries, but the whole feed is never held in memory.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure, which has
+ *                 previously got the authentication using
+ *                 \ref gcal_get_authentication.
+ *
+ * @param url Feed URL, NULL means all the events (i.e. \ref gcal_dump).
+ *
+ * @param gdata_version Version of Data API.
+ *
+ * @param length Pointer to an unsigned int, it will have the vector length.
+ *
+ * @return A pointer on sucess, NULL otherwise.
+ */
+struct gcal_event *gcal_dump_entries(struct gcal_resource *gcalobj,
+				     const char *url, const char *gdata_version,
+				     size_t *length);
+
 
 /** Always use this to set calendar event structure to a sane state.
  *
@@ -311,6 +420,166 @@ int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
 			   void *cb_download, const char *gdata_version);
 
 
+/** Library structure, incremental feed parser. */
+struct gcal_pipeline;
+
+/** Internal use function, downloads a feed page by page (following the
+ * 'next' links) and parses each one with a pipeline.
+ *
+ * Only the extracted entries are kept between pages, so the memory used
+ * by the raw feed is proportional to the page size (see
+ * \ref gcal_set_page_size). When the first page reveals the total of
+ * entries, the remaining pages can be fetched concurrently (see
+ * \ref gcal_set_prefetch).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure, which has
+ *                 previously got the authentication using
+ *                 \ref gcal_get_authentication.
+ *
+ * @param pipe A pipeline created with \ref pipeline_create.
+ *
+ * @param url URL of the first page, NULL means the default feed (i.e. all
+ * the entries).
+ *
+ * @param gdata_version Version of Data API.
+ *
+ * @return 0 for success, 1 if the feed has not changed (see
+ * \ref gcal_set_conditional), -1 for error.
+ */
+int gcal_dump_pages(struct gcal_resource *gcalobj, struct gcal_pipeline *pipe,
+		    const char *url, const char *gdata_version);
+
+/** Internal use function, downloads a set of URLs concurrently.
+ *
+ * Each download has its own curl handle (duplicated from the resource
+ * one) and buffer, and is reported to 'done' once finished. The buffer
+ * is only valid during the callback.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure, which has
+ *                 previously got the authentication using
+ *                 \ref gcal_get_authentication.
+ *
+ * @param urls Array of URLs to download.
+ *
+ * @param count Number of URLs.
+ *
+ * @param max_requests Max number of concurrent requests.
+ *
+ * @param ordered 1 to report the downloads in the same order as 'urls'
+ * (which also bounds the answers held in memory), 0 to report them as
+ * soon they finish.
+ *
+ * @param gdata_version Header with the Google Data API version.
+ *
+ * @param done Called for each download with its index in 'urls' and a
+ * resource holding the answer (NULL if the request failed). Returning
+ * non zero aborts the whole operation.
+ *
+ * @param data User data passed to 'done'.
+ *
+ * @return 0 for success, -1 for error.
+ */
+int gcal_multi_get(struct gcal_resource *gcalobj, char **urls, size_t count,
+		   int max_requests, char ordered, const char *gdata_version,
+		   int (*done)(void *data, size_t index,
+			       struct gcal_resource *res),
+		   void *data);
+
+/** Internal use function, sets up a resource to run a transfer on its
+ * own, concurrently with others.
+ *
+ * Only the curl handle (duplicated from the 'gcalobj' one), the buffer
+ * and the log fields of 'res' are used. The request method, headers and
+ * URL are left to the caller.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param res Zeroed resource, to hold the transfer.
+ *
+ * @param owner Pointer kept as CURLOPT_PRIVATE of the handle.
+ *
+ * @return 0 for success, -1 for error.
+ */
+int gcal_transfer_init(struct gcal_resource *gcalobj,
+		       struct gcal_resource *res, void *owner);
+
+/** Internal use function, ends a transfer started with
+ * \ref gcal_transfer_init (terminating the buffer and accounting it in
+ * the \ref gcal_stats of 'gcalobj').
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param res The transfer resource, its 'http_code' is set.
+ *
+ * @param code Curl code of the transfer.
+ *
+ * @return The curl code, which may have become an error.
+ */
+int gcal_transfer_finish(struct gcal_resource *gcalobj,
+			 struct gcal_resource *res, int code);
+
+/** Internal use function, frees the curl handle and buffer of a transfer
+ * (see \ref gcal_transfer_init).
+ *
+ * @param res The transfer resource.
+ */
+void gcal_transfer_release(struct gcal_resource *res);
+
+/** Internal use function, keeps the session parameter (i.e. gsessionid)
+ * of a calendar redirection URL, saving the redirection of later
+ * requests.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param url Redirection URL.
+ */
+void gcal_learn_session(struct gcal_resource *gcalobj, const char *url);
+
+/** Internal use function, appends the known session parameter to a
+ * calendar URL, so the server will answer right away.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param url Request URL.
+ *
+ * @return A new URL (free it) or NULL when there is nothing to append.
+ */
+char *gcal_session_url(struct gcal_resource *gcalobj, const char *url);
+
+
+/** Internal use function, mounts the URL of the whole feed of the
+ * service (see \ref gcal_dump).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @return The URL (you should cleanup its memory) or NULL on error.
+ */
+char *gcal_mount_feed_url(struct gcal_resource *gcalobj);
+
+/** Internal use function, mounts the URL of a query for entries updated
+ * since a timestamp (see \ref gcal_query_updated).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param timestamp Timestamp in RFC 3339 format, NULL means today.
+ *
+ * @return The URL (you should cleanup its memory) or NULL on error.
+ */
+char *gcal_mount_updated_url(struct gcal_resource *gcalobj, char *timestamp);
+
+/** Internal use function, mounts the URL of a generic query (see
+ * \ref gcal_query).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param parameters The query parameters, e.g. "showdeleted=true".
+ *
+ * @return The URL (you should cleanup its memory) or NULL on error.
+ */
+char *gcal_mount_generic_url(struct gcal_resource *gcalobj,
+			     const char *parameters);
+
+
 /** Cleanup the memory of a vector of calendar entries created using
  * \ref gcal_get_entries.
  *
@@ -350,6 +619,98 @@ int http_post(struct gcal_resource *gcalobj, const char *url,
 	      const int expected_answer,
 	      const char *gdata_version);
 
+/** Internal use function, points a Google server URL to the base URL
+ * set with \ref gcal_set_base_url.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param url A URL, only the ones on www.google.com are changed.
+ *
+ * @return The URL to request (free it) or NULL on error.
+ */
+char *gcal_target_url(struct gcal_resource *gcalobj, const char *url);
+
+/** Internal use function, tells the timing statistics (see
+ * \ref gcal_status_last_request) that the last request followed a
+ * redirection.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param retry Set if the request was also a repetition (e.g. the session
+ * used by the first one had expired).
+ */
+void gcal_account_redirection(struct gcal_resource *gcalobj, char retry);
+
+/** Internal use function, waits until the rate limit of the service of a
+ * resource (see \ref gcal_set_rate_limit) allows a new request.
+ *
+ * The wait ends early when the resource is canceled or its deadline
+ * expires (see \ref gcal_interrupted), the caller must check it.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure (only "cl"
+ * and "cp" services are limited).
+ */
+void gcal_rate_acquire(struct gcal_resource *gcalobj);
+
+/** Internal use function, tells the rate limiter the answer of a request.
+ *
+ * @param service The service ("cl" or "cp").
+ *
+ * @param code The HTTP code of the answer.
+ *
+ * @param retry_after Seconds to wait asked by the server, 0 if none.
+ *
+ * @return How many times a throttled request can be made again, 0 if the
+ * answer was not a throttling one.
+ */
+int gcal_rate_answer(const char *service, long code, long retry_after);
+
+/** Internal use function, tells if the requests of a resource must stop
+ * (i.e. it was canceled or its deadline has expired), setting the
+ * request status (see \ref gcal_status_request).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @return 1 if the requests must stop, 0 otherwise.
+ */
+int gcal_interrupted(struct gcal_resource *gcalobj);
+
+/** Internal use function, starts a call on a resource, arming its
+ * deadline (see \ref gcal_set_deadline) unless it is made by another
+ * call.
+ *
+ * Every public function making requests calls it first, and
+ * \ref gcal_call_end on return.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure (can be NULL).
+ */
+void gcal_call_begin(struct gcal_resource *gcalobj);
+
+/** Internal use function, ends a call started by \ref gcal_call_begin,
+ * removing the deadline when it is the outermost one.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure (can be NULL).
+ */
+void gcal_call_end(struct gcal_resource *gcalobj);
+
+/** Internal use function, returns the time limit of the next request
+ * (see \ref gcal_set_timeout and \ref gcal_set_deadline).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @return The limit in milliseconds, 0 means none.
+ */
+long gcal_request_limit(struct gcal_resource *gcalobj);
+
+/** Internal use function, sets the method used by \ref http_post
+ * instead of POST (e.g. "DELETE").
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param method The method (a static string), NULL restores POST.
+ */
+void gcal_set_method(struct gcal_resource *gcalobj, const char *method);
+
 
 /** Uploads an entry (calendar or contact) to a server URL
  *
@@ -388,6 +749,86 @@ int up_entry(char *data2post, unsigned int m_length,
 	     HTTP_CMD up_mode, char *content_type,
 	     int expected_code);
 
+/** Internal use function, uploads (with PUT) a body read while it is
+ * sent, instead of held in memory (e.g. a contact photo).
+ *
+ * Only for contacts: there is no calendar redirection, which would require
+ * reading the body again. A throttled upload is not retried for the same
+ * reason.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure, which has
+ *                 previously got the authentication using
+ *                 \ref gcal_get_authentication.
+ *
+ * @param url_server The URL to upload to.
+ *
+ * @param etag ETag header (e.g. "If-Match: *"), can be NULL.
+ *
+ * @param content_type The content type header.
+ *
+ * @param read_cb Callback giving the body, see \ref gcal_read_cb.
+ *
+ * @param data Data for the callback.
+ *
+ * @param length The body length, it must be known up front.
+ *
+ * @param expected_code The expected return code from server (200, 201, etc.)
+ *
+ * @return -1 on error, 0 on success.
+ */
+int up_stream(struct gcal_resource *gcalobj, const char *url_server,
+	      char *etag, char *content_type, gcal_read_cb read_cb,
+	      void *data, size_t length, int expected_code);
+
+/** Internal use function, posts a batch feed (made by
+ * \ref xmlbatch_events_create or \ref xmlbatch_contacts_create) to the
+ * service batch URL and parses the result of each entry.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param xml The batch feed.
+ *
+ * @param length The feed length.
+ *
+ * @param results Vector to receive the results (cleanup them with
+ * \ref gcal_batch_results_cleanup).
+ *
+ * @param count Number of entries in the feed (i.e. vector length).
+ *
+ * @return 0 if every entry succeeded, -1 on error (see 'results').
+ */
+int gcal_post_batch(struct gcal_resource *gcalobj, char *xml, int length,
+		    struct gcal_batch_result *results, size_t count);
+
+/** Internal use function, makes a batch request in as many batch feeds
+ * as needed (each one takes at most GCAL_BATCH_MAX entries), see
+ * \ref gcal_post_batch.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param entries A vector of entries, only used by 'create'.
+ *
+ * @param ops The operation of each entry, see \ref gcal_batch_op.
+ *
+ * @param length The vectors length.
+ *
+ * @param results Vector to receive the results (cleanup them with
+ * \ref gcal_batch_results_cleanup).
+ *
+ * @param create Makes the batch feed of the 'count' entries starting at
+ * 'first' (e.g. with \ref xmlbatch_events_create).
+ *
+ * @return 0 if every entry succeeded, -1 on error (see 'results'). A
+ * batch feed failing as a whole stops the request, the results of its
+ * entries and the following ones are left zeroed.
+ */
+int gcal_batch_entries(struct gcal_resource *gcalobj, void *entries,
+		       const gcal_batch_op *ops, size_t length,
+		       struct gcal_batch_result *results,
+		       int (*create)(void *entries, size_t first,
+				     const gcal_batch_op *ops, size_t count,
+				     char **xml, int *length));
+
 
 /** Creates an new calendar event.
  *
@@ -547,6 +988,356 @@ int gcal_set_location(struct gcal_resource *gcalobj, char *location);
  */
 void gcal_set_store_xml(struct gcal_resource *gcalobj, char flag);
 
+/** Sets the sizing policy of the internal response buffer.
+ *
+ * The buffer restarts with 'initial_size' bytes and grows as required (it
+ * is also presized when the server informs the Content-Length of an
+ * answer, up to 'max_size' or 256KB if it is 0). After an answer bigger than 'max_size', the
+ * buffer is trimmed back to 'max_size' when the next request starts, so
+ * long running programs can bound the memory used by each account.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param initial_size Initial buffer size in bytes (must be > 0).
+ *
+ * @param max_size Buffer size ceiling in bytes, it must be bigger than
+ * initial_size. Use 0 to never trim the buffer.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_buffer_size(struct gcal_resource *gcalobj, size_t initial_size,
+			 size_t max_size);
+
+/** Sets the number of entries fetched per request.
+ *
+ * By default \ref gcal_get_events and \ref gcal_get_contacts get all
+ * the entries in a single (and possibly huge) answer. Setting a page size
+ * makes them follow the feed pages, freeing each page as soon its entries
+ * are extracted. Only the paged downloads (see \ref gcal_dump_pages) use
+ * it, \ref gcal_dump still gets the whole feed.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param page_size Entries per page, 0 to fetch everything at once.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_page_size(struct gcal_resource *gcalobj, size_t page_size);
+
+/** Sets how many feed pages can be fetched concurrently.
+ *
+ * When using a page size (see \ref gcal_set_page_size), the first page
+ * tells the number of entries in the feed. The remaining pages are then
+ * requested in parallel, keeping up to 'max_requests' in flight. The
+ * results are still assembled in the server order.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param max_requests Max concurrent requests, 0 or 1 fetches one page at
+ * a time (default).
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_prefetch(struct gcal_resource *gcalobj, int max_requests);
+
+/** Sets how many contact photos can be downloaded concurrently.
+ *
+ * Each photo gets its own buffer and connection, keeping up to
+ * 'max_requests' downloads in flight over a curl multi handle.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param max_requests Max concurrent requests, 0 or 1 downloads one photo
+ * at a time (default).
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_photo_concurrency(struct gcal_resource *gcalobj,
+			       int max_requests);
+
+/** Sets if contact photos are downloaded only on demand.
+ *
+ * By default \ref gcal_get_contacts downloads the photo of every contact
+ * having one. In lazy mode only the photo link is kept (and
+ * \ref gcal_contact_get_photolength returns 1), the data being fetched
+ * later with \ref gcal_contact_fetch_photo or \ref gcal_fetch_photos.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param flag 0 to download photos with the contacts (default), 1 to
+ * download them on demand.
+ */
+void gcal_set_lazy_photos(struct gcal_resource *gcalobj, char flag);
+
+/** Sets if answers can be compressed (gzip/deflate) during transfer.
+ *
+ * It applies to feed downloads and answers of insertions, edits and
+ * deletions. The data is decompressed while being received, so the parser
+ * still gets plain XML; see \ref gcal_get_stats for the savings.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param flag 0 for plain transfers (default), 1 to accept compression.
+ *
+ * @return 0 on success, -1 otherwise (e.g. curl built without zlib).
+ */
+int gcal_set_compression(struct gcal_resource *gcalobj, char flag);
+
+/** Sets if feeds are fetched with conditional requests.
+ *
+ * The ETag and Last-Modified of each feed are kept, and the next fetch of
+ * the same feed sends them back: if nothing has changed, the server
+ * answers just the headers: \ref gcal_dump returns 1 keeping the previous
+ * answer in the buffer, and \ref gcal_get_events (or
+ * \ref gcal_get_contacts) returns 1 without parsing anything. It only
+ * applies to feeds fetched at once (i.e. not page by page, see
+ * \ref gcal_set_page_size).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param flag 0 to always fetch feeds (default), 1 for conditional
+ * requests.
+ */
+void gcal_set_conditional(struct gcal_resource *gcalobj, char flag);
+
+/** Gets the transfer statistics (accumulated since the object creation
+ * or the last \ref gcal_reset_stats).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param stats Pointer to a \ref gcal_stats structure, to be filled.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_get_stats(struct gcal_resource *gcalobj, struct gcal_stats *stats);
+
+/** Resets the transfer statistics (and the cumulative timing, see
+ * \ref gcal_status_cumulative).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ */
+void gcal_reset_stats(struct gcal_resource *gcalobj);
+
+/** Cleans up the results of a batch request (see \ref gcal_batch_result).
+ *
+ * @param results A vector of results.
+ *
+ * @param length The vector length.
+ */
+void gcal_batch_results_cleanup(struct gcal_batch_result *results,
+				size_t length);
+
+/** Library structure, a connection context shared between resources. */
+struct gcal_share;
+
+/** Creates a connection context, to be shared between resources.
+ *
+ * Resources using the same context share the DNS cache, the TLS sessions
+ * and the open connections, so requests of different accounts (or of each
+ * calendar returned by \ref gcal_calendar_list) can reuse a connection
+ * instead of doing a new handshake. It is safe to use the resources from
+ * different threads.
+ *
+ * @return A pointer to the context or NULL on error.
+ */
+struct gcal_share *gcal_share_new(void);
+
+/** Frees a connection context.
+ *
+ * It must be called after destroying the resources using it.
+ *
+ * @param share A context created with \ref gcal_share_new.
+ *
+ * @return 0 on success, -1 if the context is still in use.
+ */
+int gcal_share_delete(struct gcal_share *share);
+
+/** Sets the connection context of a resource.
+ *
+ * The calendars returned by \ref gcal_calendar_list inherit it.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param share A context created with \ref gcal_share_new, NULL to stop
+ * sharing.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_share(struct gcal_resource *gcalobj, struct gcal_share *share);
+
+/** Limits the rate of requests to a service.
+ *
+ * The limit is shared by all the gcal objects of the process (and their
+ * threads). When the server throttles (i.e. answers 429 or 503), the
+ * requests of the service are held for the time it asks for (or an
+ * increasing backoff, 64 seconds at most) and the rate is lowered, going
+ * back up to 'rate' while the answers go through. A held request still
+ * stops at the deadline (see \ref gcal_set_deadline) or cancellation of
+ * its resource. Non-blocking operations (see gcal_async.h) only report
+ * throttling, they are not held.
+ *
+ * Without a rate or retries (see \ref gcal_set_retries), the default,
+ * throttling answers just fail and no request is held. Setting the limit
+ * lifts the hold of earlier throttling answers (the waiting requests go
+ * on).
+ *
+ * @param mode Service type, see \ref gservice.
+ *
+ * @param rate Requests per second, 0 means no limit (default).
+ *
+ * @param burst How many requests can be made at once after an idle
+ * period (0 is the same as 1).
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_rate_limit(gservice mode, double rate, unsigned int burst);
+
+/** Sets how many times a throttled request is made again (after waiting,
+ * see \ref gcal_set_rate_limit) before failing.
+ *
+ * Shared by all the gcal objects of the process, the default is 0.
+ *
+ * @param mode Service type, see \ref gservice.
+ *
+ * @param retries Number of retries, 0 fails at once.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_retries(gservice mode, unsigned int retries);
+
+/** Sets the time limits of every request of a resource.
+ *
+ * A request going over them fails, and \ref gcal_status_request tells
+ * \ref GCAL_REQUEST_TIMEOUT. The calendars returned by
+ * \ref gcal_calendar_list inherit them.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param connect_ms Limit to connect to the server in milliseconds, 0
+ * means the curl default.
+ *
+ * @param request_ms Limit of each whole request in milliseconds, 0 means
+ * none (default).
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_timeout(struct gcal_resource *gcalobj, long connect_ms,
+		     long request_ms);
+
+/** Sets a time limit for each call on a resource (e.g. a
+ * \ref gcal_dump with all its requests, redirections, retries and waits
+ * for the rate limit, or a \ref gcal_batch_events with all its batch
+ * feeds).
+ *
+ * The deadline is set when a call starts and removed when it returns.
+ * Requests still running when it expires are aborted (and the later ones
+ * are not made), \ref gcal_status_request tells
+ * \ref GCAL_REQUEST_TIMEOUT. Non-blocking operations (see gcal_async.h)
+ * are only limited by \ref gcal_set_timeout. The calendars returned by
+ * \ref gcal_calendar_list inherit it.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param timeout_ms Milliseconds each call can take, 0 means no limit
+ * (default).
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_deadline(struct gcal_resource *gcalobj, long timeout_ms);
+
+/** Library structure, a cancellation handle. */
+struct gcal_cancel;
+
+/** Creates a cancellation handle, see \ref gcal_set_cancel.
+ *
+ * @return A pointer to the handle or NULL on error.
+ */
+struct gcal_cancel *gcal_cancel_new(void);
+
+/** Frees a cancellation handle.
+ *
+ * It must be called after destroying (or unsetting it from) the
+ * resources using it.
+ *
+ * @param cancel A handle created with \ref gcal_cancel_new.
+ */
+void gcal_cancel_delete(struct gcal_cancel *cancel);
+
+/** Cancels the requests of the resources using a handle.
+ *
+ * It can be called from any thread. Requests in progress are aborted
+ * (curl checks it about once a second while a transfer is stalled, more
+ * often while data flows) and new ones fail right away, until
+ * \ref gcal_cancel_reset. \ref gcal_status_request tells
+ * \ref GCAL_REQUEST_CANCELED.
+ *
+ * @param cancel A handle created with \ref gcal_cancel_new.
+ */
+void gcal_cancel_trigger(struct gcal_cancel *cancel);
+
+/** Makes a cancellation handle usable again.
+ *
+ * @param cancel A handle created with \ref gcal_cancel_new.
+ */
+void gcal_cancel_reset(struct gcal_cancel *cancel);
+
+/** Sets the cancellation handle of a resource.
+ *
+ * The same handle can be used by many resources (e.g. all the resources
+ * of a worker); the calendars returned by \ref gcal_calendar_list
+ * inherit it.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param cancel A handle created with \ref gcal_cancel_new, NULL to
+ * remove it.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_cancel(struct gcal_resource *gcalobj, struct gcal_cancel *cancel);
+
+/** Sets pipeline mode, where feeds are parsed while being downloaded.
+ *
+ * In this mode \ref gcal_get_events and \ref gcal_get_contacts extract
+ * each entry as soon it is received, overlapping the download with the
+ * parsing (the results are the same). The raw feed is not kept in the
+ * internal buffer.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param flag 0 to download then parse (default), 1 to use the pipeline.
+ */
+void gcal_set_pipeline(struct gcal_resource *gcalobj, char flag);
+
+/** Sets reader mode, where buffered feeds are parsed one entry at a time.
+ *
+ * In this mode \ref gcal_get_entries and \ref gcal_get_all_contacts use
+ * a xmlTextReader that builds, extracts and frees each entry in turn,
+ * instead of building the tree of the whole feed. The results are the
+ * same, but memory is bounded by the largest entry.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param flag 0 to parse a tree of the whole feed (default), 1 to use
+ * the reader.
+ */
+void gcal_set_reader(struct gcal_resource *gcalobj, char flag);
+
+/** Sets a threshold to spool big answers to disk.
+ *
+ * Answers bigger than 'threshold' bytes are written to an (unlinked)
+ * temporary file, created in TMPDIR (or '/tmp'), which is mapped in memory
+ * for parsing. This avoids holding huge feeds in the heap when the account
+ * has lots of entries. \ref gcal_access_buffer returns the mapped view.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param threshold Size in bytes, 0 disables spooling (the default).
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_spool(struct gcal_resource *gcalobj, size_t threshold);
+
 /** Sets network proxy.
  *
  * Use it if you are behind a network proxy and can't directly access
@@ -564,6 +1355,22 @@ void gcal_set_store_xml(struct gcal_resource *gcalobj, char flag);
  */
 void gcal_set_proxy(struct gcal_resource *gcalobj, char *proxy);
 
+/** Sends the requests to another server, instead of www.google.com.
+ *
+ * Every URL on www.google.com (over HTTP or HTTPS, including the links
+ * found in the answers) has its scheme and host replaced by the base URL,
+ * e.g. to run against the local stand-in server (see utests/gdata_server.c)
+ * with no network access.
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param base_url Scheme, host and port (e.g. "http://127.0.0.1:8080"),
+ * NULL restores Google.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int gcal_set_base_url(struct gcal_resource *gcalobj, const char *base_url);
+
 /** Sets network proxytype.
  *
  * Use it if you are behind a network proxy and can't directly access
@@ -768,8 +1575,9 @@ char gcal_get_deleted(struct gcal_entry *entry);
 
 /** Global cleanup (use only at end of program)
  *
- * Cleans up any global variables that the library may use (which currently
- * it doesn't use), as well as calls libxml2's xmlCleanupParser().
+ * Cleans up any global variables that the library may use (the compiled
+ * XPath expressions and the calling thread XPath context), as well as
+ * calls libxml2's xmlCleanupParser().
  *
  * Rationale: if the linked application is also using libxml and xmlCleanuParser
  * is called from within libgcal, it will at very best mess up with the
@@ -0,0 +1,356 @@
+/*
+Copyright (c) 2008 Instituto Nokia de Tecnologia
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the INdT nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+ * @file   gcal_async.h
+ *
+ * @brief  Non-blocking operations, driven by an external event loop.
+ *
+ * The blocking functions (e.g. \ref gcal_get_events) hold the calling
+ * thread until the answer arrives. Operations started here return right
+ * away instead: the sockets and timeouts they need are reported to the
+ * application (see \ref gcal_loop_new), which calls back
+ * \ref gcal_loop_action when one of them is ready. When an operation ends,
+ * its completion callback is called with the result.
+ *
+ * A single thread can drive many operations (and many \ref gcal_resource
+ * objects) this way. Every operation runs on its own connection, sharing
+ * the settings, session and authentication of its \ref gcal_resource,
+ * which must outlive it.
+ *
+ * All the functions of a loop (and of the resources used by its
+ * operations) must be called from the same thread.
+ */
+
+#ifndef __GCAL_ASYNC_LIB__
+#define __GCAL_ASYNC_LIB__
+
+#include "gcalendar.h"
+#include "gcontact.h"
+
+/** Events that a socket must be watched for, as told by
+ * \ref gcal_socket_cb (same values of curl multi socket interface).
+ */
+typedef enum {
+	/** Wait for the socket to be readable. */
+	GCAL_POLL_IN = 1,
+	/** Wait for the socket to be writable. */
+	GCAL_POLL_OUT = 2,
+	/** Wait for both. */
+	GCAL_POLL_INOUT = 3,
+	/** Stop watching the socket. */
+	GCAL_POLL_REMOVE = 4 } gcal_poll;
+
+/** Events that happened to a socket, to be reported with
+ * \ref gcal_loop_action (can be combined).
+ */
+typedef enum {
+	/** Socket is readable. */
+	GCAL_EVENT_IN = 1,
+	/** Socket is writable. */
+	GCAL_EVENT_OUT = 2,
+	/** Socket has an error. */
+	GCAL_EVENT_ERR = 4 } gcal_event_mask;
+
+/** Socket value to report an expired timeout to \ref gcal_loop_action. */
+#define GCAL_SOCKET_TIMEOUT -1
+
+/** Event loop, see \ref gcal_loop_new. */
+struct gcal_loop;
+
+/** Asynchronous operation, see \ref gcal_async_dump. */
+struct gcal_async;
+
+/** Application callback to watch a socket.
+ *
+ * @param fd The socket.
+ *
+ * @param what Events to watch for, see \ref gcal_poll.
+ *
+ * @param data Application data given to \ref gcal_loop_new.
+ *
+ * @return Should return 0.
+ */
+typedef int (*gcal_socket_cb)(int fd, int what, void *data);
+
+/** Application callback to set the loop timeout.
+ *
+ * When it expires, the application should call \ref gcal_loop_action with
+ * \ref GCAL_SOCKET_TIMEOUT. A new call replaces the previous timeout.
+ *
+ * @param timeout_ms Timeout in milliseconds, 0 means call as soon as
+ * possible and -1 removes the timeout.
+ *
+ * @param data Application data given to \ref gcal_loop_new.
+ *
+ * @return Should return 0.
+ */
+typedef int (*gcal_timer_cb)(long timeout_ms, void *data);
+
+/** Operation completion callback.
+ *
+ * The results of the operation (e.g. \ref gcal_async_take_events) are
+ * only available inside it, the operation is freed after it returns.
+ * New operations can be started from it.
+ *
+ * @param op The finished operation.
+ *
+ * @param result 0 for success, -1 for error.
+ *
+ * @param data Data given when the operation was started.
+ */
+typedef void (*gcal_async_cb)(struct gcal_async *op, int result, void *data);
+
+
+/** Creates an event loop.
+ *
+ * The callbacks can be NULL, when the application drives the loop using
+ * \ref gcal_loop_wait instead.
+ *
+ * @param socket_cb Called to watch (or stop watching) a socket.
+ *
+ * @param timer_cb Called to set the loop timeout.
+ *
+ * @param data Application data, passed to both callbacks.
+ *
+ * @return The loop or NULL on error.
+ */
+struct gcal_loop *gcal_loop_new(gcal_socket_cb socket_cb,
+				gcal_timer_cb timer_cb, void *data);
+
+/** Frees an event loop.
+ *
+ * Pending operations are dropped, without calling their callbacks.
+ *
+ * @param loop The loop.
+ */
+void gcal_loop_delete(struct gcal_loop *loop);
+
+/** Reports a socket event (or an expired timeout) to the loop.
+ *
+ * Transfers progress and finished operations have their callbacks called.
+ *
+ * @param loop The loop.
+ *
+ * @param fd The socket or \ref GCAL_SOCKET_TIMEOUT.
+ *
+ * @param events What happened to the socket, see \ref gcal_event_mask
+ * (0 lets the library check it).
+ *
+ * @return The number of pending operations or -1 on error.
+ */
+int gcal_loop_action(struct gcal_loop *loop, int fd, int events);
+
+/** Runs the loop, waiting at most 'timeout_ms' for some activity.
+ *
+ * A simpler alternative to the socket and timer callbacks: call it until
+ * it returns 0.
+ *
+ * @param loop The loop.
+ *
+ * @param timeout_ms Maximum wait in milliseconds.
+ *
+ * @return The number of pending operations or -1 on error.
+ */
+int gcal_loop_wait(struct gcal_loop *loop, int timeout_ms);
+
+/** Starts downloading all the entries of the service (events for
+ * calendar, contacts for contacts), see \ref gcal_get_events.
+ *
+ * Every page of the feed is followed, as \ref gcal_set_page_size
+ * requests. Get the result with \ref gcal_async_take_events or
+ * \ref gcal_async_take_contacts.
+ *
+ * @param loop The loop.
+ *
+ * @param gcalobj A libgcal object, already authenticated.
+ *
+ * @param cb Completion callback.
+ *
+ * @param data Data for the callback.
+ *
+ * @return The operation or NULL on error (the callback is never called).
+ */
+struct gcal_async *gcal_async_dump(struct gcal_loop *loop, gcal_t gcalobj,
+				   gcal_async_cb cb, void *data);
+
+/** Starts downloading the entries updated since a timestamp, see
+ * \ref gcal_get_updated_events and \ref gcal_async_dump.
+ *
+ * @param loop The loop.
+ *
+ * @param gcalobj A libgcal object, already authenticated.
+ *
+ * @param timestamp Timestamp in RFC 3339 format, NULL means today.
+ *
+ * @param cb Completion callback.
+ *
+ * @param data Data for the callback.
+ *
+ * @return The operation or NULL on error (the callback is never called).
+ */
+struct gcal_async *gcal_async_query_updated(struct gcal_loop *loop,
+					    gcal_t gcalobj, char *timestamp,
+					    gcal_async_cb cb, void *data);
+
+/** Starts a generic query, see \ref gcal_query.
+ *
+ * Unlike \ref gcal_query, the answer is parsed (following every page of
+ * it): get the entries with \ref gcal_async_take_events or
+ * \ref gcal_async_take_contacts.
+ *
+ * @param loop The loop.
+ *
+ * @param gcalobj A libgcal object, already authenticated.
+ *
+ * @param parameters The query, e.g. "showdeleted=true".
+ *
+ * @param cb Completion callback.
+ *
+ * @param data Data for the callback.
+ *
+ * @return The operation or NULL on error (the callback is never called).
+ */
+struct gcal_async *gcal_async_query(struct gcal_loop *loop, gcal_t gcalobj,
+				    const char *parameters,
+				    gcal_async_cb cb, void *data);
+
+/** Starts adding an entry, see \ref gcal_add_xmlentry.
+ *
+ * Get the updated entry with \ref gcal_async_take_xml.
+ *
+ * @param loop The loop.
+ *
+ * @param gcalobj A libgcal object, already authenticated.
+ *
+ * @param xml_entry The entry in XML (it is copied).
+ *
+ * @param cb Completion callback.
+ *
+ * @param data Data for the callback.
+ *
+ * @return The operation or NULL on error (the callback is never called).
+ */
+struct gcal_async *gcal_async_add_xmlentry(struct gcal_loop *loop,
+					   gcal_t gcalobj,
+					   char *xml_entry,
+					   gcal_async_cb cb, void *data);
+
+/** Starts updating an entry, see \ref gcal_update_xmlentry.
+ *
+ * Get the updated entry with \ref gcal_async_take_xml.
+ *
+ * @param loop The loop.
+ *
+ * @param gcalobj A libgcal object, already authenticated.
+ *
+ * @param xml_entry The entry in XML (it is copied).
+ *
+ * @param edit_url The entry edit URL, NULL extracts it from 'xml_entry'.
+ *
+ * @param etag The entry ETag, NULL extracts it from 'xml_entry'.
+ *
+ * @param cb Completion callback.
+ *
+ * @param data Data for the callback.
+ *
+ * @return The operation or NULL on error (the callback is never called).
+ */
+struct gcal_async *gcal_async_update_xmlentry(struct gcal_loop *loop,
+					      gcal_t gcalobj,
+					      char *xml_entry,
+					      const char *edit_url,
+					      const char *etag,
+					      gcal_async_cb cb, void *data);
+
+/** Starts deleting an entry, see \ref gcal_erase_xmlentry.
+ *
+ * @param loop The loop.
+ *
+ * @param gcalobj A libgcal object, already authenticated.
+ *
+ * @param xml_entry The entry in XML (only its edit URL is used).
+ *
+ * @param cb Completion callback.
+ *
+ * @param data Data for the callback.
+ *
+ * @return The operation or NULL on error (the callback is never called).
+ */
+struct gcal_async *gcal_async_erase_xmlentry(struct gcal_loop *loop,
+					     gcal_t gcalobj,
+					     char *xml_entry,
+					     gcal_async_cb cb, void *data);
+
+/** Moves the events downloaded by a finished calendar operation to an
+ * array (free it with \ref gcal_cleanup_events).
+ *
+ * Only valid inside the completion callback.
+ *
+ * @param op The operation.
+ *
+ * @param events The array to receive the events.
+ *
+ * @return 0 for success, -1 for error.
+ */
+int gcal_async_take_events(struct gcal_async *op,
+			   struct gcal_event_array *events);
+
+/** Moves the contacts downloaded by a finished contacts operation to an
+ * array (free it with \ref gcal_cleanup_contacts).
+ *
+ * Only valid inside the completion callback.
+ *
+ * @param op The operation.
+ *
+ * @param contacts The array to receive the contacts.
+ *
+ * @return 0 for success, -1 for error.
+ */
+int gcal_async_take_contacts(struct gcal_async *op,
+			     struct gcal_contact_array *contacts);
+
+/** Takes the entry returned by a finished add or update operation.
+ *
+ * Only valid inside the completion callback.
+ *
+ * @param op The operation.
+ *
+ * @return The entry in XML (free it) or NULL on error.
+ */
+char *gcal_async_take_xml(struct gcal_async *op);
+
+/** Returns the HTTP status of the last request of an operation.
+ *
+ * @param op The operation.
+ *
+ * @return The HTTP code (can be 200, 201, 404, etc).
+ */
+int gcal_async_httpcode(struct gcal_async *op);
+
+#endif
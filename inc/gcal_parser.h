@@ -105,6 +105,131 @@ dom_document *build_dom_document(char *xml_data);
  */
 void clean_dom_document(dom_document *doc);
 
+
+/** Incremental feed parser: entries are extracted as soon as they are
+ * completely downloaded, so parsing overlaps with the network transfer.
+ *
+ * It fills a vector of 'element_size' elements (i.e. events or contacts)
+ * using the 'init' and 'extract' callbacks, see \ref pipeline_create.
+ */
+struct gcal_pipeline {
+	/** libxml2 push parser context */
+	xmlParserCtxt *ctxt;
+	/** The elements vector */
+	char *entries;
+	/** Number of extracted elements */
+	size_t length;
+	/** Number of allocated elements */
+	size_t allocated;
+	/** Size of each element */
+	size_t element_size;
+	/** Sets a new element to a sane state */
+	void (*init)(void *element, char store_xml);
+	/** Parses an entry node into an element, returns -1 on error */
+	int (*extract)(xmlNode *entry, void *element);
+	/** Cleans up the memory of an element */
+	void (*destroy)(void *element);
+	/** Controls if raw XML entries will be stored in the elements */
+	char store_xml;
+	/** Number of parsed feed documents (pages) */
+	size_t pages;
+	/** Total entries in the feed, as told by its first page (0 means
+	 * unknown).
+	 */
+	size_t total_results;
+	/** Last extracted entry, if it is still in the tree */
+	xmlNode *extracted;
+	/** Flags a parsing/extraction error */
+	char failed;
+};
+
+/** Creates an incremental feed parser.
+ *
+ * @param element_size Size of each element (e.g. sizeof(struct gcal_event)).
+ * @param init Callback to initialize each element.
+ * @param extract Callback to parse an 'atom:entry' node into an element.
+ * @param destroy Callback to cleanup an element.
+ * @param store_xml Controls if the raw XML will be stored in the elements.
+ *
+ * @return NULL on error, a pointer to the pipeline in success.
+ */
+struct gcal_pipeline *pipeline_create(size_t element_size,
+				      void (*init)(void *, char),
+				      int (*extract)(xmlNode *, void *),
+				      void (*destroy)(void *),
+				      char store_xml);
+
+/** Creates an incremental parser of calendar events, see
+ * \ref pipeline_create.
+ *
+ * @param store_xml Controls if the raw XML will be stored in the events.
+ *
+ * @return NULL on error, a pointer to the pipeline in success.
+ */
+struct gcal_pipeline *pipeline_create_events(char store_xml);
+
+/** Creates an incremental parser of contacts, see \ref pipeline_create.
+ *
+ * @param store_xml Controls if the raw XML will be stored in the contacts.
+ *
+ * @return NULL on error, a pointer to the pipeline in success.
+ */
+struct gcal_pipeline *pipeline_create_contacts(char store_xml);
+
+/** Feeds a chunk of the atom stream to the pipeline, extracting all the
+ * entries completed by it.
+ *
+ * @param pipe A pipeline created with \ref pipeline_create.
+ * @param data The chunk.
+ * @param length Chunk length.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int pipeline_feed(struct gcal_pipeline *pipe, const char *data, size_t length);
+
+/** Signals the end of a feed page: the next fed data starts a new feed,
+ * while the extracted elements are kept.
+ *
+ * @param pipe A pipeline created with \ref pipeline_create.
+ * @param next_url Pointer to receive the URL of the next page (or NULL
+ * if this is the last one), you should cleanup its memory. Can be NULL.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int pipeline_end_page(struct gcal_pipeline *pipe, char **next_url);
+
+/** Parses a whole feed page with a xmlTextReader: each 'atom:entry' is
+ * expanded, extracted and freed before the next one is read, so memory
+ * is bounded by the largest entry instead of the feed size.
+ *
+ * As with \ref pipeline_feed, a feed that is not well formed (e.g.
+ * truncated) is reported as an error.
+ *
+ * @param pipe A pipeline created with \ref pipeline_create (which must
+ * not have been fed by \ref pipeline_feed).
+ * @param data The atom stream.
+ * @param length Stream length.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int pipeline_read(struct gcal_pipeline *pipe, const char *data,
+		  size_t length);
+
+/** Signals the end of the atom stream and hands over the elements vector.
+ *
+ * @param pipe A pipeline created with \ref pipeline_create.
+ * @param length Pointer to receive the vector length.
+ *
+ * @return The vector (the caller must free it) or NULL on error.
+ */
+void *pipeline_finish(struct gcal_pipeline *pipe, size_t *length);
+
+/** Cleans up a pipeline (including elements not handed over yet).
+ *
+ * @param pipe A pipeline created with \ref pipeline_create.
+ */
+void pipeline_destroy(struct gcal_pipeline *pipe);
+
 /** Return the number of calendar entries in the document.
  *
  * This is a thin wrapper to \ref clean_doc_tree.
@@ -208,4 +333,63 @@ int extract_all_contacts(dom_document *doc,
 int xmlcontact_create(struct gcal_contact *contact, char **xml_contact,
 		      int *length);
 
+/** Creates the XML of a batch feed of calendar entries.
+ *
+ * Each entry is identified by its index (see \ref extract_batch_results).
+ *
+ * @param entries A vector of pointers to calendar entries.
+ *
+ * @param ops The operation of each entry, see \ref gcal_batch_op.
+ *
+ * @param count The vectors length.
+ *
+ * @param xml Pointer to pointer string (you must free its memory!).
+ *
+ * @param length A pointer to a variable that will have its length.
+ *
+ * @return 0 on sucess, -1 on error.
+ */
+int xmlbatch_events_create(struct gcal_event **entries,
+			   const gcal_batch_op *ops, size_t count,
+			   char **xml, int *length);
+
+
+/** Creates the XML of a batch feed of contacts, see
+ * \ref xmlbatch_events_create.
+ *
+ * @param contacts A vector of pointers to contacts.
+ *
+ * @param ops The operation of each contact, see \ref gcal_batch_op.
+ *
+ * @param count The vectors length.
+ *
+ * @param xml Pointer to pointer string (you must free its memory!).
+ *
+ * @param length A pointer to a variable that will have its length.
+ *
+ * @return 0 on sucess, -1 on error.
+ */
+int xmlbatch_contacts_create(struct gcal_contact **contacts,
+			     const gcal_batch_op *ops, size_t count,
+			     char **xml, int *length);
+
+
+/** Parses the answer of a batch request, storing the result of each entry
+ * in the position given by its batch ID.
+ *
+ * Entries missing in the answer keep their results untouched.
+ *
+ * @param data Raw data (the answer feed).
+ *
+ * @param length Data buffer length.
+ *
+ * @param results A vector of results.
+ *
+ * @param count The vector length.
+ *
+ * @return 0 on sucess, -1 on error.
+ */
+int extract_batch_results(char *data, int length,
+			  struct gcal_batch_result *results, size_t count);
+
 #endif
@@ -41,6 +41,54 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "gcal.h"
 
+/** How the last request of a gcal object ended, see
+ * \ref gcal_status_request.
+ */
+typedef enum {
+	/** It got an answer (check \ref gcal_status_httpcode) */
+	GCAL_REQUEST_DONE = 0,
+	/** Network error (check \ref gcal_status_msg) */
+	GCAL_REQUEST_FAILED,
+	/** It was aborted by a timeout or deadline, see
+	 * \ref gcal_set_timeout and \ref gcal_set_deadline */
+	GCAL_REQUEST_TIMEOUT,
+	/** It was aborted by its cancellation handle, see
+	 * \ref gcal_cancel_trigger */
+	GCAL_REQUEST_CANCELED } gcal_request_status;
+
+/** Network timing and volume of HTTP requests, see
+ * \ref gcal_status_last_request and \ref gcal_status_cumulative.
+ *
+ * Times are in seconds; each phase only counts its own share of the
+ * request (e.g. 'connect_time' excludes the name resolution). Phases that
+ * did not happen (e.g. on a reused connection) are 0.
+ */
+struct gcal_request_stats {
+	/** Number of HTTP requests */
+	size_t requests;
+	/** Name resolution */
+	double dns_time;
+	/** TCP connection */
+	double connect_time;
+	/** TLS handshake */
+	double tls_time;
+	/** Wait for the first byte of the answer, after sending the
+	 * request */
+	double first_byte_time;
+	/** Transfer of the answer, after its first byte */
+	double transfer_time;
+	/** Whole request */
+	double total_time;
+	/** Bytes of request bodies sent */
+	size_t bytes_up;
+	/** Bytes of answer bodies received (as in the wire) */
+	size_t bytes_down;
+	/** Redirections followed (e.g. to get the calendar session) */
+	size_t redirects;
+	/** Requests repeated (e.g. after an expired calendar session) */
+	size_t retries;
+};
+
 /** Returns HTTP status of a gcal object.
  *
  * Use it to check for status of object after last HTTP request.
@@ -74,4 +122,41 @@ int gcal_status_setlog(struct gcal_resource *ptr_gcal, char *filepath);
  * @return NULL if everything is ok, pointer to string with error message.
  */
 const char *gcal_status_msg(struct gcal_resource *ptr_gcal);
+
+/** Tells how the last request of a gcal object ended.
+ *
+ * Operations return -1 for every failure, use it to tell an expired
+ * deadline or a cancellation from a network (or server) error.
+ *
+ * @param ptr_gcal Pointer to a library resource structure \ref gcal_resource.
+ *
+ * @return A \ref gcal_request_status value, -1 on error.
+ */
+int gcal_status_request(struct gcal_resource *ptr_gcal);
+
+/** Gets the timing breakdown of the last HTTP request of a gcal object.
+ *
+ * A redirection followed by the library (or a repeated request) is a
+ * request of its own: its 'redirects' (or 'retries') is 1.
+ *
+ * @param ptr_gcal Pointer to a library resource structure \ref gcal_resource.
+ *
+ * @param stats Pointer to a \ref gcal_request_stats structure, to be filled.
+ *
+ * @return 0 for sucess, -1 otherwise.
+ */
+int gcal_status_last_request(struct gcal_resource *ptr_gcal,
+			     struct gcal_request_stats *stats);
+
+/** Gets the timing of all the HTTP requests of a gcal object, added up
+ * since its creation (or the last \ref gcal_reset_stats).
+ *
+ * @param ptr_gcal Pointer to a library resource structure \ref gcal_resource.
+ *
+ * @param stats Pointer to a \ref gcal_request_stats structure, to be filled.
+ *
+ * @return 0 for sucess, -1 otherwise.
+ */
+int gcal_status_cumulative(struct gcal_resource *ptr_gcal,
+			   struct gcal_request_stats *stats);
 #endif
@@ -0,0 +1,194 @@
+/*
+Copyright (c) 2008 Instituto Nokia de Tecnologia
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the INdT nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+ * @file   gcal_transport.h
+ *
+ * @brief  Pluggable HTTP transport.
+ *
+ * By default, the requests of a \ref gcal_resource are made with curl.
+ * A transport replaces it: the library describes each request (method,
+ * URL, headers and body) and the transport reports the answer back (status,
+ * headers and body, which can be streamed in many pieces).
+ *
+ * Besides letting an application use its own HTTP stack, the in-memory
+ * transport (see \ref gcal_transport_memory_new) serves canned answers, so
+ * the parsing and serialization can be exercised with no network at all.
+ *
+ * Only the blocking functions use the transport: the operations of
+ * gcal_async.h still need curl, and concurrent downloads (see
+ * \ref gcal_set_prefetch and \ref gcal_set_photo_concurrency) are made
+ * one by one.
+ */
+
+#ifndef __GCAL_TRANSPORT_LIB__
+#define __GCAL_TRANSPORT_LIB__
+
+#include <stddef.h>
+#include "gcal.h"
+
+/** A request, as described to \ref gcal_transport. */
+struct gcal_request {
+	/** HTTP method (e.g. "GET", "POST", "PUT" or "DELETE") */
+	const char *method;
+	/** Full URL */
+	const char *url;
+	/** NULL terminated array of header lines (e.g. "GData-Version: 2") */
+	const char *const *headers;
+	/** Request body (NULL if there is none or it is streamed) */
+	const char *body;
+	/** Length of the body */
+	size_t body_length;
+	/** Callback giving a streamed body (e.g. see
+	 * \ref gcal_contact_set_photo_stream) while it is sent, NULL if the
+	 * body is in 'body'. It gives 'body_length' bytes in total and can
+	 * only be read once: a failure (-1) aborts the request.
+	 */
+	gcal_read_cb body_read;
+	/** Data for 'body_read' */
+	void *body_data;
+};
+
+/** Answer being received, fed by the transport. */
+struct gcal_response;
+
+/** Transport (i.e. a table of functions plus its data). */
+struct gcal_transport {
+	/** Runs a request, reporting the answer with \ref gcal_response_status,
+	 * \ref gcal_response_header and \ref gcal_response_body (in this
+	 * order). Must return 0 for success (whatever the HTTP status is)
+	 * and -1 if there was no answer.
+	 */
+	int (*perform)(void *data, const struct gcal_request *request,
+		       struct gcal_response *response);
+	/** Frees the data (can be NULL), see \ref gcal_transport_delete. */
+	void (*destroy)(void *data);
+	/** Transport data, passed to the functions */
+	void *data;
+};
+
+/** Sets the transport used by the requests of a resource.
+ *
+ * The transport is not copied, it must outlive the resource (or be
+ * replaced before being freed).
+ *
+ * @param gcalobj Pointer to a \ref gcal_resource structure.
+ *
+ * @param transport The transport, NULL restores curl.
+ *
+ * @return 0 for success, -1 for error.
+ */
+int gcal_set_transport(gcal_t gcalobj, struct gcal_transport *transport);
+
+/** Reports the HTTP status of the answer.
+ *
+ * @param response The answer.
+ *
+ * @param code HTTP code (e.g. 200).
+ */
+void gcal_response_status(struct gcal_response *response, int code);
+
+/** Reports a header line of the answer.
+ *
+ * @param response The answer.
+ *
+ * @param line The header line (e.g. "ETag: \"abc\"\r\n").
+ *
+ * @param length Length of the line.
+ */
+void gcal_response_header(struct gcal_response *response, char *line,
+			  size_t length);
+
+/** Reports a piece of the answer body.
+ *
+ * @param response The answer.
+ *
+ * @param data The piece of the body.
+ *
+ * @param length Length of the piece.
+ *
+ * @return 0 for success, -1 if the library can't take it (the transport
+ * should stop and return -1).
+ */
+int gcal_response_body(struct gcal_response *response, char *data,
+		       size_t length);
+
+/** Creates an in-memory transport, which answers requests with canned
+ * responses (see \ref gcal_transport_memory_add).
+ *
+ * @return The transport (free it with \ref gcal_transport_delete) or NULL
+ * on error.
+ */
+struct gcal_transport *gcal_transport_memory_new(void);
+
+/** Adds a canned response to an in-memory transport.
+ *
+ * A request gets the first response (in the order they were added)
+ * matching it, which can be used many times. Requests not matching any
+ * response fail.
+ *
+ * @param transport An in-memory transport.
+ *
+ * @param method Method of the requests to answer, NULL means any.
+ *
+ * @param url_prefix Answers the requests whose URL start with it, NULL
+ * means any.
+ *
+ * @param code HTTP code of the response.
+ *
+ * @param headers Header lines of the response, each one ending with a
+ * line break (can be NULL). They are copied.
+ *
+ * @param body Body of the response (can be NULL), it is copied.
+ *
+ * @param length Length of the body.
+ *
+ * @return 0 for success, -1 for error.
+ */
+int gcal_transport_memory_add(struct gcal_transport *transport,
+			      const char *method, const char *url_prefix,
+			      int code, const char *headers,
+			      const char *body, size_t length);
+
+/** Tells how many requests a transport created by
+ * \ref gcal_transport_memory_new has answered.
+ *
+ * @param transport An in-memory transport.
+ *
+ * @return Number of requests answered.
+ */
+size_t gcal_transport_memory_count(struct gcal_transport *transport);
+
+/** Frees a transport created by \ref gcal_transport_memory_new (or
+ * allocated with malloc), calling its destroy function.
+ *
+ * @param transport The transport.
+ */
+void gcal_transport_delete(struct gcal_transport *transport);
+
+#endif
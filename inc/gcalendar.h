@@ -102,7 +102,9 @@ void gcal_event_delete(gcal_event_t event);
  * @param events_array Pointer to an events array structure. See
  * \ref gcal_event_array.
  *
- * @return 0 on success, -1 otherwise.
+ * @return 0 on success, -1 otherwise. With conditional requests (see
+ * \ref gcal_set_conditional) it returns 1 if the events have not changed
+ * since the last call, leaving 'events_array' untouched.
  */
 int gcal_get_events(gcal_t gcalobj, struct gcal_event_array *events_array);
 
@@ -162,6 +164,30 @@ int gcal_update_event(gcal_t gcal_obj, gcal_event_t event);
  */
 int gcal_erase_event(gcal_t gcal_obj, gcal_event_t event);
 
+/** Adds, edits and deletes many events with a few requests.
+ *
+ * The operations are sent in batch feeds (up to 100 entries in each),
+ * instead of one request per event (plus the redirection) as
+ * \ref gcal_add_event and friends do. The events are not changed, the
+ * new ID/ETag of each one comes in its result.
+ *
+ * @param gcal_obj A gcal object, see \ref gcal_new.
+ *
+ * @param events A vector of events.
+ *
+ * @param ops The operation of each event, see \ref gcal_batch_op.
+ *
+ * @param length The vectors length.
+ *
+ * @param results A vector to receive the result of each operation (cleanup
+ * it with \ref gcal_batch_results_cleanup).
+ *
+ * @return 0 if every operation succeeded, -1 otherwise (check 'results').
+ */
+int gcal_batch_events(gcal_t gcal_obj, gcal_event_t *events,
+		      gcal_batch_op *ops, size_t length,
+		      struct gcal_batch_result *results);
+
 /** Query for updated events (added/edited/deleted).
  *
  * Its going to retrieve only updated events from user's calendar, its
@@ -63,6 +63,46 @@ struct gcal_contact;
 struct gcal_contact *gcal_get_all_contacts(struct gcal_resource *ptr_gcal,
 					   size_t *length);
 
+/** Downloads the contacts and parses them page by page (see
+ * \ref gcal_set_page_size and \ref gcal_set_pipeline), the result is
+ * the same of \ref gcal_dump followed by \ref gcal_get_all_contacts.
+ *
+ * @param ptr_gcal Pointer to a \ref gcal_resource structure, which has
+ *                 previously got the authentication using
+ *                 \ref gcal_get_authentication.
+ *
+ * @param url Feed URL, NULL means all the contacts (i.e. \ref gcal_dump).
+ *
+ * @param gdata_version Version of Data API.
+ *
+ * @param length Pointer to an unsigned int, it will have the vector length.
+ *
+ * @return A pointer on sucess, NULL otherwise.
+ */
+struct gcal_contact *gcal_dump_contacts(struct gcal_resource *ptr_gcal,
+					const char *url,
+					const char *gdata_version,
+					size_t *length);
+
+/** Downloads the photos of a set of contacts.
+ *
+ * Only contacts having a photo link whose data was not fetched yet are
+ * downloaded (concurrently, if set with \ref gcal_set_photo_concurrency).
+ * A contact whose photo download fails keeps just the link.
+ *
+ * @param ptr_gcal Pointer to a \ref gcal_resource structure, which has
+ *                 previously got the authentication using
+ *                 \ref gcal_get_authentication.
+ *
+ * @param contacts Vector of pointers to contacts.
+ *
+ * @param count Vector length.
+ *
+ * @return 0 on success, -1 if any photo could not be downloaded.
+ */
+int gcal_download_photos(struct gcal_resource *ptr_gcal,
+			 struct gcal_contact **contacts, size_t count);
+
 
 /** Cleanup memory of 1 contact structure pointer.
  *
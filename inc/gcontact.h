@@ -140,7 +140,9 @@ void gcal_contact_delete(gcal_contact_t contact);
  * @param contact_array Pointer to a contact array structure. See
  * \ref gcal_contact_array.
  *
- * @return 0 on success, -1 otherwise.
+ * @return 0 on success, -1 otherwise. With conditional requests (see
+ * \ref gcal_set_conditional) it returns 1 if the contacts have not
+ * changed since the last call, leaving 'contact_array' untouched.
  */
 int gcal_get_contacts(gcal_t gcalobj, struct gcal_contact_array *contact_array);
 
@@ -217,6 +219,28 @@ int gcal_update_contact(gcal_t gcalobj, gcal_contact_t contact);
  */
 int gcal_erase_contact(gcal_t gcalobj, gcal_contact_t contact);
 
+/** Adds, edits and deletes many contacts with a few requests, see
+ * \ref gcal_batch_events.
+ *
+ * Contact photos are not sent, use \ref gcal_update_contact for them.
+ *
+ * @param gcalobj A gcal object, see \ref gcal_new.
+ *
+ * @param contacts A vector of contacts.
+ *
+ * @param ops The operation of each contact, see \ref gcal_batch_op.
+ *
+ * @param length The vectors length.
+ *
+ * @param results A vector to receive the result of each operation (cleanup
+ * it with \ref gcal_batch_results_cleanup).
+ *
+ * @return 0 if every operation succeeded, -1 otherwise (check 'results').
+ */
+int gcal_batch_contacts(gcal_t gcalobj, gcal_contact_t *contacts,
+			gcal_batch_op *ops, size_t length,
+			struct gcal_batch_result *results);
+
 /** Query for updated contacts (added/edited/deleted).
  *
  * Pay attention that by default, google server will hide deleted contacts.
@@ -741,6 +765,38 @@ char *gcal_contact_get_photo(gcal_contact_t contact);
  */
 unsigned int gcal_contact_get_photolength(gcal_contact_t contact);
 
+/** Downloads the photo of a contact.
+ *
+ * Only required when the photos are fetched on demand (see
+ * \ref gcal_set_lazy_photos): \ref gcal_contact_get_photolength will
+ * return 1 for a contact with a photo not downloaded yet.
+ *
+ * @param gcalobj A libgcal object, must be previously authenticated with
+ * \ref gcal_get_authentication.
+ *
+ * @param contact A contact object, see \ref gcal_contact.
+ *
+ * @return 0 on success (or if there is nothing to download), -1 otherwise.
+ */
+int gcal_contact_fetch_photo(gcal_t gcalobj, gcal_contact_t contact);
+
+/** Downloads the photos of a subset of contacts.
+ *
+ * Same as \ref gcal_contact_fetch_photo, but the downloads can run
+ * concurrently (see \ref gcal_set_photo_concurrency).
+ *
+ * @param gcalobj A libgcal object, must be previously authenticated with
+ * \ref gcal_get_authentication.
+ *
+ * @param contacts Vector of contact objects, see \ref gcal_contact_element.
+ *
+ * @param count Vector length.
+ *
+ * @return 0 on success, -1 if any photo could not be downloaded (the
+ * others are still available).
+ */
+int gcal_fetch_photos(gcal_t gcalobj, gcal_contact_t *contacts, size_t count);
+
 /* Here starts the gcal_contact setters */
 
 /** Sets contact name.
@@ -1097,5 +1153,46 @@ int gcal_contact_set_blog(gcal_contact_t contact, const char *field);
 int gcal_contact_set_photo(gcal_contact_t contact, const char *field,
 			   int length);
 
+/** Sets a contact photo to be read while it is uploaded.
+ *
+ * Unlike \ref gcal_contact_set_photo, the photo is never held in memory:
+ * \ref gcal_add_contact and \ref gcal_update_contact call 'read_cb' to
+ * get its bytes while sending them. The callback must give exactly
+ * 'length' bytes, and only once (an upload is not retried). After a
+ * successful upload the stream is dropped, so later updates of the
+ * contact don't send the photo again; a callback failing (-1) makes the
+ * update fail with \ref GCAL_REQUEST_FAILED.
+ *
+ * @param contact A contact object, see \ref gcal_contact.
+ *
+ * @param read_cb Callback giving the photo bytes, see \ref gcal_read_cb.
+ * NULL removes the stream.
+ *
+ * @param data Data for the callback.
+ *
+ * @param length The photo length in bytes.
+ *
+ * @return 0 for success, -1 otherwise
+ */
+int gcal_contact_set_photo_stream(gcal_contact_t contact,
+				  gcal_read_cb read_cb, void *data,
+				  size_t length);
+
+/** Sets a contact photo to be read from a file descriptor while it is
+ * uploaded, see \ref gcal_contact_set_photo_stream.
+ *
+ * The descriptor (e.g. an open file or a pipe) is not closed by the
+ * library, it must stay open until the contact is uploaded.
+ *
+ * @param contact A contact object, see \ref gcal_contact.
+ *
+ * @param fd The file descriptor, read from its current position.
+ *
+ * @param length The photo length in bytes.
+ *
+ * @return 0 for success, -1 otherwise
+ */
+int gcal_contact_set_photo_fd(gcal_contact_t contact, int fd, size_t length);
+
 
 #endif
@@ -41,14 +41,27 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef __INTERNAL_GCAL__
 #define __INTERNAL_GCAL__
 
+#include <pthread.h>
 #include <curl/curl.h>
 #include <libxml/parser.h>
+#include "gcal_status.h"
 
 /** Abstract type to represent a DOM xml tree (a thin layer over xmlDoc).
  */
 typedef xmlDoc dom_document;
 
+/** Incremental feed parser, see \ref pipeline_create. */
+struct gcal_pipeline;
+
+/** HTTP transport replacing curl, see gcal_transport.h. */
+struct gcal_transport;
+
 static const char GCAL_DELIMITER[] = "%40";
+/* Prefixes of the Google server URLs, replaced by the base URL (see
+ * \ref gcal_set_base_url).
+ */
+static const char GCAL_HOST_HTTP[] = "http://www.google.com";
+static const char GCAL_HOST_HTTPS[] = "https://www.google.com";
 static const char GCAL_URL[] = "https://www.google.com/accounts/ClientLogin";
 static const char GCAL_LIST[] = "http://www.google.com/calendar/feeds/"
 	"default/allcalendars/full";
@@ -68,16 +81,34 @@ static const char GCAL_EVENT_END[] = "/private/full";
 static const char GCONTACT_START[] = "http://www.google.com/m8/feeds/contacts/";
 static const char GCONTACT_END[] = "/full";
 
+/* Appended to the feed URL to post a batch of operations, the server
+ * takes at most GCAL_BATCH_MAX entries in each one.
+ */
+static const char GCAL_BATCH_SUFFIX[] = "/batch";
+static const size_t GCAL_BATCH_MAX = 100;
+
 /* Google 'pages' results in a range pages of 25 entries. But for downloading
  * all results its requirement to set a 'good enough' upper limit of range of
  * entries. A hack to make 'gcal_dump' work.
  */
 static const char GCAL_UPPER[] = "max-results=999999999";
 
+/* Initial size of the response buffer, it grows geometrically from here */
+static const size_t GCAL_BUFFER_INITIAL = 256;
+/* After an oversized response, the buffer is trimmed back to this size
+ * when starting the next request.
+ */
+static const size_t GCAL_BUFFER_CEILING = 256 * 1024;
+
 static const int GCAL_DEFAULT_ANSWER = 200;
 static const int GCAL_REDIRECT_ANSWER = 302;
+static const int GCAL_NOT_MODIFIED_ANSWER = 304;
+static const char GCAL_SESSION_PARAM[] = "gsessionid=";
 static const int GCAL_EDIT_ANSWER = 201;
 static const int GCAL_CONFLICT = 409;
+/* Answers of a server throttling its clients, see gcal_ratelimit.c */
+static const int GCAL_TOO_MANY_REQUESTS = 429;
+static const int GCAL_UNAVAILABLE = 503;
 
 static const char ACCOUNT_TYPE[] = "accountType=HOSTED_OR_GOOGLE";
 static const char EMAIL_FIELD[] = "Email=";
@@ -86,18 +117,70 @@ static const char SERVICE_FIELD[] = "service=";
 static const char CLIENT_SOURCE[] = "source=libgcal";
 static const char HEADER_AUTH[] = "Auth=";
 static const char HEADER_GET[] = "Authorization: GoogleLogin auth=";
+static const char HEADER_IF_NONE_MATCH[] = "If-None-Match: ";
+static const char HEADER_IF_MODIFIED_SINCE[] = "If-Modified-Since: ";
+
+/** Library structure. A connection context (DNS cache, TLS sessions and
+ * open connections) shared between resources.
+ */
+struct gcal_share {
+	/** Curl share handle */
+	CURLSH *curlsh;
+	/** One lock for each kind of shared data */
+	pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+};
+
+/** Library structure. A cancellation flag, checked by the requests of
+ * the resources using it.
+ */
+struct gcal_cancel {
+	pthread_mutex_t lock;
+	char triggered;
+};
+
+/** Validators of a feed answer, used to make a conditional request the
+ * next time the same feed is fetched.
+ */
+struct gcal_validator {
+	/** Feed URL */
+	char *url;
+	/** ETag header of the answer (can be NULL) */
+	char *etag;
+	/** Last-Modified header of the answer (can be NULL) */
+	char *last_modified;
+	struct gcal_validator *next;
+};
 
 /** Library structure. It holds resources (curl, buffer, etc).
  */
 struct gcal_resource {
 	/** Memory buffer */
 	char *buffer;
-	/** Its length */
+	/** Its allocated length */
 	size_t length;
-	/** previous length, required when downloading binary data
-	 * i.e. contact photo data
+	/** Number of bytes stored in the buffer. Data is binary safe (i.e.
+	 * contact photo data) but is always followed by a '\0', so XML
+	 * answers can still be read as a string.
 	 */
-	size_t previous_length;
+	size_t used;
+	/** Size allocated for the buffer when (re)creating it */
+	size_t buffer_initial;
+	/** Buffer high-water mark: bigger buffers are trimmed down to it
+	 * between requests (0 means never trim).
+	 */
+	size_t buffer_ceiling;
+	/** Answers bigger than this are spooled to a temporary file
+	 * (0 means always keep them in memory).
+	 */
+	size_t spool_threshold;
+	/** Flag to signal that the current answer is being spooled */
+	char spooled;
+	/** Spool file descriptor (the file is unlinked at creation) */
+	int spool_fd;
+	/** Heap buffer, saved while 'buffer' points to the spool mapping */
+	char *heap_buffer;
+	/** Length of the spool mapping (0 means not mapped) */
+	size_t map_length;
 	/** gcalendar authorization */
 	char *auth;
 	/** curl data structure */
@@ -118,7 +201,7 @@ struct gcal_resource {
 	long http_code;
 	/** CURL error messages */
 	char *curl_msg;
-	/** Internal status from last request */
+	/** Internal status from last request, see \ref gcal_request_status */
 	int internal_status;
 	/** Handler to internal logging file */
 	FILE *fout_log;
@@ -139,6 +222,71 @@ struct gcal_resource {
 	 * event/contact object.
 	 */
 	char store_xml_entry;
+	/** Number of entries fetched per request (0 means all at once) */
+	size_t page_size;
+	/** Max number of pages fetched concurrently (0 or 1 means one by
+	 * one).
+	 */
+	int prefetch;
+	/** Max number of contact photos downloaded concurrently (0 or 1 means
+	 * one by one).
+	 */
+	int photo_concurrency;
+	/** Controls if contact photos are only downloaded on demand */
+	char lazy_photos;
+	/** Controls if feeds are parsed while being downloaded */
+	char pipeline_mode;
+	/** Parser fed by the write callback during a pipelined download */
+	struct gcal_pipeline *pipeline;
+	/** Controls if buffered feeds are parsed one entry at a time */
+	char reader_mode;
+	/** Connection context used by the curl handle (can be NULL) */
+	struct gcal_share *share;
+	/** Transport replacing curl (NULL means curl) */
+	struct gcal_transport *transport;
+	/** Method replacing POST in \ref http_post (e.g. "DELETE"), see
+	 * \ref gcal_set_method.
+	 */
+	const char *method;
+	/** Server replacing www.google.com (NULL means Google) */
+	char *base_url;
+	/** Calendar session parameter (i.e. 'gsessionid=...') learned from
+	 * a redirection, saves the redirection of later requests.
+	 */
+	char *session;
+	/** Transfer statistics, see \ref gcal_get_stats */
+	size_t requests;
+	size_t wire_bytes;
+	size_t decoded_bytes;
+	/** Timing of the last request and of all of them, see
+	 * \ref gcal_status_last_request */
+	struct gcal_request_stats last_request;
+	struct gcal_request_stats all_requests;
+	/** Seconds to wait asked by a throttling server ('Retry-After') */
+	long retry_after;
+	/** Limits (in ms) to connect and to make each request, 0 means
+	 * none */
+	long connect_timeout;
+	long request_timeout;
+	/** Limit (in ms) of each call, see \ref gcal_set_deadline, 0
+	 * means none */
+	long call_timeout;
+	/** Requests of the current call must end before it (monotonic
+	 * clock, in seconds), 0 means none */
+	double deadline;
+	/** Depth of the calls in progress (a call can make others) */
+	unsigned int calls;
+	/** Cancellation flag, see \ref gcal_set_cancel */
+	struct gcal_cancel *cancel;
+	/** Controls if feeds are fetched with conditional requests */
+	char conditional;
+	/** Set when the last feed fetched was not modified */
+	char not_modified;
+	/** Validators of the feeds already fetched */
+	struct gcal_validator *validators;
+	/** Validators of the current answer (taken from its headers) */
+	char *answer_etag;
+	char *answer_modified;
 };
 
 /** This structure has the common data fields between google services
@@ -341,6 +489,14 @@ struct gcal_contact {
 	 * > 1: has photo data
 	 */
 	unsigned int photo_length;
+	/** Photo to be streamed on upload, instead of 'photo_data' (see
+	 * \ref gcal_contact_set_photo_stream) */
+	gcal_read_cb photo_read;
+	void *photo_read_data;
+	size_t photo_stream_length;
+	/** File read by the photo stream, see
+	 * \ref gcal_contact_set_photo_fd */
+	int photo_fd;
 
 };
 
@@ -69,6 +69,10 @@ static const char gcal_ns[] = "gCal";
 static const char open_search_href[] = "http://a9.com/-/spec/opensearch/1.1/";
 static const char open_search_ns[] = "openSearch";
 
+/** Google data batch URL/URI */
+static const char batch_href[] = "http://schemas.google.com/gdata/batch";
+static const char batch_ns[] = "batch";
+
 
 
 /** Call this function to register a namespace within a xmlXPathContext.
@@ -98,7 +102,7 @@ int register_namespaces(xmlXPathContext *xpathCtx, const xmlChar *name_space,
  *
  * @param xpathCtx Pointer to a xmlXPathContext (which you can configure its
  * namespaces using \ref register_namespaces). If you wish to use the default
- * gcalendar namespaces, pass NULL.
+ * gcalendar namespaces, pass NULL (the calling thread context is reused).
  *
  * @return A pointer to a xmlXPathObject with the result of XPath expression
  * (you must cleanup its memory using 'xmlXPathFreeObject').
@@ -107,6 +111,43 @@ xmlXPathObject* execute_xpath_expression(xmlDoc *doc,
 					 const xmlChar* xpathExpr,
 					 xmlXPathContext *xpathCtx);
 
+/** Fixed XPath expressions, compiled once and shared by the library
+ * (see \ref execute_xpath_query).
+ */
+enum xpath_query {
+	/** '//openSearch:totalResults/text()' */
+	XPATH_TOTAL_RESULTS,
+	/** '//atom:entry' */
+	XPATH_ENTRIES,
+	/** '//atom:entry/gd:reminder' */
+	XPATH_REMINDERS,
+	/** '//atom:entry/gd:when/gd:reminder' */
+	XPATH_WHEN_REMINDERS,
+	/** '//atom:entry/gd:who' */
+	XPATH_ATTENDEES,
+	/** Number of fixed expressions */
+	XPATH_QUERY_NR
+};
+
+/** Executes one of the fixed XPath expressions within a XML tree document.
+ *
+ * The expression is compiled only once and evaluated using a context
+ * (with gcalendar namespaces registered) that each thread creates once.
+ *
+ * @param doc A libxml document pointer.
+ *
+ * @param query Which expression to evaluate (see \ref xpath_query).
+ *
+ * @return A pointer to a xmlXPathObject with the result of XPath expression
+ * (you must cleanup its memory using 'xmlXPathFreeObject').
+ */
+xmlXPathObject *execute_xpath_query(xmlDoc *doc, enum xpath_query query);
+
+/** Releases the compiled expressions and the XPath context of the
+ * calling thread (they are created again when needed).
+ */
+void clean_xpath_cache(void);
+
 /** Allocates resources to create a XML document.
  *
  *
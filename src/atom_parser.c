@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "xml_aux.h"
 #include "internal_gcal.h"
 #include "atom_parser.h"
+#include <libxml/xmlsave.h>
 #include <string.h>
 
 void workaround_edit_url(char *inplace)
@@ -128,9 +129,7 @@ int atom_entries(xmlDoc *document)
 
 #if defined(LIBXML_XPATH_ENABLED) && defined(LIBXML_SAX1_ENABLED)
 
-	xpath_obj = execute_xpath_expression(document,
-				       "//openSearch:totalResults/text()",
-				       NULL);
+	xpath_obj = execute_xpath_query(document, XPATH_TOTAL_RESULTS);
 	if (!xpath_obj)
 		goto exit;
 
@@ -167,9 +166,7 @@ xmlXPathObject *atom_get_entries(xmlDoc *document)
 
 #if defined(LIBXML_XPATH_ENABLED) && defined(LIBXML_SAX1_ENABLED)
 
-	xpath_obj = execute_xpath_expression(document,
-				       "//atom:entry",
-				       NULL);
+	xpath_obj = execute_xpath_query(document, XPATH_ENTRIES);
 
 
 #endif
@@ -178,198 +175,36 @@ exit:
 	return xpath_obj;
 
 }
-static char *extract_and_check(xmlDoc *doc, char *xpath_expression, char *attr)
+static void extract_alarm(xmlNode *node, struct gcal_event_alarms *alarm)
 {
-	xmlXPathObject *xpath_obj;
-	char *result = NULL;
-	xmlNodeSet *node;
-	xmlChar *tmp;
-
-	if (!doc) return NULL;
-	if (!xpath_expression) return NULL;
-
-	xpath_obj = execute_xpath_expression(doc,
-					     xpath_expression,
-					     NULL);
-
-	if (!xpath_obj) {
-		fprintf(stderr, "extract_and_check: failed to extract data\n");
-		fprintf(stderr, "xpath_expression: ---%s---\n",
-			xpath_expression);
-		goto exit;
-	}
-
-	node = xpath_obj->nodesetval;
-	/* Empty fields are set to a empty string */
-	if (!node) {
-		result = strdup("");
-		goto cleanup;
-	} else if (node->nodeNr != 1) {
-		result = strdup("");
-		goto cleanup;
-	}
-
-	if ((node->nodeTab[0]->type != XML_TEXT_NODE) &&
-	    (node->nodeTab[0]->type != XML_ELEMENT_NODE))
-		goto cleanup;
-
-	if (node->nodeTab[0]->type == XML_TEXT_NODE) {
-		if (node->nodeTab[0]->content)
-			result = strdup(node->nodeTab[0]->content);
-	} else if ((node->nodeTab[0]->type == XML_ELEMENT_NODE) &&
-		   (attr != NULL)) {
-		tmp = xmlGetProp(node->nodeTab[0], attr);
-		if (!tmp)
-			goto cleanup;
-		result = strdup(tmp);
-		xmlFree(tmp);
-	}
-
-cleanup:
-	xmlXPathFreeObject(xpath_obj);
-exit:
-	return result;
-}
-
-static int extract_and_check_multi(xmlDoc *doc, char *xpath_expression,
-				   int getContent, char *attr1, char *attr2,
-				   char* attr3, char* attr4, char* attr5,
-				   char ***values, char ***types,
-				   char ***protocols, char ***labels, int *pref)
-{
-	xmlXPathObject *xpath_obj;
-	xmlNodeSet *node;
-	xmlChar *tmp;
-	char* pos;
-	int result = -1;
-	int i;
-
-	xpath_obj = execute_xpath_expression(doc,
-					     xpath_expression,
-					     NULL);
-
-	if ((!values) || (attr2 && !types) || (attr3 && !protocols) || (attr4 && !labels) || (attr5 && !pref)) {
-		fprintf(stderr, "extract_and_check_multi: null pointers received");
-		goto exit;
-	}
-
-	if (!xpath_obj) {
-		fprintf(stderr, "extract_and_check_multi: failed to extract data");
-		goto exit;
-	}
-
-	node = xpath_obj->nodesetval;
-
-	if (!node) {
-		result = 0;
-		goto cleanup;
-	}
-	result = node->nodeNr;
-
-	if (result == 0) {
-		goto exit;
-	}
-
-	*values = (char **)malloc(node->nodeNr * sizeof(char*));
-	if (attr2)
-		*types = (char **)malloc(node->nodeNr * sizeof(char*));
-	if (attr3)
-		*protocols = (char **)malloc(node->nodeNr * sizeof(char*));
-	if (attr4)
-		*labels = (char **)malloc(node->nodeNr * sizeof(char*));
-
-	for (i = 0; i < node->nodeNr; i++) {
-		if (getContent) {
-			tmp = xmlNodeGetContent(node->nodeTab[i]);
-			if (tmp) {
-				(*values)[i] = strdup(tmp);
-				xmlFree(tmp);
-			}
-			else
-				(*values)[i] = strdup("");
-		}
-		else if (xmlHasProp(node->nodeTab[i], attr1)) {
-			tmp = xmlGetProp(node->nodeTab[i], attr1);
-			if (tmp) {
-				(*values)[i] = strdup(tmp);
-				xmlFree(tmp);
-			}
-			else
-				(*values)[i] = strdup("");
-		}
-		else
-			(*values)[i] = strdup("");
-
-		if (attr2) {
-			if (xmlHasProp(node->nodeTab[i], attr2)) {
-				tmp = xmlGetProp(node->nodeTab[i], attr2);
-				if (tmp) {
-					pos = strchr(tmp, '#');
-					if (pos)
-						(*types)[i] = strdup(pos + 1);
-					else
-						(*types)[i] = strdup("");
-					xmlFree(tmp);
-				} else
-					(*types)[i] = strdup("");
-			}
-			else
-				(*types)[i] = strdup("");
-		}
+	xmlChar	*tmp = NULL;
 
-		if (attr3) {
-			if (xmlHasProp(node->nodeTab[i], attr3)) {
-				tmp = xmlGetProp(node->nodeTab[i], attr3);
-				if (tmp) {
-					pos = strchr(tmp, '#');
-					if (pos)
-						(*protocols)[i] = strdup(pos + 1);
-					else
-						(*protocols)[i] = strdup("");
-					xmlFree(tmp);
-				} else
-					(*protocols)[i] = strdup("");
+	if (xmlHasProp(node, "method")) {
+		tmp = xmlGetProp(node, "method");
+		if (tmp) {
+			if (!strncmp(tmp, "email", strlen("email"))) {
+				alarm->type = GCAL_ALARM_EMAIL;
+			} else if (!strncmp(tmp, "alert", strlen("alert"))) {
+				alarm->type = GCAL_ALARM_ALERT;
 			}
-			else
-				(*protocols)[i] = strdup("");
+			xmlFree(tmp);
 		}
+	}
 
-		if (attr4) {
-			if (xmlHasProp(node->nodeTab[i], attr4)){
-				tmp = xmlGetProp(node->nodeTab[i], attr4);
-				if (tmp) {
-					(*labels)[i] = strdup(tmp);
-					xmlFree(tmp);
-				}
-			} else
-				(*labels)[i] = strdup("");
-		}
-
-		if (attr5) {
-			if (xmlHasProp(node->nodeTab[i], attr5)) {
-				tmp = xmlGetProp(node->nodeTab[i], attr5);
-				if (tmp) {
-					if (strcmp(tmp, "true") == 0)
-						*pref = i;
-					xmlFree(tmp);
-				}
-			}
+	if (xmlHasProp(node, "minutes")) {
+		tmp = xmlGetProp(node, "minutes");
+		if (tmp) {
+			alarm->minutes = atoi(tmp);
+			xmlFree(tmp);
 		}
 	}
-
-cleanup:
-	xmlXPathFreeObject(xpath_obj);
-exit:
-	return result;
 }
 
-/* TODO: move the internal loop code to functions, formating ATM is bad */
 int extract_and_check_alarms(xmlDoc *doc, const unsigned int recurrent,
 			     struct gcal_event_alarms **alarms)
 {
 	xmlXPathObject *xpath_obj = NULL;
 	xmlNodeSet *node;
-	xmlChar	*tmp = NULL;
 	struct gcal_event_alarms *tempval;
 	int i;
 	int result = 0;
@@ -385,11 +220,9 @@ int extract_and_check_alarms(xmlDoc *doc, const unsigned int recurrent,
 		goto exit;
 
 	if (recurrent == 1) {
-		xpath_obj = execute_xpath_expression(doc,
-						     "//atom:entry/gd:reminder", NULL);
+		xpath_obj = execute_xpath_query(doc, XPATH_REMINDERS);
 	} else if (recurrent == 0) {
-		xpath_obj = execute_xpath_expression(doc,
-						     "//atom:entry/gd:when/gd:reminder", NULL);
+		xpath_obj = execute_xpath_query(doc, XPATH_WHEN_REMINDERS);
 	}
 
 	if (!xpath_obj) {
@@ -398,38 +231,16 @@ int extract_and_check_alarms(xmlDoc *doc, const unsigned int recurrent,
 	}
 
 	node = xpath_obj->nodesetval;
-	result = node->nodeNr;
-
-	tempval = (struct gcal_event_alarms *) malloc(result * sizeof(struct gcal_event_alarms));
-	memset(tempval, 0, sizeof(struct gcal_event_alarms));
+	if ((!node) || (node->nodeNr == 0))
+		goto exit;
 
+	tempval = (struct gcal_event_alarms *) calloc(node->nodeNr, sizeof(struct gcal_event_alarms));
 	if (!tempval)
 		goto exit;
 
-	if ((node) && (node->nodeNr > 0)) {
-
-		for (i = 0; i < node->nodeNr; i++) {
-			if (xmlHasProp(node->nodeTab[i], "method")) {
-				tmp = xmlGetProp(node->nodeTab[i], "method");
-				if (tmp) {
-					if (!strncmp(tmp, "email", strlen("email"))) {
-						tempval[i].type = GCAL_ALARM_EMAIL;
-					} else if (!strncmp(tmp, "alert", strlen("alert"))) {
-						tempval[i].type = GCAL_ALARM_ALERT;
-					}
-					xmlFree(tmp);
-				}
-			}
-
-			if(xmlHasProp(node->nodeTab[i], "minutes")) {
-				tmp = xmlGetProp(node->nodeTab[i], "minutes");
-				if (tmp) {
-					tempval[i].minutes = atoi(strdup(tmp));
-					xmlFree(tmp);
-				}
-			}
-		}
-	}
+	result = node->nodeNr;
+	for (i = 0; i < node->nodeNr; i++)
+		extract_alarm(node->nodeTab[i], &tempval[i]);
 
 	*alarms = tempval;
 
@@ -439,110 +250,113 @@ exit:
 }
 
 /* TODO: move the internal loop code to functions, formating ATM is bad */
-int extract_and_check_attendees(xmlDoc *doc, const char *xpath_expression,
-				struct gcal_event_attendees **attendees)
+static void extract_attendee(xmlNode *node, struct gcal_event_attendees *attendee)
 {
-	xmlXPathObject *xpath_obj = NULL;
-	xmlNodeSet *node;
 	xmlNode	*child;
 	xmlChar	*tmp = NULL ;
-	struct gcal_event_attendees *tempval;
-	int result = 0;
-	int i;
 	size_t j;
 	char *pRel = NULL;
 
+	if (xmlHasProp(node, "email")) {
+		tmp = xmlGetProp(node, "email");
+		if (tmp) {
+			attendee->email = strdup(tmp);
+			xmlFree(tmp);
 
-	/* Sanity checks */
-	if (!doc)
-		goto exit;
-
-	if (!xpath_expression)
-		goto exit;
-
-	if (!attendees)
-		goto exit;
+		} else {
+			attendee->email = strdup("");
+		}
 
-	xpath_obj = execute_xpath_expression(doc, xpath_expression, NULL);
-	if (!xpath_obj) {
-		fprintf(stderr, "extract_and_check_attendees: failed to extract data");
-		goto exit;
+	} else {
+		attendee->email = strdup("");
 	}
 
-	node = xpath_obj->nodesetval;
-	result = node->nodeNr;
-
-	if ((!node) || (node->nodeNr == 0))
-		goto exit;
+	if (xmlHasProp(node, "rel")) {
+		tmp = xmlGetProp(node, "rel");
+		if (tmp) {
+			pRel = strrchr(tmp, '.');
+
+			if (pRel) {
+				pRel += 1;
+
+				if (!strncmp(pRel, "attendee", strlen("attendee"))) {
+					attendee->rel = GCAL_REL_ATTENDEE;
+				} else if (!strncmp(pRel, "organizer", strlen("organizer"))) {
+					attendee->rel = GCAL_REL_ORGANIZER;
+				} else if (!strncmp(pRel, "performer", strlen("performer"))) {
+					attendee->rel = GCAL_REL_PERFORMER;
+				} else if (!strncmp(pRel, "speaker", strlen("speaker"))) {
+					attendee->rel = GCAL_REL_SPEAKER;
+				}
+			}
 
-	tempval = (struct gcal_event_attendees *) malloc(result * sizeof(struct gcal_event_attendees));
-	memset(tempval, 0, sizeof(struct gcal_event_attendees));
+			xmlFree(tmp);
+		}
+	}
 
-	if (!tempval)
-		goto exit;
+	/* Parsing of the attendee's type & status */
 
-	for (i = 0; i < node->nodeNr; i++) {
+	if (attendee->rel == GCAL_REL_ORGANIZER) {
+		/* resolve the status of the organizer that is appart from the those of the attendees */
+		child = node->parent->children;
 
-		if (xmlHasProp(node->nodeTab[i], "email")) {
-			tmp = xmlGetProp(node->nodeTab[i], "email");
-			if (tmp) {
-				tempval[i].email = strdup(tmp);
-				xmlFree(tmp);
+		for (j = 0; j < xmlChildElementCount(node->parent); j++) {
+			if (!strncmp(child->name, "eventStatus", strlen("eventStatus"))) {
+				if (xmlHasProp(child,"value")) {
+					tmp = xmlGetProp(child,"value");
+					if (tmp) {
+						pRel = strrchr(tmp, '.');
 
-			} else {
-				tempval[i].email = strdup("");
-			}
+						if (pRel) {
+							pRel += 1;
 
-		} else {
-			tempval[i].email = strdup("");
-		}
+							if (!strncmp(pRel, "confirmed", strlen("confirmed"))) {
+								attendee->status = GCAL_STATUS_CONFIRMED;
+							} else if (!strncmp(pRel, "busy", strlen("busy"))) {
+								attendee->status = GCAL_STATUS_BUSY;
+							} else if (!strncmp(pRel, "canceled", strlen("canceled"))) {
+								attendee->status = GCAL_STATUS_CANCELED;
+							}
+						}
 
-		if (xmlHasProp(node->nodeTab[i], "rel")) {
-			tmp = xmlGetProp(node->nodeTab[i], "rel");
-			if (tmp) {
-				pRel = strrchr(tmp, '.');
-
-				if (pRel) {
-					pRel += 1;
-
-					if (!strncmp(pRel, "attendee", strlen("attendee"))) {
-						tempval[i].rel = GCAL_REL_ATTENDEE;
-					} else if (!strncmp(pRel, "organizer", strlen("organizer"))) {
-						tempval[i].rel = GCAL_REL_ORGANIZER;
-					} else if (!strncmp(pRel, "performer", strlen("performer"))) {
-						tempval[i].rel = GCAL_REL_PERFORMER;
-					} else if (!strncmp(pRel, "speaker", strlen("speaker"))) {
-						tempval[i].rel = GCAL_REL_SPEAKER;
+						xmlFree(tmp);
 					}
 				}
 
-				xmlFree(tmp);
+				break;
+
 			}
+
+			child=child->next;
 		}
 
-		/* Parsing of the attendee's type & status */
+	} else {
+		if (xmlChildElementCount(node) > 0) {
+			child = (xmlNode *)node->children;
+			//child = xmlFirstElementChild(node->children);
+			for (j = 0; j < xmlChildElementCount(node); j++) {
 
-		if (tempval[i].rel == GCAL_REL_ORGANIZER) {
-			/* resolve the status of the organizer that is appart from the those of the attendees */
-			child = node->nodeTab[i]->parent->children;
+				if (!strncmp(child->name, "attendeeStatus", strlen("attendeeStatus"))) {
 
-			for (j = 0; j < xmlChildElementCount(node->nodeTab[i]->parent); j++) {
-				if (!strncmp(child->name, "eventStatus", strlen("eventStatus"))) {
 					if (xmlHasProp(child,"value")) {
 						tmp = xmlGetProp(child,"value");
+
 						if (tmp) {
 							pRel = strrchr(tmp, '.');
 
 							if (pRel) {
 								pRel += 1;
 
-								if (!strncmp(pRel, "confirmed", strlen("confirmed"))) {
-									tempval[i].status = GCAL_STATUS_CONFIRMED;
-								} else if (!strncmp(pRel, "busy", strlen("busy"))) {
-									tempval[i].status = GCAL_STATUS_BUSY;
-								} else if (!strncmp(pRel, "canceled", strlen("canceled"))) {
-									tempval[i].status = GCAL_STATUS_CANCELED;
+								if (!strncmp(pRel, "accepted", strlen("accepted"))) {
+									attendee->status = GCAL_STATUS_ACCEPTED;
+								} else if (!strncmp(pRel, "declined", strlen("declined"))) {
+									attendee->status = GCAL_STATUS_DECLINED;
+								} else if (!strncmp(pRel, "invited", strlen("invited"))) {
+									attendee->status = GCAL_STATUS_INVITED;
+								} else if (!strncmp(pRel, "tentative", strlen("tentative"))) {
+									attendee->status = GCAL_STATUS_TENTATIVE;
 								}
+
 							}
 
 							xmlFree(tmp);
@@ -551,184 +365,77 @@ int extract_and_check_attendees(xmlDoc *doc, const char *xpath_expression,
 
 					break;
 
-				}
+				} else if (!strncmp(child->name, "attendeeType", strlen("attendeeType"))) {
 
-				child=child->next;
-			}
-
-		} else {
-			if (xmlChildElementCount(node->nodeTab[i]) > 0) {
-				child = (xmlNode *)node->nodeTab[i]->children;
-				//child = xmlFirstElementChild(node->nodeTab[i]->children);
-				for (j = 0; j < xmlChildElementCount(node->nodeTab[i]); j++) {
-
-					if (!strncmp(child->name, "attendeeStatus", strlen("attendeeStatus"))) {
-
-						if (xmlHasProp(child,"value")) {
-							tmp = xmlGetProp(child,"value");
-
-							if (tmp) {
-								pRel = strrchr(tmp, '.');
+					if (xmlHasProp(child, "value")) {
+						tmp = xmlGetProp(child, "value");
 
-								if (pRel) {
-									pRel += 1;
+						if (tmp) {
+							pRel = strrchr(tmp, '.');
 
-									if (!strncmp(pRel, "accepted", strlen("accepted"))) {
-										tempval[i].status = GCAL_STATUS_ACCEPTED;
-									} else if (!strncmp(pRel, "declined", strlen("declined"))) {
-										tempval[i].status = GCAL_STATUS_DECLINED;
-									} else if (!strncmp(pRel, "invited", strlen("invited"))) {
-										tempval[i].status = GCAL_STATUS_INVITED;
-									} else if (!strncmp(pRel, "tentative", strlen("tentative"))) {
-										tempval[i].status = GCAL_STATUS_TENTATIVE;
-									}
+							if (pRel) {
+								pRel += 1;
 
+								if (!strncmp(pRel, "optional", strlen("optional"))) {
+									attendee->type = GCAL_TYPE_OPTIONAL;
+								} else if (!strncmp(pRel, "required", strlen("required"))) {
+									attendee->type = GCAL_TYPE_REQUIRED;
 								}
-
-								xmlFree(tmp);
 							}
-						}
-
-						break;
 
-					} else if (!strncmp(child->name, "attendeeType", strlen("attendeeType"))) {
-
-						if (xmlHasProp(child, "value")) {
-							tmp = xmlGetProp(child, "value");
-
-							if (tmp) {
-								pRel = strrchr(tmp, '.');
-
-								if (pRel) {
-									pRel += 1;
-
-									if (!strncmp(pRel, "optional", strlen("optional"))) {
-										tempval[i].type = GCAL_TYPE_OPTIONAL;
-									} else if (!strncmp(pRel, "required", strlen("required"))) {
-										tempval[i].type = GCAL_TYPE_REQUIRED;
-									}
-								}
-
-								xmlFree(tmp);
-							}
+							xmlFree(tmp);
 						}
-						break;
 					}
-					child=child->next;
+					break;
 				}
+				child=child->next;
 			}
 		}
 	}
-
-	*attendees = tempval;
-exit:
-	xmlXPathFreeObject(xpath_obj);
-	return result;
 }
 
-
-/* TODO: move the internal loop code to functions, formating ATM is bad */
-static int extract_and_check_multisub(xmlDoc *doc, char *xpath_expression,
-				   int getContent, char *attr1, char* attr2,
-				   struct gcal_structured_subvalues **values,
-				   char ***types, int *pref)
+int extract_and_check_attendees(xmlDoc *doc, enum xpath_query query,
+				struct gcal_event_attendees **attendees)
 {
-	xmlXPathObject *xpath_obj;
+	xmlXPathObject *xpath_obj = NULL;
 	xmlNodeSet *node;
-	xmlNode *child, *cur_node;
-	xmlChar *tmp;
-	struct gcal_structured_subvalues *tempval;
-	int result = -1;
+	struct gcal_event_attendees *tempval;
+	int result = 0;
 	int i;
 
-	xpath_obj = execute_xpath_expression(doc,
-					     xpath_expression,
-					     NULL);
 
-	if ((!values) || (attr1 && !types) || (attr2 && !pref)) {
-		fprintf(stderr, "extract_and_check_multisub: null pointers received");
+	/* Sanity checks */
+	if (!doc)
 		goto exit;
-	}
 
+	if (!attendees)
+		goto exit;
+
+	xpath_obj = execute_xpath_query(doc, query);
 	if (!xpath_obj) {
-		fprintf(stderr, "extract_and_check_multisub: failed to extract data");
-		fprintf(stderr, "xpath_expression: ---%s---\n",xpath_expression);
+		fprintf(stderr, "extract_and_check_attendees: failed to extract data");
 		goto exit;
 	}
 
 	node = xpath_obj->nodesetval;
-
-	if (!node) {
-		result = 0;
-		goto cleanup;
-	}
-	result = node->nodeNr;
-
-	if (result == 0)
+	if ((!node) || (node->nodeNr == 0))
 		goto exit;
 
-	tempval = (*values);
-	if (attr1)
-		*types = (char **)malloc(node->nodeNr * sizeof(char*));
-
-	for (i = 0; i < node->nodeNr; i++) {
-		if (getContent) {
-			cur_node = node->nodeTab[i]->children;
-			for (child = cur_node; child; child = child->next) {
-				if (tempval->next_field == NULL) {
-					if((tmp = xmlNodeGetContent(child))) {
-						tempval->next_field = (struct gcal_structured_subvalues *)malloc(sizeof(struct gcal_structured_subvalues));
-						tempval->field_typenr = i;
-						tempval->field_key = strdup(child->name);
-						tempval->field_value = strdup(tmp);
-						xmlFree(tmp);
-						/* init next entry */
-						tempval = tempval->next_field;
-						if (tempval) {
-							tempval->field_typenr = 0;
-							tempval->field_key = NULL;
-							tempval->field_value = NULL;
-							tempval->next_field = NULL;
-						} else {
-							/* could not allocate enough memory, break here */
-							break;
-						}
-					}
-				}
-			}
-		}
-
-		if (attr1) {
-			if (xmlHasProp(node->nodeTab[i], attr1)) {
-				tmp = xmlGetProp(node->nodeTab[i], attr1);
-				if (tmp) {
-					if(strchr(tmp,'#'))
-						(*types)[i] = strdup(strchr(tmp,'#') + 1);
-					xmlFree(tmp);
-				} else
-					(*types)[i] = strdup("");
-			} else
-				(*types)[i] = strdup("");
-		}
+	tempval = (struct gcal_event_attendees *) calloc(node->nodeNr, sizeof(struct gcal_event_attendees));
+	if (!tempval)
+		goto exit;
 
-		if (attr2) {
-			if (xmlHasProp(node->nodeTab[i], attr2)) {
-				tmp = xmlGetProp(node->nodeTab[i], attr2);
-				if (tmp) {
-					if (!strcmp(tmp,"true"))
-						*pref = i;
-					xmlFree(tmp);
-				}
-			}
-		}
-	}
+	result = node->nodeNr;
+	for (i = 0; i < node->nodeNr; i++)
+		extract_attendee(node->nodeTab[i], &tempval[i]);
 
-cleanup:
-	xmlXPathFreeObject(xpath_obj);
+	*attendees = tempval;
 exit:
+	xmlXPathFreeObject(xpath_obj);
 	return result;
 }
 
+
 char *get_etag_attribute(xmlNode * a_node)
 {
 	xmlChar *uri = NULL;
@@ -745,78 +452,335 @@ char *get_etag_attribute(xmlNode * a_node)
 }
 
 
-int atom_extract_data(xmlNode *entry, struct gcal_event *ptr_entry)
+/* Namespaces of the elements found in an entry */
+enum entry_namespace {
+	NS_OTHER,
+	NS_ATOM,
+	NS_GD,
+	NS_GCAL,
+	NS_GCONTACT
+};
+
+/* One field of an entry, collected while walking the entry children.
+ * As with the equivalent XPath expression, no match (or more than one)
+ * yields an empty string and a missing attribute yields NULL.
+ */
+struct entry_field {
+	xmlNode *node;
+	int count;
+};
+
+static enum entry_namespace element_namespace(xmlNode *node)
 {
-	int	result = -1;
-	int	length = 0;
-	xmlChar *xml_str = NULL;
-	xmlDoc	*doc = NULL;
-	xmlNode *copy = NULL;
+	if (!node->ns || !node->ns->href)
+		return NS_OTHER;
+	if (!strcmp(node->ns->href, atom_href))
+		return NS_ATOM;
+	if (!strcmp(node->ns->href, gd_href))
+		return NS_GD;
+	if (!strcmp(node->ns->href, gcal_href))
+		return NS_GCAL;
+	if (!strcmp(node->ns->href, gContact_href))
+		return NS_GCONTACT;
+
+	return NS_OTHER;
+}
 
+/* Same as matching 'element/text()' */
+static void field_add_text(struct entry_field *field, xmlNode *element)
+{
+	xmlNode *child;
 
-	if (!entry || !ptr_entry)
-		goto exit;
+	for (child = element->children; child; child = child->next)
+		if ((child->type == XML_TEXT_NODE) ||
+		    (child->type == XML_CDATA_SECTION_NODE)) {
+			field->node = child;
+			++field->count;
+		}
+}
 
-	/* Creates a doc from this element node: yeah, nasty, I should
-	 * think of a better way later...
-	 */
-	doc = xmlNewDoc("1.0");
-	if (!doc)
+static void field_add(struct entry_field *field, xmlNode *element)
+{
+	field->node = element;
+	++field->count;
+}
+
+static char *field_value(struct entry_field *field, char *attr)
+{
+	char *result = NULL;
+	xmlChar *tmp;
+
+	if (field->count != 1)
+		return strdup("");
+
+	if (!attr) {
+		if ((field->node->type == XML_TEXT_NODE) &&
+		    field->node->content)
+			result = strdup(field->node->content);
+	} else if ((tmp = xmlGetProp(field->node, attr))) {
+		result = strdup(tmp);
+		xmlFree(tmp);
+	}
+
+	return result;
+}
+
+static int append_attendee(struct gcal_event *ptr_entry, xmlNode *node)
+{
+	struct gcal_event_attendees *tmp;
+
+	tmp = realloc(ptr_entry->attendees, (ptr_entry->attendees_nr + 1) *
+		      sizeof(struct gcal_event_attendees));
+	if (!tmp)
+		return -1;
+
+	ptr_entry->attendees = tmp;
+	tmp += ptr_entry->attendees_nr++;
+	memset(tmp, 0, sizeof(struct gcal_event_attendees));
+	extract_attendee(node, tmp);
+
+	return 0;
+}
+
+static int append_alarm(struct gcal_event *ptr_entry, xmlNode *node)
+{
+	struct gcal_event_alarms *tmp;
+
+	tmp = realloc(ptr_entry->alarms, (ptr_entry->alarms_nr + 1) *
+		      sizeof(struct gcal_event_alarms));
+	if (!tmp)
+		return -1;
+
+	ptr_entry->alarms = tmp;
+	tmp += ptr_entry->alarms_nr++;
+	memset(tmp, 0, sizeof(struct gcal_event_alarms));
+	extract_alarm(node, tmp);
+
+	return 0;
+}
+
+/* Records the namespaces used within 'node' that are declared outside
+ * of the entry, in document order (i.e. the order a deep copy of the
+ * entry would declare them).
+ */
+static int collect_namespaces(xmlNode *node, xmlNs ***declared,
+			      int *declared_nr, xmlNs ***outside,
+			      int *outside_nr)
+{
+	xmlAttr *attr;
+	xmlNs *ns, **tmp;
+	int i, j;
+
+	for (ns = node->nsDef; ns; ns = ns->next) {
+		if (!(tmp = realloc(*declared, (*declared_nr + 1) *
+				    sizeof(xmlNs *))))
+			return -1;
+		*declared = tmp;
+		(*declared)[(*declared_nr)++] = ns;
+	}
+
+	attr = node->properties;
+	for (i = -1; (i == -1) || attr; ++i) {
+		if (i == -1)
+			ns = node->ns;
+		else {
+			ns = attr->ns;
+			attr = attr->next;
+		}
+		if (!ns)
+			continue;
+
+		for (j = 0; j < *declared_nr; ++j)
+			if ((*declared)[j] == ns)
+				break;
+		if (j < *declared_nr)
+			continue;
+		for (j = 0; j < *outside_nr; ++j)
+			if ((*outside)[j] == ns)
+				break;
+		if (j < *outside_nr)
+			continue;
+
+		if (!(tmp = realloc(*outside, (*outside_nr + 1) *
+				    sizeof(xmlNs *))))
+			return -1;
+		*outside = tmp;
+		(*outside)[(*outside_nr)++] = ns;
+	}
+
+	for (node = node->children; node; node = node->next)
+		if (node->type == XML_ELEMENT_NODE)
+			if (collect_namespaces(node, declared, declared_nr,
+					       outside, outside_nr))
+				return -1;
+
+	return 0;
+}
+
+/* Serializes an entry as a standalone XML document, straight from the
+ * feed tree. The namespaces the entry inherits from the feed are
+ * declared on it while it is saved and removed afterwards.
+ */
+static char *dump_entry(xmlNode *entry)
+{
+	const char header[] = "<?xml version=\"1.0\"?>\n";
+	xmlNs **declared = NULL, **outside = NULL, *added = NULL, *last;
+	int declared_nr = 0, outside_nr = 0, i;
+	xmlBuffer *buffer = NULL;
+	xmlSaveCtxt *save;
+	char *result = NULL;
+
+	if (collect_namespaces(entry, &declared, &declared_nr, &outside,
+			       &outside_nr))
 		goto exit;
 
-	copy = xmlCopyNode(entry, 1);
-	if (!copy)
+	/* xmlNewNs appends to the entry declarations */
+	for (last = entry->nsDef; last && last->next; last = last->next)
+		;
+	for (i = 0; i < outside_nr; ++i)
+		xmlNewNs(entry, outside[i]->href, outside[i]->prefix);
+
+	if (!(buffer = xmlBufferCreate()))
+		goto cleanup;
+	if (!(save = xmlSaveToBuffer(buffer, NULL, 0)))
 		goto cleanup;
+	xmlSaveTree(save, entry);
+	xmlSaveClose(save);
 
-	xmlDocSetRootElement(doc, copy);
-	xmlSaveFormatFileEnc("-", doc, "UTF-8", 1);
+	if (!(result = malloc(sizeof(header) + xmlBufferLength(buffer) + 1)))
+		goto cleanup;
+	strcpy(result, header);
+	strcat(result, (const char *)xmlBufferContent(buffer));
+	strcat(result, "\n");
+
+cleanup:
+	added = last ? last->next : entry->nsDef;
+	if (added) {
+		if (last)
+			last->next = NULL;
+		else
+			entry->nsDef = NULL;
+		xmlFreeNsList(added);
+	}
+	if (buffer)
+		xmlBufferFree(buffer);
+exit:
+	free(declared);
+	free(outside);
+	return result;
+}
+
+int atom_extract_data(xmlNode *entry, struct gcal_event *ptr_entry)
+{
+	int	result = -1;
+	xmlChar *rel;
+	xmlNode *child;
+	struct entry_field title = { NULL, 0 }, id = { NULL, 0 },
+		edit = { NULL, 0 }, content = { NULL, 0 }, where = { NULL, 0 },
+		status = { NULL, 0 }, recurrence = { NULL, 0 },
+		when = { NULL, 0 }, add_self = { NULL, 0 },
+		invite = { NULL, 0 }, modify = { NULL, 0 },
+		see_guests = { NULL, 0 }, sequence = { NULL, 0 },
+		published = { NULL, 0 }, updated = { NULL, 0 },
+		visibility = { NULL, 0 };
+
+	if (!entry || !ptr_entry)
+		goto exit;
 
 	/* Google Data API 2.0 requires ETag to edit an entry */
 	/* //atom:entry/@gd:etag*/
-	ptr_entry->common.etag = get_etag_attribute(copy);
+	ptr_entry->common.etag = get_etag_attribute(entry);
 	if (!ptr_entry->common.etag) {
 		fprintf(stderr, "failed getting ETag!!!!!!\n");
-		goto cleanup;
+		goto exit;
 	}
 
 	/* Store XML raw data */
 	if (ptr_entry->common.store_xml) {
-		xmlDocDumpMemory(doc, &xml_str, &length);
-		if (xml_str) {
-			if (!(ptr_entry->common.xml = strdup(xml_str)))
-				goto cleanup;
-		}
-		else
-			goto cleanup;
+		if (!(ptr_entry->common.xml = dump_entry(entry)))
+			goto exit;
 	} else
 		if (!(ptr_entry->common.xml = strdup("")))
-			goto cleanup;
+			goto exit;
+
+	/* Walks the entry children once, dispatching on namespace and name */
+	for (child = entry->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE)
+			continue;
+
+		switch (element_namespace(child)) {
+		case NS_ATOM:
+			if (!strcmp(child->name, "title"))
+				field_add_text(&title, child);
+			else if (!strcmp(child->name, "id"))
+				field_add_text(&id, child);
+			else if (!strcmp(child->name, "content"))
+				field_add_text(&content, child);
+			else if (!strcmp(child->name, "published"))
+				field_add_text(&published, child);
+			else if (!strcmp(child->name, "updated"))
+				field_add_text(&updated, child);
+			else if (!strcmp(child->name, "link")) {
+				rel = xmlGetNoNsProp(child, "rel");
+				if (rel && !strcmp(rel, "edit"))
+					field_add(&edit, child);
+				if (rel)
+					xmlFree(rel);
+			}
+			break;
+
+		case NS_GD:
+			if (!strcmp(child->name, "where"))
+				field_add(&where, child);
+			else if (!strcmp(child->name, "eventStatus"))
+				field_add(&status, child);
+			else if (!strcmp(child->name, "recurrence"))
+				field_add_text(&recurrence, child);
+			else if (!strcmp(child->name, "when"))
+				field_add(&when, child);
+			else if (!strcmp(child->name, "visibility"))
+				field_add(&visibility, child);
+			else if (!strcmp(child->name, "who")) {
+				if (append_attendee(ptr_entry, child))
+					goto exit;
+			} else if (!strcmp(child->name, "reminder")) {
+				if (append_alarm(ptr_entry, child))
+					goto exit;
+			}
+			break;
+
+		case NS_GCAL:
+			if (!strcmp(child->name, "anyoneCanAddSelf"))
+				field_add(&add_self, child);
+			else if (!strcmp(child->name, "guestsCanInviteOthers"))
+				field_add(&invite, child);
+			else if (!strcmp(child->name, "guestsCanModify"))
+				field_add(&modify, child);
+			else if (!strcmp(child->name, "guestsCanSeeGuests"))
+				field_add(&see_guests, child);
+			else if (!strcmp(child->name, "sequence"))
+				field_add(&sequence, child);
+			break;
+
+		default:
+			break;
+		}
+	}
 
 	/* Gets the 'what' calendar field */
-	ptr_entry->common.title = extract_and_check(doc,
-					     "//atom:entry/atom:title/text()",
-					     NULL);
+	ptr_entry->common.title = field_value(&title, NULL);
 	if (!ptr_entry->common.title)
-		goto cleanup;
+		goto exit;
 
 	/* Gets the 'id' calendar field */
-	ptr_entry->common.id = extract_and_check(doc,
-					  "//atom:entry/atom:id/text()",
-					  NULL);
+	ptr_entry->common.id = field_value(&id, NULL);
 	if (!ptr_entry->common.id)
-		goto cleanup;
+		goto exit;
 
-	/* Gets the 'edit url' calendar field
-	 * FIXME: I dont known how to extract attribute value from
-	 * XML_ATTRIBUTE_NODE. If I discover later how to do it, it
-	 * should work with the XPath expression:
-	 * '//atom:entry/atom:link[@rel='edit']/@href'
-	 */
-	ptr_entry->common.edit_uri = extract_and_check(doc, "//atom:entry/"
-						"atom:link[@rel='edit']",
-						"href");
+	/* Gets the 'edit url' calendar field */
+	ptr_entry->common.edit_uri = field_value(&edit, "href");
 	if (!ptr_entry->common.edit_uri)
-		goto cleanup;
+		goto exit;
 	/* XXX: Starting with gcalendar protocol 2.1, the edit URL is
 	 * different between a just added event versus a retrieved event.
 	 * This makes the same event to have 2 distinct urls and breaks
@@ -829,86 +793,60 @@ int atom_extract_data(xmlNode *entry, struct gcal_event *ptr_entry)
 	workaround_edit_url(ptr_entry->common.edit_uri);
 
 	/* Gets the 'content' calendar field */
-	ptr_entry->content = extract_and_check(doc,
-					       "//atom:entry/"
-					       "atom:content/text()",
-					       NULL);
+	ptr_entry->content = field_value(&content, NULL);
 
 	/* Gets the 'where' calendar field */
-	ptr_entry->where = extract_and_check(doc,
-					     "//atom:entry/"
-					     "gd:where",
-					     "valueString");
+	ptr_entry->where = field_value(&where, "valueString");
 
 	/* Gets the 'status' calendar field */
-	ptr_entry->status = extract_and_check(doc,
-					      "//atom:entry/gd:eventStatus",
-					      "value");
+	ptr_entry->status = field_value(&status, "value");
 	if (!ptr_entry->status)
-		goto cleanup;
-
-	/* Gets informations about the attendees invited to the event */
-
-	ptr_entry->attendees_nr = extract_and_check_attendees(doc,
-							      "//atom:entry/gd:who",
-							      &ptr_entry->attendees);
+		goto exit;
 
 	/* Retreive the recurrence pattern */
-	ptr_entry->dt_recurrent = extract_and_check(doc,"//atom:entry/"
-							  "gd:recurrence/text()",
-							  NULL);
+	ptr_entry->dt_recurrent = field_value(&recurrence, NULL);
+	if (!ptr_entry->dt_recurrent)
+		goto exit;
 	if (ptr_entry->dt_recurrent[0] != 0) {
-	  ptr_entry->dt_start = strdup("");
-	  ptr_entry->dt_end = strdup("");
-	  ptr_entry->alarms_nr = extract_and_check_alarms(doc, 1, &ptr_entry->alarms);
+		ptr_entry->dt_start = strdup("");
+		ptr_entry->dt_end = strdup("");
 	} else {
-	  /* Gets the when 'start' calendar field */
-	  ptr_entry->dt_start = extract_and_check(doc,
-						  "//atom:entry/gd:when",
-						  "startTime");
-
-	  /* Gets the when 'end' calendar field */
-	  ptr_entry->dt_end = extract_and_check(doc,
-						"//atom:entry/gd:when",
-						"endTime");
-
-	  ptr_entry->alarms_nr = extract_and_check_alarms(doc, 0, &ptr_entry->alarms);
+		/* Gets the when 'start' and 'end' calendar fields */
+		ptr_entry->dt_start = field_value(&when, "startTime");
+		ptr_entry->dt_end = field_value(&when, "endTime");
+
+		/* Only recurrent events report their alarms (reminders
+		 * within 'gd:when' are not extracted).
+		 */
+		free(ptr_entry->alarms);
+		ptr_entry->alarms = NULL;
+		ptr_entry->alarms_nr = 0;
 	}
 
 	/* Gets the 'anyoneCanAddSelf' calendar field */
-	ptr_entry->anyoneCanAddSelf = extract_and_check(doc,
-							"//atom:entry/gCal:anyoneCanAddSelf",
-							"value");
+	ptr_entry->anyoneCanAddSelf = field_value(&add_self, "value");
 	if (!ptr_entry->anyoneCanAddSelf)
-	  goto cleanup;
+		goto exit;
 
 	/* Gets the 'guestsCanInviteOthers' calendar field */
-	ptr_entry->guestsCanInviteOthers = extract_and_check(doc,
-							     "//atom:entry/gCal:guestsCanInviteOthers",
-							     "value");
+	ptr_entry->guestsCanInviteOthers = field_value(&invite, "value");
 	if (!ptr_entry->guestsCanInviteOthers)
-	  goto cleanup;
+		goto exit;
 
 	/* Gets the 'guestsCanModify' calendar field */
-	ptr_entry->guestsCanModify = extract_and_check(doc,
-						       "//atom:entry/gCal:guestsCanModify",
-						       "value");
+	ptr_entry->guestsCanModify = field_value(&modify, "value");
 	if (!ptr_entry->guestsCanModify)
-	  goto cleanup;
+		goto exit;
 
 	/* Gets the 'guestsCanSeeGuests' calendar field */
-	ptr_entry->guestsCanSeeGuests = extract_and_check(doc,
-							  "//atom:entry/gCal:guestsCanSeeGuests",
-							  "value");
+	ptr_entry->guestsCanSeeGuests = field_value(&see_guests, "value");
 	if (!ptr_entry->guestsCanSeeGuests)
-	  goto cleanup;
+		goto exit;
 
 	/* Gets the 'sequence' calendar field */
-	ptr_entry->sequence = extract_and_check(doc,
-						"//atom:entry/gCal:sequence",
-						"value");
+	ptr_entry->sequence = field_value(&sequence, "value");
 	if (!ptr_entry->sequence)
-	  goto cleanup;
+		goto exit;
 
 	/* Detects if event was deleted/canceled and marks the flag */
 	if (!(strcmp("http://schemas.google.com/g/2005#event.canceled",
@@ -918,39 +856,22 @@ int atom_extract_data(xmlNode *entry, struct gcal_event *ptr_entry)
 		ptr_entry->common.deleted = 0;
 
 	/* Gets the 'published' calendar field */
-	ptr_entry->common.published = extract_and_check(doc,
-							"//atom:entry/"
-							"atom:published/text()",
-							NULL);
+	ptr_entry->common.published = field_value(&published, NULL);
 	if (!ptr_entry->common.published)
-	  goto cleanup;
+		goto exit;
 
 	/* Gets the 'updated' calendar field */
-	ptr_entry->common.updated = extract_and_check(doc,
-						      "//atom:entry/"
-						      "atom:updated/text()",
-						      NULL);
+	ptr_entry->common.updated = field_value(&updated, NULL);
 	if (!ptr_entry->common.updated)
-		goto cleanup;
+		goto exit;
 
 	/* Gets the 'visibility' calendar field */
-	ptr_entry->common.visibility = extract_and_check(doc,
-							 "//atom:entry/"
-							 "gd:visibility",
-							 "value");
+	ptr_entry->common.visibility = field_value(&visibility, "value");
 	if (!ptr_entry->common.updated)
-		goto cleanup;
+		goto exit;
 
 	result = 0;
 
-cleanup:
-
-	/* Dumps the doc to stdout */
-	/* xmlSaveFormatFileEnc("-", doc, "UTF-8", 1); */
-	xmlFreeDoc(doc);
-	if (xml_str)
-		xmlFree(xml_str);
-
 exit:
 	return result;
 }
@@ -958,8 +879,8 @@ exit:
 int atom_extract_calendar(xmlNode *entry, struct gcal_resource *ptr_res)
 {
 	int	result = -1;
-	xmlDoc	*doc = NULL;
-	xmlNode	*copy = NULL;
+	struct entry_field id = { NULL, 0 };
+	xmlNode	*child;
 	char	*url = NULL;
 	char	*username = NULL;
 	char	*domain = NULL;
@@ -968,19 +889,13 @@ int atom_extract_calendar(xmlNode *entry, struct gcal_resource *ptr_res)
 	if (!entry || !ptr_res)
 		goto exit;
 
-	doc = xmlNewDoc("1.0");
-	if (!doc)
-		goto exit;
-
-	copy = xmlCopyNode(entry, 1);
-	if (!copy)
-		goto exit;
-
-	xmlDocSetRootElement(doc, copy);
-	//xmlSaveFormatFileEnc("-", doc, "UTF-8", 1);
+	for (child = entry->children; child; child = child->next)
+		if ((child->type == XML_ELEMENT_NODE) &&
+		    (element_namespace(child) == NS_ATOM) &&
+		    !strcmp(child->name, "id"))
+			field_add_text(&id, child);
 
-	url = extract_and_check(doc, "//atom:entry/atom:id/text()",
-				NULL);
+	url = field_value(&id, NULL);
 	if (!url)
 		goto exit;
 
@@ -1000,262 +915,420 @@ int atom_extract_calendar(xmlNode *entry, struct gcal_resource *ptr_res)
 
 	if (url)
 	    free(url);
-	if (doc)
-	    xmlFreeDoc(doc);
 
 exit:
 	return result;
 }
 
-int atom_extract_contact(xmlNode *entry, struct gcal_contact *ptr_entry)
+/* Element nodes of a multi-valued contact field, in document order */
+struct entry_list {
+	xmlNode **nodes;
+	int count;
+	int size;
+};
+
+static int list_add(struct entry_list *list, xmlNode *node)
 {
-	int result = -1, length = 0;
-	//int j, t;
-	//char *atom_str = NULL;
-	char *tmp;
-	xmlChar *xml_str = NULL;
-	xmlDoc *doc = NULL;
-	xmlNode *copy = NULL;
+	xmlNode **tmp;
 
-	if (!entry || !ptr_entry)
-		goto exit;
+	if (list->count == list->size) {
+		tmp = realloc(list->nodes, (list->size ? list->size * 2 : 4) *
+			      sizeof(xmlNode *));
+		if (!tmp)
+			return -1;
+		list->nodes = tmp;
+		list->size = list->size ? list->size * 2 : 4;
+	}
 
-	/* XXX: this function is pretty much a copy of 'atom_extract_data'
-	 * some code could be shared if I provided a common type between
-	 * contact X calendar.
-	 */
+	list->nodes[list->count++] = node;
+	return 0;
+}
 
-	/* Creates a doc from this element node: yeah, nasty, I should
-	 * think of a better way later...
-	 */
-	doc = xmlNewDoc("1.0");
-	if (!doc)
-		goto exit;
+/* Attribute value (or what follows its '#' when 'fragment' is set),
+ * missing attributes are reported as an empty string.
+ */
+static char *attribute_value(xmlNode *node, char *attr, char fragment)
+{
+	xmlChar *tmp;
+	char *pos, *result = NULL;
 
-	copy = xmlCopyNode(entry, 1);
-	if (!copy)
-		goto cleanup;
+	if ((tmp = xmlGetProp(node, attr))) {
+		pos = fragment ? strchr(tmp, '#') : (char *)tmp;
+		if (pos)
+			result = strdup(fragment ? pos + 1 : pos);
+		xmlFree(tmp);
+	}
+
+	return result ? result : strdup("");
+}
+
+static int is_primary(xmlNode *node, char *attr)
+{
+	xmlChar *tmp;
+	int result = 0;
+
+	if ((tmp = xmlGetProp(node, attr))) {
+		result = !strcmp(tmp, "true");
+		xmlFree(tmp);
+	}
+
+	return result;
+}
+
+/* Fills the arrays of a multi-valued field (e.g. emails): the value is
+ * either the element content or 'attr1', types/protocols come from the
+ * fragment of 'attr2'/'attr3', labels from 'attr4' and 'attr5' flags
+ * the preferred one.
+ */
+static int extract_multi(struct entry_list *list, int getContent,
+			 char *attr1, char *attr2, char *attr3, char *attr4,
+			 char *attr5, char ***values, char ***types,
+			 char ***protocols, char ***labels, int *pref)
+{
+	xmlChar *tmp;
+	int i;
+
+	if (!list->count)
+		return 0;
+
+	if (!(*values = malloc(list->count * sizeof(char *))))
+		return -1;
+	if (attr2 && !(*types = malloc(list->count * sizeof(char *))))
+		return -1;
+	if (attr3 && !(*protocols = malloc(list->count * sizeof(char *))))
+		return -1;
+	if (attr4 && !(*labels = malloc(list->count * sizeof(char *))))
+		return -1;
+
+	for (i = 0; i < list->count; i++) {
+		if (getContent) {
+			tmp = xmlNodeGetContent(list->nodes[i]);
+			(*values)[i] = strdup(tmp ? (char *)tmp : "");
+			if (tmp)
+				xmlFree(tmp);
+		} else
+			(*values)[i] = attribute_value(list->nodes[i],
+						       attr1, 0);
+
+		if (attr2)
+			(*types)[i] = attribute_value(list->nodes[i], attr2, 1);
+		if (attr3)
+			(*protocols)[i] = attribute_value(list->nodes[i],
+							  attr3, 1);
+		if (attr4)
+			(*labels)[i] = attribute_value(list->nodes[i], attr4, 0);
+		if (attr5 && is_primary(list->nodes[i], attr5))
+			*pref = i;
+	}
+
+	return list->count;
+}
+
+/* Appends the children of every node to the 'values' list of subfields
+ * (e.g. street, city) tagged with the node index.
+ */
+static int extract_multisub(struct entry_list *list, char *attr1,
+			    char *attr2, struct gcal_structured_subvalues *values,
+			    char ***types, int *pref)
+{
+	xmlNode *child;
+	xmlChar *tmp;
+	int i;
+
+	if (!list->count)
+		return 0;
+
+	if (attr1 && !(*types = malloc(list->count * sizeof(char *))))
+		return -1;
+
+	/* The list always ends with an empty entry */
+	while (values->next_field)
+		values = values->next_field;
+
+	for (i = 0; i < list->count; i++) {
+		for (child = list->nodes[i]->children; child;
+		     child = child->next) {
+			if (!(tmp = xmlNodeGetContent(child)))
+				continue;
+
+			values->next_field = malloc(sizeof(struct gcal_structured_subvalues));
+			values->field_typenr = i;
+			values->field_key = strdup(child->name);
+			values->field_value = strdup(tmp);
+			xmlFree(tmp);
+
+			if (!(values = values->next_field))
+				return -1;
+			values->field_typenr = 0;
+			values->field_key = NULL;
+			values->field_value = NULL;
+			values->next_field = NULL;
+		}
+
+		if (attr1)
+			(*types)[i] = attribute_value(list->nodes[i], attr1, 1);
+		if (attr2 && is_primary(list->nodes[i], attr2))
+			*pref = i;
+	}
+
+	return list->count;
+}
 
-	xmlDocSetRootElement(doc, copy);
+int atom_extract_contact(xmlNode *entry, struct gcal_contact *ptr_entry)
+{
+	int result = -1;
+	char *tmp;
+	xmlChar *attr;
+	xmlNode *child, *sub;
+	struct entry_field deleted = { NULL, 0 }, id = { NULL, 0 },
+		updated = { NULL, 0 }, full_name = { NULL, 0 },
+		edit = { NULL, 0 }, content = { NULL, 0 },
+		nickname = { NULL, 0 }, homepage = { NULL, 0 },
+		blog = { NULL, 0 }, org_name = { NULL, 0 },
+		org_title = { NULL, 0 }, occupation = { NULL, 0 },
+		post_address = { NULL, 0 }, birthday = { NULL, 0 },
+		photo = { NULL, 0 };
+	struct entry_list name = { NULL, 0, 0 }, emails = { NULL, 0, 0 },
+		phones = { NULL, 0, 0 }, ims = { NULL, 0, 0 },
+		addresses = { NULL, 0, 0 }, groups = { NULL, 0, 0 };
+
+	if (!entry || !ptr_entry)
+		goto exit;
 
 	/* Google Data API 2.0 requires ETag to edit an entry */
 	/* //atom:entry/@gd:etag*/
-	ptr_entry->common.etag = get_etag_attribute(copy);
+	ptr_entry->common.etag = get_etag_attribute(entry);
 	if (!ptr_entry->common.etag) {
 		fprintf(stderr, "failed getting ETag!!!!!!\n");
-		goto cleanup;
+		goto exit;
 	}
 
 	/* Store XML raw data */
 	if (ptr_entry->common.store_xml) {
-		xmlDocDumpMemory(doc, &xml_str, &length);
-		if (xml_str) {
-			if (!(ptr_entry->common.xml = strdup(xml_str)))
-				goto cleanup;
-		}
-		else
-			goto cleanup;
+		if (!(ptr_entry->common.xml = dump_entry(entry)))
+			goto exit;
 	} else
 		if (!(ptr_entry->common.xml = strdup("")))
-			goto cleanup;
+			goto exit;
+
+	/* Walks the entry children once, collecting single fields and
+	 * the nodes of the multi-valued ones.
+	 */
+	for (child = entry->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE)
+			continue;
+
+		switch (element_namespace(child)) {
+		case NS_ATOM:
+			if (!strcmp(child->name, "id"))
+				field_add_text(&id, child);
+			else if (!strcmp(child->name, "updated"))
+				field_add_text(&updated, child);
+			else if (!strcmp(child->name, "content"))
+				field_add_text(&content, child);
+			else if (!strcmp(child->name, "link")) {
+				attr = xmlGetNoNsProp(child, "rel");
+				if (attr && !strcmp(attr, "edit"))
+					field_add(&edit, child);
+				if (attr)
+					xmlFree(attr);
+				attr = xmlGetNoNsProp(child, "type");
+				if (attr && !strcmp(attr, "image/*"))
+					field_add(&photo, child);
+				if (attr)
+					xmlFree(attr);
+			}
+			break;
+
+		case NS_GD:
+			if (!strcmp(child->name, "deleted"))
+				field_add(&deleted, child);
+			else if (!strcmp(child->name, "email")) {
+				if (list_add(&emails, child))
+					goto cleanup;
+			} else if (!strcmp(child->name, "phoneNumber")) {
+				if (list_add(&phones, child))
+					goto cleanup;
+			} else if (!strcmp(child->name, "im")) {
+				if (list_add(&ims, child))
+					goto cleanup;
+			} else if (!strcmp(child->name, "name")) {
+				if (list_add(&name, child))
+					goto cleanup;
+				for (sub = child->children; sub; sub = sub->next)
+					if ((sub->type == XML_ELEMENT_NODE) &&
+					    (element_namespace(sub) == NS_GD) &&
+					    !strcmp(sub->name, "fullName"))
+						field_add_text(&full_name, sub);
+			} else if (!strcmp(child->name,
+					   "structuredPostalAddress")) {
+				if (list_add(&addresses, child))
+					goto cleanup;
+				for (sub = child->children; sub; sub = sub->next)
+					if ((sub->type == XML_ELEMENT_NODE) &&
+					    (element_namespace(sub) == NS_GD) &&
+					    !strcmp(sub->name, "formattedAddress"))
+						field_add_text(&post_address, sub);
+			} else if (!strcmp(child->name, "organization")) {
+				for (sub = child->children; sub; sub = sub->next) {
+					if ((sub->type != XML_ELEMENT_NODE) ||
+					    (element_namespace(sub) != NS_GD))
+						continue;
+					if (!strcmp(sub->name, "orgName"))
+						field_add_text(&org_name, sub);
+					else if (!strcmp(sub->name, "orgTitle"))
+						field_add_text(&org_title, sub);
+				}
+			}
+			break;
+
+		case NS_GCONTACT:
+			if (!strcmp(child->name, "nickname"))
+				field_add_text(&nickname, child);
+			else if (!strcmp(child->name, "occupation"))
+				field_add_text(&occupation, child);
+			else if (!strcmp(child->name, "birthday"))
+				field_add(&birthday, child);
+			else if (!strcmp(child->name, "website")) {
+				attr = xmlGetNoNsProp(child, "rel");
+				if (attr && !strcmp(attr, "home-page"))
+					field_add(&homepage, child);
+				else if (attr && !strcmp(attr, "blog"))
+					field_add(&blog, child);
+				if (attr)
+					xmlFree(attr);
+			} else if (!strcmp(child->name, "groupMembershipInfo")) {
+				attr = xmlGetNoNsProp(child, "deleted");
+				if (attr && !strcmp(attr, "false") &&
+				    list_add(&groups, child)) {
+					xmlFree(attr);
+					goto cleanup;
+				}
+				if (attr)
+					xmlFree(attr);
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
 
 	/* Detects if this contacts was deleted */
-	tmp = extract_and_check(doc, "//atom:entry/gd:deleted", NULL);
-	if (tmp) {
-		free(tmp);
-		ptr_entry->common.deleted = 0;
-	} else
-		ptr_entry->common.deleted = 1;
+	ptr_entry->common.deleted = (deleted.count == 1);
 
 	/* Gets the 'id' contact field */
-	ptr_entry->common.id = extract_and_check(doc,
-					  "//atom:entry/atom:id/text()",
-					  NULL);
+	ptr_entry->common.id = field_value(&id, NULL);
 	if (!ptr_entry->common.id)
 		goto cleanup;
 
 	/* Gets the 'updated' contact field */
-	ptr_entry->common.updated = extract_and_check(doc,
-					       "//atom:entry/"
-					       "atom:updated/text()",
-					       NULL);
-
+	ptr_entry->common.updated = field_value(&updated, NULL);
 
-	ptr_entry->structured_name_nr = extract_and_check_multisub(doc,
-						    "//atom:entry/"
-						    "gd:name",
-						    1,
-						    NULL,
-						    NULL,
-						    &ptr_entry->structured_name,
-						    NULL,
-						    NULL);
+	ptr_entry->structured_name_nr = extract_multisub(&name, NULL, NULL,
+							 ptr_entry->structured_name,
+							 NULL, NULL);
+	if (ptr_entry->structured_name_nr == -1)
+		goto cleanup;
 
 	/* The 'who' contact field changed in GData-Version: 3.0 API, see:
 	 * http://code.google.com/intl/en-EN/apis/contacts/docs/3.0/
 	 * migration_guide.html#Protocol
 	 */
-	ptr_entry->common.title = extract_and_check(doc, "//atom:entry"
-						    "/gd:name/gd:fullName/text()",
-						    NULL);
-
+	ptr_entry->common.title = field_value(&full_name, NULL);
 
 	if (!ptr_entry->common.title && !ptr_entry->structured_name_nr)
 		goto cleanup;
 
 	/* Gets the 'edit url' contact field */
-	ptr_entry->common.edit_uri = extract_and_check(doc, "//atom:entry/"
-						"atom:link[@rel='edit']",
-						"href");
+	ptr_entry->common.edit_uri = field_value(&edit, "href");
 	if (!ptr_entry->common.edit_uri)
 		goto cleanup;
 
 	/* Gets email addressess */
-	ptr_entry->emails_nr = extract_and_check_multi(doc,
-						    "//atom:entry/"
-						    "gd:email",
-						    0,
-						    "address",
-						    "rel",
-						    NULL,
-						    "label",
-						    "primary",
-						    &ptr_entry->emails_field,
-						    &ptr_entry->emails_type,
-						    NULL,
-						    &ptr_entry->emails_label,
-						    &ptr_entry->pref_email);
-
-	/* TODO Commented to allow contacts without an email address
-	if (!ptr_entry->email)
-		goto cleanup; */
+	ptr_entry->emails_nr = extract_multi(&emails, 0, "address", "rel",
+					     NULL, "label", "primary",
+					     &ptr_entry->emails_field,
+					     &ptr_entry->emails_type, NULL,
+					     &ptr_entry->emails_label,
+					     &ptr_entry->pref_email);
+	if (ptr_entry->emails_nr == -1)
+		goto cleanup;
 
 	/* Here begins extra fields */
 
 	/* Gets the 'content' contact field */
-	ptr_entry->content = extract_and_check(doc,
-					       "//atom:entry/"
-					       "atom:content/text()",
-					       NULL);
+	ptr_entry->content = field_value(&content, NULL);
 
 	/* Gets contact nickname */
-	ptr_entry->nickname = extract_and_check(doc,
-						"//atom:entry/"
-						"gContact:nickname/text()",
-						NULL);
+	ptr_entry->nickname = field_value(&nickname, NULL);
 
 	/* Gets the 'homepage' contact field */
-	ptr_entry->homepage = extract_and_check(doc, "//atom:entry/"
-						"gContact:website[@rel='home-page']",
-						"href");
+	ptr_entry->homepage = field_value(&homepage, "href");
 
 	/* Gets the 'blog' contact field */
-	ptr_entry->blog = extract_and_check(doc, "//atom:entry/"
-						"gContact:website[@rel='blog']",
-						"href");
+	ptr_entry->blog = field_value(&blog, "href");
 
 	/* Gets the organization contact field */
-	ptr_entry->org_name = extract_and_check(doc,
-						"//atom:entry/"
-						"gd:organization/"
-						"gd:orgName/text()",
-						NULL);
+	ptr_entry->org_name = field_value(&org_name, NULL);
 
 	/* Gets the org. title contact field */
-	ptr_entry->org_title = extract_and_check(doc,
-						"//atom:entry/"
-						"gd:organization/"
-						"gd:orgTitle/text()",
-						NULL);
+	ptr_entry->org_title = field_value(&org_title, NULL);
 
 	/* Gets the occupation/profession contact field */
-	ptr_entry->occupation = extract_and_check(doc,
-						"//atom:entry/"
-						"gContact:occupation/text()",
-						NULL);
+	ptr_entry->occupation = field_value(&occupation, NULL);
 
 	/* Gets contact phone numbers */
-	ptr_entry->phone_numbers_nr = extract_and_check_multi(doc,
-						    "//atom:entry/"
-						    "gd:phoneNumber",
-						    1,
-						    NULL,
-						    "rel",
-						    NULL,
-						    "label",
-						    "primary",
+	ptr_entry->phone_numbers_nr = extract_multi(&phones, 1, NULL, "rel",
+						    NULL, "label", "primary",
 						    &ptr_entry->phone_numbers_field,
 						    &ptr_entry->phone_numbers_type,
 						    NULL,
 						    &ptr_entry->phone_numbers_label,
 						    &ptr_entry->pref_phone_number);
+	if (ptr_entry->phone_numbers_nr == -1)
+		goto cleanup;
 
 	/* Gets contact IM addresses */
-	ptr_entry->im_nr = extract_and_check_multi(doc,
-						    "//atom:entry/"
-						    "gd:im",
-						    0,
-						    "address",
-						    "rel",
-						    "protocol",
-						    "label",
-						    "primary",
-						    &ptr_entry->im_address,
-						    &ptr_entry->im_type,
-						    &ptr_entry->im_protocol,
-						    &ptr_entry->im_label,
-						    &ptr_entry->im_pref);
+	ptr_entry->im_nr = extract_multi(&ims, 0, "address", "rel",
+					 "protocol", "label", "primary",
+					 &ptr_entry->im_address,
+					 &ptr_entry->im_type,
+					 &ptr_entry->im_protocol,
+					 &ptr_entry->im_label,
+					 &ptr_entry->im_pref);
+	if (ptr_entry->im_nr == -1)
+		goto cleanup;
 
 	/* The 'postalAddress' contact field changed in GData-Version: 3.0 API, see:
 	 * http://code.google.com/intl/en-EN/apis/contacts/docs/3.0/
 	 * migration_guide.html#Protocol
 	 */
-	ptr_entry->post_address = extract_and_check(doc,
-				"//atom:entry/"
-				"gd:structuredPostalAddress/"
-				"gd:formattedAddress/text()",
-				NULL);
+	ptr_entry->post_address = field_value(&post_address, NULL);
 
 	/* Gets contact structured postal addressees (Google API 3.0) */
-	ptr_entry->structured_address_nr = extract_and_check_multisub(doc,
-						    "//atom:entry/"
-						    "gd:structuredPostalAddress",
-						    1,
-						    "rel",
-						    "primary",
-						    &ptr_entry->structured_address,
-						    &ptr_entry->structured_address_type,
-						    &ptr_entry->structured_address_pref);
+	ptr_entry->structured_address_nr = extract_multisub(&addresses,
+							    "rel", "primary",
+							    ptr_entry->structured_address,
+							    &ptr_entry->structured_address_type,
+							    &ptr_entry->structured_address_pref);
+	if (ptr_entry->structured_address_nr == -1)
+		goto cleanup;
 
 	/* Gets contact group membership info */
-	ptr_entry->groupMembership_nr = extract_and_check_multi(doc,
-						    "//atom:entry/"
-						    "gContact:groupMembershipInfo[@deleted='false']",
-						    0,
-						    "href",
-						    NULL,
-						    NULL,
-						    NULL,
-						    NULL,
-						    &ptr_entry->groupMembership,
-						    NULL,
-						    NULL,
-						    NULL,
-						    NULL);
+	ptr_entry->groupMembership_nr = extract_multi(&groups, 0, "href",
+						      NULL, NULL, NULL, NULL,
+						      &ptr_entry->groupMembership,
+						      NULL, NULL, NULL, NULL);
+	if (ptr_entry->groupMembership_nr == -1)
+		goto cleanup;
 
 	/* Gets contact birthday */
-	ptr_entry->birthday = extract_and_check(doc,
-						    "//atom:entry/"
-						    "gContact:birthday",
-						    "when");
+	ptr_entry->birthday = field_value(&birthday, "when");
 
 	/* Gets contact photo edit url and test for etag */
-	ptr_entry->photo = extract_and_check(doc, "//atom:entry/"
-					     "atom:link[@type='image/*']",
-					     "href");
-	tmp = extract_and_check(doc, "//atom:entry/"
-				"atom:link[@type='image/*']",
-				"etag");
+	ptr_entry->photo = field_value(&photo, "href");
+	tmp = field_value(&photo, "etag");
 	if (tmp) {
 		ptr_entry->photo_length = 1;
 		free(tmp);
@@ -1264,12 +1337,12 @@ int atom_extract_contact(xmlNode *entry, struct gcal_contact *ptr_entry)
 	result = 0;
 
 cleanup:
-
-	/* Dumps the doc to stdout */
-	/* xmlSaveFormatFileEnc("-", doc, "UTF-8", 1); */
-	xmlFreeDoc(doc);
-	if (xml_str)
-		xmlFree(xml_str);
+	free(name.nodes);
+	free(emails.nodes);
+	free(phones.nodes);
+	free(ims.nodes);
+	free(addresses.nodes);
+	free(groups.nodes);
 
 exit:
 	return result;
@@ -54,28 +54,371 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <string.h>
+#include <errno.h>
+#include <strings.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <curl/curl.h>
 
 #include "internal_gcal.h"
 #include "gcal.h"
 #include "gcal_parser.h"
+#include "xml_aux.h"
 #include "msvc_hacks.h"
 #include "gcontact.h"
+#include "gcal_transport.h"
 
 #ifdef GCAL_DEBUG_CURL
 #include "curl_debug_gcal.h"
 #endif
 
+static void unmap_spool(struct gcal_resource *gcal_obj)
+{
+	if (!gcal_obj->map_length)
+		return;
+
+	munmap(gcal_obj->buffer, gcal_obj->map_length);
+	gcal_obj->buffer = gcal_obj->heap_buffer;
+	gcal_obj->heap_buffer = NULL;
+	gcal_obj->map_length = 0;
+}
+
+static void release_spool(struct gcal_resource *gcal_obj)
+{
+	if (!gcal_obj->spooled)
+		return;
+
+	unmap_spool(gcal_obj);
+	close(gcal_obj->spool_fd);
+	gcal_obj->spool_fd = -1;
+	gcal_obj->spooled = 0;
+}
+
+static int write_spool(struct gcal_resource *gcal_obj, const void *data,
+		       size_t size)
+{
+	const char *ptr = data;
+	ssize_t written;
+
+	while (size) {
+		written = write(gcal_obj->spool_fd, ptr, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			if (gcal_obj->fout_log)
+				fprintf(gcal_obj->fout_log,
+					"write_spool: %s\n", strerror(errno));
+			return -1;
+		}
+		ptr += written;
+		size -= written;
+	}
+
+	return 0;
+}
+
+static int start_spool(struct gcal_resource *gcal_obj)
+{
+	const char template[] = "/libgcal-XXXXXX";
+	const char *dir;
+	char *path;
+	int fd = -1;
+
+	if (!(dir = getenv("TMPDIR")) || !dir[0])
+		dir = "/tmp";
+	path = malloc(strlen(dir) + sizeof(template));
+	if (!path)
+		goto exit;
+	strcpy(path, dir);
+	strcat(path, template);
+
+	/* Removing the name right away, the data lives while it is open */
+	fd = mkstemp(path);
+	if (fd != -1)
+		unlink(path);
+	else if (gcal_obj->fout_log)
+		fprintf(gcal_obj->fout_log, "start_spool: %s: %s\n", path,
+			strerror(errno));
+	free(path);
+	if (fd == -1)
+		goto exit;
+
+	gcal_obj->spool_fd = fd;
+	gcal_obj->spooled = 1;
+	/* Whatever was accumulated so far goes first */
+	if (write_spool(gcal_obj, gcal_obj->buffer, gcal_obj->used)) {
+		release_spool(gcal_obj);
+		fd = -1;
+	}
+
+exit:
+	return (fd == -1) ? -1 : 0;
+}
+
+/** Makes a spooled answer accessible as a string thru 'buffer', mapping
+ * the spool file (with a terminating '\0') in memory.
+ */
+static int finish_buffer(struct gcal_resource *gcal_obj)
+{
+	void *map;
+
+	if (!gcal_obj->spooled || gcal_obj->map_length)
+		return 0;
+
+	if (write_spool(gcal_obj, "", 1))
+		return -1;
+
+	map = mmap(NULL, gcal_obj->used + 1, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE, gcal_obj->spool_fd, 0);
+	if (map == MAP_FAILED) {
+		if (gcal_obj->fout_log)
+			fprintf(gcal_obj->fout_log, "finish_buffer: %s\n",
+				strerror(errno));
+		return -1;
+	}
+
+	gcal_obj->heap_buffer = gcal_obj->buffer;
+	gcal_obj->buffer = map;
+	gcal_obj->map_length = gcal_obj->used + 1;
+	return 0;
+}
+
 static void reset_buffer(struct gcal_resource *ptr)
 {
+	release_spool(ptr);
 	if (ptr->buffer)
 		free(ptr->buffer);
-	ptr->length = 256;
+	if (!ptr->buffer_initial)
+		ptr->buffer_initial = GCAL_BUFFER_INITIAL;
+	ptr->length = ptr->buffer_initial;
 	ptr->buffer = (char *) calloc(ptr->length, sizeof(char));
-	ptr->previous_length = 0;
+	ptr->used = 0;
+}
+
+/* Answer put aside while a conditional request finds out if it is still
+ * current (see follow_redirection).
+ */
+struct saved_answer {
+	char *buffer;
+	size_t length;
+	size_t used;
+	char spooled;
+	int spool_fd;
+	char *heap_buffer;
+	size_t map_length;
+};
+
+static void swap_answer(struct gcal_resource *gcal_obj,
+			struct saved_answer *saved)
+{
+	struct saved_answer tmp = *saved;
+
+	saved->buffer = gcal_obj->buffer;
+	saved->length = gcal_obj->length;
+	saved->used = gcal_obj->used;
+	saved->spooled = gcal_obj->spooled;
+	saved->spool_fd = gcal_obj->spool_fd;
+	saved->heap_buffer = gcal_obj->heap_buffer;
+	saved->map_length = gcal_obj->map_length;
+
+	gcal_obj->buffer = tmp.buffer;
+	gcal_obj->length = tmp.length;
+	gcal_obj->used = tmp.used;
+	gcal_obj->spooled = tmp.spooled;
+	gcal_obj->spool_fd = tmp.spool_fd;
+	gcal_obj->heap_buffer = tmp.heap_buffer;
+	gcal_obj->map_length = tmp.map_length;
+}
+
+/* Moves the current answer to 'saved', leaving an empty buffer */
+static int save_answer(struct gcal_resource *gcal_obj,
+		       struct saved_answer *saved)
+{
+	memset(saved, 0, sizeof(struct saved_answer));
+	saved->spool_fd = -1;
+	swap_answer(gcal_obj, saved);
+	reset_buffer(gcal_obj);
+	if (!gcal_obj->buffer) {
+		swap_answer(gcal_obj, saved);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Brings back the saved answer if 'restore' is set (dropping the current
+ * one), otherwise just drops the saved answer.
+ */
+static void restore_answer(struct gcal_resource *gcal_obj,
+			   struct saved_answer *saved, char restore)
+{
+	if (!restore)
+		swap_answer(gcal_obj, saved);
+	release_spool(gcal_obj);
+	free(gcal_obj->buffer);
+	gcal_obj->buffer = NULL;
+	swap_answer(gcal_obj, saved);
+}
+
+static int reserve_buffer(struct gcal_resource *gcal_obj, size_t needed,
+			  char exact)
+{
+	size_t new_length;
+	char *ptr_tmp;
+
+	if (needed <= gcal_obj->length)
+		return 0;
+
+	/* Grows geometrically, so appending N bytes in small chunks
+	 * costs O(N) in copies and O(log N) reallocs.
+	 */
+	new_length = gcal_obj->length ? gcal_obj->length : GCAL_BUFFER_INITIAL;
+	if (exact)
+		new_length = needed;
+	while (new_length < needed) {
+		if (new_length > ((size_t)-1) / 2) {
+			new_length = needed;
+			break;
+		}
+		new_length *= 2;
+	}
+
+	ptr_tmp = realloc(gcal_obj->buffer, new_length);
+	if (!ptr_tmp) {
+		if (gcal_obj->fout_log)
+			fprintf(gcal_obj->fout_log,
+				"reserve_buffer: Failed relloc!\n");
+		return -1;
+	}
+
+	gcal_obj->buffer = ptr_tmp;
+	gcal_obj->length = new_length;
+	return 0;
+}
+
+int gcal_buffer_append(struct gcal_resource *gcal_obj, const void *data,
+		       size_t size)
+{
+	size_t needed;
+
+	if (!gcal_obj || (!data && size))
+		return -1;
+
+	/* Room for the data plus the terminating '\0' */
+	needed = gcal_obj->used + size + 1;
+	if (needed <= gcal_obj->used)
+		return -1;
+
+	if (gcal_obj->spool_threshold && !gcal_obj->spooled &&
+	    (needed > gcal_obj->spool_threshold))
+		if (start_spool(gcal_obj))
+			return -1;
+
+	if (gcal_obj->spooled) {
+		/* Appending after the answer was mapped: unmaps it and
+		 * overwrites the '\0' that was written at its end.
+		 */
+		if (gcal_obj->map_length) {
+			unmap_spool(gcal_obj);
+			if (lseek(gcal_obj->spool_fd, gcal_obj->used,
+				  SEEK_SET) == (off_t)-1)
+				return -1;
+		}
+		if (write_spool(gcal_obj, data, size))
+			return -1;
+		gcal_obj->used += size;
+		return 0;
+	}
+
+	if (reserve_buffer(gcal_obj, needed, 0))
+		return -1;
+
+	if (size)
+		memcpy(gcal_obj->buffer + gcal_obj->used, data, size);
+	gcal_obj->used += size;
+	gcal_obj->buffer[gcal_obj->used] = '\0';
+
+	return 0;
+}
+
+static double monotonic_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+int gcal_interrupted(struct gcal_resource *gcalobj)
+{
+	char triggered = 0;
+
+	if (gcalobj->cancel) {
+		pthread_mutex_lock(&gcalobj->cancel->lock);
+		triggered = gcalobj->cancel->triggered;
+		pthread_mutex_unlock(&gcalobj->cancel->lock);
+	}
+
+	if (triggered)
+		gcalobj->internal_status = GCAL_REQUEST_CANCELED;
+	else if (gcalobj->deadline && (monotonic_seconds() >= gcalobj->deadline))
+		gcalobj->internal_status = GCAL_REQUEST_TIMEOUT;
+	else
+		return 0;
+
+	return 1;
+}
+
+/* Called by curl while transferring, a non zero return aborts it */
+static int progress_cb(void *data, curl_off_t dltotal, curl_off_t dlnow,
+		       curl_off_t ultotal, curl_off_t ulnow)
+{
+	(void)dltotal;
+	(void)dlnow;
+	(void)ultotal;
+	(void)ulnow;
+
+	return gcal_interrupted((struct gcal_resource *)data);
+}
+
+long gcal_request_limit(struct gcal_resource *gcalobj)
+{
+	long limit = gcalobj->request_timeout, left;
+
+	if (gcalobj->deadline) {
+		left = (long)((gcalobj->deadline - monotonic_seconds()) * 1000);
+		/* 0 would mean no limit at all */
+		if (left < 1)
+			left = 1;
+		if (!limit || (left < limit))
+			limit = left;
+	}
+
+	return limit;
+}
+
+void gcal_call_begin(struct gcal_resource *gcalobj)
+{
+	if (!gcalobj)
+		return;
+
+	/* Calls made by another one share its deadline */
+	if (!gcalobj->calls++ && gcalobj->call_timeout)
+		gcalobj->deadline = monotonic_seconds() +
+			gcalobj->call_timeout / 1000.0;
+}
+
+void gcal_call_end(struct gcal_resource *gcalobj)
+{
+	if (!gcalobj || !gcalobj->calls)
+		return;
+
+	if (!--gcalobj->calls)
+		gcalobj->deadline = 0;
 }
 
 struct gcal_resource *gcal_construct(gservice mode)
@@ -92,8 +435,43 @@ struct gcal_resource *gcal_construct(gservice mode)
 	ptr->url = NULL;
 	ptr->auth = NULL;
 	ptr->buffer = NULL;
+	ptr->page_size = 0;
+	ptr->prefetch = 0;
+	ptr->photo_concurrency = 0;
+	ptr->lazy_photos = 0;
+	ptr->pipeline_mode = 0;
+	ptr->pipeline = NULL;
+	ptr->reader_mode = 0;
+	ptr->share = NULL;
+	ptr->transport = NULL;
+	ptr->method = NULL;
+	ptr->base_url = NULL;
+	ptr->session = NULL;
+	ptr->requests = ptr->wire_bytes = ptr->decoded_bytes = 0;
+	ptr->retry_after = 0;
+	memset(&ptr->last_request, 0, sizeof(struct gcal_request_stats));
+	memset(&ptr->all_requests, 0, sizeof(struct gcal_request_stats));
+	ptr->conditional = ptr->not_modified = 0;
+	ptr->validators = NULL;
+	ptr->answer_etag = ptr->answer_modified = NULL;
+	ptr->spooled = 0;
+	ptr->spool_fd = -1;
+	ptr->heap_buffer = NULL;
+	ptr->map_length = 0;
+	ptr->spool_threshold = 0;
+	ptr->buffer_initial = GCAL_BUFFER_INITIAL;
+	ptr->buffer_ceiling = GCAL_BUFFER_CEILING;
 	reset_buffer(ptr);
 	ptr->curl = curl_easy_init();
+	ptr->connect_timeout = ptr->request_timeout = 0;
+	ptr->call_timeout = 0;
+	ptr->deadline = 0;
+	ptr->calls = 0;
+	ptr->cancel = NULL;
+	/* Deadlines and cancellation are checked while transferring */
+	curl_easy_setopt(ptr->curl, CURLOPT_NOPROGRESS, 0L);
+	curl_easy_setopt(ptr->curl, CURLOPT_XFERINFOFUNCTION, progress_cb);
+	curl_easy_setopt(ptr->curl, CURLOPT_XFERINFODATA, (void *)ptr);
 	ptr->http_code = 0;
 	ptr->curl_msg = NULL;
 	ptr->http_code = 0;
@@ -143,10 +521,138 @@ int gcal_set_service(struct gcal_resource *gcalobj, gservice mode)
 
 void clean_buffer(struct gcal_resource *gcal_obj)
 {
-	if (gcal_obj) {
-		memset(gcal_obj->buffer, 0, gcal_obj->length);
-		gcal_obj->previous_length = 0;
+	char *ptr_tmp;
+
+	if (!gcal_obj)
+		return;
+
+	release_spool(gcal_obj);
+	if (!gcal_obj->buffer)
+		return;
+
+	/* Gives back memory after an oversized response */
+	if (gcal_obj->buffer_ceiling &&
+	    (gcal_obj->length > gcal_obj->buffer_ceiling)) {
+		ptr_tmp = realloc(gcal_obj->buffer, gcal_obj->buffer_ceiling);
+		if (ptr_tmp) {
+			gcal_obj->buffer = ptr_tmp;
+			gcal_obj->length = gcal_obj->buffer_ceiling;
+		}
+	}
+
+	/* No need to zero the whole thing, data is always terminated */
+	gcal_obj->used = 0;
+	gcal_obj->buffer[0] = '\0';
+}
+
+int gcal_set_buffer_size(struct gcal_resource *gcalobj, size_t initial_size,
+			 size_t max_size)
+{
+	char *ptr_tmp;
+	int result = -1;
+
+	if ((!gcalobj) || (!initial_size))
+		goto exit;
+
+	if (max_size && (max_size < initial_size))
+		goto exit;
+
+	gcalobj->buffer_initial = initial_size;
+	gcalobj->buffer_ceiling = max_size;
+	clean_buffer(gcalobj);
+
+	/* The buffer restarts at the new size */
+	if (gcalobj->buffer && (gcalobj->length != initial_size)) {
+		if (!(ptr_tmp = realloc(gcalobj->buffer, initial_size)))
+			goto exit;
+		gcalobj->buffer = ptr_tmp;
+		gcalobj->length = initial_size;
+	}
+	result = 0;
+
+exit:
+	return result;
+}
+
+int gcal_set_spool(struct gcal_resource *gcalobj, size_t threshold)
+{
+	if (!gcalobj)
+		return -1;
+
+	clean_buffer(gcalobj);
+	gcalobj->spool_threshold = threshold;
+	return 0;
+}
+
+int gcal_buffer_finish(struct gcal_resource *gcal_obj)
+{
+	if (!gcal_obj)
+		return -1;
+
+	return finish_buffer(gcal_obj);
+}
+
+static void forget_answer(struct gcal_resource *gcal_obj)
+{
+	if (gcal_obj->answer_etag)
+		free(gcal_obj->answer_etag);
+	if (gcal_obj->answer_modified)
+		free(gcal_obj->answer_modified);
+	gcal_obj->answer_etag = gcal_obj->answer_modified = NULL;
+}
+
+static void release_validators(struct gcal_resource *gcal_obj)
+{
+	struct gcal_validator *ptr;
+
+	while ((ptr = gcal_obj->validators)) {
+		gcal_obj->validators = ptr->next;
+		free(ptr->url);
+		if (ptr->etag)
+			free(ptr->etag);
+		if (ptr->last_modified)
+			free(ptr->last_modified);
+		free(ptr);
+	}
+}
+
+static struct gcal_validator *find_validator(struct gcal_resource *gcal_obj,
+					     const char *url)
+{
+	struct gcal_validator *ptr;
+
+	for (ptr = gcal_obj->validators; ptr; ptr = ptr->next)
+		if (!strcmp(ptr->url, url))
+			break;
+
+	return ptr;
+}
+
+/* Keeps the validators of the current answer (if any) for a feed URL */
+static void save_validator(struct gcal_resource *gcal_obj, const char *url)
+{
+	struct gcal_validator *ptr;
+
+	if (!(ptr = find_validator(gcal_obj, url))) {
+		if (!gcal_obj->answer_etag && !gcal_obj->answer_modified)
+			return;
+		if (!(ptr = calloc(1, sizeof(struct gcal_validator))))
+			return;
+		if (!(ptr->url = strdup(url))) {
+			free(ptr);
+			return;
+		}
+		ptr->next = gcal_obj->validators;
+		gcal_obj->validators = ptr;
 	}
+
+	if (ptr->etag)
+		free(ptr->etag);
+	if (ptr->last_modified)
+		free(ptr->last_modified);
+	ptr->etag = gcal_obj->answer_etag;
+	ptr->last_modified = gcal_obj->answer_modified;
+	gcal_obj->answer_etag = gcal_obj->answer_modified = NULL;
 }
 
 static void _gcal_destroy(struct gcal_resource *gcal_obj, int free_obj)
@@ -154,6 +660,8 @@ static void _gcal_destroy(struct gcal_resource *gcal_obj, int free_obj)
 	if (!gcal_obj)
 		return;
 
+	release_spool(gcal_obj);
+
 	if (gcal_obj->buffer)
 		free(gcal_obj->buffer);
 	if (gcal_obj->curl && free_obj == 0)
@@ -178,6 +686,12 @@ static void _gcal_destroy(struct gcal_resource *gcal_obj, int free_obj)
 		free(gcal_obj->location);
 	if (gcal_obj->domain)
 		free(gcal_obj->domain);
+	if (gcal_obj->session)
+		free(gcal_obj->session);
+	if (gcal_obj->base_url)
+		free(gcal_obj->base_url);
+	forget_answer(gcal_obj);
+	release_validators(gcal_obj);
 
 	if (free_obj == 0) {
 		free(gcal_obj);
@@ -189,49 +703,489 @@ void gcal_destroy(struct gcal_resource *gcal_obj)
 	_gcal_destroy(gcal_obj, 0);
 }
 
+/* HTTP code of the current (or last) answer */
+static long answer_code(struct gcal_resource *gcal_ptr)
+{
+	long code = 0;
+
+	/* Other transports report it, see \ref gcal_response_status */
+	if (gcal_ptr->transport)
+		return gcal_ptr->http_code;
+
+	curl_easy_getinfo(gcal_ptr->curl, CURLINFO_RESPONSE_CODE, &code);
+	return code;
+}
+
+/* Only the feed goes to the pipeline, other answers (e.g. the calendar
+ * redirection page or an error message) go to the buffer as usual.
+ */
+static int pipeline_answer(struct gcal_resource *gcal_ptr)
+{
+	if (!gcal_ptr->pipeline)
+		return 0;
+
+	return (answer_code(gcal_ptr) == GCAL_DEFAULT_ANSWER);
+}
+
 static size_t write_cb(void *ptr, size_t count, size_t chunk_size, void *data)
 {
+	size_t size = count * chunk_size;
+	struct gcal_resource *gcal_ptr = (struct gcal_resource *)data;
+
+	gcal_ptr->decoded_bytes += size;
+
+	/* Returning less than 'size' makes curl abort the transfer */
+	if (pipeline_answer(gcal_ptr)) {
+		if (pipeline_feed(gcal_ptr->pipeline, ptr, size))
+			return 0;
+		return size;
+	}
+
+	if (gcal_buffer_append(gcal_ptr, ptr, size))
+		return 0;
+
+	return size;
+}
+
+/* Returns a copy of the value of a header line, if it is the 'field' one
+ * (without the surrounding spaces and line break).
+ */
+static char *header_value(const char *line, size_t size, const char *field)
+{
+	size_t length = strlen(field);
+	const char *end = line + size;
+
+	if ((size <= length) || strncasecmp(line, field, length))
+		return NULL;
+
+	for (line += length; (line < end) && ((*line == ' ') ||
+					      (*line == '\t')); ++line)
+		;
+	while ((end > line) && ((end[-1] == '\r') || (end[-1] == '\n') ||
+				(end[-1] == ' ')))
+		--end;
 
+	return strndup(line, end - line);
+}
+
+static size_t header_cb(void *ptr, size_t count, size_t chunk_size, void *data)
+{
 	size_t size = count * chunk_size;
 	struct gcal_resource *gcal_ptr = (struct gcal_resource *)data;
-	int current_length = strlen(gcal_ptr->buffer);
-	char *ptr_tmp;
+	unsigned long long content_length;
+	size_t ceiling;
+	char *value;
+	time_t date;
 
-	if (size > (gcal_ptr->length - current_length - 1)) {
-		gcal_ptr->length = current_length + size + 1;
-		/* TODO: is it save to continue reallocing more memory?
-		 * what happens if the gcalendar list is *really* big?
-		 * how big can it be? Maybe I should use another write
-		 * callback
-		 * when requesting the Atom feed (one that will treat the
-		 * the stream as its being read and not store it in memory).
-		 */
-		ptr_tmp = realloc(gcal_ptr->buffer, gcal_ptr->length);
+	/* How long a throttling server wants us to wait, in seconds or
+	 * until a date.
+	 */
+	if ((value = header_value(ptr, size, "Retry-After:"))) {
+		gcal_ptr->retry_after = strtol(value, NULL, 10);
+		if (((date = curl_getdate(value, NULL)) != -1) &&
+		    (date > time(NULL)))
+			gcal_ptr->retry_after = (long)(date - time(NULL));
+		free(value);
+		goto exit;
+	}
 
-		if (!ptr_tmp) {
-			if (gcal_ptr->fout_log)
-				fprintf(gcal_ptr->fout_log,
-					"write_cb: Failed relloc!\n");
+	/* Validators are only kept for conditional requests, a status line
+	 * starts a new answer (e.g. after a redirection).
+	 */
+	if (gcal_ptr->conditional) {
+		if ((size > 5) && !strncmp((char *)ptr, "HTTP/", 5)) {
+			forget_answer(gcal_ptr);
+			goto exit;
+		}
+		if ((value = header_value(ptr, size, "ETag:"))) {
+			if (gcal_ptr->answer_etag)
+				free(gcal_ptr->answer_etag);
+			gcal_ptr->answer_etag = value;
+			goto exit;
+		}
+		if ((value = header_value(ptr, size, "Last-Modified:"))) {
+			if (gcal_ptr->answer_modified)
+				free(gcal_ptr->answer_modified);
+			gcal_ptr->answer_modified = value;
 			goto exit;
 		}
-
-		gcal_ptr->buffer = ptr_tmp;
 	}
 
-	strncat(gcal_ptr->buffer, (char *)ptr, size);
+	if (!(value = header_value(ptr, size, "Content-Length:")))
+		goto exit;
+
+	/* Presizes the buffer to hold the whole answer at once, it is
+	 * only a hint (i.e. a failure is not fatal) and never goes past the
+	 * ceiling: a bogus length must not make a huge allocation.
+	 */
+	content_length = strtoull(value, NULL, 10);
+	free(value);
+	if (pipeline_answer(gcal_ptr))
+		goto exit;
+	if (gcal_ptr->spool_threshold &&
+	    (gcal_ptr->used + content_length >= gcal_ptr->spool_threshold))
+		goto exit;
+	ceiling = gcal_ptr->buffer_ceiling ? gcal_ptr->buffer_ceiling :
+		GCAL_BUFFER_CEILING;
+	if (content_length > ceiling)
+		content_length = ceiling;
+	if (content_length)
+		reserve_buffer(gcal_ptr,
+			       gcal_ptr->used + (size_t)content_length + 1, 1);
 
 exit:
 	return size;
 }
 
+/* Makes 'stats' the last request and adds it to the cumulative view */
+static void account_request(struct gcal_resource *gcalobj,
+			    const struct gcal_request_stats *stats)
+{
+	struct gcal_request_stats *all = &gcalobj->all_requests;
+
+	gcalobj->last_request = *stats;
+	all->requests += stats->requests;
+	all->dns_time += stats->dns_time;
+	all->connect_time += stats->connect_time;
+	all->tls_time += stats->tls_time;
+	all->first_byte_time += stats->first_byte_time;
+	all->transfer_time += stats->transfer_time;
+	all->total_time += stats->total_time;
+	all->bytes_up += stats->bytes_up;
+	all->bytes_down += stats->bytes_down;
+	all->redirects += stats->redirects;
+	all->retries += stats->retries;
+}
+
+/* The last request repeated an earlier one */
+static void account_retry(struct gcal_resource *gcalobj)
+{
+	++gcalobj->last_request.retries;
+	++gcalobj->all_requests.retries;
+}
+
+void gcal_account_redirection(struct gcal_resource *gcalobj, char retry)
+{
+	++gcalobj->last_request.redirects;
+	++gcalobj->all_requests.redirects;
+	if (retry)
+		account_retry(gcalobj);
+}
+
+/* Elapsed time between two points of the request (curl reports them
+ * since its start), 0 if the later one did not happen.
+ */
+static double phase_time(double start, double end)
+{
+	return (end > start) ? end - start : 0;
+}
+
+static void account_transfer(struct gcal_resource *gcalobj, CURL *curl)
+{
+	struct gcal_request_stats stats;
+	curl_off_t wire = 0, sent = 0;
+	double dns = 0, connect = 0, tls = 0, pretransfer = 0,
+		first_byte = 0, total = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+	curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &sent);
+	gcalobj->wire_bytes += (size_t)wire;
+	++gcalobj->requests;
+
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect);
+	curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls);
+	curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+	curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &first_byte);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.requests = 1;
+	stats.dns_time = dns;
+	stats.connect_time = phase_time(dns, connect);
+	/* No TLS handshake for plain HTTP (or a reused connection) */
+	stats.tls_time = tls ? phase_time(connect, tls) : 0;
+	stats.first_byte_time = phase_time(pretransfer, first_byte);
+	stats.transfer_time = phase_time(first_byte, total);
+	stats.total_time = total;
+	stats.bytes_up = (size_t)sent;
+	stats.bytes_down = (size_t)wire;
+	account_request(gcalobj, &stats);
+}
+
+/* Same signature of the curl write callbacks */
+typedef size_t (*write_function)(void *ptr, size_t count, size_t chunk_size,
+				 void *data);
+
+/* Body of a request read while it is sent, see \ref up_stream */
+struct stream_source {
+	gcal_read_cb read;
+	void *data;
+	/* Bytes still to be read */
+	size_t left;
+	/* Set when the callback failed (aborting the request) */
+	char failed;
+};
+
+/* Same signature of the curl read callbacks */
+static size_t read_source(char *ptr, size_t count, size_t chunk_size,
+			  void *data)
+{
+	struct stream_source *source = (struct stream_source *)data;
+	size_t size = count * chunk_size;
+	long result;
+
+	if (size > source->left)
+		size = source->left;
+	if (!size)
+		return 0;
+
+	/* Ending before the announced length is an error too */
+	result = source->read(ptr, size, source->data);
+	if ((result <= 0) || ((size_t)result > size)) {
+		source->failed = 1;
+		return CURL_READFUNC_ABORT;
+	}
+	source->left -= result;
+
+	return (size_t)result;
+}
+
+/* Same as read_source, for other transports (see \ref gcal_read_cb) */
+static long read_body(char *ptr, size_t size, void *data)
+{
+	size_t result = read_source(ptr, 1, size, data);
+
+	if (result == CURL_READFUNC_ABORT)
+		return -1;
+	return (long)result;
+}
+
+/* A request, as set in the curl handle by the callers. Other transports
+ * get it from here.
+ */
+struct http_request {
+	const char *method;
+	const char *url;
+	struct curl_slist *headers;
+	const char *body;
+	size_t length;
+	/* Body read while it is sent (instead of 'body'), can be NULL */
+	struct stream_source *source;
+	/* Where the answer body goes (e.g. \ref write_cb) */
+	write_function write;
+};
+
+/** Answer being received by a transport other than curl. */
+struct gcal_response {
+	struct gcal_resource *gcalobj;
+	write_function write;
+	/* Body bytes received */
+	size_t bytes;
+	/* Set when the body could not be taken */
+	char failed;
+};
+
+void gcal_response_status(struct gcal_response *response, int code)
+{
+	char line[32];
+
+	response->gcalobj->http_code = code;
+	/* The status line starts a new answer, as it does with curl */
+	snprintf(line, sizeof(line), "HTTP/1.1 %d\r\n", code);
+	header_cb(line, 1, strlen(line), response->gcalobj);
+}
+
+void gcal_response_header(struct gcal_response *response, char *line,
+			  size_t length)
+{
+	header_cb(line, 1, length, response->gcalobj);
+}
+
+int gcal_response_body(struct gcal_response *response, char *data,
+		       size_t length)
+{
+	if (response->failed)
+		return -1;
+
+	response->bytes += length;
+	if (response->write(data, 1, length, response->gcalobj) != length) {
+		response->failed = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
+static CURLcode transport_request(struct gcal_resource *gcalobj,
+				  const struct http_request *request)
+{
+	struct gcal_transport *transport = gcalobj->transport;
+	struct gcal_request description;
+	struct gcal_response response;
+	struct gcal_request_stats stats;
+	struct timeval start, end;
+	struct curl_slist *ptr;
+	const char **headers;
+	size_t count = 0;
+	int result;
+
+	for (ptr = request->headers; ptr; ptr = ptr->next)
+		++count;
+	if (!(headers = malloc(sizeof(char *) * (count + 1))))
+		return CURLE_OUT_OF_MEMORY;
+	for (count = 0, ptr = request->headers; ptr; ptr = ptr->next)
+		headers[count++] = ptr->data;
+	headers[count] = NULL;
+
+	description.method = request->method;
+	description.url = request->url;
+	description.headers = headers;
+	description.body = request->body;
+	description.body_length = (request->body || request->source) ?
+		request->length : 0;
+	/* A streamed body is read by the transport, as curl does */
+	description.body_read = request->source ? read_body : NULL;
+	description.body_data = request->source;
+
+	response.gcalobj = gcalobj;
+	response.write = request->write;
+	response.bytes = 0;
+	response.failed = 0;
+
+	gcalobj->http_code = 0;
+	gettimeofday(&start, NULL);
+	result = transport->perform(transport->data, &description, &response);
+	gettimeofday(&end, NULL);
+	free(headers);
+
+	/* Nothing is compressed, the wire carries just the body */
+	gcalobj->wire_bytes += response.bytes;
+	++gcalobj->requests;
+
+	/* The phases of the request are up to the transport, only the
+	 * whole of it is known.
+	 */
+	memset(&stats, 0, sizeof(stats));
+	stats.requests = 1;
+	stats.total_time = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+	stats.bytes_up = description.body_length;
+	if (request->source)
+		stats.bytes_up -= request->source->left;
+	stats.bytes_down = response.bytes;
+	account_request(gcalobj, &stats);
+
+	if (request->source && request->source->failed)
+		return CURLE_ABORTED_BY_CALLBACK;
+	if (response.failed)
+		return CURLE_WRITE_ERROR;
+	if (result)
+		return CURLE_RECV_ERROR;
+	return CURLE_OK;
+}
+
+char *gcal_target_url(struct gcal_resource *gcalobj, const char *url)
+{
+	const char *path = NULL;
+	char *result;
+	size_t length;
+
+	if (!url)
+		return NULL;
+
+	if (gcalobj->base_url) {
+		if (!strncmp(url, GCAL_HOST_HTTP, sizeof(GCAL_HOST_HTTP) - 1))
+			path = url + sizeof(GCAL_HOST_HTTP) - 1;
+		else if (!strncmp(url, GCAL_HOST_HTTPS,
+				  sizeof(GCAL_HOST_HTTPS) - 1))
+			path = url + sizeof(GCAL_HOST_HTTPS) - 1;
+	}
+	/* Only the host part is replaced (e.g. not 'www.google.com.br') */
+	if (!path || ((*path != '/') && (*path != '\0')))
+		return strdup(url);
+
+	length = strlen(gcalobj->base_url) + strlen(path) + 1;
+	if (!(result = malloc(length)))
+		return NULL;
+	snprintf(result, length, "%s%s", gcalobj->base_url, path);
+
+	return result;
+}
+
+/* Runs a request (set in the curl handle, unless there is another
+ * transport), the answer ends up in the buffer (see
+ * \ref gcal_buffer_finish).
+ */
+static CURLcode perform_request(struct gcal_resource *gcalobj,
+				const struct http_request *request)
+{
+	struct http_request target = *request;
+	char *url;
+	CURLcode result;
+	int attempt;
+
+	if (!(url = gcal_target_url(gcalobj, request->url)))
+		return CURLE_OUT_OF_MEMORY;
+	target.url = url;
+
+	for (attempt = 0; ; ++attempt) {
+		gcal_rate_acquire(gcalobj);
+		gcalobj->retry_after = 0;
+		gcalobj->internal_status = GCAL_REQUEST_DONE;
+		if (gcal_interrupted(gcalobj)) {
+			result = CURLE_ABORTED_BY_CALLBACK;
+			finish_buffer(gcalobj);
+			break;
+		}
+
+		if (gcalobj->transport)
+			result = transport_request(gcalobj, &target);
+		else {
+			curl_easy_setopt(gcalobj->curl, CURLOPT_URL, url);
+			curl_easy_setopt(gcalobj->curl, CURLOPT_TIMEOUT_MS,
+					 gcal_request_limit(gcalobj));
+			result = curl_easy_perform(gcalobj->curl);
+		}
+		if (finish_buffer(gcalobj))
+			result = CURLE_WRITE_ERROR;
+		if (!gcalobj->transport)
+			account_transfer(gcalobj, gcalobj->curl);
+		if (attempt)
+			account_retry(gcalobj);
+
+		/* A throttled request is made again, once the service can
+		 * take it (see gcal_ratelimit.c). A streamed body can't be
+		 * read again.
+		 */
+		if ((result != CURLE_OK) ||
+		    (attempt >= gcal_rate_answer(gcalobj->service,
+						 answer_code(gcalobj),
+						 gcalobj->retry_after)) ||
+		    request->source)
+			break;
+		clean_buffer(gcalobj);
+	}
+	free(url);
+
+	/* An abort by progress_cb has already set why, one by the body
+	 * callback is a failure */
+	if (result == CURLE_OPERATION_TIMEDOUT)
+		gcalobj->internal_status = GCAL_REQUEST_TIMEOUT;
+	else if ((result != CURLE_OK) &&
+		 ((result != CURLE_ABORTED_BY_CALLBACK) ||
+		  (request->source && request->source->failed)))
+		gcalobj->internal_status = GCAL_REQUEST_FAILED;
+
+	return result;
+}
+
 static int check_request_error(struct gcal_resource *gcalobj, int code,
 			       int expected_answer)
 {
 	int result = 0;
-	CURL *curl_ctx = gcalobj->curl;
 
-	curl_easy_getinfo(curl_ctx, CURLINFO_HTTP_CODE,
-			  &(gcalobj->http_code));
+	gcalobj->http_code = answer_code(gcalobj);
 	if (code || (gcalobj->http_code != expected_answer)) {
 
 		if (gcalobj->curl_msg)
@@ -290,6 +1244,8 @@ static int common_upload(struct gcal_resource *gcalobj,
 	curl_easy_setopt(curl_ctx, CURLOPT_HTTPHEADER, response_headers);
 	curl_easy_setopt(curl_ctx, CURLOPT_WRITEFUNCTION, write_cb);
 	curl_easy_setopt(curl_ctx, CURLOPT_WRITEDATA, (void *)gcalobj);
+	curl_easy_setopt(curl_ctx, CURLOPT_HEADERFUNCTION, header_cb);
+	curl_easy_setopt(curl_ctx, CURLOPT_HEADERDATA, (void *)gcalobj);
 
 	return result = 0;
 }
@@ -304,6 +1260,7 @@ int http_post(struct gcal_resource *gcalobj, const char *url,
 	int result = -1;
 	CURLcode res;
 	struct curl_slist *response_headers = NULL;
+	struct http_request request;
 	CURL *curl_ctx;
 	if (!gcalobj)
 		goto exit;
@@ -315,9 +1272,16 @@ int http_post(struct gcal_resource *gcalobj, const char *url,
 	if (result)
 		goto exit;
 
+	request.method = gcalobj->method ? gcalobj->method : "POST";
+	request.url = url;
+	request.headers = response_headers;
+	request.body = post_data;
+	request.length = length;
+	request.source = NULL;
+	request.write = write_cb;
+
 	/* It seems deprecated, as long I set POSTFIELDS */
 	curl_easy_setopt(curl_ctx, CURLOPT_POST, 1);
-	curl_easy_setopt(curl_ctx, CURLOPT_URL, url);
 	if (post_data) {
 		curl_easy_setopt(curl_ctx, CURLOPT_POSTFIELDS, post_data);
 		curl_easy_setopt(curl_ctx, CURLOPT_POSTFIELDSIZE,
@@ -326,7 +1290,7 @@ int http_post(struct gcal_resource *gcalobj, const char *url,
 	else
 		curl_easy_setopt(curl_ctx, CURLOPT_POSTFIELDSIZE, 0);
 
-	res = curl_easy_perform(curl_ctx);
+	res = perform_request(gcalobj, &request);
 	result = check_request_error(gcalobj, res, expected_answer);
 
 	/* cleanup */
@@ -347,6 +1311,7 @@ static int http_put(struct gcal_resource *gcalobj, const char *url,
 	int result = -1;
 	CURLcode res;
 	struct curl_slist *response_headers = NULL;
+	struct http_request request;
 	CURL *curl_ctx;
 	if (!gcalobj)
 		goto exit;
@@ -358,7 +1323,14 @@ static int http_put(struct gcal_resource *gcalobj, const char *url,
 	if (result)
 		goto exit;
 
-	curl_easy_setopt(curl_ctx, CURLOPT_URL, url);
+	request.method = "PUT";
+	request.url = url;
+	request.headers = response_headers;
+	request.body = post_data;
+	request.length = length;
+	request.source = NULL;
+	request.write = write_cb;
+
 	/* Tells curl that I want to PUT */
 	curl_easy_setopt(gcalobj->curl, CURLOPT_CUSTOMREQUEST, "PUT");
 
@@ -372,7 +1344,7 @@ static int http_put(struct gcal_resource *gcalobj, const char *url,
 
 
 
-	res = curl_easy_perform(curl_ctx);
+	res = perform_request(gcalobj, &request);
 	result = check_request_error(gcalobj, res, expected_answer);
 
 	/* cleanup */
@@ -386,6 +1358,49 @@ exit:
 
 }
 
+static void forget_session(struct gcal_resource *gcalobj)
+{
+	if (gcalobj->session) {
+		free(gcalobj->session);
+		gcalobj->session = NULL;
+	}
+}
+
+void gcal_learn_session(struct gcal_resource *gcalobj, const char *url)
+{
+	const char *start, *end;
+
+	forget_session(gcalobj);
+	if (!url || !(start = strstr(url, GCAL_SESSION_PARAM)))
+		return;
+	/* The server may append the new session to the old one */
+	while ((end = strstr(start + 1, GCAL_SESSION_PARAM)))
+		start = end;
+	if (!(end = strchr(start, '&')))
+		end = start + strlen(start);
+
+	gcalobj->session = strndup(start, end - start);
+}
+
+char *gcal_session_url(struct gcal_resource *gcalobj, const char *url)
+{
+	char *result = NULL;
+	size_t length;
+
+	if (!gcalobj->session || !url || strcmp(gcalobj->service, "cl") ||
+	    strstr(url, GCAL_SESSION_PARAM))
+		goto exit;
+
+	length = strlen(url) + strlen(gcalobj->session) + 2;
+	if (!(result = malloc(length)))
+		goto exit;
+	snprintf(result, length, "%s%c%s", url, strchr(url, '?') ? '&' : '?',
+		 gcalobj->session);
+
+exit:
+	return result;
+}
+
 int gcal_get_authentication(struct gcal_resource *gcalobj,
 			    char *user, char *password)
 {
@@ -398,6 +1413,7 @@ int gcal_get_authentication(struct gcal_resource *gcalobj,
 	char *enc_user = NULL;
 	char *enc_password = NULL;
 
+	gcal_call_begin(gcalobj);
 	if (!gcalobj || !user || !password)
 		goto exit;
 
@@ -470,6 +1486,8 @@ int gcal_get_authentication(struct gcal_resource *gcalobj,
 	 */
 	if (gcalobj->auth)
 		free(gcalobj->auth);
+	/* A new login gets a new session */
+	forget_session(gcalobj);
 
 	gcalobj->auth = strstr(gcalobj->buffer, HEADER_AUTH);
 	gcalobj->auth = strdup(gcalobj->auth + strlen(HEADER_AUTH));
@@ -491,33 +1509,113 @@ cleanup:
 		free(post);
 
 exit:
+	gcal_call_end(gcalobj);
 	return result;
 
 }
 
-int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
-			   void *cb_download, const char *gdata_version)
+/* Checks for a 'not modified' answer of a conditional request */
+static int not_modified_answer(struct gcal_resource *gcalobj, int code)
+{
+	gcalobj->http_code = answer_code(gcalobj);
+
+	return (code == CURLE_OK) &&
+		(gcalobj->http_code == GCAL_NOT_MODIFIED_ANSWER);
+}
+
+/* Same as http_put, but the body is read while it is sent */
+static int http_put_stream(struct gcal_resource *gcalobj, const char *url,
+			   char *header, char *header2, char *header3,
+			   struct stream_source *source,
+			   const int expected_answer,
+			   const char *gdata_version)
+{
+	int result = -1;
+	CURLcode res;
+	struct curl_slist *response_headers = NULL;
+	struct http_request request;
+
+	result = common_upload(gcalobj, header, header2, header3, NULL,
+			       &response_headers, gdata_version);
+	if (result)
+		goto exit;
+
+	request.method = "PUT";
+	request.url = url;
+	request.headers = response_headers;
+	request.body = NULL;
+	request.length = source->left;
+	request.source = source;
+	request.write = write_cb;
+
+	/* An upload is a PUT, curl sets the length header */
+	curl_easy_setopt(gcalobj->curl, CURLOPT_UPLOAD, 1L);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_READFUNCTION, read_source);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_READDATA, (void *)source);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_INFILESIZE_LARGE,
+			 (curl_off_t)source->left);
+
+	res = perform_request(gcalobj, &request);
+	result = check_request_error(gcalobj, res, expected_answer);
+
+	/* cleanup */
+	curl_slist_free_all(response_headers);
+
+	/* Restores curl context to previous standard mode */
+	curl_easy_setopt(gcalobj->curl, CURLOPT_UPLOAD, 0L);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_READFUNCTION, NULL);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_READDATA, NULL);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_INFILESIZE_LARGE,
+			 (curl_off_t)-1);
+
+exit:
+	return result;
+}
+
+/* Same as get_follow_redirection, but when 'conditional' is set the
+ * request is made conditional to the feed having changed since the
+ * last time (returning 1 when it has not).
+ */
+static int follow_redirection(struct gcal_resource *gcalobj, const char *url,
+			      void *cb_download, const char *gdata_version,
+			      char conditional)
 {
 	struct curl_slist *response_headers = NULL;
 	int length = 0;
 	int result = -1;
 	char *tmp_buffer = NULL;
+	char *cached_url = NULL;
+	char *h_etag = NULL, *h_modified = NULL;
+	struct gcal_validator *validator = NULL;
+	struct saved_answer saved;
+	char kept = 0;
+	struct http_request request;
 	void *downloader = NULL;
+	long code = 0;
+
+	gcalobj->not_modified = 0;
 
 	if (cb_download == NULL)
 		downloader = write_cb;
 	else
 		downloader = cb_download;
 
-	/* Must cleanup HTTP buffer between requests */
-	clean_buffer(gcalobj);
+	/* Must cleanup HTTP buffer between requests, but the previous
+	 * answer stays there if the feed has not changed.
+	 */
+	if (conditional)
+		validator = find_validator(gcalobj, url);
+	if (validator && !save_answer(gcalobj, &saved))
+		kept = 1;
+	else
+		clean_buffer(gcalobj);
 
 	if (!gcalobj->auth)
-		goto exit;
+		goto cleanup;
 	length = strlen(gcalobj->auth) + sizeof(HEADER_GET) + 1;
 	tmp_buffer = (char *) malloc(length);
 	if (!tmp_buffer)
-		goto exit;
+		goto cleanup;
 	snprintf(tmp_buffer, length - 1, "%s%s", HEADER_GET, gcalobj->auth);
 
 	/* To support Google Data API 2.0 */
@@ -526,15 +1624,51 @@ int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
 
 	response_headers = curl_slist_append(response_headers, tmp_buffer);
 	if (!response_headers)
-		return result;
+		goto cleanup;
+
+	/* Asks for the feed only if it has changed */
+	if (validator && validator->etag) {
+		length = strlen(validator->etag) + sizeof(HEADER_IF_NONE_MATCH);
+		if (!(h_etag = malloc(length)))
+			goto cleanup;
+		snprintf(h_etag, length, "%s%s", HEADER_IF_NONE_MATCH,
+			 validator->etag);
+		response_headers = curl_slist_append(response_headers, h_etag);
+	}
+	if (validator && validator->last_modified) {
+		length = strlen(validator->last_modified) +
+			sizeof(HEADER_IF_MODIFIED_SINCE);
+		if (!(h_modified = malloc(length)))
+			goto cleanup;
+		snprintf(h_modified, length, "%s%s", HEADER_IF_MODIFIED_SINCE,
+			 validator->last_modified);
+		response_headers = curl_slist_append(response_headers,
+						     h_modified);
+	}
+
+	/* Skips the redirection if the session is already known */
+	cached_url = gcal_session_url(gcalobj, url);
 
 	curl_easy_setopt(gcalobj->curl, CURLOPT_HTTPGET, 1);
 	curl_easy_setopt(gcalobj->curl, CURLOPT_HTTPHEADER, response_headers);
-	curl_easy_setopt(gcalobj->curl, CURLOPT_URL, url);
 	curl_easy_setopt(gcalobj->curl, CURLOPT_WRITEFUNCTION, downloader);
 	curl_easy_setopt(gcalobj->curl, CURLOPT_WRITEDATA, (void *)gcalobj);
-
-	result = curl_easy_perform(gcalobj->curl);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_HEADERFUNCTION, header_cb);
+	curl_easy_setopt(gcalobj->curl, CURLOPT_HEADERDATA, (void *)gcalobj);
+
+	request.method = "GET";
+	request.url = cached_url ? cached_url : url;
+	request.headers = response_headers;
+	request.body = NULL;
+	request.length = 0;
+	request.source = NULL;
+	request.write = (write_function)downloader;
+
+	result = perform_request(gcalobj, &request);
+	if (validator && not_modified_answer(gcalobj, result)) {
+		result = 1;
+		goto cleanup;
+	}
 
 	if (!(strcmp(gcalobj->service, "cp"))) {
 		/* For contacts, there is *not* redirection. */
@@ -544,7 +1678,18 @@ int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
 			goto cleanup;
 		}
 	} else if (!(strcmp(gcalobj->service, "cl"))) {
-		/* For calendar, it *must* be redirection */
+		/* URLs having the session ID (e.g. the 'next' link of a
+		 * feed page) are answered right away.
+		 */
+		code = answer_code(gcalobj);
+		if ((result == CURLE_OK) && (code == GCAL_DEFAULT_ANSWER)) {
+			result = 0;
+			goto cleanup;
+		}
+		/* The session has expired (if it was used) */
+		if (cached_url && (code == GCAL_REDIRECT_ANSWER))
+			forget_session(gcalobj);
+		/* Otherwise, it *must* be redirection */
 		if (check_request_error(gcalobj, result,
 					GCAL_REDIRECT_ANSWER)) {
 			result = -1;
@@ -562,14 +1707,21 @@ int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
 		gcalobj->url = NULL;
 	}
 
-	if (get_the_url(gcalobj->buffer, gcalobj->length, &gcalobj->url)) {
+	if (get_the_url(gcalobj->buffer, gcalobj->used, &gcalobj->url)) {
 		result = -1;
 		goto cleanup;
 	}
+	gcal_learn_session(gcalobj, gcalobj->url);
 
 	clean_buffer(gcalobj);
-	curl_easy_setopt(gcalobj->curl, CURLOPT_URL, gcalobj->url);
-	result = curl_easy_perform(gcalobj->curl);
+	request.url = gcalobj->url;
+	result = perform_request(gcalobj, &request);
+	/* With an expired session, the request is made once again */
+	gcal_account_redirection(gcalobj, cached_url != NULL);
+	if (validator && not_modified_answer(gcalobj, result)) {
+		result = 1;
+		goto cleanup;
+	}
 	if ((result = check_request_error(gcalobj, result,
 					  GCAL_DEFAULT_ANSWER))) {
 		result = -1;
@@ -577,16 +1729,34 @@ int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
 	}
 
 cleanup:
+	if (conditional && !result)
+		save_validator(gcalobj, url);
+	if (conditional)
+		forget_answer(gcalobj);
+	gcalobj->not_modified = (result == 1);
+	if (kept)
+		restore_answer(gcalobj, &saved, gcalobj->not_modified);
 
 	if (tmp_buffer)
 		free(tmp_buffer);
+	if (cached_url)
+		free(cached_url);
+	if (h_etag)
+		free(h_etag);
+	if (h_modified)
+		free(h_modified);
 	if (response_headers)
 		curl_slist_free_all(response_headers);
 
-exit:
 	return result;
 }
 
+int get_follow_redirection(struct gcal_resource *gcalobj, const char *url,
+			   void *cb_download, const char *gdata_version)
+{
+	return follow_redirection(gcalobj, url, cb_download, gdata_version, 0);
+}
+
 
 static char *mount_query_url(struct gcal_resource *gcalobj,
 			     const char *parameters, ...)
@@ -721,6 +1891,7 @@ int gcal_dump(struct gcal_resource *gcalobj, const char *gdata_version)
 	int result = -1;
 	char *buffer = NULL;
 
+	gcal_call_begin(gcalobj);
 	if (!gcalobj)
 		goto exit;
 	/* Failed to get authentication token */
@@ -731,7 +1902,8 @@ int gcal_dump(struct gcal_resource *gcalobj, const char *gdata_version)
 	if (!buffer)
 		goto exit;
 
-	result =  get_follow_redirection(gcalobj, buffer, NULL, gdata_version);
+	result = follow_redirection(gcalobj, buffer, NULL, gdata_version,
+				    gcalobj->conditional);
 
 	if (!result)
 		gcalobj->has_xml = 1;
@@ -739,6 +1911,520 @@ int gcal_dump(struct gcal_resource *gcalobj, const char *gdata_version)
 	free(buffer);
 exit:
 
+	gcal_call_end(gcalobj);
+	return result;
+}
+
+/** A concurrent download, it has its own curl handle and buffer */
+struct multi_transfer {
+	/** Only the buffer, curl handle and log fields are used */
+	struct gcal_resource res;
+	/** Download URL */
+	char *url;
+	/** 0: waiting, 1: running, 2: done, 3: failed */
+	int state;
+	/** Flags that the calendar redirection was already followed */
+	char redirected;
+};
+
+/* Copies the per-resource configuration (not the session or the state of
+ * the last request) of 'src' to 'dst', whose strings must be unset.
+ * Returns -1 if a copy can't be made; the strings copied so far are owned
+ * by 'dst'.
+ */
+static int copy_settings(struct gcal_resource *dst, struct gcal_resource *src)
+{
+	dst->buffer_initial = src->buffer_initial;
+	dst->buffer_ceiling = src->buffer_ceiling;
+	dst->spool_threshold = src->spool_threshold;
+	dst->fout_log = src->fout_log;
+	dst->deleted = src->deleted;
+	dst->store_xml_entry = src->store_xml_entry;
+	dst->page_size = src->page_size;
+	dst->prefetch = src->prefetch;
+	dst->photo_concurrency = src->photo_concurrency;
+	dst->lazy_photos = src->lazy_photos;
+	dst->pipeline_mode = src->pipeline_mode;
+	dst->reader_mode = src->reader_mode;
+	dst->conditional = src->conditional;
+	dst->transport = src->transport;
+	dst->connect_timeout = src->connect_timeout;
+	dst->request_timeout = src->request_timeout;
+	dst->call_timeout = src->call_timeout;
+	dst->cancel = src->cancel;
+
+	if (src->max_results && !(dst->max_results = strdup(src->max_results)))
+		return -1;
+	if (src->base_url && !(dst->base_url = strdup(src->base_url)))
+		return -1;
+	if (src->timezone && !(dst->timezone = strdup(src->timezone)))
+		return -1;
+	if (src->location && !(dst->location = strdup(src->location)))
+		return -1;
+
+	return 0;
+}
+
+int gcal_transfer_init(struct gcal_resource *gcalobj,
+		       struct gcal_resource *res, void *owner)
+{
+	res->spool_fd = -1;
+	res->retry_after = 0;
+	/* Concurrent transfers are made with curl */
+	if (gcalobj->transport)
+		return -1;
+	res->curl = curl_easy_duphandle(gcalobj->curl);
+	if (!res->curl)
+		return -1;
+	if (gcalobj->share)
+		curl_easy_setopt(res->curl, CURLOPT_SHARE,
+				 gcalobj->share->curlsh);
+	if (copy_settings(res, gcalobj))
+		return -1;
+	/* Validators are kept by the resource making the request */
+	res->conditional = 0;
+	reset_buffer(res);
+	if (!res->buffer)
+		return -1;
+
+	curl_easy_setopt(res->curl, CURLOPT_WRITEFUNCTION, write_cb);
+	curl_easy_setopt(res->curl, CURLOPT_WRITEDATA, (void *)res);
+	curl_easy_setopt(res->curl, CURLOPT_HEADERFUNCTION, header_cb);
+	curl_easy_setopt(res->curl, CURLOPT_HEADERDATA, (void *)res);
+	curl_easy_setopt(res->curl, CURLOPT_PRIVATE, owner);
+
+	return 0;
+}
+
+int gcal_transfer_finish(struct gcal_resource *gcalobj,
+			 struct gcal_resource *res, int code)
+{
+	if (finish_buffer(res))
+		code = CURLE_WRITE_ERROR;
+	account_transfer(gcalobj, res->curl);
+	gcalobj->decoded_bytes += res->decoded_bytes;
+	res->decoded_bytes = 0;
+	curl_easy_getinfo(res->curl, CURLINFO_RESPONSE_CODE, &res->http_code);
+	if (code == CURLE_OPERATION_TIMEDOUT)
+		gcalobj->internal_status = GCAL_REQUEST_TIMEOUT;
+	/* Throttling slows down the later requests, this one just fails */
+	if (code == CURLE_OK)
+		gcal_rate_answer(gcalobj->service, res->http_code,
+				 res->retry_after);
+	res->retry_after = 0;
+
+	return code;
+}
+
+void gcal_transfer_release(struct gcal_resource *res)
+{
+	if (res->curl) {
+		curl_easy_cleanup(res->curl);
+		res->curl = NULL;
+	}
+
+	release_spool(res);
+	if (res->buffer)
+		free(res->buffer);
+	res->buffer = NULL;
+	if (res->max_results)
+		free(res->max_results);
+	if (res->base_url)
+		free(res->base_url);
+	if (res->timezone)
+		free(res->timezone);
+	if (res->location)
+		free(res->location);
+	res->max_results = res->base_url = NULL;
+	res->timezone = res->location = NULL;
+}
+
+static void release_transfer(CURLM *multi, struct multi_transfer *transfer)
+{
+	struct gcal_resource *res = &transfer->res;
+
+	if (res->curl && multi)
+		curl_multi_remove_handle(multi, res->curl);
+	gcal_transfer_release(res);
+}
+
+static int start_transfer(struct gcal_resource *gcalobj, CURLM *multi,
+			  struct multi_transfer *transfer,
+			  struct curl_slist *headers)
+{
+	struct gcal_resource *res = &transfer->res;
+	char *url;
+
+	if (!res->curl) {
+		if (gcal_transfer_init(gcalobj, res, (void *)transfer))
+			return -1;
+		curl_easy_setopt(res->curl, CURLOPT_HTTPGET, 1);
+		curl_easy_setopt(res->curl, CURLOPT_HTTPHEADER, headers);
+	}
+
+	clean_buffer(res);
+	if (!(url = gcal_target_url(gcalobj, transfer->url)))
+		return -1;
+	curl_easy_setopt(res->curl, CURLOPT_URL, url);
+	free(url);
+	curl_easy_setopt(res->curl, CURLOPT_TIMEOUT_MS,
+			 gcal_request_limit(gcalobj));
+	gcal_rate_acquire(gcalobj);
+	if (curl_multi_add_handle(multi, res->curl) != CURLM_OK)
+		return -1;
+
+	transfer->state = 1;
+	return 0;
+}
+
+/* Handles a finished transfer, returns 1 if it was restarted (to follow
+ * the calendar redirection) and -1 on fatal errors.
+ */
+static int end_transfer(struct gcal_resource *gcalobj, CURLM *multi,
+			struct multi_transfer *transfer, CURLcode code,
+			struct curl_slist *headers)
+{
+	struct gcal_resource *res = &transfer->res;
+	char *url = NULL;
+
+	curl_multi_remove_handle(multi, res->curl);
+	code = gcal_transfer_finish(gcalobj, res, code);
+
+	if ((code == CURLE_OK) && (res->http_code == GCAL_REDIRECT_ANSWER) &&
+	    !(strcmp(gcalobj->service, "cl")) && !transfer->redirected &&
+	    !get_the_url(res->buffer, res->used, &url)) {
+		free(transfer->url);
+		transfer->url = url;
+		transfer->redirected = 1;
+		if (start_transfer(gcalobj, multi, transfer, headers))
+			return -1;
+		return 1;
+	}
+
+	transfer->state = 2;
+	if ((code != CURLE_OK) || (res->http_code != GCAL_DEFAULT_ANSWER)) {
+		if (gcalobj->fout_log)
+			fprintf(gcalobj->fout_log, "%s\n%s%s\n%s%d\n%s%s\n",
+				"end_transfer: failed request.",
+				"Curl code: ", curl_easy_strerror(code),
+				"HTTP code: ", (int)res->http_code,
+				"URL: ", transfer->url);
+		transfer->state = 3;
+	}
+
+	return 0;
+}
+
+/* Downloads one URL after the other, using the resource itself (i.e.
+ * its transport). The answers are always delivered in order.
+ */
+static int serial_get(struct gcal_resource *gcalobj, char **urls,
+		      size_t count, const char *gdata_version,
+		      int (*done)(void *data, size_t index,
+				  struct gcal_resource *res),
+		      void *data)
+{
+	size_t i;
+	int failed;
+
+	for (i = 0; i < count; ++i) {
+		failed = get_follow_redirection(gcalobj, urls[i], NULL,
+						gdata_version);
+		if (done(data, i, failed ? NULL : gcalobj))
+			return -1;
+		clean_buffer(gcalobj);
+	}
+
+	return 0;
+}
+
+int gcal_multi_get(struct gcal_resource *gcalobj, char **urls, size_t count,
+		   int max_requests, char ordered, const char *gdata_version,
+		   int (*done)(void *data, size_t index,
+			       struct gcal_resource *res),
+		   void *data)
+{
+	int result = -1, running, queued, restarted;
+	size_t i, delivered = 0, started = 0, in_flight = 0, max;
+	struct multi_transfer *transfers = NULL, *transfer;
+	struct curl_slist *headers = NULL;
+	char *auth_header = NULL;
+	CURLM *multi = NULL;
+	CURLMsg *msg;
+	size_t length;
+	CURLMcode mcode;
+
+	if (!gcalobj || !urls || !done || !gcalobj->auth)
+		goto exit;
+	/* Concurrent transfers are made with curl */
+	if (gcalobj->transport)
+		return serial_get(gcalobj, urls, count, gdata_version, done,
+				  data);
+	max = (max_requests > 1) ? (size_t)max_requests : 1;
+
+	if (!(transfers = calloc(count ? count : 1,
+				 sizeof(struct multi_transfer))))
+		goto exit;
+	for (i = 0; i < count; ++i) {
+		transfers[i].res.spool_fd = -1;
+		if (!(transfers[i].url = strdup(urls[i])))
+			goto cleanup;
+	}
+
+	length = strlen(gcalobj->auth) + sizeof(HEADER_GET) + 1;
+	if (!(auth_header = malloc(length)))
+		goto cleanup;
+	snprintf(auth_header, length - 1, "%s%s", HEADER_GET, gcalobj->auth);
+	headers = curl_slist_append(headers, gdata_version);
+	headers = curl_slist_append(headers, auth_header);
+	if (!headers || !(multi = curl_multi_init()))
+		goto cleanup;
+
+	while (delivered < count) {
+		/* When ordered, this also bounds the answers held in memory
+		 * waiting for their turn to be delivered.
+		 */
+		while ((started < count) &&
+		       ((ordered && (started < delivered + max)) ||
+			(!ordered && (in_flight < max)))) {
+			if (start_transfer(gcalobj, multi, &transfers[started],
+					   headers))
+				goto cleanup;
+			++started;
+			++in_flight;
+		}
+
+		mcode = curl_multi_perform(multi, &running);
+		if ((mcode != CURLM_OK) && (mcode != CURLM_CALL_MULTI_PERFORM))
+			goto cleanup;
+
+		restarted = 0;
+		while ((msg = curl_multi_info_read(multi, &queued))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE,
+					  (char **)&transfer);
+			switch (end_transfer(gcalobj, multi, transfer,
+					     msg->data.result, headers)) {
+			case 1:
+				restarted = 1;
+				break;
+			case -1:
+				goto cleanup;
+			default:
+				--in_flight;
+				if (ordered)
+					break;
+				/* Delivers right away */
+				if (done(data, transfer - transfers,
+					 (transfer->state == 2) ?
+					 &transfer->res : NULL))
+					goto cleanup;
+				release_transfer(NULL, transfer);
+				++delivered;
+			}
+		}
+
+		/* Delivers the finished downloads in order */
+		while (ordered && (delivered < count) &&
+		       (transfers[delivered].state >= 2)) {
+			transfer = &transfers[delivered];
+			if (done(data, delivered, (transfer->state == 2) ?
+				 &transfer->res : NULL))
+				goto cleanup;
+			release_transfer(NULL, transfer);
+			++delivered;
+		}
+
+		if (running && !restarted)
+			curl_multi_wait(multi, NULL, 0, 1000, NULL);
+	}
+
+	result = 0;
+
+cleanup:
+	for (i = 0; i < count; ++i) {
+		release_transfer(multi, &transfers[i]);
+		if (transfers[i].url)
+			free(transfers[i].url);
+	}
+	if (multi)
+		curl_multi_cleanup(multi);
+	if (headers)
+		curl_slist_free_all(headers);
+	if (auth_header)
+		free(auth_header);
+	free(transfers);
+
+exit:
+	return result;
+}
+
+/* Mounts the URL of a page, replacing the 'start-index' parameter of the
+ * 'next' link URL.
+ */
+static char *mount_page_url(const char *next_url, size_t start_index)
+{
+	const char param[] = "start-index=";
+	const char *start, *end;
+	char *result = NULL;
+	size_t length;
+
+	if (!(start = strstr(next_url, param)))
+		goto exit;
+	start += sizeof(param) - 1;
+	for (end = start; (*end >= '0') && (*end <= '9'); ++end)
+		;
+
+	/* Enough for a 64 bits number */
+	length = strlen(next_url) + 21;
+	if (!(result = malloc(length)))
+		goto exit;
+
+	snprintf(result, length, "%.*s%lu%s", (int)(start - next_url),
+		 next_url, (unsigned long)start_index, end);
+
+exit:
+	return result;
+}
+
+static int parse_page(void *data, size_t index, struct gcal_resource *res)
+{
+	struct gcal_pipeline *pipe = (struct gcal_pipeline *)data;
+
+	(void)index;
+	/* A missing page would silently drop entries */
+	if (!res)
+		return -1;
+
+	if (pipeline_feed(pipe, res->buffer, res->used) ||
+	    pipeline_end_page(pipe, NULL))
+		return -1;
+
+	return 0;
+}
+
+/* Fetches the remaining pages of a feed concurrently, they are parsed
+ * in server order. Returns 1 if the pages can't be prefetched.
+ */
+static int prefetch_pages(struct gcal_resource *gcalobj,
+			  struct gcal_pipeline *pipe, const char *next_url,
+			  const char *gdata_version)
+{
+	int result = 1;
+	size_t i, count = 0, first_index;
+	char **urls = NULL;
+	const char *ptr;
+
+	/* Without a start index, pages can only be fetched one by one */
+	if ((pipe->total_results <= gcalobj->page_size) ||
+	    !(ptr = strstr(next_url, "start-index=")))
+		goto exit;
+	first_index = strtoul(ptr + sizeof("start-index=") - 1, NULL, 10);
+	if (!first_index || (first_index > pipe->total_results))
+		goto exit;
+
+	result = -1;
+	/* Pages after the first one */
+	count = (pipe->total_results - first_index + gcalobj->page_size) /
+		gcalobj->page_size;
+	if (!(urls = calloc(count, sizeof(char *))))
+		goto exit;
+	for (i = 0; i < count; ++i)
+		if (!(urls[i] = mount_page_url(next_url, first_index +
+					       i * gcalobj->page_size)))
+			goto cleanup;
+
+	result = gcal_multi_get(gcalobj, urls, count, gcalobj->prefetch, 1,
+				gdata_version, parse_page, (void *)pipe);
+
+cleanup:
+	for (i = 0; i < count; ++i)
+		if (urls[i])
+			free(urls[i]);
+	free(urls);
+
+exit:
+	return result;
+}
+
+int gcal_dump_pages(struct gcal_resource *gcalobj, struct gcal_pipeline *pipe,
+		    const char *url, const char *gdata_version)
+{
+	int result = -1;
+	char *page_url = NULL, *ptr_tmp;
+	/* Enough for "max-results=" plus a 64 bits number */
+	char max_results[40];
+	/* The validators of a page don't tell if the next ones have changed,
+	 * so only a whole feed can be fetched conditionally.
+	 */
+	char conditional = gcalobj && gcalobj->conditional && !url &&
+		!gcalobj->page_size;
+
+	gcal_call_begin(gcalobj);
+	if (!gcalobj || !pipe)
+		goto exit;
+	/* Failed to get authentication token */
+	if (!gcalobj->auth)
+		goto exit;
+
+	if (url)
+		page_url = strdup(url);
+	else if (gcalobj->page_size) {
+		/* The first page has 'page_size' entries, the server links
+		 * the next one.
+		 */
+		snprintf(max_results, sizeof(max_results), "max-results=%lu",
+			 (unsigned long)gcalobj->page_size);
+		ptr_tmp = gcalobj->max_results;
+		gcalobj->max_results = max_results;
+		page_url = mount_query_url(gcalobj, NULL);
+		gcalobj->max_results = ptr_tmp;
+	} else
+		page_url = mount_query_url(gcalobj, NULL);
+
+	while (page_url) {
+		/* In pipeline mode, the page is parsed while downloaded */
+		if (gcalobj->pipeline_mode)
+			gcalobj->pipeline = pipe;
+		result = follow_redirection(gcalobj, page_url, NULL,
+					    gdata_version, conditional);
+		gcalobj->pipeline = NULL;
+		free(page_url);
+		page_url = NULL;
+		if (result)
+			break;
+
+		result = -1;
+		if (!gcalobj->pipeline_mode &&
+		    pipeline_feed(pipe, gcalobj->buffer, gcalobj->used))
+			break;
+
+		/* Drops the page, only its entries are kept */
+		if (pipeline_end_page(pipe, &page_url))
+			break;
+		clean_buffer(gcalobj);
+		result = 0;
+
+		/* The first page tells how many are left, they can be
+		 * fetched all together.
+		 */
+		if (page_url && (gcalobj->prefetch > 1) &&
+		    gcalobj->page_size && (pipe->pages == 1) &&
+		    (pipe->total_results > 0)) {
+			result = prefetch_pages(gcalobj, pipe, page_url,
+						gdata_version);
+			if (result != 1)
+				break;
+			result = 0;
+		}
+	}
+
+	if (page_url)
+		free(page_url);
+
+exit:
+	gcal_call_end(gcalobj);
 	return result;
 }
 
@@ -750,6 +2436,9 @@ void gcal_cleanup_calendar(struct gcal_resource_array *resource_array)
 		return;
 
 	for(i = 0; i < resource_array->length; i++) {
+		/* Each calendar owns its curl handle */
+		if (resource_array->entries[i].curl)
+			curl_easy_cleanup(resource_array->entries[i].curl);
 		_gcal_destroy(&(resource_array->entries[i]), 1);
 	}
 
@@ -807,6 +2496,7 @@ int gcal_calendar_list(struct gcal_resource *gcalobj,
 	int result = 0;
 	size_t i;
 
+	gcal_call_begin(gcalobj);
 	if (gcal_array)
 		gcal_array->length = 0;
 
@@ -831,28 +2521,47 @@ int gcal_calendar_list(struct gcal_resource *gcalobj,
 	result = -1;
 	gcal_array->entries = malloc(sizeof(struct gcal_resource) * gcal_array->length);
 	if (!gcal_array->entries) {
+		gcal_array->length = 0;
 		goto cleanup;
 	}
+	result = 0;
 	memset(gcal_array->entries, 0, sizeof(struct gcal_resource) * gcal_array->length);
 
 	for (i = 0; i < gcal_array->length; i++) {
 		gcal_array->entries[i].has_xml = 1;
-		gcal_array->entries[i].curl = gcalobj->curl;
+		gcal_array->entries[i].spool_fd = -1;
+		/* The connection context is shared, not the handle */
+		gcal_array->entries[i].curl = curl_easy_duphandle(gcalobj->curl);
+		if (!gcal_array->entries[i].curl)
+			result = -1;
+		else {
+			curl_easy_setopt(gcal_array->entries[i].curl,
+					 CURLOPT_XFERINFODATA,
+					 (void *)&gcal_array->entries[i]);
+			if (gcalobj->share)
+				gcal_set_share(&gcal_array->entries[i],
+					       gcalobj->share);
+		}
+		if (copy_settings(&gcal_array->entries[i], gcalobj))
+			result = -1;
 		gcal_array->entries[i].auth = strdup(gcalobj->auth);
+		if (gcalobj->session)
+			gcal_array->entries[i].session =
+				strdup(gcalobj->session);
 		gcal_array->entries[i].buffer = NULL;
 		gcal_array->entries[i].document = NULL;
 		reset_buffer(&gcal_array->entries[i]);
-		gcal_array->entries[i].max_results = strdup(GCAL_UPPER);
 		gcal_set_service(&(gcal_array->entries[i]), GCALENDAR);
 
-		result = get_calendar_entry(gcalobj->document, i, &gcal_array->entries[i]);
+		if (result != -1)
+			result = get_calendar_entry(gcalobj->document, i,
+						    &gcal_array->entries[i]);
 		if (result == -1) {
-			free(gcal_array->entries);
-
-			gcal_array->length = 0;
-			gcal_array->entries = NULL;
+			/* Entries after this one are still zeroed */
+			gcal_array->length = i + 1;
+			gcal_cleanup_calendar(gcal_array);
 
-			goto exit;
+			goto cleanup;
 		}
 	}
 
@@ -861,6 +2570,7 @@ cleanup:
 	gcalobj->document = NULL;
 
 exit:
+	gcal_call_end(gcalobj);
 	if (gcalobj->url) {
 		free(gcalobj->url);
 		gcalobj->url = NULL;
@@ -894,12 +2604,38 @@ exit:
 	return result;
 }
 
+struct gcal_event *gcal_dump_entries(struct gcal_resource *gcalobj,
+				     const char *url, const char *gdata_version,
+				     size_t *length)
+{
+	struct gcal_event *ptr_res = NULL;
+	struct gcal_pipeline *pipe = NULL;
+
+	if (!gcalobj || !length)
+		goto exit;
+
+	pipe = pipeline_create_events(gcalobj->store_xml_entry);
+	if (!pipe)
+		goto exit;
+
+	if (!gcal_dump_pages(gcalobj, pipe, url, gdata_version))
+		ptr_res = pipeline_finish(pipe, length);
+	/* The whole feed is never stored in the buffer */
+	gcalobj->has_xml = 0;
+
+	pipeline_destroy(pipe);
+
+exit:
+	return ptr_res;
+}
+
 struct gcal_event *gcal_get_entries(struct gcal_resource *gcalobj,
 				    size_t *length)
 {
 
 	int result = -1, i;
 	struct gcal_event *ptr_res = NULL;
+	struct gcal_pipeline *pipe = NULL;
 
 	if (!gcalobj)
 		goto exit;
@@ -907,6 +2643,15 @@ struct gcal_event *gcal_get_entries(struct gcal_resource *gcalobj,
 	if (!gcalobj->buffer || !gcalobj->has_xml)
 		goto exit;
 
+	if (gcalobj->reader_mode) {
+		pipe = pipeline_create_events(gcalobj->store_xml_entry);
+		if (pipe && !pipeline_read(pipe, gcalobj->buffer,
+					   gcalobj->used))
+			ptr_res = pipeline_finish(pipe, length);
+		pipeline_destroy(pipe);
+		goto exit;
+	}
+
 	gcalobj->document = build_dom_document(gcalobj->buffer);
 	if (!gcalobj->document)
 		goto exit;
@@ -1023,6 +2768,44 @@ void gcal_destroy_entries(struct gcal_event *entries, size_t length)
 /* This function makes possible to share code between 'add'
  * and 'edit' events.
  */
+int up_stream(struct gcal_resource *gcalobj, const char *url_server,
+	      char *etag, char *content_type, gcal_read_cb read_cb,
+	      void *data, size_t length, int expected_code)
+{
+	int result = -1;
+	int size;
+	char *h_auth = NULL;
+	struct stream_source source;
+
+	if (!gcalobj || !url_server || !read_cb || !gcalobj->auth)
+		goto exit;
+
+	/* The calendar redirection would need the body twice */
+	if (strcmp(gcalobj->service, "cp"))
+		goto exit;
+
+	/* Must cleanup HTTP buffer between requests */
+	clean_buffer(gcalobj);
+
+	size = strlen(gcalobj->auth) + sizeof(HEADER_GET) + 1;
+	if (!(h_auth = (char *) malloc(size)))
+		goto exit;
+	snprintf(h_auth, size - 1, "%s%s", HEADER_GET, gcalobj->auth);
+
+	source.read = read_cb;
+	source.data = data;
+	source.left = length;
+	source.failed = 0;
+	result = http_put_stream(gcalobj, url_server, content_type, h_auth,
+				 etag, &source, expected_code,
+				 "GData-Version: 3.0");
+
+	free(h_auth);
+
+exit:
+	return result;
+}
+
 int up_entry(char *data2post, unsigned int m_length,
 	     struct gcal_resource *gcalobj,
 	     const char *url_server, char *etag,
@@ -1032,6 +2815,7 @@ int up_entry(char *data2post, unsigned int m_length,
 	int result = -1;
 	int length = 0;
 	char *h_auth = NULL, *h_length = NULL, *tmp, *content;
+	char *cached_url = NULL;
 	const char header[] = "Content-length: ";
 	int (*up_callback)(struct gcal_resource *, const char *,
 			   char *, char *, char *, char *,
@@ -1093,16 +2877,27 @@ int up_entry(char *data2post, unsigned int m_length,
 			goto cleanup;
 		}
 	} else if (!(strcmp(gcalobj->service, "cl"))) {
-		/* For calendar, it *must* be redirection */
-		result = up_callback(gcalobj, url_server,
+		/* With a known session the server answers right away,
+		 * otherwise it *must* be redirection.
+		 */
+		cached_url = gcal_session_url(gcalobj, url_server);
+		result = up_callback(gcalobj,
+				     cached_url ? cached_url : url_server,
 				     content,
 				     h_length,
 				     h_auth,
 				     etag,
 				     data2post, m_length,
+				     cached_url ? expected_code :
 				     GCAL_REDIRECT_ANSWER,
 				     "GData-Version: 2");
-		if (result == -1) {
+		if (cached_url && !result)
+			goto cleanup;
+		if (cached_url &&
+		    (gcalobj->http_code == GCAL_REDIRECT_ANSWER)) {
+			/* The session has expired, follows the new one */
+			forget_session(gcalobj);
+		} else if (result == -1) {
 			/* XXX: there is one report where google server
 			 * doesn't always return redirection.
 			 */
@@ -1120,8 +2915,9 @@ int up_entry(char *data2post, unsigned int m_length,
 		gcalobj->url = NULL;
 	}
 
-	if (get_the_url(gcalobj->buffer, gcalobj->length, &gcalobj->url))
+	if (get_the_url(gcalobj->buffer, gcalobj->used, &gcalobj->url))
 		goto cleanup;
+	gcal_learn_session(gcalobj, gcalobj->url);
 
 	clean_buffer(gcalobj);
 
@@ -1162,12 +2958,109 @@ int up_entry(char *data2post, unsigned int m_length,
 
 cleanup:
 
-	if (h_length)
-		free(h_length);
-	if (h_auth)
-		free(h_auth);
+	if (h_length)
+		free(h_length);
+	if (h_auth)
+		free(h_auth);
+	if (cached_url)
+		free(cached_url);
+
+exit:
+	return result;
+}
+
+int gcal_post_batch(struct gcal_resource *gcalobj, char *xml, int length,
+		    struct gcal_batch_result *results, size_t count)
+{
+	int result = -1;
+	char *url = NULL;
+	size_t i, url_length;
+
+	gcal_call_begin(gcalobj);
+	if (!gcalobj || !xml || !results || !gcalobj->auth)
+		goto exit;
+
+	if (!(strcmp(gcalobj->service, "cl"))) {
+		url_length = sizeof(GCAL_EDIT_URL) + sizeof(GCAL_BATCH_SUFFIX);
+		if (!(url = malloc(url_length)))
+			goto exit;
+		snprintf(url, url_length, "%s%s", GCAL_EDIT_URL,
+			 GCAL_BATCH_SUFFIX);
+	} else {
+		url_length = sizeof(GCONTACT_START) + sizeof(GCONTACT_END) +
+			strlen(gcalobj->user) + sizeof(GCAL_DELIMITER) +
+			strlen(gcalobj->domain) + sizeof(GCAL_BATCH_SUFFIX);
+		if (!(url = malloc(url_length)))
+			goto exit;
+		snprintf(url, url_length, "%s%s%s%s%s%s", GCONTACT_START,
+			 gcalobj->user, GCAL_DELIMITER, gcalobj->domain,
+			 GCONTACT_END, GCAL_BATCH_SUFFIX);
+	}
+
+	/* The whole batch is accepted, each entry has its own result */
+	if (up_entry(xml, length, gcalobj, url, NULL, POST, NULL,
+		     GCAL_DEFAULT_ANSWER))
+		goto cleanup;
+	if (extract_batch_results(gcalobj->buffer, gcalobj->used, results,
+				  count))
+		goto cleanup;
+
+	result = 0;
+	for (i = 0; i < count; ++i)
+		if ((results[i].status < 200) || (results[i].status > 299))
+			result = -1;
+
+cleanup:
+	free(url);
+
+exit:
+	gcal_call_end(gcalobj);
+	return result;
+}
+
+int gcal_batch_entries(struct gcal_resource *gcalobj, void *entries,
+		       const gcal_batch_op *ops, size_t length,
+		       struct gcal_batch_result *results,
+		       int (*create)(void *entries, size_t first,
+				     const gcal_batch_op *ops, size_t count,
+				     char **xml, int *length))
+{
+	int result = -1, xml_length;
+	size_t i, j, count;
+	char *xml;
+
+	/* All the batch feeds share the deadline of the call */
+	gcal_call_begin(gcalobj);
+	if ((!gcalobj) || (!entries) || (!ops) || (!results) || (!create))
+		goto exit;
+
+	memset(results, 0, length * sizeof(struct gcal_batch_result));
+	result = 0;
+	for (i = 0; i < length; i += count) {
+		count = length - i;
+		if (count > GCAL_BATCH_MAX)
+			count = GCAL_BATCH_MAX;
+
+		xml = NULL;
+		if (create(entries, i, ops + i, count, &xml, &xml_length)) {
+			result = -1;
+			break;
+		}
+		/* The dump length counts the string terminator */
+		if (gcal_post_batch(gcalobj, xml, strlen(xml), results + i,
+				    count))
+			result = -1;
+		free(xml);
+
+		/* The batch itself failed, so will the next ones */
+		for (j = i; (j < i + count) && !results[j].status; ++j)
+			;
+		if (j == i + count)
+			break;
+	}
 
 exit:
+	gcal_call_end(gcalobj);
 	return result;
 }
 
@@ -1178,8 +3071,9 @@ int gcal_create_event(struct gcal_resource *gcalobj,
 	int result = -1, length;
 	char *xml_entry = NULL;
 
+	gcal_call_begin(gcalobj);
 	if ((!entries) || (!gcalobj))
-		return result;
+		goto exit;
 
 	result = xmlentry_create(entries, &xml_entry, &length);
 	if (result == -1)
@@ -1223,6 +3117,7 @@ cleanup:
 		free(xml_entry);
 
 exit:
+	gcal_call_end(gcalobj);
 	return result;
 }
 
@@ -1230,8 +3125,9 @@ int gcal_delete_event(struct gcal_resource *gcalobj,
 		      struct gcal_event *entry)
 {
 	int result = -1, length;
-	char *h_auth;
+	char *h_auth, *cached_url;
 
+	gcal_call_begin(gcalobj);
 	if ((!entry) || (!gcalobj) || (!gcalobj->auth))
 		goto exit;
 
@@ -1244,15 +3140,29 @@ int gcal_delete_event(struct gcal_resource *gcalobj,
 		goto exit;
 	snprintf(h_auth, length - 1, "%s%s", HEADER_GET, gcalobj->auth);
 
-	curl_easy_setopt(gcalobj->curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-	result = http_post(gcalobj, entry->common.edit_uri,
+	gcal_set_method(gcalobj, "DELETE");
+	/* With a known session there is no redirection */
+	cached_url = gcal_session_url(gcalobj, entry->common.edit_uri);
+	result = http_post(gcalobj,
+			   cached_url ? cached_url : entry->common.edit_uri,
 			   "Content-Type: application/atom+xml",
 			   /* Google Data API 2.0 requires ETag */
 			   "If-Match: *",
 			   h_auth,
-			   NULL, NULL, 0, GCAL_REDIRECT_ANSWER,
+			   NULL, NULL, 0,
+			   cached_url ? GCAL_DEFAULT_ANSWER :
+			   GCAL_REDIRECT_ANSWER,
 			   "GData-Version: 2");
 
+	if (cached_url) {
+		free(cached_url);
+		if (!result || (gcalobj->http_code != GCAL_REDIRECT_ANSWER))
+			goto cleanup;
+		/* The session has expired, follows the new one */
+		forget_session(gcalobj);
+		result = 0;
+	}
+
 	if (result == -1) {
 		/* XXX: there is one report where google server
 		 * doesn't always return redirection and deletes
@@ -1269,8 +3179,9 @@ int gcal_delete_event(struct gcal_resource *gcalobj,
 		free(gcalobj->url);
 		gcalobj->url = NULL;
 	}
-	if (get_the_url(gcalobj->buffer, gcalobj->length, &gcalobj->url))
+	if (get_the_url(gcalobj->buffer, gcalobj->used, &gcalobj->url))
 		goto cleanup;
+	gcal_learn_session(gcalobj, gcalobj->url);
 
 	result = http_post(gcalobj, gcalobj->url,
 			   "Content-Type: application/atom+xml",
@@ -1282,13 +3193,14 @@ int gcal_delete_event(struct gcal_resource *gcalobj,
 
 cleanup:
 	/* Restores curl context to previous standard mode */
-	curl_easy_setopt(gcalobj->curl, CURLOPT_CUSTOMREQUEST, NULL);
+	gcal_set_method(gcalobj, NULL);
 
 	if (h_auth)
 		free(h_auth);
 
 exit:
 
+	gcal_call_end(gcalobj);
 	return result;
 
 }
@@ -1301,6 +3213,7 @@ int gcal_edit_event(struct gcal_resource *gcalobj,
 	int result = -1, length;
 	char *xml_entry = NULL;
 
+	gcal_call_begin(gcalobj);
 	if ((!entry) || (!gcalobj))
 		goto exit;
 
@@ -1348,6 +3261,7 @@ cleanup:
 		free(xml_entry);
 
 exit:
+	gcal_call_end(gcalobj);
 	return result;
 }
 
@@ -1392,12 +3306,35 @@ int get_mili_timestamp(char *timestamp, size_t length, char *atimezone)
 }
 
 
+char *gcal_mount_feed_url(struct gcal_resource *gcalobj)
+{
+	return mount_query_url(gcalobj, NULL);
+}
+
+char *gcal_mount_generic_url(struct gcal_resource *gcalobj,
+			     const char *parameters)
+{
+	char *query_url, *ptr_tmp;
+
+	if ((!gcalobj) || (!parameters))
+		return NULL;
+
+	/* Swaps the max-results internal member for NULL. This makes
+	 * possible a generic query with user defined max-results.
+	 */
+	ptr_tmp = gcalobj->max_results;
+	gcalobj->max_results = NULL;
+	query_url = mount_query_url(gcalobj, parameters, NULL);
+	gcalobj->max_results = ptr_tmp;
+
+	return query_url;
+}
+
 /* TODO: move most of this code to a generic 'query' function, since
  * quering for updated entries is just a query with a set of
  * parameters.
  */
-int gcal_query_updated(struct gcal_resource *gcalobj, char *timestamp,
-		const char *gdata_version)
+char *gcal_mount_updated_url(struct gcal_resource *gcalobj, char *timestamp)
 {
 	int result = -1;
 	char *query_url = NULL;
@@ -1411,10 +3348,6 @@ int gcal_query_updated(struct gcal_resource *gcalobj, char *timestamp,
 	if (!gcalobj)
 		goto exit;
 
-	/* Failed to get authentication token */
-	if (!gcalobj->auth)
-		goto exit;
-
 	length = TIMESTAMP_MAX_SIZE + sizeof(query_updated_param) + 1;
 	buffer1 = (char *) malloc(length);
 	if (!buffer1)
@@ -1493,12 +3426,6 @@ int gcal_query_updated(struct gcal_resource *gcalobj, char *timestamp,
 	 * 'curl_easy_escape'.
 	 */
 	query_url = mount_query_url(gcalobj, buffer1, buffer2, buffer3, NULL);
-	if (!query_url)
-		goto cleanup;
-
-	result = get_follow_redirection(gcalobj, query_url, NULL, gdata_version);
-	if (!result)
-		gcalobj->has_xml = 1;
 
 cleanup:
 
@@ -1510,10 +3437,38 @@ cleanup:
 		free(buffer2);
 	if (buffer3)
 		free(buffer3);
-	if (query_url)
-		free(query_url);
 
 exit:
+	return query_url;
+
+}
+
+int gcal_query_updated(struct gcal_resource *gcalobj, char *timestamp,
+		const char *gdata_version)
+{
+	int result = -1;
+	char *query_url = NULL;
+
+	gcal_call_begin(gcalobj);
+	if (!gcalobj)
+		goto exit;
+
+	/* Failed to get authentication token */
+	if (!gcalobj->auth)
+		goto exit;
+
+	query_url = gcal_mount_updated_url(gcalobj, timestamp);
+	if (!query_url)
+		goto exit;
+
+	result = get_follow_redirection(gcalobj, query_url, NULL, gdata_version);
+	if (!result)
+		gcalobj->has_xml = 1;
+
+	free(query_url);
+
+exit:
+	gcal_call_end(gcalobj);
 	return result;
 
 }
@@ -1561,6 +3516,326 @@ void gcal_set_store_xml(struct gcal_resource *gcalobj, char flag)
 	gcalobj->store_xml_entry = flag;
 }
 
+int gcal_set_page_size(struct gcal_resource *gcalobj, size_t page_size)
+{
+	if (!gcalobj)
+		return -1;
+
+	/* Only the paged downloads use it (see gcal_dump_pages), a plain
+	 * gcal_dump still gets the whole feed.
+	 */
+	gcalobj->page_size = page_size;
+
+	return 0;
+}
+
+int gcal_set_prefetch(struct gcal_resource *gcalobj, int max_requests)
+{
+	if ((!gcalobj) || (max_requests < 0))
+		return -1;
+
+	gcalobj->prefetch = max_requests;
+	return 0;
+}
+
+int gcal_set_photo_concurrency(struct gcal_resource *gcalobj,
+			       int max_requests)
+{
+	if ((!gcalobj) || (max_requests < 0))
+		return -1;
+
+	gcalobj->photo_concurrency = max_requests;
+	return 0;
+}
+
+int gcal_set_compression(struct gcal_resource *gcalobj, char flag)
+{
+	if ((!gcalobj) || (!gcalobj->curl))
+		return -1;
+
+	/* An empty string means any encoding supported by curl */
+	if (curl_easy_setopt(gcalobj->curl, CURLOPT_ACCEPT_ENCODING,
+			     flag ? "" : NULL) != CURLE_OK)
+		return -1;
+
+	return 0;
+}
+
+void gcal_set_conditional(struct gcal_resource *gcalobj, char flag)
+{
+	if ((!gcalobj))
+		return;
+
+	/* Validators of an older session could be out of date */
+	if (!flag)
+		release_validators(gcalobj);
+	forget_answer(gcalobj);
+	gcalobj->conditional = flag;
+}
+
+int gcal_get_stats(struct gcal_resource *gcalobj, struct gcal_stats *stats)
+{
+	if ((!gcalobj) || (!stats))
+		return -1;
+
+	stats->requests = gcalobj->requests;
+	stats->wire_bytes = gcalobj->wire_bytes;
+	stats->decoded_bytes = gcalobj->decoded_bytes;
+	return 0;
+}
+
+void gcal_reset_stats(struct gcal_resource *gcalobj)
+{
+	if ((!gcalobj))
+		return;
+
+	gcalobj->requests = gcalobj->wire_bytes = gcalobj->decoded_bytes = 0;
+	memset(&gcalobj->all_requests, 0, sizeof(struct gcal_request_stats));
+}
+
+void gcal_batch_results_cleanup(struct gcal_batch_result *results,
+				size_t length)
+{
+	size_t i;
+
+	if (!results)
+		return;
+
+	for (i = 0; i < length; ++i) {
+		if (results[i].reason)
+			free(results[i].reason);
+		if (results[i].id)
+			free(results[i].id);
+		if (results[i].etag)
+			free(results[i].etag);
+		if (results[i].edit_uri)
+			free(results[i].edit_uri);
+		memset(&results[i], 0, sizeof(struct gcal_batch_result));
+	}
+}
+
+static void share_lock(CURL *handle, curl_lock_data data,
+		       curl_lock_access access, void *userptr)
+{
+	struct gcal_share *share = (struct gcal_share *)userptr;
+
+	(void)handle;
+	(void)access;
+	pthread_mutex_lock(&share->locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+	struct gcal_share *share = (struct gcal_share *)userptr;
+
+	(void)handle;
+	pthread_mutex_unlock(&share->locks[data]);
+}
+
+struct gcal_share *gcal_share_new(void)
+{
+	struct gcal_share *share;
+	int i;
+
+	if (!(share = malloc(sizeof(struct gcal_share))))
+		goto exit;
+
+	if (!(share->curlsh = curl_share_init())) {
+		free(share);
+		share = NULL;
+		goto exit;
+	}
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+		pthread_mutex_init(&share->locks[i], NULL);
+
+	curl_share_setopt(share->curlsh, CURLSHOPT_LOCKFUNC, share_lock);
+	curl_share_setopt(share->curlsh, CURLSHOPT_UNLOCKFUNC, share_unlock);
+	curl_share_setopt(share->curlsh, CURLSHOPT_USERDATA, (void *)share);
+	curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share->curlsh, CURLSHOPT_SHARE,
+			  CURL_LOCK_DATA_SSL_SESSION);
+	/* Older libcurl can't share connections, not fatal */
+	curl_share_setopt(share->curlsh, CURLSHOPT_SHARE,
+			  CURL_LOCK_DATA_CONNECT);
+
+exit:
+	return share;
+}
+
+int gcal_share_delete(struct gcal_share *share)
+{
+	int i;
+
+	if (!share)
+		return -1;
+
+	/* Fails while some handle is still using it */
+	if (curl_share_cleanup(share->curlsh) != CURLSHE_OK)
+		return -1;
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+		pthread_mutex_destroy(&share->locks[i]);
+	free(share);
+
+	return 0;
+}
+
+int gcal_set_share(struct gcal_resource *gcalobj, struct gcal_share *share)
+{
+	if ((!gcalobj) || (!gcalobj->curl))
+		return -1;
+
+	if (curl_easy_setopt(gcalobj->curl, CURLOPT_SHARE,
+			     share ? share->curlsh : NULL) != CURLE_OK)
+		return -1;
+
+	gcalobj->share = share;
+	return 0;
+}
+
+int gcal_set_transport(struct gcal_resource *gcalobj,
+		       struct gcal_transport *transport)
+{
+	if (!gcalobj || (transport && !transport->perform))
+		return -1;
+
+	gcalobj->transport = transport;
+	return 0;
+}
+
+int gcal_set_base_url(struct gcal_resource *gcalobj, const char *base_url)
+{
+	char *copy = NULL;
+	size_t length;
+
+	if (!gcalobj)
+		return -1;
+
+	if (base_url) {
+		/* Paths are appended to it, they already start with '/' */
+		length = strlen(base_url);
+		while (length && (base_url[length - 1] == '/'))
+			--length;
+		if (!length || !(copy = strndup(base_url, length)))
+			return -1;
+	}
+
+	if (gcalobj->base_url)
+		free(gcalobj->base_url);
+	gcalobj->base_url = copy;
+	/* The session belongs to the previous server */
+	forget_session(gcalobj);
+
+	return 0;
+}
+
+int gcal_set_timeout(struct gcal_resource *gcalobj, long connect_ms,
+		     long request_ms)
+{
+	if ((!gcalobj) || (connect_ms < 0) || (request_ms < 0))
+		return -1;
+
+	if (curl_easy_setopt(gcalobj->curl, CURLOPT_CONNECTTIMEOUT_MS,
+			     connect_ms) != CURLE_OK)
+		return -1;
+	gcalobj->connect_timeout = connect_ms;
+	gcalobj->request_timeout = request_ms;
+
+	return 0;
+}
+
+int gcal_set_deadline(struct gcal_resource *gcalobj, long timeout_ms)
+{
+	if ((!gcalobj) || (timeout_ms < 0))
+		return -1;
+
+	gcalobj->call_timeout = timeout_ms;
+
+	return 0;
+}
+
+struct gcal_cancel *gcal_cancel_new(void)
+{
+	struct gcal_cancel *cancel;
+
+	if (!(cancel = malloc(sizeof(struct gcal_cancel))))
+		return NULL;
+
+	pthread_mutex_init(&cancel->lock, NULL);
+	cancel->triggered = 0;
+
+	return cancel;
+}
+
+void gcal_cancel_delete(struct gcal_cancel *cancel)
+{
+	if (!cancel)
+		return;
+
+	pthread_mutex_destroy(&cancel->lock);
+	free(cancel);
+}
+
+void gcal_cancel_trigger(struct gcal_cancel *cancel)
+{
+	if (!cancel)
+		return;
+
+	pthread_mutex_lock(&cancel->lock);
+	cancel->triggered = 1;
+	pthread_mutex_unlock(&cancel->lock);
+}
+
+void gcal_cancel_reset(struct gcal_cancel *cancel)
+{
+	if (!cancel)
+		return;
+
+	pthread_mutex_lock(&cancel->lock);
+	cancel->triggered = 0;
+	pthread_mutex_unlock(&cancel->lock);
+}
+
+int gcal_set_cancel(struct gcal_resource *gcalobj, struct gcal_cancel *cancel)
+{
+	if (!gcalobj)
+		return -1;
+
+	gcalobj->cancel = cancel;
+	return 0;
+}
+
+void gcal_set_method(struct gcal_resource *gcalobj, const char *method)
+{
+	gcalobj->method = method;
+	curl_easy_setopt(gcalobj->curl, CURLOPT_CUSTOMREQUEST, method);
+}
+
+void gcal_set_lazy_photos(struct gcal_resource *gcalobj, char flag)
+{
+	if ((!gcalobj))
+		return;
+
+	gcalobj->lazy_photos = flag;
+}
+
+void gcal_set_pipeline(struct gcal_resource *gcalobj, char flag)
+{
+	if ((!gcalobj))
+		return;
+
+	gcalobj->pipeline_mode = flag;
+}
+
+void gcal_set_reader(struct gcal_resource *gcalobj, char flag)
+{
+	if ((!gcalobj))
+		return;
+
+	gcalobj->reader_mode = flag;
+}
+
 void gcal_set_proxy(struct gcal_resource *gcalobj, char *proxy)
 {
 	if ((!gcalobj) || (!proxy)) {
@@ -1629,20 +3904,11 @@ void gcal_deleted(struct gcal_resource *gcalobj, display_deleted_entries opt)
 int gcal_query(struct gcal_resource *gcalobj, const char *parameters,
 		const char *gdata_version)
 {
-	char *query_url = NULL, *ptr_tmp;
+	char *query_url = NULL;
 	int result = -1;
 
-	if ((!gcalobj) || (!parameters))
-		goto exit;
-
-	/* Swaps the max-results internal member for NULL. This makes
-	 * possible a generic query with user defined max-results.
-	 */
-	ptr_tmp = gcalobj->max_results;
-	gcalobj->max_results = NULL;
-	query_url = mount_query_url(gcalobj, parameters, NULL);
-	gcalobj->max_results = ptr_tmp;
-	if (!query_url)
+	gcal_call_begin(gcalobj);
+	if (!(query_url = gcal_mount_generic_url(gcalobj, parameters)))
 		goto exit;
 
 	result = get_follow_redirection(gcalobj, query_url, NULL,
@@ -1655,6 +3921,7 @@ int gcal_query(struct gcal_resource *gcalobj, const char *parameters,
 		free(query_url);
 exit:
 
+	gcal_call_end(gcalobj);
 	return result;
 }
 
@@ -1737,6 +4004,7 @@ char *gcal_get_etag(struct gcal_entry *entry)
 
 void gcal_final_cleanup()
 {
+	clean_xpath_cache();
 	xmlCleanupParser();
 }
 
@@ -0,0 +1,638 @@
+/*
+Copyright (c) 2008 Instituto Nokia de Tecnologia
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the INdT nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+ * @file   gcal_async.c
+ *
+ * @brief  Non-blocking operations, on top of curl multi socket interface.
+ *
+ * Each operation is a small state machine: it runs a request, then
+ * either finishes or runs another one (following the calendar session
+ * redirection or the next page of a feed) from the completion handler,
+ * so nothing ever waits for the network.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <curl/curl.h>
+
+#include "internal_gcal.h"
+#include "gcal_async.h"
+#include "gcal_parser.h"
+
+struct gcal_loop {
+	CURLM *multi;
+	gcal_socket_cb socket_cb;
+	gcal_timer_cb timer_cb;
+	void *data;
+	/** Pending operations */
+	struct gcal_async *ops;
+	size_t count;
+};
+
+struct gcal_async {
+	struct gcal_loop *loop;
+	struct gcal_resource *gcalobj;
+	/** Holds the connection and answer of the operation */
+	struct gcal_resource res;
+	/** Next request URL, may be a redirection or the next page */
+	char *url;
+	/** Entry being uploaded */
+	char *body;
+	struct curl_slist *headers;
+	int expected_code;
+	/** The session redirection was already followed */
+	char redirected;
+	/** Parser of a feed download, NULL for edits */
+	struct gcal_pipeline *pipe;
+	gcal_async_cb cb;
+	void *data;
+	struct gcal_async *next;
+};
+
+
+static int socket_adapter(CURL *curl, curl_socket_t fd, int what,
+			  void *userp, void *socketp)
+{
+	struct gcal_loop *loop = (struct gcal_loop *)userp;
+
+	(void)curl;
+	(void)socketp;
+	return loop->socket_cb((int)fd, what, loop->data);
+}
+
+static int timer_adapter(CURLM *multi, long timeout_ms, void *userp)
+{
+	struct gcal_loop *loop = (struct gcal_loop *)userp;
+
+	(void)multi;
+	return loop->timer_cb(timeout_ms, loop->data);
+}
+
+struct gcal_loop *gcal_loop_new(gcal_socket_cb socket_cb,
+				gcal_timer_cb timer_cb, void *data)
+{
+	struct gcal_loop *loop;
+
+	if (!(loop = calloc(1, sizeof(struct gcal_loop))))
+		goto exit;
+	if (!(loop->multi = curl_multi_init())) {
+		free(loop);
+		loop = NULL;
+		goto exit;
+	}
+
+	loop->socket_cb = socket_cb;
+	loop->timer_cb = timer_cb;
+	loop->data = data;
+	if (socket_cb) {
+		curl_multi_setopt(loop->multi, CURLMOPT_SOCKETFUNCTION,
+				  socket_adapter);
+		curl_multi_setopt(loop->multi, CURLMOPT_SOCKETDATA,
+				  (void *)loop);
+	}
+	if (timer_cb) {
+		curl_multi_setopt(loop->multi, CURLMOPT_TIMERFUNCTION,
+				  timer_adapter);
+		curl_multi_setopt(loop->multi, CURLMOPT_TIMERDATA,
+				  (void *)loop);
+	}
+
+exit:
+	return loop;
+}
+
+static void op_free(struct gcal_async *op)
+{
+	if (op->res.curl && op->loop)
+		curl_multi_remove_handle(op->loop->multi, op->res.curl);
+	gcal_transfer_release(&op->res);
+	if (op->url)
+		free(op->url);
+	if (op->body)
+		free(op->body);
+	if (op->headers)
+		curl_slist_free_all(op->headers);
+	if (op->pipe)
+		pipeline_destroy(op->pipe);
+	free(op);
+}
+
+void gcal_loop_delete(struct gcal_loop *loop)
+{
+	struct gcal_async *op;
+
+	if (!loop)
+		return;
+
+	while ((op = loop->ops)) {
+		loop->ops = op->next;
+		op_free(op);
+	}
+	curl_multi_cleanup(loop->multi);
+	free(loop);
+}
+
+/* Runs the current request of an operation */
+static int op_start(struct gcal_async *op)
+{
+	char *cached_url = NULL, *url;
+
+	/* Skips the redirection if the session is already known */
+	if (!op->redirected)
+		cached_url = gcal_session_url(op->gcalobj, op->url);
+
+	clean_buffer(&op->res);
+	url = gcal_target_url(op->gcalobj, cached_url ? cached_url : op->url);
+	if (cached_url)
+		free(cached_url);
+	if (!url)
+		return -1;
+	curl_easy_setopt(op->res.curl, CURLOPT_URL, url);
+	free(url);
+	curl_easy_setopt(op->res.curl, CURLOPT_TIMEOUT_MS,
+			 gcal_request_limit(op->gcalobj));
+
+	if (curl_multi_add_handle(op->loop->multi, op->res.curl) != CURLM_OK)
+		return -1;
+
+	return 0;
+}
+
+static void op_unlink(struct gcal_async *op)
+{
+	struct gcal_async **ptr;
+
+	for (ptr = &op->loop->ops; *ptr; ptr = &(*ptr)->next)
+		if (*ptr == op) {
+			*ptr = op->next;
+			--op->loop->count;
+			break;
+		}
+}
+
+/* Replaces the request URL, returns -1 if there is none */
+static int op_set_url(struct gcal_async *op, char *url, char redirected)
+{
+	if (!url)
+		return -1;
+
+	if (op->url)
+		free(op->url);
+	op->url = url;
+	op->redirected = redirected;
+
+	return 0;
+}
+
+/* Moves an operation to its next state after a request has finished */
+static void op_end(struct gcal_async *op, CURLcode code)
+{
+	struct gcal_resource *res = &op->res;
+	char *url = NULL;
+	int result = -1;
+
+	code = gcal_transfer_finish(op->gcalobj, res, code);
+	if (op->redirected)
+		gcal_account_redirection(op->gcalobj, 0);
+	if (code != CURLE_OK)
+		goto done;
+
+	/* Calendar *may* redirect, the request is redone with the session */
+	if ((res->http_code == GCAL_REDIRECT_ANSWER) &&
+	    !(strcmp(op->gcalobj->service, "cl")) && !op->redirected) {
+		if (get_the_url(res->buffer, res->used, &url))
+			goto done;
+		gcal_learn_session(op->gcalobj, url);
+		if (op_set_url(op, url, 1) || op_start(op))
+			goto done;
+		return;
+	}
+
+	if (res->http_code != op->expected_code)
+		goto done;
+
+	/* Drops the page, only its entries are kept */
+	if (op->pipe) {
+		if (pipeline_end_page(op->pipe, &url))
+			goto done;
+		if (url) {
+			if (op_set_url(op, url, 0) || op_start(op))
+				goto done;
+			return;
+		}
+	}
+
+	result = 0;
+
+done:
+	if (result && op->gcalobj->fout_log)
+		fprintf(op->gcalobj->fout_log, "%s\n%s%s\n%s%d\n%s%s\n",
+			"op_end: failed request.",
+			"Curl code: ", curl_easy_strerror(code),
+			"HTTP code: ", (int)res->http_code,
+			"URL: ", op->url);
+
+	op_unlink(op);
+	op->cb(op, result, op->data);
+	op->loop = NULL;
+	op_free(op);
+}
+
+/* Delivers the finished transfers */
+static void loop_check(struct gcal_loop *loop)
+{
+	struct gcal_async *op;
+	CURLMsg *msg;
+	CURLcode code;
+	CURL *curl;
+	int queued;
+
+	while ((msg = curl_multi_info_read(loop->multi, &queued))) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		/* 'msg' is gone after the handle removal */
+		curl = msg->easy_handle;
+		code = msg->data.result;
+		curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&op);
+		curl_multi_remove_handle(loop->multi, curl);
+		op_end(op, code);
+	}
+}
+
+int gcal_loop_action(struct gcal_loop *loop, int fd, int events)
+{
+	int running;
+
+	if (!loop)
+		return -1;
+
+	if (curl_multi_socket_action(loop->multi, (curl_socket_t)fd, events,
+				     &running) != CURLM_OK)
+		return -1;
+	loop_check(loop);
+
+	return (int)loop->count;
+}
+
+int gcal_loop_wait(struct gcal_loop *loop, int timeout_ms)
+{
+	int running;
+
+	if (!loop)
+		return -1;
+
+	if (loop->count && (curl_multi_wait(loop->multi, NULL, 0, timeout_ms,
+					    NULL) != CURLM_OK))
+		return -1;
+	if (curl_multi_perform(loop->multi, &running) != CURLM_OK)
+		return -1;
+	loop_check(loop);
+
+	return (int)loop->count;
+}
+
+static struct gcal_async *op_new(struct gcal_loop *loop,
+				 struct gcal_resource *gcalobj,
+				 gcal_async_cb cb, void *data)
+{
+	struct gcal_async *op = NULL;
+	char *auth_header = NULL;
+	size_t length;
+
+	if (!loop || !gcalobj || !cb)
+		goto exit;
+	/* Failed to get authentication token */
+	if (!gcalobj->auth)
+		goto exit;
+
+	if (!(op = calloc(1, sizeof(struct gcal_async))))
+		goto exit;
+	op->loop = loop;
+	op->gcalobj = gcalobj;
+	op->cb = cb;
+	op->data = data;
+	op->expected_code = GCAL_DEFAULT_ANSWER;
+	if (gcal_transfer_init(gcalobj, &op->res, (void *)op))
+		goto cleanup;
+
+	length = strlen(gcalobj->auth) + sizeof(HEADER_GET) + 1;
+	if (!(auth_header = malloc(length)))
+		goto cleanup;
+	snprintf(auth_header, length - 1, "%s%s", HEADER_GET, gcalobj->auth);
+	op->headers = curl_slist_append(op->headers, auth_header);
+	free(auth_header);
+	if (!op->headers)
+		goto cleanup;
+
+	if (!(strcmp(gcalobj->service, "cl")))
+		op->headers = curl_slist_append(op->headers,
+						"GData-Version: 2");
+	else
+		op->headers = curl_slist_append(op->headers,
+						"GData-Version: 3.0");
+	if (!op->headers)
+		goto cleanup;
+
+	/* The handle may carry the method of a previous request */
+	curl_easy_setopt(op->res.curl, CURLOPT_CUSTOMREQUEST, NULL);
+	curl_easy_setopt(op->res.curl, CURLOPT_HTTPGET, 1);
+
+	return op;
+
+cleanup:
+	op->loop = NULL;
+	op_free(op);
+	op = NULL;
+
+exit:
+	return op;
+}
+
+/* Sends the first request of a new operation */
+static struct gcal_async *op_launch(struct gcal_async *op)
+{
+	curl_easy_setopt(op->res.curl, CURLOPT_HTTPHEADER, op->headers);
+	if (op_start(op)) {
+		op->loop = NULL;
+		op_free(op);
+		return NULL;
+	}
+
+	op->next = op->loop->ops;
+	op->loop->ops = op;
+	++op->loop->count;
+
+	return op;
+}
+
+/* Starts downloading a feed, taking ownership of 'url' */
+static struct gcal_async *feed_new(struct gcal_loop *loop,
+				   struct gcal_resource *gcalobj, char *url,
+				   gcal_async_cb cb, void *data)
+{
+	struct gcal_async *op;
+
+	if (!url)
+		return NULL;
+	if (!(op = op_new(loop, gcalobj, cb, data))) {
+		free(url);
+		return NULL;
+	}
+	op->url = url;
+
+	if (!(strcmp(gcalobj->service, "cl")))
+		op->pipe = pipeline_create_events(gcalobj->store_xml_entry);
+	else
+		op->pipe = pipeline_create_contacts(gcalobj->store_xml_entry);
+	if (!op->pipe) {
+		op->loop = NULL;
+		op_free(op);
+		return NULL;
+	}
+	/* Pages are parsed while downloaded */
+	op->res.pipeline = op->pipe;
+
+	return op_launch(op);
+}
+
+struct gcal_async *gcal_async_dump(struct gcal_loop *loop, gcal_t gcalobj,
+				   gcal_async_cb cb, void *data)
+{
+	if (!gcalobj)
+		return NULL;
+
+	return feed_new(loop, gcalobj, gcal_mount_feed_url(gcalobj), cb, data);
+}
+
+struct gcal_async *gcal_async_query_updated(struct gcal_loop *loop,
+					    gcal_t gcalobj, char *timestamp,
+					    gcal_async_cb cb, void *data)
+{
+	if (!gcalobj)
+		return NULL;
+
+	return feed_new(loop, gcalobj,
+			gcal_mount_updated_url(gcalobj, timestamp), cb, data);
+}
+
+struct gcal_async *gcal_async_query(struct gcal_loop *loop, gcal_t gcalobj,
+				    const char *parameters,
+				    gcal_async_cb cb, void *data)
+{
+	if (!gcalobj)
+		return NULL;
+
+	return feed_new(loop, gcalobj,
+			gcal_mount_generic_url(gcalobj, parameters), cb, data);
+}
+
+/* Adds the upload of 'xml_entry' to an operation */
+static int op_set_body(struct gcal_async *op, char *xml_entry)
+{
+	op->headers = curl_slist_append(op->headers,
+					"Content-Type: application/atom+xml");
+	if (!op->headers || !(op->body = strdup(xml_entry)))
+		return -1;
+
+	curl_easy_setopt(op->res.curl, CURLOPT_POSTFIELDS, op->body);
+	curl_easy_setopt(op->res.curl, CURLOPT_POSTFIELDSIZE,
+			 (long)strlen(op->body));
+
+	return 0;
+}
+
+struct gcal_async *gcal_async_add_xmlentry(struct gcal_loop *loop,
+					   gcal_t gcalobj,
+					   char *xml_entry,
+					   gcal_async_cb cb, void *data)
+{
+	struct gcal_async *op;
+	size_t length;
+
+	if (!xml_entry || !(op = op_new(loop, gcalobj, cb, data)))
+		return NULL;
+
+	if (!(strcmp(gcalobj->service, "cl")))
+		op->url = strdup(GCAL_EDIT_URL);
+	else {
+		length = sizeof(GCONTACT_START) + sizeof(GCONTACT_END) +
+			strlen(gcalobj->user) + sizeof(GCAL_DELIMITER) +
+			strlen(gcalobj->domain) + 1;
+		if ((op->url = malloc(length)))
+			snprintf(op->url, length - 1, "%s%s%s%s%s",
+				 GCONTACT_START, gcalobj->user,
+				 GCAL_DELIMITER, gcalobj->domain,
+				 GCONTACT_END);
+	}
+	if (!op->url || op_set_body(op, xml_entry))
+		goto cleanup;
+	curl_easy_setopt(op->res.curl, CURLOPT_POST, 1);
+	op->expected_code = GCAL_EDIT_ANSWER;
+
+	return op_launch(op);
+
+cleanup:
+	op->loop = NULL;
+	op_free(op);
+	return NULL;
+}
+
+struct gcal_async *gcal_async_update_xmlentry(struct gcal_loop *loop,
+					      gcal_t gcalobj,
+					      char *xml_entry,
+					      const char *edit_url,
+					      const char *etag,
+					      gcal_async_cb cb, void *data)
+{
+	struct gcal_async *op;
+	char *pvt_etag = NULL;
+	char buffer[512];
+	const char if_match[] = "If-Match: ";
+
+	if (!xml_entry || !(op = op_new(loop, gcalobj, cb, data)))
+		return NULL;
+
+	if (!edit_url) {
+		if (get_edit_url(xml_entry, strlen(xml_entry),
+				 &op->url))
+			goto cleanup;
+	} else if (!(op->url = strdup(edit_url)))
+		goto cleanup;
+
+	if (!etag) {
+		if (get_edit_etag(xml_entry, strlen(xml_entry),
+				  &pvt_etag))
+			goto cleanup;
+		etag = pvt_etag;
+	}
+
+	/* Mounts costum HTTP header using ETag */
+	snprintf(buffer, sizeof(buffer) - 1, "%s%s", if_match, etag);
+	if (pvt_etag)
+		free(pvt_etag);
+	op->headers = curl_slist_append(op->headers, buffer);
+	if (!op->headers || op_set_body(op, xml_entry))
+		goto cleanup;
+	curl_easy_setopt(op->res.curl, CURLOPT_CUSTOMREQUEST, "PUT");
+
+	return op_launch(op);
+
+cleanup:
+	op->loop = NULL;
+	op_free(op);
+	return NULL;
+}
+
+struct gcal_async *gcal_async_erase_xmlentry(struct gcal_loop *loop,
+					     gcal_t gcalobj,
+					     char *xml_entry,
+					     gcal_async_cb cb, void *data)
+{
+	struct gcal_async *op;
+
+	if (!xml_entry || !(op = op_new(loop, gcalobj, cb, data)))
+		return NULL;
+
+	if (get_edit_url(xml_entry, strlen(xml_entry), &op->url))
+		goto cleanup;
+
+	op->headers = curl_slist_append(op->headers,
+					"Content-Type: application/atom+xml");
+	/* Google Data API 2.0 requires ETag */
+	if (op->headers)
+		op->headers = curl_slist_append(op->headers, "If-Match: *");
+	if (!op->headers)
+		goto cleanup;
+	curl_easy_setopt(op->res.curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+
+	return op_launch(op);
+
+cleanup:
+	op->loop = NULL;
+	op_free(op);
+	return NULL;
+}
+
+int gcal_async_take_events(struct gcal_async *op,
+			   struct gcal_event_array *events)
+{
+	if (!op || !events || !op->pipe ||
+	    strcmp(op->gcalobj->service, "cl"))
+		return -1;
+
+	events->length = 0;
+	events->entries = pipeline_finish(op->pipe, &events->length);
+	if (!events->entries) {
+		events->length = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+int gcal_async_take_contacts(struct gcal_async *op,
+			     struct gcal_contact_array *contacts)
+{
+	if (!op || !contacts || !op->pipe ||
+	    strcmp(op->gcalobj->service, "cp"))
+		return -1;
+
+	contacts->length = 0;
+	contacts->entries = pipeline_finish(op->pipe, &contacts->length);
+	if (!contacts->entries) {
+		contacts->length = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+char *gcal_async_take_xml(struct gcal_async *op)
+{
+	if (!op || op->pipe || !op->res.buffer || !op->res.used)
+		return NULL;
+
+	return strdup(op->res.buffer);
+}
+
+int gcal_async_httpcode(struct gcal_async *op)
+{
+	if (!op)
+		return -1;
+
+	return (int)op->res.http_code;
+}
@@ -39,10 +39,12 @@ POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "gcal_parser.h"
+#include "gcont.h"
 #include "atom_parser.h"
 #include "xml_aux.h"
 
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include <string.h>
 
 char scheme_href[] = "http://schemas.google.com/g/2005#kind";
@@ -142,6 +144,64 @@ exit:
 	return result;
 }
 
+/* Reads the feed 'openSearch:totalResults' (0 if not available) */
+static size_t get_total_results(xmlNode *feed)
+{
+	xmlNode *cur_node = NULL;
+	xmlChar *content;
+	size_t result = 0;
+
+	if (!feed)
+		goto exit;
+
+	for (cur_node = feed->children; cur_node; cur_node = cur_node->next)
+		if ((cur_node->type == XML_ELEMENT_NODE) &&
+		    !xmlStrcmp(cur_node->name, BAD_CAST "totalResults")) {
+			content = xmlNodeGetContent(cur_node);
+			if (content) {
+				result = strtoul((char *)content, NULL, 10);
+				xmlFree(content);
+			}
+			break;
+		}
+
+exit:
+	return result;
+}
+
+/* Looks for the feed 'next' link (i.e. the URL of the next page) */
+static char *get_next(xmlNode *feed)
+{
+	xmlNode *cur_node = NULL;
+	char *result = NULL;
+	xmlChar *attr = NULL, *uri = NULL;
+
+	if (!feed)
+		goto exit;
+
+	for (cur_node = feed->children; cur_node; cur_node = cur_node->next) {
+		if ((cur_node->type != XML_ELEMENT_NODE) ||
+		    xmlStrcmp(cur_node->name, BAD_CAST "link"))
+			continue;
+
+		attr = xmlGetProp(cur_node, BAD_CAST "rel");
+		if (attr && !xmlStrcmp(attr, BAD_CAST "next")) {
+			uri = xmlGetProp(cur_node, BAD_CAST "href");
+			if (uri)
+				result = strdup((char *)uri);
+			xmlFree(attr);
+			xmlFree(uri);
+			goto exit;
+		}
+
+		if (attr)
+			xmlFree(attr);
+	}
+
+exit:
+	return result;
+}
+
 int get_edit_url(char *data, int length, char **url)
 {
 	xmlDoc *doc = NULL;
@@ -216,6 +276,357 @@ void clean_dom_document(dom_document *doc)
 
 }
 
+struct gcal_pipeline *pipeline_create(size_t element_size,
+				      void (*init)(void *, char),
+				      int (*extract)(xmlNode *, void *),
+				      void (*destroy)(void *),
+				      char store_xml)
+{
+	struct gcal_pipeline *pipe = NULL;
+
+	if (!element_size || !init || !extract || !destroy)
+		goto exit;
+
+	if (!(pipe = malloc(sizeof(struct gcal_pipeline))))
+		goto exit;
+	memset(pipe, 0, sizeof(struct gcal_pipeline));
+
+	pipe->element_size = element_size;
+	pipe->init = init;
+	pipe->extract = extract;
+	pipe->destroy = destroy;
+	pipe->store_xml = store_xml;
+
+	/* An empty feed must still have a valid vector */
+	pipe->allocated = 16;
+	pipe->entries = malloc(pipe->allocated * element_size);
+	if (!pipe->entries) {
+		free(pipe);
+		pipe = NULL;
+	}
+
+exit:
+	return pipe;
+}
+
+static int pipeline_is_entry(xmlNode *node)
+{
+	return ((node->type == XML_ELEMENT_NODE) && node->ns &&
+		!xmlStrcmp(node->name, BAD_CAST "entry") &&
+		!xmlStrcmp(node->ns->href, BAD_CAST atom_href));
+}
+
+/* Adds a new element to the vector, parsed from an entry node */
+static int pipeline_append(struct gcal_pipeline *pipe, xmlNode *entry)
+{
+	char *ptr_tmp, *element;
+
+	if (pipe->length == pipe->allocated) {
+		ptr_tmp = realloc(pipe->entries, 2 * pipe->allocated *
+				  pipe->element_size);
+		if (!ptr_tmp)
+			return -1;
+		pipe->entries = ptr_tmp;
+		pipe->allocated *= 2;
+	}
+
+	element = pipe->entries + pipe->length * pipe->element_size;
+	memset(element, 0, pipe->element_size);
+	pipe->init(element, pipe->store_xml);
+	++pipe->length;
+
+	return pipe->extract(entry, element);
+}
+
+/* Extracts the finished entries and drops them from the tree, so only
+ * the entry being downloaded is held in memory. The last child of the
+ * feed is kept, since the parser may still append text to it.
+ */
+static int pipeline_harvest(struct gcal_pipeline *pipe, int all)
+{
+	xmlNode *root, *node, *next, *open;
+
+	if (!pipe->ctxt->myDoc)
+		return 0;
+	if (!(root = xmlDocGetRootElement(pipe->ctxt->myDoc)))
+		return 0;
+
+	for (node = root->children; node; node = next) {
+		next = node->next;
+		if (!pipeline_is_entry(node)) {
+			if (next && xmlIsBlankNode(node)) {
+				xmlUnlinkNode(node);
+				xmlFreeNode(node);
+			}
+			continue;
+		}
+
+		if (node == pipe->extracted) {
+			if (next) {
+				xmlUnlinkNode(node);
+				xmlFreeNode(node);
+				pipe->extracted = NULL;
+			}
+			continue;
+		}
+
+		/* An entry still being parsed has the current node within */
+		if (!all)
+			for (open = pipe->ctxt->node; open; open = open->parent)
+				if (open == node)
+					return 0;
+
+		if (pipeline_append(pipe, node))
+			return -1;
+
+		if (next) {
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		} else
+			pipe->extracted = node;
+	}
+
+	return 0;
+}
+
+int pipeline_feed(struct gcal_pipeline *pipe, const char *data, size_t length)
+{
+	int result = -1;
+
+	if (!pipe || pipe->failed)
+		goto exit;
+
+	/* The first chunk is used to detect the encoding */
+	if (!pipe->ctxt) {
+		pipe->ctxt = xmlCreatePushParserCtxt(NULL, NULL, data,
+						     length > 4 ? 4 : length,
+						     "noname.xml");
+		if (!pipe->ctxt)
+			goto error;
+		if (length <= 4) {
+			result = 0;
+			goto exit;
+		}
+		data += 4;
+		length -= 4;
+	}
+
+	if (xmlParseChunk(pipe->ctxt, data, length, 0))
+		goto error;
+	if (pipeline_harvest(pipe, 0))
+		goto error;
+
+	result = 0;
+	goto exit;
+
+error:
+	pipe->failed = 1;
+exit:
+	return result;
+}
+
+static void pipeline_free_document(struct gcal_pipeline *pipe)
+{
+	if (!pipe->ctxt)
+		return;
+
+	if (pipe->ctxt->myDoc)
+		xmlFreeDoc(pipe->ctxt->myDoc);
+	xmlFreeParserCtxt(pipe->ctxt);
+	pipe->ctxt = NULL;
+	pipe->extracted = NULL;
+}
+
+int pipeline_end_page(struct gcal_pipeline *pipe, char **next_url)
+{
+	int result = -1;
+
+	if (next_url)
+		*next_url = NULL;
+
+	if (!pipe || pipe->failed || !pipe->ctxt)
+		goto exit;
+
+	if (xmlParseChunk(pipe->ctxt, NULL, 0, 1) ||
+	    !pipe->ctxt->wellFormed) {
+		fprintf(stderr, "pipeline_end_page: failed doc parse\n");
+		goto error;
+	}
+
+	if (pipeline_harvest(pipe, 1))
+		goto error;
+
+	if (next_url)
+		*next_url = get_next(xmlDocGetRootElement(pipe->ctxt->myDoc));
+	if (!pipe->pages)
+		pipe->total_results = get_total_results(
+			xmlDocGetRootElement(pipe->ctxt->myDoc));
+
+	/* The next page starts a new document */
+	pipeline_free_document(pipe);
+	++pipe->pages;
+	result = 0;
+	goto exit;
+
+error:
+	pipe->failed = 1;
+exit:
+	return result;
+}
+
+int pipeline_read(struct gcal_pipeline *pipe, const char *data,
+		  size_t length)
+{
+	int result = -1, ret;
+	size_t total = 0;
+	xmlTextReader *reader = NULL;
+	const xmlChar *name, *uri;
+	xmlChar *content;
+	xmlNode *entry;
+
+	if (!pipe || pipe->failed || pipe->ctxt || !data)
+		goto exit;
+
+	reader = xmlReaderForMemory(data, length, "noname.xml", NULL, 0);
+	if (!reader)
+		goto error;
+
+	ret = xmlTextReaderRead(reader);
+	while (ret == 1) {
+		/* Only the feed children are of interest */
+		if ((xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) ||
+		    (xmlTextReaderDepth(reader) != 1)) {
+			ret = xmlTextReaderRead(reader);
+			continue;
+		}
+
+		name = xmlTextReaderConstLocalName(reader);
+		uri = xmlTextReaderConstNamespaceUri(reader);
+		if (uri && !xmlStrcmp(uri, BAD_CAST atom_href) &&
+		    !xmlStrcmp(name, BAD_CAST "entry")) {
+			if (!(entry = xmlTextReaderExpand(reader)))
+				goto error;
+			if (pipeline_append(pipe, entry))
+				goto error;
+
+		} else if (!xmlStrcmp(name, BAD_CAST "totalResults")) {
+			if ((content = xmlTextReaderReadString(reader))) {
+				total = strtoul((char *)content, NULL, 10);
+				xmlFree(content);
+			}
+		}
+
+		/* Skips the subtree, the reader frees it as it moves on */
+		ret = xmlTextReaderNext(reader);
+	}
+
+	if (ret == -1) {
+		fprintf(stderr, "pipeline_read: failed doc parse\n");
+		goto error;
+	}
+
+	if (!pipe->pages)
+		pipe->total_results = total;
+	++pipe->pages;
+	result = 0;
+	goto cleanup;
+
+error:
+	pipe->failed = 1;
+cleanup:
+	if (reader)
+		xmlFreeTextReader(reader);
+exit:
+	return result;
+}
+
+void *pipeline_finish(struct gcal_pipeline *pipe, size_t *length)
+{
+	void *result = NULL;
+
+	if (!pipe || !length || pipe->failed)
+		goto exit;
+
+	if (pipe->ctxt && pipeline_end_page(pipe, NULL))
+		goto exit;
+
+	/* Not even a single (maybe empty) feed was parsed */
+	if (!pipe->pages)
+		goto exit;
+
+	result = pipe->entries;
+	*length = pipe->length;
+	pipe->entries = NULL;
+	pipe->length = 0;
+
+exit:
+	return result;
+}
+
+void pipeline_destroy(struct gcal_pipeline *pipe)
+{
+	size_t i;
+
+	if (!pipe)
+		return;
+
+	pipeline_free_document(pipe);
+
+	if (pipe->entries) {
+		for (i = 0; i < pipe->length; ++i)
+			pipe->destroy(pipe->entries + i * pipe->element_size);
+		free(pipe->entries);
+	}
+
+	free(pipe);
+}
+
+static void pipeline_init_event(void *element, char store_xml)
+{
+	gcal_init_event((struct gcal_event *)element);
+	((struct gcal_event *)element)->common.store_xml = store_xml;
+}
+
+static int pipeline_extract_event(xmlNode *entry, void *element)
+{
+	return atom_extract_data(entry, (struct gcal_event *)element);
+}
+
+static void pipeline_destroy_event(void *element)
+{
+	gcal_destroy_entry((struct gcal_event *)element);
+}
+
+struct gcal_pipeline *pipeline_create_events(char store_xml)
+{
+	return pipeline_create(sizeof(struct gcal_event), pipeline_init_event,
+			       pipeline_extract_event, pipeline_destroy_event,
+			       store_xml);
+}
+
+static void pipeline_init_contact(void *element, char store_xml)
+{
+	gcal_init_contact((struct gcal_contact *)element);
+	((struct gcal_contact *)element)->common.store_xml = store_xml;
+}
+
+static int pipeline_extract_contact(xmlNode *entry, void *element)
+{
+	return atom_extract_contact(entry, (struct gcal_contact *)element);
+}
+
+static void pipeline_destroy_contact(void *element)
+{
+	gcal_destroy_contact((struct gcal_contact *)element);
+}
+
+struct gcal_pipeline *pipeline_create_contacts(char store_xml)
+{
+	return pipeline_create(sizeof(struct gcal_contact),
+			       pipeline_init_contact, pipeline_extract_contact,
+			       pipeline_destroy_contact, store_xml);
+}
+
 int get_entries_number(dom_document *doc)
 {
 	int result = -1;
@@ -315,29 +726,53 @@ exit:
 	return result;
 }
 
-int xmlentry_create(struct gcal_event *entry, char **xml_entry, int *length)
+/* Adds the fields identifying an existing entry (i.e. all that is
+ * needed to delete it).
+ */
+static int xmlentry_build_key(struct gcal_entry *common, xmlNode *root)
 {
-	int result = -1;
-	xmlDoc *doc = NULL;
-	xmlNode *root, *node;
-	xmlNs *ns;
-	xmlChar *xml_str = NULL;
+	xmlNode *node;
 
-	doc = xmlNewDoc(BAD_CAST "1.0");
-	root = xmlNewNode(NULL, BAD_CAST "entry");
+	/* Google Data API 2.0 requires ETag to edit an entry */
+	if (common->etag)
+		xmlSetProp(root, BAD_CAST "gd:etag", BAD_CAST common->etag);
+	xmlNewNs(root, BAD_CAST gd_href, BAD_CAST "gd");
+
+	if (common->id && common->id[0]) {
+		if (!(node = xmlNewNode(NULL, "id")))
+			return -1;
+		xmlNodeAddContent(node, common->id);
+		xmlAddChild(root, node);
+	}
 
-	if (!doc || !root)
-		goto exit;
+	if (common->edit_uri && common->edit_uri[0]) {
+		if (!(node = xmlNewNode(NULL, "link")))
+			return -1;
+		xmlSetProp(node, BAD_CAST "rel", BAD_CAST "edit");
+		xmlSetProp(node, BAD_CAST "type",
+			   BAD_CAST "application/atom+xml");
+		xmlSetProp(node, BAD_CAST "href", BAD_CAST common->edit_uri);
+		xmlAddChild(root, node);
+	}
+
+	return 0;
+}
+
+/* Adds the fields of a calendar entry to an 'entry' element, shared by
+ * single entries and batch feeds.
+ */
+static int xmlentry_build(struct gcal_event *entry, xmlNode *root)
+{
+	int result = -1;
+	xmlNode *node;
+	xmlNs *ns;
 
-	xmlSetProp(root, BAD_CAST "xmlns", BAD_CAST atom_href);
 	/* Google Data API 2.0 requires ETag to edit an entry */
 	if (entry->common.etag)
 		xmlSetProp(root, BAD_CAST "gd:etag",
 			   BAD_CAST entry->common.etag);
 	ns =  xmlNewNs(root, BAD_CAST gd_href, BAD_CAST "gd");
 
-	xmlDocSetRootElement(doc, root);
-
 
 	/* entry ID, only if the 'entry' is already existant (i.e. the user
 	 * of library just got one entry result from a request from
@@ -443,26 +878,56 @@ int xmlentry_create(struct gcal_event *entry, char **xml_entry, int *length)
 		xmlAddChild(root, node);
 	}
 
+	result = 0;
+
+cleanup:
+	return result;
+}
+
+/* Writes a document to a new string */
+static int xmldoc_dump(xmlDoc *doc, char **xml, int *length)
+{
+	int result = -1;
+	xmlChar *xml_str = NULL;
 
 	xmlDocDumpMemory(doc, &xml_str, length);
 	/* xmlDocDumpMemory doesn't include the last 0 in the returned size */
 	++(*length);
 	if (xml_str)
-		if ((*xml_entry = strdup(xml_str)))
+		if ((*xml = strdup(xml_str)))
 			result = 0;
 
-cleanup:
-
 	if (xml_str)
 		xmlFree(xml_str);
 
-	if (doc)
-		xmlFreeDoc(doc);
+	return result;
+}
+
+int xmlentry_create(struct gcal_event *entry, char **xml_entry, int *length)
+{
+	int result = -1;
+	xmlDoc *doc = NULL;
+	xmlNode *root;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	root = xmlNewNode(NULL, BAD_CAST "entry");
+
+	if (!doc || !root)
+		goto exit;
+
+	xmlSetProp(root, BAD_CAST "xmlns", BAD_CAST atom_href);
+	xmlDocSetRootElement(doc, root);
+
+	if (!xmlentry_build(entry, root))
+		result = xmldoc_dump(doc, xml_entry, length);
 
 exit:
+	if (doc)
+		xmlFreeDoc(doc);
+	else if (root)
+		xmlFreeNode(root);
 
 	return result;
-
 }
 
 int extract_all_contacts(dom_document *doc,
@@ -511,10 +976,12 @@ exit:
 	return result;
 }
 
-int xmlcontact_create(struct gcal_contact *contact, char **xml_contact,
-		      int *length)
+/* Adds the fields of a contact to an 'atom:entry' element, shared by
+ * single contacts and batch feeds.
+ */
+static int xmlcontact_build(struct gcal_contact *contact, xmlNode *root)
 {
-	/* XXX: this function is pretty much a copy of 'xmlentry_create'
+	/* XXX: this function is pretty much a copy of 'xmlentry_build'
 	 * some code could be shared if I provided a common type between
 	 * contact X calendar.
 	 */
@@ -522,24 +989,14 @@ int xmlcontact_create(struct gcal_contact *contact, char **xml_contact,
 	int i;
 	struct gcal_structured_subvalues *this_structured_entry;
 	int set_structured_entry = 0;
-	xmlDoc *doc = NULL;
-	xmlNode *root = NULL;
 	xmlNode *node = NULL;
 	xmlNode *node2 = NULL;
 	xmlNode *child = NULL;
 	xmlNs *ns;
 	xmlNs *ns2;
-	xmlChar *xml_str = NULL;
 	char *temp;
 	const char * rel_prefix = "http://schemas.google.com/g/2005#";
 
-	doc = xmlNewDoc(BAD_CAST "1.0");
-	root = xmlNewNode(NULL, BAD_CAST "atom:entry");
-
-	if (!doc || !root)
-		goto exit;
-
-	xmlSetProp(root, BAD_CAST "xmlns:atom", BAD_CAST atom_href);
 	/* Google Data API 2.0 requires ETag to edit an entry */
 	if (contact->common.etag)
 		xmlSetProp(root, BAD_CAST "gd:etag",
@@ -550,8 +1007,6 @@ int xmlcontact_create(struct gcal_contact *contact, char **xml_contact,
 	/* Google contact group */
 	ns2 =  xmlNewNs(root, BAD_CAST gContact_href, BAD_CAST "gContact");
 
-	xmlDocSetRootElement(doc, root);
-
 	/* category element */
 	node = xmlNewNode(NULL, "category");
 	if (!node)
@@ -857,21 +1312,238 @@ int xmlcontact_create(struct gcal_contact *contact, char **xml_contact,
 	/* TODO: implement missing fields (which ones? geo location?)
 	 */
 
-	xmlDocDumpMemory(doc, &xml_str, length);
-	/* xmlDocDumpMemory doesn't include the last 0 in the returned size */
-	++(*length);
-	if (xml_str)
-		if ((*xml_contact = strdup(xml_str)))
-			result = 0;
+	result = 0;
+
 cleanup:
+	return result;
+}
 
-	if (xml_str)
-		xmlFree(xml_str);
+int xmlcontact_create(struct gcal_contact *contact, char **xml_contact,
+		      int *length)
+{
+	int result = -1;
+	xmlDoc *doc = NULL;
+	xmlNode *root;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	root = xmlNewNode(NULL, BAD_CAST "atom:entry");
+
+	if (!doc || !root)
+		goto exit;
 
+	xmlSetProp(root, BAD_CAST "xmlns:atom", BAD_CAST atom_href);
+	xmlDocSetRootElement(doc, root);
+
+	if (!xmlcontact_build(contact, root))
+		result = xmldoc_dump(doc, xml_contact, length);
+
+exit:
 	if (doc)
 		xmlFreeDoc(doc);
+	else if (root)
+		xmlFreeNode(root);
+
+	return result;
+}
+
+/* Builds a batch feed, 'build' adds the fields of the entry 'index' (all
+ * of them or just its key, when 'full' is not set).
+ */
+static int xmlbatch_create(const char *entry_name, void *entries,
+			   const gcal_batch_op *ops, size_t count,
+			   int (*build)(void *, size_t, xmlNode *, char),
+			   char **xml, int *length)
+{
+	int result = -1;
+	xmlDoc *doc = NULL;
+	xmlNode *root, *entry, *node;
+	xmlNs *ns;
+	char index[32];
+	size_t i;
+	const char *op_types[] = { "insert", "update", "delete" };
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	root = xmlNewNode(NULL, BAD_CAST "feed");
+
+	if (!doc || !root || !entries || !ops || !xml || !length)
+		goto exit;
+
+	xmlSetProp(root, BAD_CAST "xmlns", BAD_CAST atom_href);
+	ns = xmlNewNs(root, BAD_CAST batch_href, BAD_CAST batch_ns);
+	xmlDocSetRootElement(doc, root);
+
+	for (i = 0; i < count; ++i) {
+		if (ops[i] > GCAL_BATCH_DELETE)
+			goto exit;
+		if (!(entry = xmlNewChild(root, NULL, BAD_CAST entry_name,
+					  NULL)))
+			goto exit;
+
+		/* The answer entries are matched by this ID */
+		snprintf(index, sizeof(index), "%lu", (unsigned long)i);
+		if (!(node = xmlNewChild(entry, ns, BAD_CAST "id",
+					 BAD_CAST index)))
+			goto exit;
+		if (!(node = xmlNewChild(entry, ns, BAD_CAST "operation",
+					 NULL)))
+			goto exit;
+		xmlSetProp(node, BAD_CAST "type", BAD_CAST op_types[ops[i]]);
+
+		if (build(entries, i, entry, ops[i] != GCAL_BATCH_DELETE))
+			goto exit;
+	}
+
+	result = xmldoc_dump(doc, xml, length);
 
 exit:
+	if (doc)
+		xmlFreeDoc(doc);
+	else if (root)
+		xmlFreeNode(root);
+
+	return result;
+}
+
+static int batch_event(void *entries, size_t index, xmlNode *root, char full)
+{
+	struct gcal_event *entry = ((struct gcal_event **)entries)[index];
+
+	if (!entry)
+		return -1;
+	if (!full)
+		return xmlentry_build_key(&entry->common, root);
+
+	return xmlentry_build(entry, root);
+}
+
+static int batch_contact(void *entries, size_t index, xmlNode *root,
+			 char full)
+{
+	struct gcal_contact *contact =
+		((struct gcal_contact **)entries)[index];
+
+	if (!contact)
+		return -1;
+	xmlSetProp(root, BAD_CAST "xmlns:atom", BAD_CAST atom_href);
+	if (!full)
+		return xmlentry_build_key(&contact->common, root);
+
+	return xmlcontact_build(contact, root);
+}
+
+int xmlbatch_events_create(struct gcal_event **entries,
+			   const gcal_batch_op *ops, size_t count,
+			   char **xml, int *length)
+{
+	return xmlbatch_create("entry", (void *)entries, ops, count,
+			       batch_event, xml, length);
+}
+
+int xmlbatch_contacts_create(struct gcal_contact **contacts,
+			     const gcal_batch_op *ops, size_t count,
+			     char **xml, int *length)
+{
+	return xmlbatch_create("atom:entry", (void *)contacts, ops, count,
+			       batch_contact, xml, length);
+}
+
+static char *get_content(xmlNode *node)
+{
+	xmlChar *content;
+	char *result = NULL;
+
+	if ((content = xmlNodeGetContent(node))) {
+		result = strdup((char *)content);
+		xmlFree(content);
+	}
+
+	return result;
+}
+
+static char *get_prop(xmlNode *node, const char *name)
+{
+	xmlChar *prop;
+	char *result = NULL;
+
+	if ((prop = xmlGetProp(node, BAD_CAST name))) {
+		result = strdup((char *)prop);
+		xmlFree(prop);
+	}
+
+	return result;
+}
+
+int extract_batch_results(char *data, int length,
+			  struct gcal_batch_result *results, size_t count)
+{
+	xmlDoc *doc = NULL;
+	xmlNode *root, *entry, *node;
+	struct gcal_batch_result item, *target;
+	size_t index;
+	char *tmp;
+	int result = -1;
 
+	if (!data || !results)
+		goto exit;
+
+	doc = xmlReadMemory(data, length, "noname.xml", NULL, 0);
+	if (!doc)
+		goto exit;
+	if (!(root = xmlDocGetRootElement(doc)))
+		goto cleanup;
+
+	for (entry = root->children; entry; entry = entry->next) {
+		if ((entry->type != XML_ELEMENT_NODE) ||
+		    xmlStrcmp(entry->name, BAD_CAST "entry"))
+			continue;
+
+		memset(&item, 0, sizeof(item));
+		index = count;
+		for (node = entry->children; node; node = node->next) {
+			if (node->type != XML_ELEMENT_NODE)
+				continue;
+
+			if (node->ns && !xmlStrcmp(node->ns->href,
+						   BAD_CAST batch_href)) {
+				if (!xmlStrcmp(node->name, BAD_CAST "id") &&
+				    (tmp = get_content(node))) {
+					index = strtoul(tmp, NULL, 10);
+					free(tmp);
+				} else if (!xmlStrcmp(node->name,
+						      BAD_CAST "status")) {
+					if ((tmp = get_prop(node, "code"))) {
+						item.status = atoi(tmp);
+						free(tmp);
+					}
+					if (!item.reason)
+						item.reason =
+							get_prop(node,
+								 "reason");
+				}
+
+			} else if (!xmlStrcmp(node->name, BAD_CAST "id") &&
+				   !item.id)
+				item.id = get_content(node);
+		}
+		item.etag = get_etag_attribute(entry);
+		item.edit_uri = get_edit(entry->children);
+
+		/* Not one of ours */
+		if (index >= count) {
+			gcal_batch_results_cleanup(&item, 1);
+			continue;
+		}
+
+		target = &results[index];
+		gcal_batch_results_cleanup(target, 1);
+		*target = item;
+	}
+
+	result = 0;
+
+cleanup:
+	xmlFreeDoc(doc);
+
+exit:
 	return result;
 }
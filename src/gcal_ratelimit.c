@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2008 Instituto Nokia de Tecnologia
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the INdT nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+ * @file   gcal_ratelimit.c
+ *
+ * @brief  Client side rate limiting, shared by all the gcal objects of a
+ * process.
+ *
+ * Each service (calendar and contacts) has a token bucket: requests take a
+ * token, waiting for one when the bucket is empty. When the server
+ * throttles (i.e. answers 429 or 503), new requests are held for the time
+ * it asks for ('Retry-After') or an exponential backoff, and the rate is
+ * halved; answers that go through raise it back, a bit at a time, up to
+ * the configured one. Until a rate or retries are set, throttling answers
+ * just fail and nobody waits.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "internal_gcal.h"
+#include "gcal.h"
+
+/* Longest wait (in seconds) of the backoff, also caps 'Retry-After' */
+static const double BACKOFF_CEILING = 64;
+/* Longest sleep (in seconds) between checks of the deadline and
+ * cancellation of the waiting resource */
+static const double WAIT_SLICE = 0.1;
+/* The adapted rate never goes below this fraction of the configured one */
+static const double RATE_FLOOR = 1.0 / 64;
+/* Share of the configured rate recovered by each successful answer */
+static const double RATE_STEP = 1.0 / 16;
+
+struct rate_limit {
+	/** Configured rate (requests per second), 0 means no limit */
+	double rate;
+	/** Rate in use, lowered when the server throttles */
+	double current;
+	double burst;
+	double tokens;
+	/** When the bucket was last refilled */
+	double refilled;
+	/** No request of the service is made before it */
+	double resume;
+	/** Throttled answers in a row */
+	unsigned int throttled;
+	unsigned int retries;
+};
+
+static pthread_mutex_t limits_lock = PTHREAD_MUTEX_INITIALIZER;
+/* By service (see \ref gservice): no limit, no retries */
+static struct rate_limit limits[] = {
+	{ 0, 0, 1, 1, 0, 0, 0, 0 },
+	{ 0, 0, 1, 1, 0, 0, 0, 0 } };
+
+static struct rate_limit *find_limit(const char *service)
+{
+	if (!service)
+		return NULL;
+	if (!strcmp(service, "cl"))
+		return &limits[GCALENDAR];
+	if (!strcmp(service, "cp"))
+		return &limits[GCONTACT];
+
+	return NULL;
+}
+
+static double clock_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+static void sleep_seconds(double seconds)
+{
+	struct timespec wait;
+
+	wait.tv_sec = (time_t)seconds;
+	wait.tv_nsec = (long)((seconds - wait.tv_sec) * 1000000000.0);
+	while (nanosleep(&wait, &wait) && (errno == EINTR))
+		;
+}
+
+int gcal_set_rate_limit(gservice mode, double rate, unsigned int burst)
+{
+	struct rate_limit *limit;
+
+	if (((mode != GCALENDAR) && (mode != GCONTACT)) || (rate < 0))
+		return -1;
+
+	pthread_mutex_lock(&limits_lock);
+	limit = &limits[mode];
+	limit->rate = limit->current = rate;
+	limit->burst = limit->tokens = burst ? burst : 1;
+	limit->refilled = clock_seconds();
+	/* A new limit starts afresh, lifting any hold of the old one */
+	limit->resume = 0;
+	limit->throttled = 0;
+	pthread_mutex_unlock(&limits_lock);
+
+	return 0;
+}
+
+int gcal_set_retries(gservice mode, unsigned int retries)
+{
+	if ((mode != GCALENDAR) && (mode != GCONTACT))
+		return -1;
+
+	pthread_mutex_lock(&limits_lock);
+	limits[mode].retries = retries;
+	pthread_mutex_unlock(&limits_lock);
+
+	return 0;
+}
+
+void gcal_rate_acquire(struct gcal_resource *gcalobj)
+{
+	struct rate_limit *limit;
+	double now, wait;
+
+	if (!(limit = find_limit(gcalobj->service)))
+		return;
+
+	pthread_mutex_lock(&limits_lock);
+	while (1) {
+		now = clock_seconds();
+		if (!limit->rate && !limit->retries)
+			break;
+		else if (limit->resume > now)
+			wait = limit->resume - now;
+		else if (limit->current <= 0)
+			break;
+		else {
+			limit->tokens += (now - limit->refilled) *
+				limit->current;
+			if (limit->tokens > limit->burst)
+				limit->tokens = limit->burst;
+			limit->refilled = now;
+			if (limit->tokens >= 1) {
+				limit->tokens -= 1;
+				break;
+			}
+			wait = (1 - limit->tokens) / limit->current;
+		}
+
+		/* Other threads can go on meanwhile, the caller stops
+		 * waiting at its deadline or when canceled */
+		pthread_mutex_unlock(&limits_lock);
+		if (gcal_interrupted(gcalobj))
+			return;
+		sleep_seconds(wait < WAIT_SLICE ? wait : WAIT_SLICE);
+		pthread_mutex_lock(&limits_lock);
+	}
+	pthread_mutex_unlock(&limits_lock);
+}
+
+int gcal_rate_answer(const char *service, long code, long retry_after)
+{
+	struct rate_limit *limit;
+	double delay;
+	int result = 0;
+
+	if (!(limit = find_limit(service)))
+		return result;
+
+	pthread_mutex_lock(&limits_lock);
+	if (!limit->rate && !limit->retries)
+		goto exit;
+
+	if ((code != GCAL_TOO_MANY_REQUESTS) && (code != GCAL_UNAVAILABLE)) {
+		limit->throttled = 0;
+		if (limit->rate && (limit->current < limit->rate)) {
+			limit->current += limit->rate * RATE_STEP;
+			if (limit->current > limit->rate)
+				limit->current = limit->rate;
+		}
+		goto exit;
+	}
+
+	/* Exponential backoff, unless the server tells how long to wait */
+	if (retry_after > 0)
+		delay = (retry_after < BACKOFF_CEILING) ? retry_after :
+			BACKOFF_CEILING;
+	else {
+		delay = BACKOFF_CEILING;
+		if (limit->throttled < 6)
+			delay = 1 << limit->throttled;
+	}
+	++limit->throttled;
+	if (limit->resume < clock_seconds() + delay)
+		limit->resume = clock_seconds() + delay;
+
+	if (limit->rate) {
+		limit->current /= 2;
+		if (limit->current < limit->rate * RATE_FLOOR)
+			limit->current = limit->rate * RATE_FLOOR;
+		limit->tokens = 0;
+	}
+	result = limit->retries;
+
+exit:
+	pthread_mutex_unlock(&limits_lock);
+	return result;
+}
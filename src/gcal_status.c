@@ -68,3 +68,31 @@ const char *gcal_status_msg(struct gcal_resource *ptr_gcal)
 
 	return ptr_gcal->curl_msg;
 }
+
+int gcal_status_request(struct gcal_resource *ptr_gcal)
+{
+	if (!ptr_gcal)
+		return -1;
+
+	return ptr_gcal->internal_status;
+}
+
+int gcal_status_last_request(struct gcal_resource *ptr_gcal,
+			     struct gcal_request_stats *stats)
+{
+	if ((!ptr_gcal) || (!stats))
+		return -1;
+
+	*stats = ptr_gcal->last_request;
+	return 0;
+}
+
+int gcal_status_cumulative(struct gcal_resource *ptr_gcal,
+			   struct gcal_request_stats *stats)
+{
+	if ((!ptr_gcal) || (!stats))
+		return -1;
+
+	*stats = ptr_gcal->all_requests;
+	return 0;
+}
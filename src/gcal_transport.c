@@ -0,0 +1,231 @@
+/*
+Copyright (c) 2008 Instituto Nokia de Tecnologia
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the INdT nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+ * @file   gcal_transport.c
+ *
+ * @brief  In-memory transport, answering requests with canned responses.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "gcal_transport.h"
+
+/* The body is handed in pieces of this size, as a socket would do */
+static const size_t MEMORY_CHUNK = 16384;
+
+struct memory_response {
+	char *method;
+	char *url_prefix;
+	int code;
+	char *headers;
+	char *body;
+	size_t length;
+	struct memory_response *next;
+};
+
+struct memory_transport {
+	/** Responses, in the order they were added */
+	struct memory_response *first, *last;
+	/** Requests answered */
+	size_t count;
+};
+
+static void memory_response_free(struct memory_response *ptr)
+{
+	if (ptr->method)
+		free(ptr->method);
+	if (ptr->url_prefix)
+		free(ptr->url_prefix);
+	if (ptr->headers)
+		free(ptr->headers);
+	if (ptr->body)
+		free(ptr->body);
+	free(ptr);
+}
+
+static void memory_destroy(void *data)
+{
+	struct memory_transport *memory = (struct memory_transport *)data;
+	struct memory_response *ptr, *next;
+
+	if (!memory)
+		return;
+
+	for (ptr = memory->first; ptr; ptr = next) {
+		next = ptr->next;
+		memory_response_free(ptr);
+	}
+	free(memory);
+}
+
+static struct memory_response *memory_match(struct memory_transport *memory,
+					    const struct gcal_request *request)
+{
+	struct memory_response *ptr;
+
+	for (ptr = memory->first; ptr; ptr = ptr->next) {
+		if (ptr->method && strcmp(ptr->method, request->method))
+			continue;
+		if (ptr->url_prefix && strncmp(ptr->url_prefix, request->url,
+					       strlen(ptr->url_prefix)))
+			continue;
+		break;
+	}
+
+	return ptr;
+}
+
+static int memory_perform(void *data, const struct gcal_request *request,
+			  struct gcal_response *response)
+{
+	struct memory_transport *memory = (struct memory_transport *)data;
+	struct memory_response *match;
+	char *line, *end, *chunk;
+	size_t offset, length;
+	long read;
+
+	if (!(match = memory_match(memory, request)))
+		return -1;
+	++memory->count;
+
+	/* A streamed body is taken in pieces (and dropped), as a server
+	 * would do */
+	if (request->body_read) {
+		if (!(chunk = malloc(MEMORY_CHUNK)))
+			return -1;
+		for (offset = 0; offset < request->body_length; offset += read)
+			if ((read = request->body_read(chunk, MEMORY_CHUNK,
+						       request->body_data)) <= 0) {
+				free(chunk);
+				return -1;
+			}
+		free(chunk);
+	}
+
+	gcal_response_status(response, match->code);
+
+	for (line = match->headers; line && *line; line = end) {
+		if ((end = strchr(line, '\n')))
+			++end;
+		else
+			end = line + strlen(line);
+		gcal_response_header(response, line, end - line);
+	}
+
+	for (offset = 0; offset < match->length; offset += length) {
+		length = match->length - offset;
+		if (length > MEMORY_CHUNK)
+			length = MEMORY_CHUNK;
+		if (gcal_response_body(response, match->body + offset, length))
+			return -1;
+	}
+
+	return 0;
+}
+
+struct gcal_transport *gcal_transport_memory_new(void)
+{
+	struct gcal_transport *transport;
+
+	if (!(transport = malloc(sizeof(struct gcal_transport))))
+		return NULL;
+	if (!(transport->data = calloc(1, sizeof(struct memory_transport)))) {
+		free(transport);
+		return NULL;
+	}
+	transport->perform = memory_perform;
+	transport->destroy = memory_destroy;
+
+	return transport;
+}
+
+int gcal_transport_memory_add(struct gcal_transport *transport,
+			      const char *method, const char *url_prefix,
+			      int code, const char *headers,
+			      const char *body, size_t length)
+{
+	struct memory_transport *memory;
+	struct memory_response *ptr;
+
+	if (!transport || (transport->perform != memory_perform) ||
+	    (!body && length))
+		return -1;
+	memory = (struct memory_transport *)transport->data;
+
+	if (!(ptr = calloc(1, sizeof(struct memory_response))))
+		return -1;
+	if ((method && !(ptr->method = strdup(method))) ||
+	    (url_prefix && !(ptr->url_prefix = strdup(url_prefix))) ||
+	    (headers && !(ptr->headers = strdup(headers))))
+		goto error;
+	if (length) {
+		if (!(ptr->body = malloc(length)))
+			goto error;
+		memcpy(ptr->body, body, length);
+	}
+	ptr->code = code;
+	ptr->length = length;
+
+	if (memory->last)
+		memory->last->next = ptr;
+	else
+		memory->first = ptr;
+	memory->last = ptr;
+
+	return 0;
+
+error:
+	memory_response_free(ptr);
+	return -1;
+}
+
+size_t gcal_transport_memory_count(struct gcal_transport *transport)
+{
+	if (!transport || (transport->perform != memory_perform))
+		return 0;
+
+	return ((struct memory_transport *)transport->data)->count;
+}
+
+void gcal_transport_delete(struct gcal_transport *transport)
+{
+	if (!transport)
+		return;
+
+	if (transport->destroy)
+		transport->destroy(transport->data);
+	free(transport);
+}
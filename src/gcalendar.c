@@ -341,16 +341,57 @@ exit:
 	return result;
 }
 
+/* Batch feed of some of the events, see \ref gcal_batch_entries */
+static int batch_events_xml(void *entries, size_t first,
+			    const gcal_batch_op *ops, size_t count,
+			    char **xml, int *length)
+{
+	return xmlbatch_events_create((gcal_event_t *)entries + first, ops,
+				      count, xml, length);
+}
+
+int gcal_batch_events(gcal_t gcal_obj, gcal_event_t *events,
+		      gcal_batch_op *ops, size_t length,
+		      struct gcal_batch_result *results)
+{
+	int result = -1;
+
+	if ((!gcal_obj) || (!events) || strcmp(gcal_obj->service, "cl"))
+		goto exit;
+
+	result = gcal_batch_entries(gcal_obj, (void *)events, ops, length,
+				    results, batch_events_xml);
+
+exit:
+	return result;
+}
+
 int gcal_get_updated_events(gcal_t gcal_obj, struct gcal_event_array *events,
 			    char *timestamp)
 {
 	int result = -1;
+	char *url;
 	if (events)
 		events->length = 0;
 
 	if ((!gcal_obj) || (!events))
 		return result;
 
+	if (gcal_obj->pipeline_mode || gcal_obj->page_size) {
+		events->entries = NULL;
+		if (!(url = gcal_mount_updated_url(gcal_obj, timestamp)))
+			return result;
+		events->entries = gcal_dump_entries(gcal_obj, url,
+						    "GData-Version: 2",
+						    &events->length);
+		free(url);
+		if (!events->entries) {
+			events->length = 0;
+			return result;
+		}
+		return 0;
+	}
+
 	result = gcal_query_updated(gcal_obj, timestamp, "GData-Version: 2");
 	if (result) {
 		events->entries = NULL;
@@ -368,13 +409,32 @@ int gcal_get_updated_events(gcal_t gcal_obj, struct gcal_event_array *events,
 int gcal_get_events(gcal_t gcalobj, struct gcal_event_array *events_array)
 {
 	int result = -1;
-	if (events_array)
-		events_array->length = 0;
+	struct gcal_event *entries;
+	size_t length = 0;
 
+	gcal_call_begin(gcalobj);
 	if ((!gcalobj) || (!events_array))
 		goto exit;
 
+	/* An unchanged feed leaves the previous array untouched */
+	if (gcalobj->pipeline_mode || gcalobj->page_size) {
+		entries = gcal_dump_entries(gcalobj, NULL, "GData-Version: 2",
+					    &length);
+		if (!entries && gcalobj->not_modified) {
+			result = 1;
+			goto exit;
+		}
+		events_array->entries = entries;
+		events_array->length = entries ? length : 0;
+		if (entries)
+			result = 0;
+		goto exit;
+	}
+
 	result = gcal_dump(gcalobj, "GData-Version: 2");
+	if (result == 1)
+		goto exit;
+	events_array->length = 0;
 	if (result == -1) {
 		events_array->entries = NULL;
 		events_array->length = 0;
@@ -386,6 +446,9 @@ int gcal_get_events(gcal_t gcalobj, struct gcal_event_array *events_array)
 		result = -1;
 
 exit:
+	if (events_array && (result == -1))
+		events_array->length = 0;
+	gcal_call_end(gcalobj);
 	return result;
 }
 
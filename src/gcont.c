@@ -51,27 +51,199 @@ static size_t write_cb_binary(void *ptr, size_t count, size_t chunk_size,
 
 	size_t size = count * chunk_size;
 	struct gcal_resource *gcal_ptr = (struct gcal_resource *)data;
-	char *ptr_tmp;
 
-	if (size > (gcal_ptr->length - gcal_ptr->previous_length - 1)) {
-		gcal_ptr->length = gcal_ptr->length + size + 1;
-		ptr_tmp = realloc(gcal_ptr->buffer, gcal_ptr->length);
+	gcal_ptr->decoded_bytes += size;
+	if (gcal_buffer_append(gcal_ptr, ptr, size)) {
+		if (gcal_ptr->fout_log)
+			fprintf(gcal_ptr->fout_log,
+				"write_cb_binary: Failed append!\n");
+		return 0;
+	}
+
+	return size;
+}
+
+/** Contacts whose photos are being downloaded concurrently */
+struct photo_batch {
+	struct gcal_resource *gcalobj;
+	struct gcal_contact **contacts;
+	/** Set when any download has failed */
+	char failed;
+};
+
+static int store_photo(void *data, size_t index, struct gcal_resource *res)
+{
+	struct photo_batch *batch = (struct photo_batch *)data;
+	struct gcal_contact *contact = batch->contacts[index];
+
+	/* The contact keeps only the photo link, so it can be retried */
+	if (!res) {
+		if (batch->gcalobj->fout_log)
+			fprintf(batch->gcalobj->fout_log,
+				"failed photo download: %s\n", contact->photo);
+		batch->failed = 1;
+		return 0;
+	}
+
+	contact->photo_data = malloc(sizeof(char) * res->used);
+	if (!contact->photo_data)
+		return -1;
+	contact->photo_length = res->used;
+	memcpy(contact->photo_data, res->buffer, contact->photo_length);
+
+	return 0;
+}
+
+/* Downloads the photos over parallel connections, see
+ * \ref gcal_set_photo_concurrency.
+ */
+static int download_photos_multi(struct gcal_resource *gcalobj,
+				 struct gcal_contact **contacts, size_t count)
+{
+	int result = -1;
+	size_t i;
+	struct photo_batch batch;
+	char **urls = NULL;
+
+	batch.gcalobj = gcalobj;
+	batch.contacts = contacts;
+	batch.failed = 0;
+	if (!(urls = malloc(sizeof(char *) * (count + 1))))
+		goto exit;
+
+	for (i = 0; i < count; ++i)
+		urls[i] = contacts[i]->photo;
+
+	result = gcal_multi_get(gcalobj, urls, count,
+				gcalobj->photo_concurrency, 0,
+				"GData-Version: 3.0", store_photo,
+				(void *)&batch);
+	if (batch.failed)
+		result = -1;
+
+	free(urls);
+
+exit:
+	return result;
+}
+
+int gcal_download_photos(struct gcal_resource *gcalobj,
+			 struct gcal_contact **contacts, size_t count)
+{
+	int result = 0;
+	size_t i, pending = 0;
+	struct gcal_contact **ptr = NULL;
+
+	gcal_call_begin(gcalobj);
+	if (!gcalobj || (!contacts && count)) {
+		result = -1;
+		goto exit;
+	}
+
+	/* Only contacts having a photo link which was not fetched yet */
+	if (!(ptr = malloc(sizeof(struct gcal_contact *) * (count + 1)))) {
+		result = -1;
+		goto exit;
+	}
+	for (i = 0; i < count; ++i) {
+		if (contacts[i] && contacts[i]->photo_length &&
+		    contacts[i]->photo && !contacts[i]->photo_data) {
+			if (gcalobj->fout_log)
+				fprintf(gcalobj->fout_log,
+					"contact with photo!\n");
+			ptr[pending++] = contacts[i];
+		} else if (gcalobj->fout_log)
+			fprintf(gcalobj->fout_log, "contact without photo!\n");
+	}
+
+	if (gcalobj->photo_concurrency > 1) {
+		if (pending)
+			result = download_photos_multi(gcalobj, ptr, pending);
+		goto exit;
+	}
+
+	for (i = 0; i < pending; ++i) {
+		if (get_follow_redirection(gcalobj, ptr[i]->photo,
+					   write_cb_binary,
+					   "GData-Version: 3.0")) {
+			clean_buffer(gcalobj);
+			result = -1;
+			continue;
+		}
 
-		if (!ptr_tmp) {
-			if (gcal_ptr->fout_log)
-				fprintf(gcal_ptr->fout_log,
-					"write_cb: Failed relloc!\n");
+		ptr[i]->photo_data = malloc(sizeof(char) * gcalobj->used);
+		if (!ptr[i]->photo_data) {
+			result = -1;
 			goto exit;
 		}
+		ptr[i]->photo_length = gcalobj->used;
+		memcpy(ptr[i]->photo_data, gcalobj->buffer,
+		       ptr[i]->photo_length);
 
-		gcal_ptr->buffer = ptr_tmp;
+		clean_buffer(gcalobj);
 	}
 
-	memcpy(gcal_ptr->buffer + gcal_ptr->previous_length, ptr, size);
-	gcal_ptr->previous_length += size;
+exit:
+	gcal_call_end(gcalobj);
+	free(ptr);
+	return result;
+}
+
+/* Downloads the pictures of a freshly parsed vector of contacts, unless
+ * they are fetched on demand (see \ref gcal_set_lazy_photos).
+ */
+static int download_photos(struct gcal_resource *gcalobj,
+			   struct gcal_contact *contacts, size_t length)
+{
+	int result = -1;
+	size_t i;
+	struct gcal_contact **ptr;
+
+	if (gcalobj->lazy_photos)
+		return 0;
+
+	if (!(ptr = malloc(sizeof(struct gcal_contact *) * (length + 1))))
+		goto exit;
+	for (i = 0; i < length; ++i)
+		ptr[i] = contacts + i;
+
+	result = gcal_download_photos(gcalobj, ptr, length);
+	free(ptr);
 
 exit:
-	return size;
+	return result;
+}
+
+struct gcal_contact *gcal_dump_contacts(struct gcal_resource *gcalobj,
+					const char *url,
+					const char *gdata_version,
+					size_t *length)
+{
+	struct gcal_contact *ptr_res = NULL;
+	struct gcal_pipeline *pipe = NULL;
+
+	gcal_call_begin(gcalobj);
+	if (!gcalobj || !length)
+		goto exit;
+
+	pipe = pipeline_create_contacts(gcalobj->store_xml_entry);
+	if (!pipe)
+		goto exit;
+
+	if (!gcal_dump_pages(gcalobj, pipe, url, gdata_version))
+		ptr_res = pipeline_finish(pipe, length);
+	/* The whole feed is never stored in the buffer */
+	gcalobj->has_xml = 0;
+
+	pipeline_destroy(pipe);
+
+	/* Photos are downloaded after the feed */
+	if (ptr_res)
+		download_photos(gcalobj, ptr_res, *length);
+
+exit:
+	gcal_call_end(gcalobj);
+	return ptr_res;
 }
 
 struct gcal_contact *gcal_get_all_contacts(struct gcal_resource *gcalobj,
@@ -81,6 +253,7 @@ struct gcal_contact *gcal_get_all_contacts(struct gcal_resource *gcalobj,
 	int result = -1;
 	size_t i = 0;
 	struct gcal_contact *ptr_res = NULL;
+	struct gcal_pipeline *pipe = NULL;
 
 	if (!gcalobj)
 		goto exit;
@@ -88,6 +261,19 @@ struct gcal_contact *gcal_get_all_contacts(struct gcal_resource *gcalobj,
 	if (!gcalobj->buffer || !gcalobj->has_xml)
 		goto exit;
 
+	if (gcalobj->reader_mode) {
+		pipe = pipeline_create_contacts(gcalobj->store_xml_entry);
+		if (pipe && !pipeline_read(pipe, gcalobj->buffer,
+					   gcalobj->used))
+			ptr_res = pipeline_finish(pipe, length);
+		pipeline_destroy(pipe);
+
+		/* Check contacts with photo and download the pictures */
+		if (ptr_res)
+			download_photos(gcalobj, ptr_res, *length);
+		goto exit;
+	}
+
 	gcalobj->document = build_dom_document(gcalobj->buffer);
 	if (!gcalobj->document)
 		goto exit;
@@ -116,29 +302,7 @@ struct gcal_contact *gcal_get_all_contacts(struct gcal_resource *gcalobj,
 	}
 
 	/* Check contacts with photo and download the pictures */
-	for (i = 0; i < *length; ++i){
-		if (ptr_res[i].photo_length) {
-			if (gcalobj->fout_log)
-				fprintf(gcalobj->fout_log,
-					"contact with photo!\n");
-
- 			result = get_follow_redirection(gcalobj,
- 							ptr_res[i].photo,
-							write_cb_binary,
-							"GData-Version: 3.0");
-			ptr_res[i].photo_data = malloc(sizeof(char) *
-						       gcalobj->length);
-			if (!ptr_res[i].photo_data)
-				goto exit;
-			ptr_res[i].photo_length = gcalobj->length;
-			memcpy(ptr_res[i].photo_data, gcalobj->buffer,
-			       ptr_res[i].photo_length);
-
-			clean_buffer(gcalobj);
-
-		} else if (gcalobj->fout_log)
-			fprintf(gcalobj->fout_log, "contact without photo!\n");
-	}
+	download_photos(gcalobj, ptr_res, *length);
 	goto exit;
 
 cleanup:
@@ -210,6 +374,10 @@ void gcal_init_contact(struct gcal_contact *contact)
 	contact->blog = NULL;
 	contact->photo = contact->photo_data = NULL;
 	contact->photo_length = 0;
+	contact->photo_read = NULL;
+	contact->photo_read_data = NULL;
+	contact->photo_stream_length = 0;
+	contact->photo_fd = -1;
 	contact->birthday = NULL;
 }
 
@@ -297,6 +465,40 @@ void gcal_destroy_contacts(struct gcal_contact *contacts, size_t length)
 	free(contacts);
 }
 
+/* Uploads the photo set in 'contact' (if any) to the photo link of the
+ * contact as the server has it, streaming it when it is not in memory.
+ */
+static int upload_photo(struct gcal_resource *gcalobj,
+			struct gcal_contact *contact,
+			struct gcal_contact *updated)
+{
+	int result;
+
+	/* Google Data API 2.0 requires ETag */
+	if (contact->photo_read) {
+		result = up_stream(gcalobj, updated->photo, "If-Match: *",
+				   "Content-Type: image/*", contact->photo_read,
+				   contact->photo_read_data,
+				   contact->photo_stream_length,
+				   GCAL_DEFAULT_ANSWER);
+		/* A stream is read once, later updates don't send it */
+		if (!result) {
+			contact->photo_read = NULL;
+			contact->photo_read_data = NULL;
+			contact->photo_stream_length = 0;
+		}
+		return result;
+	}
+
+	if (contact->photo_data && contact->photo_length)
+		return up_entry(contact->photo_data, contact->photo_length,
+				gcalobj, updated->photo, "If-Match: *",
+				PUT, "Content-Type: image/*",
+				GCAL_DEFAULT_ANSWER);
+
+	return 0;
+}
+
 int gcal_create_contact(struct gcal_resource *gcalobj,
 			struct gcal_contact *contact,
 			struct gcal_contact *updated)
@@ -304,8 +506,9 @@ int gcal_create_contact(struct gcal_resource *gcalobj,
 	int result = -1, length;
 	char *xml_contact = NULL, *buffer;
 
+	gcal_call_begin(gcalobj);
 	if ((!contact) || (!gcalobj))
-		return result;
+		goto exit;
 
 	result = xmlcontact_create(contact, &xml_contact, &length);
 	if (result == -1)
@@ -350,16 +553,8 @@ int gcal_create_contact(struct gcal_resource *gcalobj,
 		goto xmlclean;
 
 	/* Adding photo is the same as an edit operation */
-	if (contact->photo_length) {
-		result = up_entry(contact->photo_data, contact->photo_length,
-				  gcalobj, updated->photo,
-				  /* Google Data API 2.0 requires ETag */
-				  "If-Match: *",
-				  PUT, "Content-Type: image/*",
-				  GCAL_DEFAULT_ANSWER);
-		if (result)
-			goto cleanup;
-	}
+	if ((result = upload_photo(gcalobj, contact, updated)))
+		goto cleanup;
 
 	result = 0;
 
@@ -374,6 +569,7 @@ cleanup:
 		free(buffer);
 
 exit:
+	gcal_call_end(gcalobj);
 	return result;
 
 }
@@ -384,6 +580,7 @@ int gcal_delete_contact(struct gcal_resource *gcalobj,
 	int result = -1, length;
 	char *h_auth;
 
+	gcal_call_begin(gcalobj);
 	if (!contact || !gcalobj)
 		goto exit;
 
@@ -397,7 +594,7 @@ int gcal_delete_contact(struct gcal_resource *gcalobj,
 		goto exit;
 	snprintf(h_auth, length - 1, "%s%s", HEADER_GET, gcalobj->auth);
 
-	curl_easy_setopt(gcalobj->curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+	gcal_set_method(gcalobj, "DELETE");
 	result = http_post(gcalobj, contact->common.edit_uri,
 			   "Content-Type: application/atom+xml",
 			   /* Google Data API 2.0 requires ETag */
@@ -407,13 +604,14 @@ int gcal_delete_contact(struct gcal_resource *gcalobj,
 			   "GData-Version: 3.0");
 
 	/* Restores curl context to previous standard mode */
-	curl_easy_setopt(gcalobj->curl, CURLOPT_CUSTOMREQUEST, NULL);
+	gcal_set_method(gcalobj, NULL);
 
 	if (h_auth)
 		free(h_auth);
 
 exit:
 
+	gcal_call_end(gcalobj);
 	return result;
 }
 
@@ -425,6 +623,7 @@ int gcal_edit_contact(struct gcal_resource *gcalobj,
 	int result = -1, length;
 	char *xml_contact = NULL;
 
+	gcal_call_begin(gcalobj);
 	if ((!contact) || (!gcalobj))
 		goto exit;
 
@@ -463,17 +662,8 @@ int gcal_edit_contact(struct gcal_resource *gcalobj,
 		goto xmlclean;
 
 	/* Adding photo is the same as an edit operation */
-	if (contact->photo_length) {
-		result = up_entry(contact->photo_data, contact->photo_length,
-				  gcalobj, updated->photo,
-				  /* Google Data API 2.0 requires ETag */
-				  "If-Match: *",
-				  PUT, "Content-Type: image/*",
-				  GCAL_DEFAULT_ANSWER);
-		if (result)
-			goto cleanup;
-
-	}
+	if ((result = upload_photo(gcalobj, contact, updated)))
+		goto cleanup;
 
 	result = 0;
 
@@ -488,6 +678,7 @@ cleanup:
 		free(xml_contact);
 
 exit:
+	gcal_call_end(gcalobj);
 	return result;
 
 }
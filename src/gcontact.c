@@ -44,6 +44,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include "gcontact.h"
 #include "gcal_parser.h"
 #include "internal_gcal.h"
@@ -139,26 +141,52 @@ void gcal_contact_delete(gcal_contact_t contact)
 int gcal_get_contacts(gcal_t gcalobj, struct gcal_contact_array *contact_array)
 {
 	int result = -1;
-	if (contact_array)
-		contact_array->length = 0;
+	struct gcal_contact *entries;
+	size_t length = 0;
 
-	if ((!gcalobj) || (!contact_array))
-		return result;
+	gcal_call_begin(gcalobj);
+	if ((!gcalobj) || (!contact_array)) {
+		if (contact_array)
+			contact_array->length = 0;
+		goto exit;
+	}
+
+	/* An unchanged feed leaves the previous array untouched */
+	if (gcalobj->pipeline_mode || gcalobj->page_size) {
+		entries = gcal_dump_contacts(gcalobj, NULL,
+					     "GData-Version: 3.0", &length);
+		if (!entries && gcalobj->not_modified) {
+			result = 1;
+			goto exit;
+		}
+		contact_array->entries = entries;
+		contact_array->length = entries ? length : 0;
+		if (entries)
+			result = 0;
+		goto exit;
+	}
 
 	result = gcal_dump(gcalobj, "GData-Version: 3.0");
+	if (result == 1)
+		goto exit;
+	contact_array->length = 0;
 	if (result == -1) {
 		contact_array->entries = NULL;
 		contact_array->length = 0;
-		return result;
+		goto exit;
 	}
 
 	contact_array->entries = gcal_get_all_contacts(gcalobj,
 						       &contact_array->length);
-	if (!contact_array->entries)
-		return result;
+	if (!contact_array->entries) {
+		result = -1;
+		goto exit;
+	}
 
 	result = 0;
 
+exit:
+	gcal_call_end(gcalobj);
 	return result;
 
 }
@@ -275,17 +303,60 @@ exit:
 	return result;
 }
 
+/* Batch feed of some of the contacts, see \ref gcal_batch_entries */
+static int batch_contacts_xml(void *entries, size_t first,
+			      const gcal_batch_op *ops, size_t count,
+			      char **xml, int *length)
+{
+	gcal_contact_t *contacts = (gcal_contact_t *)entries;
+
+	return xmlbatch_contacts_create(contacts + first, ops, count, xml,
+					length);
+}
+
+int gcal_batch_contacts(gcal_t gcalobj, gcal_contact_t *contacts,
+		        gcal_batch_op *ops, size_t length,
+		        struct gcal_batch_result *results)
+{
+	int result = -1;
+
+	if ((!gcalobj) || (!contacts) || strcmp(gcalobj->service, "cp"))
+		goto exit;
+
+	result = gcal_batch_entries(gcalobj, (void *)contacts, ops, length,
+				    results, batch_contacts_xml);
+
+exit:
+	return result;
+}
+
 int gcal_get_updated_contacts(gcal_t gcal_obj,
 			      struct gcal_contact_array *contacts,
 			      char *timestamp)
 {
 	int result = -1;
+	char *url;
 	if (contacts)
 		contacts->length = 0;
 
 	if ((!gcal_obj) || (!contacts))
 		return result;
 
+	if (gcal_obj->pipeline_mode || gcal_obj->page_size) {
+		contacts->entries = NULL;
+		if (!(url = gcal_mount_updated_url(gcal_obj, timestamp)))
+			return result;
+		contacts->entries = gcal_dump_contacts(gcal_obj, url,
+						       "GData-Version: 3.0",
+						       &contacts->length);
+		free(url);
+		if (!contacts->entries) {
+			contacts->length = 0;
+			return result;
+		}
+		return 0;
+	}
+
 	result = gcal_query_updated(gcal_obj, timestamp, "GData-Version: 3.0");
 	if (result) {
 		contacts->entries = NULL;
@@ -735,6 +806,22 @@ unsigned int gcal_contact_get_photolength(gcal_contact_t contact)
 	return contact->photo_length;
 }
 
+int gcal_contact_fetch_photo(gcal_t gcalobj, gcal_contact_t contact)
+{
+	if ((!gcalobj) || (!contact))
+		return -1;
+
+	return gcal_download_photos(gcalobj, &contact, 1);
+}
+
+int gcal_fetch_photos(gcal_t gcalobj, gcal_contact_t *contacts, size_t count)
+{
+	if ((!gcalobj) || (!contacts))
+		return -1;
+
+	return gcal_download_photos(gcalobj, contacts, count);
+}
+
 char *gcal_contact_get_birthday(gcal_contact_t contact)
 {
 	if ((!contact))
@@ -1355,11 +1442,57 @@ int gcal_contact_set_photo(gcal_contact_t contact, const char *field,
 
 	memcpy(contact->photo_data, field, length);
 	contact->photo_length = length;
+	/* The last photo set is the one uploaded */
+	contact->photo_read = NULL;
 	result = 0;
 
 	return result;
 }
 
+int gcal_contact_set_photo_stream(gcal_contact_t contact,
+				  gcal_read_cb read_cb, void *data,
+				  size_t length)
+{
+	if ((!contact) || (read_cb && !length))
+		return -1;
+
+	/* The last photo set is the one uploaded */
+	if (read_cb && contact->photo_data) {
+		if (contact->photo_length > 1)
+			free(contact->photo_data);
+		contact->photo_data = NULL;
+		contact->photo_length = contact->photo ? 1 : 0;
+	}
+
+	contact->photo_read = read_cb;
+	contact->photo_read_data = data;
+	contact->photo_stream_length = read_cb ? length : 0;
+
+	return 0;
+}
+
+static long read_photo_fd(char *buffer, size_t size, void *data)
+{
+	int fd = *(int *)data;
+	ssize_t result;
+
+	do
+		result = read(fd, buffer, size);
+	while ((result < 0) && (errno == EINTR));
+
+	return (long)result;
+}
+
+int gcal_contact_set_photo_fd(gcal_contact_t contact, int fd, size_t length)
+{
+	if ((!contact) || (fd < 0))
+		return -1;
+
+	contact->photo_fd = fd;
+	return gcal_contact_set_photo_stream(contact, read_photo_fd,
+					     &contact->photo_fd, length);
+}
+
 int gcal_contact_set_birthday(gcal_contact_t contact, const char *field)
 {
 	int result = -1;
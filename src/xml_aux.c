@@ -42,6 +42,23 @@ POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "xml_aux.h"
+#include <pthread.h>
+
+/* Text of the fixed expressions, see 'enum xpath_query' */
+static const char *xpath_queries[XPATH_QUERY_NR] = {
+	"//openSearch:totalResults/text()",
+	"//atom:entry",
+	"//atom:entry/gd:reminder",
+	"//atom:entry/gd:when/gd:reminder",
+	"//atom:entry/gd:who"
+};
+
+static xmlXPathCompExpr *xpath_compiled[XPATH_QUERY_NR];
+static pthread_mutex_t xpath_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Each thread has its own context, freed when the thread exits */
+static pthread_key_t xpath_key;
+static pthread_once_t xpath_key_once = PTHREAD_ONCE_INIT;
 
 int register_namespaces(xmlXPathContext *xpathCtx, const xmlChar *name_space,
 			const xmlChar* href)
@@ -64,8 +81,7 @@ int register_namespaces(xmlXPathContext *xpathCtx, const xmlChar *name_space,
 		    register_namespaces(xpathCtx, gContact_ns, gContact_href) ||
 		    register_namespaces(xpathCtx, gcal_ns, gcal_href) ||
 		    register_namespaces(xpathCtx, open_search_ns,
-					open_search_href) ||
-		    register_namespaces(xpathCtx, gContact_ns, gContact_href))
+					open_search_href))
 			goto exit;
 	}
 
@@ -75,6 +91,45 @@ exit:
 
 }
 
+static void free_thread_context(void *context)
+{
+	xmlXPathFreeContext((xmlXPathContext *)context);
+}
+
+static void create_context_key(void)
+{
+	pthread_key_create(&xpath_key, free_thread_context);
+}
+
+static xmlXPathContext *thread_context(xmlDoc *doc)
+{
+	xmlXPathContext *xpathCtx;
+
+	pthread_once(&xpath_key_once, create_context_key);
+	xpathCtx = pthread_getspecific(xpath_key);
+	if (!xpathCtx) {
+		xpathCtx = xmlXPathNewContext(NULL);
+		if (!xpathCtx) {
+			fprintf(stderr,"Error: unable to create new XPath"
+				"context\n");
+			goto exit;
+		}
+
+		if (register_namespaces(xpathCtx, NULL, NULL) ||
+		    pthread_setspecific(xpath_key, xpathCtx)) {
+			xmlXPathFreeContext(xpathCtx);
+			xpathCtx = NULL;
+			goto exit;
+		}
+	}
+
+	xpathCtx->doc = doc;
+	xpathCtx->node = NULL;
+
+exit:
+	return xpathCtx;
+}
+
 xmlXPathObject* execute_xpath_expression(xmlDoc *doc,
 					 const xmlChar* xpathExpr,
 					 xmlXPathContext *xpathCtx)
@@ -83,25 +138,64 @@ xmlXPathObject* execute_xpath_expression(xmlDoc *doc,
 	xmlXPathObject *xpath_obj = NULL;
 	if (!xpathCtx) {
 		ownership = 1;
-		xpathCtx = xmlXPathNewContext(doc);
-		if (xpathCtx == NULL) {
-			fprintf(stderr,"Error: unable to create new XPath"
-				"context\n");
+		if (!(xpathCtx = thread_context(doc)))
 			goto exit;
-		}
-
-		if (register_namespaces(xpathCtx, NULL, NULL))
-				goto exit;
-
 	}
 
 	xpath_obj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
-	if (ownership && (xpathCtx != NULL))
-		xmlXPathFreeContext(xpathCtx);
+	if (ownership)
+		xpathCtx->doc = NULL;
+
+exit:
+	return xpath_obj;
+
+}
+
+xmlXPathObject *execute_xpath_query(xmlDoc *doc, enum xpath_query query)
+{
+	xmlXPathContext *xpathCtx;
+	xmlXPathCompExpr *comp;
+	xmlXPathObject *xpath_obj = NULL;
+
+	if ((unsigned int)query >= XPATH_QUERY_NR)
+		goto exit;
+
+	pthread_mutex_lock(&xpath_lock);
+	if (!xpath_compiled[query])
+		xpath_compiled[query] = xmlXPathCompile(xpath_queries[query]);
+	comp = xpath_compiled[query];
+	pthread_mutex_unlock(&xpath_lock);
+	if (!comp)
+		goto exit;
+
+	if (!(xpathCtx = thread_context(doc)))
+		goto exit;
+
+	xpath_obj = xmlXPathCompiledEval(comp, xpathCtx);
+	xpathCtx->doc = NULL;
 
 exit:
 	return xpath_obj;
+}
+
+void clean_xpath_cache(void)
+{
+	xmlXPathContext *xpathCtx;
+	int i;
+
+	pthread_mutex_lock(&xpath_lock);
+	for (i = 0; i < XPATH_QUERY_NR; ++i)
+		if (xpath_compiled[i]) {
+			xmlXPathFreeCompExpr(xpath_compiled[i]);
+			xpath_compiled[i] = NULL;
+		}
+	pthread_mutex_unlock(&xpath_lock);
 
+	pthread_once(&xpath_key_once, create_context_key);
+	if ((xpathCtx = pthread_getspecific(xpath_key))) {
+		pthread_setspecific(xpath_key, NULL);
+		xmlXPathFreeContext(xpathCtx);
+	}
 }
 
 int xmlentry_init_resources(xmlTextWriter **writer, xmlBuffer **buffer)
@@ -0,0 +1,1697 @@
+/*
+ * @file   gdata_server.c
+ *
+ * @brief  Local stand-in for the Google Data servers, to run the library
+ * (and load benchmarks) on a box with no network access.
+ *
+ * It emulates what libgcal uses of the real services: ClientLogin, the
+ * calendar 'gsessionid' redirection, feeds (paging, 'updated-min',
+ * 'showdeleted' and ETags), creation, edition and deletion of entries
+ * (honoring 'If-Match'), batch operations and contact photos. Entries are
+ * kept in memory, generated or loaded from fixtures like utests/ *.xml.
+ *
+ * Start it and point a library object to it, e.g.:
+ *
+ *   gdata_server -p 8080 -e 500 -c 200 -i utests/images/gromit.jpg
+ *
+ *   gcal_set_base_url(gcal, "http://127.0.0.1:8080");
+ *
+ * Any account is accepted (with the password given by '-w', if any) and
+ * all of them share the same entries. Run it with '-h' for the options.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "xml_aux.h"
+
+static const char AUTH_TOKEN[] = "gdata-server-token";
+static const char EVENT_KIND[] = "http://schemas.google.com/g/2005#event";
+static const char CONTACT_KIND[] =
+	"http://schemas.google.com/contact/2008#contact";
+static const char PHOTO_REL[] =
+	"http://schemas.google.com/contacts/2008/rel#photo";
+static const char CANCELED[] =
+	"http://schemas.google.com/g/2005#event.canceled";
+/* Google default page size */
+static const long DEFAULT_PAGE = 25;
+
+/** Growing string, answers are built on it */
+struct text {
+	char *data;
+	size_t used;
+	size_t size;
+};
+
+/** An entry, kept as a document and also serialized (feeds are served
+ * from the text).
+ */
+struct entry {
+	char key[24];
+	unsigned long version;
+	char deleted;
+	time_t published;
+	time_t updated;
+	xmlDoc *doc;
+	char *xml;
+	/** Contact photo (can be NULL) */
+	char *photo;
+	size_t photo_length;
+	unsigned long photo_version;
+	struct entry *prev, *next;
+};
+
+/** Entries of a service, in modification order (i.e. the last modified
+ * is the last one).
+ */
+struct collection {
+	/** Feed path, entries have their key appended to it */
+	const char *path;
+	const char *kind;
+	const char *title;
+	const char *key_prefix;
+	struct entry *first, *last;
+	/** Changes on every modification, it makes the feed ETag */
+	unsigned long version;
+};
+
+struct request {
+	char *head;
+	char *method;
+	char *path;
+	char *query;
+	char *authorization;
+	char *if_match;
+	char *if_none_match;
+	char *expect;
+	char *body;
+	size_t length;
+	char close;
+};
+
+struct connection {
+	int fd;
+	struct text in;
+	struct text out;
+	size_t sent;
+	/** Time (in ms) when the answer can be sent, see '-d' */
+	long long ready;
+	char close;
+	char continued;
+	struct connection *next;
+};
+
+struct server {
+	char base[64];
+	/** Account (e.g. "user%40example.com") of the last login */
+	char account[256];
+	char session[32];
+	unsigned long session_count;
+	unsigned long session_uses;
+	unsigned long session_limit;
+	const char *password;
+	int delay;
+	int verbose;
+	char *photo;
+	size_t photo_length;
+	const char *photo_type;
+	unsigned long keys;
+	struct collection events;
+	struct collection contacts;
+};
+
+static volatile sig_atomic_t stop;
+
+static void fatal(const char *message)
+{
+	fprintf(stderr, "gdata_server: %s\n", message);
+	exit(1);
+}
+
+static long long now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void text_reserve(struct text *t, size_t more)
+{
+	char *ptr;
+	size_t size;
+
+	if (t->used + more + 1 <= t->size)
+		return;
+
+	size = t->size ? t->size : 1024;
+	while (size < t->used + more + 1)
+		size *= 2;
+	if (!(ptr = realloc(t->data, size)))
+		fatal("out of memory");
+	t->data = ptr;
+	t->size = size;
+}
+
+static void text_append(struct text *t, const char *data, size_t length)
+{
+	text_reserve(t, length);
+	memcpy(t->data + t->used, data, length);
+	t->used += length;
+	t->data[t->used] = '\0';
+}
+
+static void text_printf(struct text *t, const char *format, ...)
+{
+	va_list ap;
+	int length;
+
+	va_start(ap, format);
+	length = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	if (length < 0)
+		fatal("bad format");
+
+	text_reserve(t, length);
+	va_start(ap, format);
+	vsnprintf(t->data + t->used, length + 1, format, ap);
+	va_end(ap);
+	t->used += length;
+}
+
+/* Appends a string escaped for XML attributes and text */
+static void text_escaped(struct text *t, const char *data)
+{
+	for (; *data; ++data)
+		switch (*data) {
+		case '&':
+			text_append(t, "&amp;", 5);
+			break;
+		case '<':
+			text_append(t, "&lt;", 4);
+			break;
+		case '>':
+			text_append(t, "&gt;", 4);
+			break;
+		case '\'':
+			text_append(t, "&apos;", 6);
+			break;
+		case '"':
+			text_append(t, "&quot;", 6);
+			break;
+		default:
+			text_append(t, data, 1);
+		}
+}
+
+static void text_consume(struct text *t, size_t length)
+{
+	memmove(t->data, t->data + length, t->used - length);
+	t->used -= length;
+	t->data[t->used] = '\0';
+}
+
+static void format_time(time_t value, char *buffer, size_t length)
+{
+	struct tm tm;
+
+	gmtime_r(&value, &tm);
+	strftime(buffer, length, "%Y-%m-%dT%H:%M:%S.000Z", &tm);
+}
+
+/* Parses a RFC 3339 timestamp (e.g. "2008-06-18T15:06:06.000-04:00") */
+static int parse_time(const char *text, time_t *value)
+{
+	struct tm tm;
+	int offset = 0, hours, minutes;
+	const char *ptr;
+
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon,
+		   &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+		/* Just a date */
+		if (sscanf(text, "%4d-%2d-%2d", &tm.tm_year, &tm.tm_mon,
+			   &tm.tm_mday) != 3)
+			return -1;
+	}
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+
+	if ((ptr = strpbrk(text + 10, "+- Z")) && (*ptr != 'Z') &&
+	    (sscanf(ptr + 1, "%2d:%2d", &hours, &minutes) == 2)) {
+		offset = hours * 3600 + minutes * 60;
+		/* A '+' may arrive as a space, from the query string */
+		if (*ptr == '-')
+			offset = -offset;
+	}
+
+	*value = timegm(&tm) - offset;
+	return 0;
+}
+
+/* Decodes the URL encoding (i.e. '%xx') of a string, in place */
+static char *url_decode(char *text)
+{
+	char *in, *out, hex[3] = { 0, 0, 0 };
+
+	for (in = out = text; *in; ++out) {
+		if ((in[0] == '%') && in[1] && in[2]) {
+			hex[0] = in[1];
+			hex[1] = in[2];
+			*out = (char)strtol(hex, NULL, 16);
+			in += 3;
+		} else
+			*out = *in++;
+	}
+	*out = '\0';
+
+	return text;
+}
+
+/* Returns a (decoded) copy of a parameter of a query string, or of a
+ * form (e.g. "Email=a&Passwd=b").
+ */
+static char *query_param(const char *query, const char *name)
+{
+	size_t length = strlen(name);
+	const char *ptr, *end;
+
+	for (ptr = query; ptr && *ptr; ptr = end + (*end == '&')) {
+		end = ptr + strcspn(ptr, "&");
+		if (!strncmp(ptr, name, length) && (ptr[length] == '='))
+			return url_decode(strndup(ptr + length + 1,
+						  end - ptr - length - 1));
+	}
+
+	return NULL;
+}
+
+static long query_number(const char *query, const char *name, long value)
+{
+	char *text;
+
+	if ((text = query_param(query, name))) {
+		value = strtol(text, NULL, 10);
+		free(text);
+	}
+
+	return value;
+}
+
+static const char *reason_phrase(int code)
+{
+	switch (code) {
+	case 200: return "OK";
+	case 201: return "Created";
+	case 302: return "Moved Temporarily";
+	case 304: return "Not Modified";
+	case 400: return "Bad Request";
+	case 401: return "Unauthorized";
+	case 403: return "Forbidden";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 409: return "Conflict";
+	case 412: return "Precondition Failed";
+	default: return "Internal Server Error";
+	}
+}
+
+/* Writes an answer, 'headers' are extra header lines (each one ending
+ * with "\r\n").
+ */
+static void answer(struct text *out, int code, const char *type,
+		   const char *headers, const char *body, size_t length)
+{
+	text_printf(out, "HTTP/1.1 %d %s\r\n", code, reason_phrase(code));
+	if (type)
+		text_printf(out, "Content-Type: %s\r\n", type);
+	if (headers)
+		text_append(out, headers, strlen(headers));
+	text_printf(out, "Content-Length: %lu\r\n\r\n", (unsigned long)length);
+	if (length)
+		text_append(out, body, length);
+}
+
+static void answer_text(struct text *out, int code, const char *message)
+{
+	answer(out, code, "text/plain; charset=UTF-8", NULL, message,
+	       strlen(message));
+}
+
+static void answer_xml(struct text *out, int code, const char *headers,
+		       struct text *xml)
+{
+	answer(out, code, "application/atom+xml; charset=UTF-8", headers,
+	       xml->data, xml->used);
+}
+
+
+/* Entries */
+
+static int is_element(xmlNode *node, const char *href, const char *name)
+{
+	return (node->type == XML_ELEMENT_NODE) &&
+		!xmlStrcmp(node->name, BAD_CAST name) &&
+		(!href || (node->ns && !xmlStrcmp(node->ns->href,
+						  BAD_CAST href)));
+}
+
+static int is_link(xmlNode *node, const char *rel)
+{
+	xmlChar *value;
+	int result;
+
+	if (!is_element(node, atom_href, "link"))
+		return 0;
+	if (!(value = xmlGetProp(node, BAD_CAST "rel")))
+		return 0;
+	result = !xmlStrcmp(value, BAD_CAST rel);
+	xmlFree(value);
+
+	return result;
+}
+
+static xmlNs *namespace(xmlNode *root, const char *href, const char *prefix)
+{
+	xmlNs *ns;
+
+	if ((ns = xmlSearchNsByHref(root->doc, root, BAD_CAST href)))
+		return ns;
+
+	return xmlNewNs(root, BAD_CAST href, BAD_CAST prefix);
+}
+
+static void entry_url(struct server *srv, struct collection *coll,
+		      struct entry *e, struct text *t)
+{
+	text_printf(t, "%s%s/%s", srv->base, coll->path, e->key);
+}
+
+static void photo_url(struct server *srv, struct entry *e, struct text *t)
+{
+	text_printf(t, "%s/m8/feeds/photos/media/default/%s", srv->base,
+		    e->key);
+}
+
+static void entry_etag(struct entry *e, char *buffer, size_t length)
+{
+	snprintf(buffer, length, "\"%s.%lu\"", e->key, e->version);
+}
+
+static xmlNode *add_link(xmlNode *root, xmlNode *before, const char *rel,
+			 const char *type, const char *href)
+{
+	xmlNode *link;
+
+	link = xmlNewDocNode(root->doc, root->ns, BAD_CAST "link", NULL);
+	xmlSetProp(link, BAD_CAST "rel", BAD_CAST rel);
+	xmlSetProp(link, BAD_CAST "type", BAD_CAST type);
+	xmlSetProp(link, BAD_CAST "href", BAD_CAST href);
+
+	return before ? xmlAddPrevSibling(before, link) :
+		xmlAddChild(root, link);
+}
+
+/* Sets the fields owned by the server (ID, timestamps, links and ETag) and
+ * serializes the entry.
+ */
+static void stamp_entry(struct server *srv, struct collection *coll,
+			struct entry *e)
+{
+	xmlNode *root = xmlDocGetRootElement(e->doc), *node, *next, *first;
+	xmlBuffer *buffer;
+	struct text url = { NULL, 0, 0 };
+	char stamp[64], etag[64];
+	char contact = (coll == &srv->contacts);
+	xmlNs *gd = namespace(root, gd_href, gd_ns);
+
+	for (node = root->children; node; node = next) {
+		next = node->next;
+		if (is_element(node, atom_href, "id") ||
+		    is_element(node, atom_href, "updated") ||
+		    is_element(node, atom_href, "published") ||
+		    is_element(node, NULL, "edited") ||
+		    is_element(node, gd_href, "deleted") ||
+		    is_element(node, batch_href, "id") ||
+		    is_element(node, batch_href, "operation") ||
+		    is_element(node, batch_href, "status") ||
+		    is_link(node, "self") || is_link(node, "edit") ||
+		    is_link(node, PHOTO_REL)) {
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		} else if (e->deleted && !contact &&
+			   is_element(node, gd_href, "eventStatus"))
+			xmlSetProp(node, BAD_CAST "value", BAD_CAST CANCELED);
+	}
+
+	first = root->children;
+	entry_url(srv, coll, e, &url);
+	node = xmlNewDocNode(e->doc, root->ns, BAD_CAST "id",
+			     BAD_CAST url.data);
+	first = first ? xmlAddPrevSibling(first, node) : xmlAddChild(root, node);
+	first = first->next;
+
+	if (!contact) {
+		format_time(e->published, stamp, sizeof(stamp));
+		node = xmlNewDocNode(e->doc, root->ns, BAD_CAST "published",
+				     BAD_CAST stamp);
+		first ? xmlAddPrevSibling(first, node) : xmlAddChild(root, node);
+	}
+	format_time(e->updated, stamp, sizeof(stamp));
+	node = xmlNewDocNode(e->doc, root->ns, BAD_CAST "updated",
+			     BAD_CAST stamp);
+	first ? xmlAddPrevSibling(first, node) : xmlAddChild(root, node);
+
+	add_link(root, first, "self", "application/atom+xml", url.data);
+	add_link(root, first, "edit", "application/atom+xml", url.data);
+	if (contact) {
+		url.used = 0;
+		photo_url(srv, e, &url);
+		node = add_link(root, first, PHOTO_REL, "image/*", url.data);
+		/* The ETag tells that the contact has a photo */
+		if (e->photo) {
+			snprintf(etag, sizeof(etag), "\"p%s.%lu\"", e->key,
+				 e->photo_version);
+			xmlSetNsProp(node, gd, BAD_CAST "etag", BAD_CAST etag);
+		}
+		if (e->deleted)
+			xmlNewChild(root, gd, BAD_CAST "deleted", NULL);
+	}
+
+	entry_etag(e, etag, sizeof(etag));
+	xmlSetNsProp(root, gd, BAD_CAST "etag", BAD_CAST etag);
+
+	if (!(buffer = xmlBufferCreate()))
+		fatal("out of memory");
+	xmlNodeDump(buffer, e->doc, root, 0, 0);
+	free(e->xml);
+	if (!(e->xml = strdup((const char *)xmlBufferContent(buffer))))
+		fatal("out of memory");
+	xmlBufferFree(buffer);
+	free(url.data);
+}
+
+/* Makes a document of its own for an entry node */
+static xmlDoc *entry_document(xmlNode *node)
+{
+	xmlDoc *doc;
+	xmlNode *copy;
+
+	if (!(doc = xmlNewDoc(BAD_CAST "1.0")))
+		fatal("out of memory");
+	if (!(copy = xmlDocCopyNode(node, doc, 1)))
+		fatal("out of memory");
+	xmlDocSetRootElement(doc, copy);
+	xmlReconciliateNs(doc, copy);
+
+	return doc;
+}
+
+static void link_last(struct collection *coll, struct entry *e)
+{
+	e->next = NULL;
+	e->prev = coll->last;
+	if (coll->last)
+		coll->last->next = e;
+	else
+		coll->first = e;
+	coll->last = e;
+}
+
+static void unlink_entry(struct collection *coll, struct entry *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		coll->first = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		coll->last = e->prev;
+}
+
+/* Takes ownership of 'doc' */
+static struct entry *insert_entry(struct server *srv, struct collection *coll,
+				  xmlDoc *doc)
+{
+	struct entry *e;
+
+	if (!(e = calloc(1, sizeof(struct entry))))
+		fatal("out of memory");
+	snprintf(e->key, sizeof(e->key), "%s%lu", coll->key_prefix,
+		 ++srv->keys);
+	e->version = 1;
+	e->published = e->updated = time(NULL);
+	e->doc = doc;
+	if (coll == &srv->contacts && srv->photo) {
+		if (!(e->photo = malloc(srv->photo_length)))
+			fatal("out of memory");
+		memcpy(e->photo, srv->photo, srv->photo_length);
+		e->photo_length = srv->photo_length;
+		e->photo_version = 1;
+	}
+	stamp_entry(srv, coll, e);
+	link_last(coll, e);
+	++coll->version;
+
+	return e;
+}
+
+/* Replaces the entry document (if 'doc' is not NULL) and moves the entry
+ * to the end, as the last modified one.
+ */
+static void touch_entry(struct server *srv, struct collection *coll,
+			struct entry *e, xmlDoc *doc)
+{
+	if (doc) {
+		xmlFreeDoc(e->doc);
+		e->doc = doc;
+	}
+	++e->version;
+	e->updated = time(NULL);
+	stamp_entry(srv, coll, e);
+	unlink_entry(coll, e);
+	link_last(coll, e);
+	++coll->version;
+}
+
+static void free_entries(struct collection *coll)
+{
+	struct entry *e, *next;
+
+	for (e = coll->first; e; e = next) {
+		next = e->next;
+		xmlFreeDoc(e->doc);
+		free(e->xml);
+		free(e->photo);
+		free(e);
+	}
+	coll->first = coll->last = NULL;
+}
+
+static struct entry *find_entry(struct collection *coll, const char *key,
+				size_t length)
+{
+	struct entry *e;
+
+	for (e = coll->first; e; e = e->next)
+		if ((strlen(e->key) == length) && !strncmp(e->key, key, length))
+			return e;
+
+	return NULL;
+}
+
+/* Finds the entry of a URL (an ID or edit link, which can have a version
+ * appended, e.g. ".../full/ev12/63349499166").
+ */
+static struct entry *find_url(struct collection *coll, const char *url)
+{
+	const char *key;
+
+	if (!url || !(key = strstr(url, coll->path)))
+		return NULL;
+	key += strlen(coll->path);
+	if (*key++ != '/')
+		return NULL;
+
+	return find_entry(coll, key, strcspn(key, "/?"));
+}
+
+static struct entry *find_node(struct collection *coll, xmlNode *root)
+{
+	struct entry *e = NULL;
+	xmlNode *node;
+	xmlChar *value;
+
+	for (node = root->children; node && !e; node = node->next) {
+		value = NULL;
+		if (is_link(node, "edit"))
+			value = xmlGetProp(node, BAD_CAST "href");
+		else if (is_element(node, atom_href, "id"))
+			value = xmlNodeGetContent(node);
+		if (value) {
+			e = find_url(coll, (char *)value);
+			xmlFree(value);
+		}
+	}
+
+	return e;
+}
+
+/* An 'If-Match' value (or an entry ETag) allows the change if it is '*'
+ * or the current ETag.
+ */
+static int etag_matches(struct entry *e, const char *value)
+{
+	char etag[64];
+
+	if (!value || !strcmp(value, "*"))
+		return 1;
+	entry_etag(e, etag, sizeof(etag));
+	if (!strncmp(value, "W/", 2))
+		value += 2;
+
+	return !strcmp(value, etag);
+}
+
+static xmlDoc *parse_entry(const char *data, size_t length)
+{
+	xmlDoc *doc;
+	xmlNode *root;
+
+	if (!(doc = xmlReadMemory(data, length, NULL, NULL,
+				  XML_PARSE_NONET | XML_PARSE_NOWARNING |
+				  XML_PARSE_NOERROR)))
+		return NULL;
+
+	root = xmlDocGetRootElement(doc);
+	if (!root || !is_element(root, atom_href, "entry")) {
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+
+	return doc;
+}
+
+
+/* Fixtures */
+
+static void generate(struct server *srv, struct collection *coll,
+		     unsigned long count)
+{
+	struct text t = { NULL, 0, 0 };
+	unsigned long i;
+	xmlDoc *doc;
+
+	for (i = 1; i <= count; ++i) {
+		t.used = 0;
+		if (coll == &srv->events)
+			text_printf(&t,
+				    "<entry xmlns='%s' xmlns:gd='%s' "
+				    "xmlns:gCal='%s'>"
+				    "<category scheme='http://schemas.google."
+				    "com/g/2005#kind' term='%s'/>"
+				    "<title type='text'>Event %lu</title>"
+				    "<content type='text'>Generated event "
+				    "number %lu</content>"
+				    "<gd:eventStatus value='http://schemas."
+				    "google.com/g/2005#event.confirmed'/>"
+				    "<gd:visibility value='http://schemas."
+				    "google.com/g/2005#event.default'/>"
+				    "<gd:transparency value='http://schemas."
+				    "google.com/g/2005#event.opaque'/>"
+				    "<gd:when startTime='2008-%02lu-%02luT10:00"
+				    ":00.000Z' endTime='2008-%02lu-%02luT11:00"
+				    ":00.000Z'/>"
+				    "<gd:where valueString='Room %lu'/>"
+				    "</entry>", atom_href, gd_href, gcal_href,
+				    EVENT_KIND, i, i, i % 12 + 1, i % 28 + 1,
+				    i % 12 + 1, i % 28 + 1, i % 100);
+		else
+			text_printf(&t,
+				    "<entry xmlns='%s' xmlns:gd='%s' "
+				    "xmlns:gContact='%s'>"
+				    "<category scheme='http://schemas.google."
+				    "com/g/2005#kind' term='%s'/>"
+				    "<title>Contact %lu</title>"
+				    "<content>Generated contact number %lu"
+				    "</content>"
+				    "<gd:email rel='http://schemas.google.com/"
+				    "g/2005#work' address='contact%lu@example."
+				    "com' primary='true'/>"
+				    "<gd:phoneNumber rel='http://schemas.google."
+				    "com/g/2005#mobile'>+1 555 %04lu"
+				    "</gd:phoneNumber>"
+				    "<gd:organization rel='http://schemas."
+				    "google.com/g/2005#work'><gd:orgName>"
+				    "Example</gd:orgName><gd:orgTitle>Tester"
+				    "</gd:orgTitle></gd:organization>"
+				    "<gd:postalAddress rel='http://schemas."
+				    "google.com/g/2005#home'>%lu Main St"
+				    "</gd:postalAddress>"
+				    "</entry>", atom_href, gd_href,
+				    gContact_href, CONTACT_KIND, i, i, i,
+				    i % 10000, i);
+
+		if (!(doc = parse_entry(t.data, t.used)))
+			fatal("bad generated entry");
+		insert_entry(srv, coll, doc);
+	}
+
+	free(t.data);
+}
+
+/* Loads the entries of a feed (or a single entry) file */
+static void load(struct server *srv, struct collection *coll,
+		 const char *path)
+{
+	xmlDoc *doc;
+	xmlNode *root, *node;
+
+	if (!(doc = xmlReadFile(path, NULL, XML_PARSE_NONET)))
+		fatal("can't load fixture");
+	if (!(root = xmlDocGetRootElement(doc)))
+		fatal("empty fixture");
+
+	if (is_element(root, atom_href, "entry"))
+		insert_entry(srv, coll, entry_document(root));
+	else
+		for (node = root->children; node; node = node->next)
+			if (is_element(node, atom_href, "entry"))
+				insert_entry(srv, coll, entry_document(node));
+
+	xmlFreeDoc(doc);
+}
+
+static char *read_all(const char *path, size_t *length)
+{
+	FILE *file;
+	char *data;
+	long size;
+
+	if (!(file = fopen(path, "rb")))
+		fatal("can't open photo");
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	if ((size <= 0) || !(data = malloc(size)) ||
+	    (fread(data, 1, size, file) != (size_t)size))
+		fatal("can't read photo");
+	fclose(file);
+	*length = size;
+
+	return data;
+}
+
+
+/* Requests */
+
+static void feed_start(struct server *srv, struct collection *coll,
+		       struct text *t, const char *etag)
+{
+	char stamp[64];
+
+	format_time(time(NULL), stamp, sizeof(stamp));
+	text_printf(t, "<?xml version='1.0' encoding='UTF-8'?>\n"
+		    "<feed xmlns='%s' xmlns:openSearch='%s' xmlns:gd='%s' "
+		    "xmlns:gCal='%s' xmlns:gContact='%s' xmlns:batch='%s'",
+		    atom_href, open_search_href, gd_href, gcal_href,
+		    gContact_href, batch_href);
+	if (etag) {
+		text_append(t, " gd:etag='", 10);
+		text_escaped(t, etag);
+		text_append(t, "'", 1);
+	}
+	text_printf(t, "><id>%s%s</id><updated>%s</updated>"
+		    "<category scheme='http://schemas.google.com/g/2005#kind'"
+		    " term='%s'/><title type='text'>%s</title>"
+		    "<link rel='http://schemas.google.com/g/2005#feed' "
+		    "type='application/atom+xml' href='%s%s'/>"
+		    "<link rel='http://schemas.google.com/g/2005#post' "
+		    "type='application/atom+xml' href='%s%s'/>"
+		    "<link rel='http://schemas.google.com/g/2005#batch' "
+		    "type='application/atom+xml' href='%s%s/batch'/>",
+		    srv->base, coll->path, stamp, coll->kind, coll->title,
+		    srv->base, coll->path, srv->base, coll->path, srv->base,
+		    coll->path);
+}
+
+/* Link to the same feed, with another 'start-index' */
+static void page_link(struct server *srv, struct request *req,
+		      struct text *t, const char *rel, long start)
+{
+	const char *ptr, *end;
+	char *param;
+
+	text_printf(t, "<link rel='%s' type='application/atom+xml' "
+		    "href='%s", rel, srv->base);
+	text_escaped(t, req->path);
+	text_append(t, "?", 1);
+	for (ptr = req->query; ptr && *ptr; ptr = end + (*end == '&')) {
+		end = ptr + strcspn(ptr, "&");
+		if (!strncmp(ptr, "start-index=", 12) || (end == ptr))
+			continue;
+		if (!(param = strndup(ptr, end - ptr)))
+			fatal("out of memory");
+		text_escaped(t, param);
+		text_append(t, "&amp;", 5);
+		free(param);
+	}
+	text_printf(t, "start-index=%ld'/>", start);
+}
+
+static void get_feed(struct server *srv, struct collection *coll,
+		     struct request *req, struct text *out)
+{
+	struct text t = { NULL, 0, 0 }, headers = { NULL, 0, 0 };
+	long max = query_number(req->query, "max-results", DEFAULT_PAGE);
+	long start = query_number(req->query, "start-index", 1);
+	long total = 0, shown = 0;
+	char *value, etag[96];
+	char show_deleted = 0;
+	time_t updated_min = 0;
+	struct entry *e;
+
+	if ((value = query_param(req->query, "showdeleted"))) {
+		show_deleted = !strcmp(value, "true");
+		free(value);
+	}
+	if ((value = query_param(req->query, "updated-min"))) {
+		if (parse_time(value, &updated_min))
+			updated_min = 0;
+		free(value);
+	}
+	if (max < 1)
+		max = DEFAULT_PAGE;
+	if (start < 1)
+		start = 1;
+
+	/* Any change of the feed (or of the query) changes it */
+	snprintf(etag, sizeof(etag), "W/\"%lu.%ld.%ld.%d.%ld\"",
+		 coll->version, start, max, show_deleted, (long)updated_min);
+	if (req->if_none_match && !strcmp(req->if_none_match, etag)) {
+		text_printf(&headers, "ETag: %s\r\n", etag);
+		answer(out, 304, NULL, headers.data, NULL, 0);
+		free(headers.data);
+		return;
+	}
+
+	for (e = coll->first; e; e = e->next)
+		if ((!e->deleted || show_deleted) && (e->updated >= updated_min))
+			++total;
+
+	feed_start(srv, coll, &t, etag);
+	page_link(srv, req, &t, "self", start);
+	if (start + max <= total)
+		page_link(srv, req, &t, "next", start + max);
+	text_printf(&t, "<openSearch:totalResults>%ld</openSearch:"
+		    "totalResults><openSearch:startIndex>%ld</openSearch:"
+		    "startIndex><openSearch:itemsPerPage>%ld</openSearch:"
+		    "itemsPerPage>", total, start, max);
+
+	for (e = coll->first, total = 0; e && (shown < max); e = e->next) {
+		if ((e->deleted && !show_deleted) || (e->updated < updated_min))
+			continue;
+		if (++total < start)
+			continue;
+		text_append(&t, e->xml, strlen(e->xml));
+		++shown;
+	}
+	text_append(&t, "</feed>", 7);
+
+	text_printf(&headers, "ETag: %s\r\n", etag);
+	answer_xml(out, 200, headers.data, &t);
+	free(headers.data);
+	free(t.data);
+}
+
+static void answer_entry(struct text *out, int code, struct entry *e)
+{
+	struct text t = { NULL, 0, 0 }, headers = { NULL, 0, 0 };
+	char etag[64];
+
+	entry_etag(e, etag, sizeof(etag));
+	text_printf(&headers, "ETag: %s\r\n", etag);
+	text_printf(&t, "<?xml version='1.0' encoding='UTF-8'?>\n%s", e->xml);
+	answer_xml(out, code, headers.data, &t);
+	free(t.data);
+	free(headers.data);
+}
+
+static void calendar_list(struct server *srv, struct text *out)
+{
+	struct text t = { NULL, 0, 0 };
+	struct collection list = { "/calendar/feeds/default/allcalendars/full",
+				   "http://schemas.google.com/gCal/2005#"
+				   "calendarmeta", "Calendars", "", NULL,
+				   NULL, 0 };
+
+	feed_start(srv, &list, &t, NULL);
+	text_printf(&t, "<openSearch:totalResults>1</openSearch:"
+		    "totalResults><openSearch:startIndex>1</openSearch:"
+		    "startIndex><entry>"
+		    "<id>%s/calendar/feeds/default/calendars/%s</id>"
+		    "<title type='text'>Stand-in calendar</title>"
+		    "<link rel='alternate' type='application/atom+xml' "
+		    "href='%s%s'/><gCal:timezone value='UTC'/>"
+		    "<gCal:accesslevel value='owner'/></entry></feed>",
+		    srv->base, srv->account, srv->base, srv->events.path);
+	answer_xml(out, 200, NULL, &t);
+	free(t.data);
+}
+
+static void add_batch_status(xmlNode *entry, xmlNs *ns, const char *id,
+			     const char *operation, int code)
+{
+	xmlNode *node;
+	char value[16];
+
+	xmlNewChild(entry, ns, BAD_CAST "id", BAD_CAST id);
+	node = xmlNewChild(entry, ns, BAD_CAST "operation", NULL);
+	xmlSetProp(node, BAD_CAST "type", BAD_CAST operation);
+	node = xmlNewChild(entry, ns, BAD_CAST "status", NULL);
+	snprintf(value, sizeof(value), "%d", code);
+	xmlSetProp(node, BAD_CAST "code", BAD_CAST value);
+	xmlSetProp(node, BAD_CAST "reason", BAD_CAST reason_phrase(code));
+}
+
+static void batch(struct server *srv, struct collection *coll,
+		  struct request *req, struct text *out)
+{
+	xmlDoc *doc, *answer_doc;
+	xmlNode *root, *node, *child, *answer_root, *result;
+	xmlNs *ns;
+	xmlChar *id, *operation, *etag;
+	struct entry *e;
+	struct text t = { NULL, 0, 0 };
+	xmlChar *dump;
+	int code, length;
+
+	if (!(doc = xmlReadMemory(req->body, req->length, NULL, NULL,
+				  XML_PARSE_NONET | XML_PARSE_NOWARNING |
+				  XML_PARSE_NOERROR)) ||
+	    !(root = xmlDocGetRootElement(doc))) {
+		if (doc)
+			xmlFreeDoc(doc);
+		answer_text(out, 400, "Invalid batch feed");
+		return;
+	}
+
+	answer_doc = xmlNewDoc(BAD_CAST "1.0");
+	answer_root = xmlNewNode(NULL, BAD_CAST "feed");
+	xmlDocSetRootElement(answer_doc, answer_root);
+	xmlSetNs(answer_root, xmlNewNs(answer_root, BAD_CAST atom_href, NULL));
+	ns = xmlNewNs(answer_root, BAD_CAST batch_href, BAD_CAST batch_ns);
+	xmlNewNs(answer_root, BAD_CAST gd_href, BAD_CAST gd_ns);
+
+	for (node = root->children; node; node = node->next) {
+		if (!is_element(node, atom_href, "entry"))
+			continue;
+		id = operation = NULL;
+		for (child = node->children; child; child = child->next) {
+			if (is_element(child, batch_href, "id") && !id)
+				id = xmlNodeGetContent(child);
+			else if (is_element(child, batch_href, "operation") &&
+				 !operation)
+				operation = xmlGetProp(child, BAD_CAST "type");
+		}
+		if (!operation)
+			operation = xmlStrdup(BAD_CAST "insert");
+
+		e = NULL;
+		code = 400;
+		if (!xmlStrcmp(operation, BAD_CAST "insert")) {
+			e = insert_entry(srv, coll, entry_document(node));
+			code = 201;
+		} else if (!(e = find_node(coll, node)) || e->deleted) {
+			e = NULL;
+			code = 404;
+		} else {
+			etag = xmlGetNsProp(node, BAD_CAST "etag",
+					    BAD_CAST gd_href);
+			if (!etag_matches(e, (char *)etag))
+				code = 409;
+			else if (!xmlStrcmp(operation, BAD_CAST "update")) {
+				touch_entry(srv, coll, e,
+					    entry_document(node));
+				code = 200;
+			} else if (!xmlStrcmp(operation, BAD_CAST "delete")) {
+				e->deleted = 1;
+				touch_entry(srv, coll, e, NULL);
+				code = 200;
+			}
+			if (etag)
+				xmlFree(etag);
+		}
+
+		/* The answer has the entry (as stored), plus the status */
+		if (e && (code < 300))
+			result = xmlDocCopyNode(xmlDocGetRootElement(e->doc),
+						answer_doc, 1);
+		else
+			result = xmlNewDocNode(answer_doc, answer_root->ns,
+					       BAD_CAST "entry", NULL);
+		xmlAddChild(answer_root, result);
+		add_batch_status(result, ns, id ? (char *)id : "",
+				 (char *)operation, code);
+		if (id)
+			xmlFree(id);
+		xmlFree(operation);
+	}
+
+	xmlReconciliateNs(answer_doc, answer_root);
+	xmlDocDumpMemoryEnc(answer_doc, &dump, &length, "UTF-8");
+	text_append(&t, (char *)dump, length);
+	answer_xml(out, 200, NULL, &t);
+
+	xmlFree(dump);
+	free(t.data);
+	xmlFreeDoc(answer_doc);
+	xmlFreeDoc(doc);
+}
+
+/* Requests on a collection: 'rest' is what follows its feed path */
+static void collection_request(struct server *srv, struct collection *coll,
+			       struct request *req, const char *rest,
+			       struct text *out)
+{
+	struct entry *e;
+	xmlDoc *doc;
+	size_t length;
+
+	if (!*rest) {
+		if (!strcmp(req->method, "GET"))
+			get_feed(srv, coll, req, out);
+		else if (!strcmp(req->method, "POST")) {
+			if (!(doc = parse_entry(req->body, req->length)))
+				answer_text(out, 400, "Invalid entry");
+			else
+				answer_entry(out, 201,
+					     insert_entry(srv, coll, doc));
+		} else
+			answer_text(out, 405, "Method not allowed");
+		return;
+	}
+
+	++rest;
+	if (!strcmp(rest, "batch")) {
+		if (!strcmp(req->method, "POST"))
+			batch(srv, coll, req, out);
+		else
+			answer_text(out, 405, "Method not allowed");
+		return;
+	}
+
+	length = strcspn(rest, "/");
+	if (!(e = find_entry(coll, rest, length)) || e->deleted) {
+		answer_text(out, 404, "Entry not found");
+		return;
+	}
+
+	if (!strcmp(req->method, "GET"))
+		answer_entry(out, 200, e);
+	else if (!etag_matches(e, req->if_match))
+		answer_text(out, 412, "Mismatch: etags");
+	else if (!strcmp(req->method, "PUT")) {
+		if (!(doc = parse_entry(req->body, req->length)))
+			answer_text(out, 400, "Invalid entry");
+		else {
+			touch_entry(srv, coll, e, doc);
+			answer_entry(out, 200, e);
+		}
+	} else if (!strcmp(req->method, "DELETE")) {
+		e->deleted = 1;
+		touch_entry(srv, coll, e, NULL);
+		answer(out, 200, NULL, NULL, NULL, 0);
+	} else
+		answer_text(out, 405, "Method not allowed");
+}
+
+static void photo_request(struct server *srv, struct request *req,
+			  const char *key, struct text *out)
+{
+	struct entry *e;
+	char *photo;
+
+	if (!(e = find_entry(&srv->contacts, key, strcspn(key, "/"))) ||
+	    e->deleted) {
+		answer_text(out, 404, "Contact not found");
+		return;
+	}
+
+	if (!strcmp(req->method, "GET")) {
+		if (e->photo)
+			answer(out, 200, srv->photo_type, NULL, e->photo,
+			       e->photo_length);
+		else
+			answer_text(out, 404, "Photo not found");
+		return;
+	}
+
+	if (!strcmp(req->method, "PUT") && req->length) {
+		if (!(photo = malloc(req->length)))
+			fatal("out of memory");
+		memcpy(photo, req->body, req->length);
+		free(e->photo);
+		e->photo = photo;
+		e->photo_length = req->length;
+	} else if (!strcmp(req->method, "DELETE")) {
+		free(e->photo);
+		e->photo = NULL;
+		e->photo_length = 0;
+	} else {
+		answer_text(out, 405, "Method not allowed");
+		return;
+	}
+
+	++e->photo_version;
+	touch_entry(srv, &srv->contacts, e, NULL);
+	answer(out, 200, NULL, NULL, NULL, 0);
+}
+
+static void login(struct server *srv, struct request *req, struct text *out)
+{
+	struct text t = { NULL, 0, 0 };
+	char *email, *password, *ptr;
+
+	email = query_param(req->body, "Email");
+	password = query_param(req->body, "Passwd");
+
+	if (!email || !password ||
+	    (srv->password && strcmp(password, srv->password)))
+		answer_text(out, 403, "Error=BadAuthentication\n");
+	else {
+		/* Kept as the calendar list shows it */
+		if (!(ptr = strchr(email, '@')))
+			snprintf(srv->account, sizeof(srv->account),
+				 "%s%%40gmail.com", email);
+		else
+			snprintf(srv->account, sizeof(srv->account),
+				 "%.*s%%40%s", (int)(ptr - email), email,
+				 ptr + 1);
+		text_printf(&t, "SID=gdata-server-sid\n"
+			    "LSID=gdata-server-lsid\nAuth=%s\n", AUTH_TOKEN);
+		answer(out, 200, "text/plain", NULL, t.data, t.used);
+	}
+
+	free(t.data);
+	free(email);
+	free(password);
+}
+
+/* Answers a calendar request lacking the current session with the same
+ * redirection Google does (the URL in both the header and the page).
+ */
+static int session_redirect(struct server *srv, struct request *req,
+			    struct text *out)
+{
+	struct text url = { NULL, 0, 0 }, page = { NULL, 0, 0 };
+	struct text headers = { NULL, 0, 0 };
+	char *session = query_param(req->query, "gsessionid");
+	const char *ptr, *end;
+	int valid;
+
+	/* The session expires from time to time, see '-s' */
+	if (srv->session_limit && (++srv->session_uses > srv->session_limit)) {
+		snprintf(srv->session, sizeof(srv->session), "S%lu",
+			 ++srv->session_count);
+		srv->session_uses = 1;
+	}
+
+	valid = session && !strcmp(session, srv->session);
+	free(session);
+	if (valid)
+		return 0;
+
+	text_printf(&url, "%s%s?", srv->base, req->path);
+	for (ptr = req->query; ptr && *ptr; ptr = end + (*end == '&')) {
+		end = ptr + strcspn(ptr, "&");
+		if ((end == ptr) || !strncmp(ptr, "gsessionid=", 11))
+			continue;
+		text_append(&url, ptr, end - ptr);
+		text_append(&url, "&", 1);
+	}
+	text_printf(&url, "gsessionid=%s", srv->session);
+
+	text_printf(&headers, "Location: %s\r\n", url.data);
+	text_printf(&page, "<HTML>\n<HEAD>\n<TITLE>Moved Temporarily</TITLE>\n"
+		    "</HEAD>\n<BODY BGCOLOR=\"#FFFFFF\" TEXT=\"#000000\">\n"
+		    "<H1>Moved Temporarily</H1>\nThe document has moved "
+		    "<A HREF=\"");
+	text_escaped(&page, url.data);
+	text_printf(&page, "\">here</A>.\n</BODY>\n</HTML>\n");
+	answer(out, 302, "text/html; charset=UTF-8", headers.data, page.data,
+	       page.used);
+
+	free(url.data);
+	free(page.data);
+	free(headers.data);
+	return 1;
+}
+
+/* Skips the user part of a path, e.g. "user%40example.com/full" */
+static const char *skip_segment(const char *path)
+{
+	const char *ptr = strchr(path, '/');
+
+	return ptr ? ptr : path + strlen(path);
+}
+
+static void handle(struct server *srv, struct request *req, struct text *out)
+{
+	const char *rest;
+	char expected[sizeof(AUTH_TOKEN) + 32];
+
+	if (!strcmp(req->path, "/accounts/ClientLogin")) {
+		if (strcmp(req->method, "POST"))
+			answer_text(out, 405, "Method not allowed");
+		else
+			login(srv, req, out);
+		return;
+	}
+
+	snprintf(expected, sizeof(expected), "GoogleLogin auth=%s",
+		 AUTH_TOKEN);
+	if (!req->authorization || strcmp(req->authorization, expected)) {
+		answer(out, 401, "text/html", NULL,
+		       "<HTML><BODY>Token invalid</BODY></HTML>", 39);
+		return;
+	}
+
+	if (!strncmp(req->path, "/calendar/feeds/", 16)) {
+		if (session_redirect(srv, req, out))
+			return;
+		rest = skip_segment(req->path + 16);
+		if (!strcmp(rest, "/allcalendars/full") ||
+		    !strcmp(rest, "/owncalendars/full"))
+			calendar_list(srv, out);
+		else if (!strncmp(rest, "/private/full", 13) &&
+			 (!rest[13] || (rest[13] == '/')))
+			collection_request(srv, &srv->events, req, rest + 13,
+					   out);
+		else
+			answer_text(out, 404, "Unknown feed");
+	} else if (!strncmp(req->path, "/m8/feeds/contacts/", 19)) {
+		rest = skip_segment(req->path + 19);
+		if (!strncmp(rest, "/full", 5) && (!rest[5] || (rest[5] == '/')))
+			collection_request(srv, &srv->contacts, req, rest + 5,
+					   out);
+		else
+			answer_text(out, 404, "Unknown feed");
+	} else if (!strncmp(req->path, "/m8/feeds/photos/media/", 23)) {
+		rest = skip_segment(req->path + 23);
+		if (*rest)
+			photo_request(srv, req, rest + 1, out);
+		else
+			answer_text(out, 404, "Unknown photo");
+	} else
+		answer_text(out, 404, "Unknown URL");
+}
+
+
+/* HTTP */
+
+static char *header_value(char *line, const char *name)
+{
+	size_t length = strlen(name);
+
+	if (strncasecmp(line, name, length) || (line[length] != ':'))
+		return NULL;
+	for (line += length + 1; (*line == ' ') || (*line == '\t'); ++line)
+		;
+
+	return line;
+}
+
+/* Parses the head of a request, returns the body length or -1 */
+static long parse_head(struct request *req, char *head)
+{
+	char *line, *next, *value, *version;
+	long length = 0;
+
+	memset(req, 0, sizeof(struct request));
+	req->head = head;
+
+	next = strstr(head, "\r\n");
+	*next = '\0';
+	next += 2;
+	req->method = head;
+	if (!(req->path = strchr(head, ' ')))
+		return -1;
+	*req->path++ = '\0';
+	if (!(version = strchr(req->path, ' ')))
+		return -1;
+	*version++ = '\0';
+	if ((req->query = strchr(req->path, '?')))
+		*req->query++ = '\0';
+	/* HTTP/1.0 closes by default */
+	req->close = !strcmp(version, "HTTP/1.0");
+
+	for (line = next; *line; line = next) {
+		if (!(next = strstr(line, "\r\n")))
+			break;
+		*next = '\0';
+		next += 2;
+
+		if ((value = header_value(line, "Content-Length")))
+			length = strtol(value, NULL, 10);
+		else if ((value = header_value(line, "Authorization")))
+			req->authorization = value;
+		else if ((value = header_value(line, "If-Match")))
+			req->if_match = value;
+		else if ((value = header_value(line, "If-None-Match")))
+			req->if_none_match = value;
+		else if ((value = header_value(line, "Expect")))
+			req->expect = value;
+		else if ((value = header_value(line, "Connection")))
+			req->close = !strcasecmp(value, "close");
+	}
+
+	return length;
+}
+
+static void log_request(struct server *srv, struct request *req,
+			struct text *out)
+{
+	int code = 0;
+
+	if (!srv->verbose)
+		return;
+
+	sscanf(out->data, "HTTP/1.1 %d", &code);
+	fprintf(stderr, "%s %s%s%s %d\n", req->method, req->path,
+		req->query ? "?" : "", req->query ? req->query : "", code);
+}
+
+/* Handles the (complete) requests received, returns -1 to drop the
+ * connection.
+ */
+static int process(struct server *srv, struct connection *conn)
+{
+	struct request req;
+	char *end, *head;
+	size_t head_length;
+	long length;
+
+	/* One answer at a time */
+	while (!conn->out.used) {
+		if (!conn->in.used ||
+		    !(end = strstr(conn->in.data, "\r\n\r\n")))
+			return 0;
+		head_length = end - conn->in.data + 4;
+		if (!(head = strndup(conn->in.data, head_length - 2)))
+			fatal("out of memory");
+
+		if ((length = parse_head(&req, head)) < 0) {
+			free(head);
+			return -1;
+		}
+		if (conn->in.used < head_length + length) {
+			/* curl waits for it before sending big bodies */
+			if (req.expect && !conn->continued) {
+				text_append(&conn->out, "HTTP/1.1 100 "
+					    "Continue\r\n\r\n", 25);
+				conn->continued = 1;
+				conn->ready = 0;
+			}
+			free(head);
+			return 0;
+		}
+
+		req.body = conn->in.data + head_length;
+		req.length = length;
+		/* Bodies are handled as strings (e.g. the login form) */
+		if (!(req.body = strndup(req.body, length)))
+			fatal("out of memory");
+
+		handle(srv, &req, &conn->out);
+		log_request(srv, &req, &conn->out);
+		conn->close = req.close;
+		conn->continued = 0;
+		conn->ready = now_ms() + srv->delay;
+
+		free(req.body);
+		free(head);
+		text_consume(&conn->in, head_length + length);
+	}
+
+	return 0;
+}
+
+static void close_connection(struct connection **list,
+			     struct connection *conn)
+{
+	struct connection **ptr;
+
+	for (ptr = list; *ptr; ptr = &(*ptr)->next)
+		if (*ptr == conn) {
+			*ptr = conn->next;
+			break;
+		}
+
+	close(conn->fd);
+	free(conn->in.data);
+	free(conn->out.data);
+	free(conn);
+}
+
+static int listen_on(const char *address, int *port)
+{
+	struct sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+	int fd, on = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(*port);
+	if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+		fatal("invalid address");
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		fatal("can't create socket");
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, 128))
+		fatal("can't listen");
+
+	getsockname(fd, (struct sockaddr *)&addr, &length);
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+static void serve(struct server *srv, int listener)
+{
+	struct connection *list = NULL, *conn, *next;
+	struct pollfd *fds = NULL;
+	size_t count, i, size = 0;
+	long long now, wait;
+	ssize_t bytes;
+	int fd, on = 1;
+
+	while (!stop) {
+		count = 1;
+		for (conn = list; conn; conn = conn->next)
+			++count;
+		if (count > size) {
+			size = count * 2;
+			if (!(fds = realloc(fds, size * sizeof(struct pollfd))))
+				fatal("out of memory");
+		}
+
+		/* Delayed answers are only written when ready */
+		now = now_ms();
+		wait = -1;
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		for (conn = list, i = 1; conn; conn = conn->next, ++i) {
+			fds[i].fd = conn->fd;
+			fds[i].events = POLLIN;
+			if (conn->out.used && (conn->ready <= now))
+				fds[i].events |= POLLOUT;
+			else if (conn->out.used &&
+				 ((wait < 0) || (conn->ready - now < wait)))
+				wait = conn->ready - now;
+		}
+
+		if ((poll(fds, count, (int)wait) < 0) && (errno != EINTR))
+			fatal("poll failed");
+		if (stop)
+			break;
+
+		for (conn = list, i = 1; conn; conn = next, ++i) {
+			next = conn->next;
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				text_reserve(&conn->in, 65536);
+				bytes = read(conn->fd,
+					     conn->in.data + conn->in.used,
+					     conn->in.size - conn->in.used - 1);
+				if (bytes <= 0) {
+					if ((bytes < 0) && (errno == EAGAIN))
+						continue;
+					close_connection(&list, conn);
+					continue;
+				}
+				conn->in.used += bytes;
+				conn->in.data[conn->in.used] = '\0';
+			}
+
+			if (fds[i].revents & POLLOUT) {
+				bytes = write(conn->fd,
+					      conn->out.data + conn->sent,
+					      conn->out.used - conn->sent);
+				if ((bytes < 0) && (errno != EAGAIN)) {
+					close_connection(&list, conn);
+					continue;
+				}
+				if (bytes > 0)
+					conn->sent += bytes;
+				if (conn->sent == conn->out.used) {
+					conn->out.used = conn->sent = 0;
+					if (conn->close) {
+						close_connection(&list, conn);
+						continue;
+					}
+				}
+			}
+
+			if (process(srv, conn))
+				close_connection(&list, conn);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			if ((fd = accept(listener, NULL, NULL)) < 0)
+				continue;
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on,
+				   sizeof(on));
+			if (!(conn = calloc(1, sizeof(struct connection))))
+				fatal("out of memory");
+			conn->fd = fd;
+			conn->next = list;
+			list = conn;
+		}
+	}
+
+	while (list)
+		close_connection(&list, list);
+	free(fds);
+}
+
+static void on_signal(int signal_number)
+{
+	(void)signal_number;
+	stop = 1;
+}
+
+static void usage(void)
+{
+	printf("Usage: gdata_server [options]\n"
+	       "  -a ADDRESS  address to listen on (default 127.0.0.1)\n"
+	       "  -p PORT     port to listen on (default 8080, 0 picks one)\n"
+	       "  -e COUNT    generated events (default 10)\n"
+	       "  -c COUNT    generated contacts (default 10)\n"
+	       "  -E FILE     loads the events of a feed (or entry) file\n"
+	       "  -C FILE     loads the contacts of a feed (or entry) file\n"
+	       "  -i FILE     photo of the contacts (default none)\n"
+	       "  -w PASSWORD only accepts this password (default any)\n"
+	       "  -d MS       delays every answer (default 0)\n"
+	       "  -s COUNT    calendar session expires after COUNT requests\n"
+	       "  -v          logs the requests\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct server srv;
+	const char *address = "127.0.0.1", *ext;
+	unsigned long events = 10, contacts = 10;
+	int option, port = 8080, listener, i;
+	struct sigaction action;
+
+	memset(&srv, 0, sizeof(srv));
+	srv.events.path = "/calendar/feeds/default/private/full";
+	srv.events.kind = EVENT_KIND;
+	srv.events.title = "Stand-in events";
+	srv.events.key_prefix = "ev";
+	srv.contacts.path = "/m8/feeds/contacts/default/full";
+	srv.contacts.kind = CONTACT_KIND;
+	srv.contacts.title = "Stand-in contacts";
+	srv.contacts.key_prefix = "ct";
+	srv.photo_type = "image/*";
+	strcpy(srv.account, "tester%40example.com");
+	strcpy(srv.session, "S0");
+
+	while ((option = getopt(argc, argv, "a:p:e:c:E:C:i:w:d:s:vh")) != -1)
+		switch (option) {
+		case 'a':
+			address = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'e':
+			events = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			contacts = strtoul(optarg, NULL, 10);
+			break;
+		case 'E':
+		case 'C':
+			/* Loaded after the photo is known */
+			break;
+		case 'i':
+			srv.photo = read_all(optarg, &srv.photo_length);
+			if ((ext = strrchr(optarg, '.')) &&
+			    (!strcasecmp(ext, ".jpg") ||
+			     !strcasecmp(ext, ".jpeg")))
+				srv.photo_type = "image/jpeg";
+			else if (ext && !strcasecmp(ext, ".png"))
+				srv.photo_type = "image/png";
+			else if (ext && !strcasecmp(ext, ".gif"))
+				srv.photo_type = "image/gif";
+			break;
+		case 'w':
+			srv.password = optarg;
+			break;
+		case 'd':
+			srv.delay = atoi(optarg);
+			break;
+		case 's':
+			srv.session_limit = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			srv.verbose = 1;
+			break;
+		default:
+			usage();
+			return option == 'h' ? 0 : 1;
+		}
+
+	listener = listen_on(address, &port);
+	snprintf(srv.base, sizeof(srv.base), "http://%s:%d", address, port);
+
+	xmlInitParser();
+	generate(&srv, &srv.events, events);
+	generate(&srv, &srv.contacts, contacts);
+	for (i = 1; i < argc; ++i)
+		if (!strcmp(argv[i], "-E") && (i + 1 < argc))
+			load(&srv, &srv.events, argv[++i]);
+		else if (!strcmp(argv[i], "-C") && (i + 1 < argc))
+			load(&srv, &srv.contacts, argv[++i]);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Scripts can wait for this line (e.g. to learn the port) */
+	printf("%s\n", srv.base);
+	fflush(stdout);
+
+	serve(&srv, listener);
+
+	close(listener);
+	free_entries(&srv.events);
+	free_entries(&srv.contacts);
+	free(srv.photo);
+	xmlCleanupParser();
+
+	return 0;
+}
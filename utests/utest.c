@@ -25,6 +25,8 @@
 #include "utest_userapi.h"
 #include "utest_xmlmode.h"
 #include "utest_screw.h"
+#include "utest_buffer.h"
+#include "utest_server.h"
 
 static Suite *core_suite(void)
 {
@@ -47,6 +49,10 @@ static Suite *core_suite(void)
 			suite_add_tcase(s, gcaldebug_tcase_create());
 		else if (!(strcmp(test_var, "query")))
 			suite_add_tcase(s, gcal_query_tcase_create());
+		else if (!(strcmp(test_var, "buffer")))
+			suite_add_tcase(s, buffer_tcase_create());
+		else if (!(strcmp(test_var, "server")))
+			suite_add_tcase(s, server_tcase_create());
 		else
 			goto all;
 
@@ -60,6 +66,8 @@ all:
 	suite_add_tcase(s, gcontact_tcase_create());
 	suite_add_tcase(s, gcaldebug_tcase_create());
 	suite_add_tcase(s, gcal_query_tcase_create());
+	suite_add_tcase(s, buffer_tcase_create());
+	suite_add_tcase(s, server_tcase_create());
 exit:
 	return s;
 }
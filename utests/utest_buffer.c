@@ -0,0 +1,244 @@
+/*
+ * @file   utest_buffer.c
+ *
+ * @brief  Response buffer utests (no network access is required).
+ *
+ * They also check that accumulating a response grows the buffer
+ * geometrically, so it costs linear time on its size.
+ */
+
+#define _GNU_SOURCE
+#include "utest_buffer.h"
+#include "gcal.h"
+#include "internal_gcal.h"
+#include "gcal_transport.h"
+#include <string.h>
+
+static struct gcal_resource *ptr_gcal = NULL;
+
+static void setup(void)
+{
+	ptr_gcal = gcal_construct(GCALENDAR);
+}
+
+static void teardown(void)
+{
+	gcal_destroy(ptr_gcal);
+}
+
+/* Curl delivers at most CURL_MAX_WRITE_SIZE bytes per callback */
+#define CHUNK_SIZE 16384
+
+/* Appends 'total' bytes in curl sized chunks, counting the times the
+ * buffer was reallocated ('grown' can be NULL). Returns -1 if the buffer
+ * did not at least double on each reallocation.
+ */
+static int feed_response(struct gcal_resource *gcal_obj, size_t total,
+			 size_t *grown)
+{
+	static char chunk[CHUNK_SIZE];
+	size_t sent, size, capacity, count = 0;
+
+	memset(chunk, 'x', sizeof(chunk));
+	clean_buffer(gcal_obj);
+
+	capacity = gcal_obj->length;
+	for (sent = 0; sent < total; sent += size) {
+		size = total - sent;
+		if (size > sizeof(chunk))
+			size = sizeof(chunk);
+		if (gcal_buffer_append(gcal_obj, chunk, size))
+			return -1;
+		if (gcal_obj->length != capacity) {
+			if (gcal_obj->length < 2 * capacity)
+				return -1;
+			capacity = gcal_obj->length;
+			++count;
+		}
+	}
+
+	if (grown)
+		*grown = count;
+	return 0;
+}
+
+START_TEST (test_buffer_binary)
+{
+	const char data[] = { 'a', '\0', 'b', '\0', 'c' };
+	int result;
+
+	clean_buffer(ptr_gcal);
+	result = gcal_buffer_append(ptr_gcal, data, sizeof(data));
+	fail_if(result != 0, "Failed appending binary data!");
+	result = gcal_buffer_append(ptr_gcal, data, sizeof(data));
+	fail_if(result != 0, "Failed appending binary data!");
+
+	fail_if(ptr_gcal->used != 2 * sizeof(data), "Wrong fill length!");
+	fail_if(memcmp(ptr_gcal->buffer, data, sizeof(data)) ||
+		memcmp(ptr_gcal->buffer + sizeof(data), data, sizeof(data)),
+		"Buffer content differs from appended data!");
+	fail_if(ptr_gcal->buffer[ptr_gcal->used] != '\0',
+		"Buffer must be null terminated!");
+
+	clean_buffer(ptr_gcal);
+	fail_if(ptr_gcal->used != 0, "Cleaning must reset fill length!");
+
+	result = gcal_buffer_append(NULL, data, sizeof(data));
+	fail_if(result != -1, "Should fail with NULL object!");
+}
+END_TEST
+
+START_TEST (test_buffer_linear)
+{
+	size_t sizes[] = { 1024, 1024 * 1024, 10 * 1024 * 1024 };
+	size_t i, start, grown, limit;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		clean_buffer(ptr_gcal);
+		start = ptr_gcal->length;
+		fail_if(feed_response(ptr_gcal, sizes[i], &grown) == -1,
+			"Buffer must at least double when it grows!");
+		fail_if(ptr_gcal->used != sizes[i], "Wrong fill length!");
+
+		/* Doubling from 'start' reaches the size in log2 steps, so
+		 * the bytes copied by the reallocations stay below the size.
+		 */
+		for (limit = 0; (start << limit) <= sizes[i]; ++limit)
+			;
+		fail_if(grown > limit, "Too many reallocations: %lu > %lu",
+			(unsigned long)grown, (unsigned long)limit);
+		fail_if(ptr_gcal->length > 2 * (sizes[i] + 1) &&
+			ptr_gcal->length > start,
+			"Buffer overgrown: %lu for %lu bytes",
+			(unsigned long)ptr_gcal->length,
+			(unsigned long)sizes[i]);
+	}
+}
+END_TEST
+
+START_TEST (test_buffer_policy)
+{
+	int result;
+
+	result = gcal_set_buffer_size(ptr_gcal, 0, 1024);
+	fail_if(result != -1, "Should fail with empty initial size!");
+	result = gcal_set_buffer_size(ptr_gcal, 2048, 1024);
+	fail_if(result != -1, "Should fail with ceiling below initial size!");
+	result = gcal_set_buffer_size(ptr_gcal, 512, 4096);
+	fail_if(result != 0, "Failed setting buffer policy!");
+	fail_if(ptr_gcal->length != 512, "Initial size was not applied: %lu",
+		(unsigned long)ptr_gcal->length);
+
+	/* A big answer grows the buffer past the ceiling... */
+	fail_if(feed_response(ptr_gcal, 64 * 1024, NULL) < 0,
+		"Failed accumulating response!");
+	fail_if(ptr_gcal->length <= 4096, "Buffer should have grown!");
+
+	/* ...and it is trimmed back when the next request starts */
+	clean_buffer(ptr_gcal);
+	fail_if(ptr_gcal->length != 4096, "Buffer was not trimmed: %lu",
+		(unsigned long)ptr_gcal->length);
+	fail_if(ptr_gcal->used != 0 || ptr_gcal->buffer[0] != '\0',
+		"Buffer should be empty!");
+
+	/* Zero ceiling means never trimming */
+	result = gcal_set_buffer_size(ptr_gcal, 512, 0);
+	fail_if(result != 0, "Failed setting buffer policy!");
+	fail_if(feed_response(ptr_gcal, 64 * 1024, NULL) < 0,
+		"Failed accumulating response!");
+	clean_buffer(ptr_gcal);
+	fail_if(ptr_gcal->length < 64 * 1024, "Buffer should be kept!");
+}
+END_TEST
+
+START_TEST (test_buffer_presize)
+{
+	struct gcal_transport *transport;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+
+	/* A wrong length must not presize past the ceiling */
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST", NULL, 200,
+					  "Content-Length: 1048576\r\n",
+					  login, strlen(login)),
+		"Failed adding canned response");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+	fail_if(gcal_set_buffer_size(ptr_gcal, 512, 4096) != 0,
+		"Failed setting buffer policy!");
+
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+	fail_if(ptr_gcal->length > 4096 + 1,
+		"Presized past the ceiling: %lu",
+		(unsigned long)ptr_gcal->length);
+
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+}
+END_TEST
+
+START_TEST (test_buffer_spool)
+{
+	const char data[] = "<feed>spooled</feed>";
+	size_t i, count = 1000;
+	int result;
+
+	result = gcal_set_spool(ptr_gcal, 4096);
+	fail_if(result != 0, "Failed setting spool threshold!");
+
+	/* Small answers stay in memory */
+	result = gcal_buffer_append(ptr_gcal, data, sizeof(data) - 1);
+	fail_if(result != 0, "Failed appending data!");
+	fail_if(gcal_buffer_finish(ptr_gcal) != 0, "Failed finishing buffer!");
+	fail_if(ptr_gcal->spooled, "Small answer should not be spooled!");
+	fail_if(strcmp(gcal_access_buffer(ptr_gcal), data),
+		"Wrong buffer content!");
+
+	/* Bigger ones are moved to a file, including what was already read */
+	for (i = 1; i < count; ++i) {
+		result = gcal_buffer_append(ptr_gcal, data, sizeof(data) - 1);
+		fail_if(result != 0, "Failed appending data!");
+	}
+	fail_if(!ptr_gcal->spooled, "Big answer should be spooled!");
+	fail_if(ptr_gcal->length > 4096, "Heap buffer should not grow!");
+	fail_if(gcal_buffer_finish(ptr_gcal) != 0, "Failed finishing buffer!");
+
+	fail_if(ptr_gcal->used != count * (sizeof(data) - 1),
+		"Wrong fill length!");
+	fail_if(strlen(gcal_access_buffer(ptr_gcal)) != ptr_gcal->used,
+		"Mapped view must be null terminated!");
+	for (i = 0; i < count; ++i)
+		fail_if(memcmp(ptr_gcal->buffer + i * (sizeof(data) - 1), data,
+			       sizeof(data) - 1), "Wrong spooled content!");
+
+	/* Appending after mapping must keep the data contiguous */
+	result = gcal_buffer_append(ptr_gcal, "x", 1);
+	fail_if(result != 0, "Failed appending data!");
+	fail_if(gcal_buffer_finish(ptr_gcal) != 0, "Failed finishing buffer!");
+	fail_if(strlen(ptr_gcal->buffer) != count * (sizeof(data) - 1) + 1,
+		"Wrong content after remapping!");
+
+	/* Back to memory for the next answer */
+	clean_buffer(ptr_gcal);
+	fail_if(ptr_gcal->spooled || ptr_gcal->used != 0 ||
+		ptr_gcal->buffer[0] != '\0', "Spool was not released!");
+}
+END_TEST
+
+TCase *buffer_tcase_create(void)
+{
+	TCase *tc = NULL;
+	int timeout_seconds = 60;
+	tc = tcase_create("buffer");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_set_timeout(tc, timeout_seconds);
+	tcase_add_test(tc, test_buffer_binary);
+	tcase_add_test(tc, test_buffer_linear);
+	tcase_add_test(tc, test_buffer_policy);
+	tcase_add_test(tc, test_buffer_presize);
+	tcase_add_test(tc, test_buffer_spool);
+	return tc;
+}
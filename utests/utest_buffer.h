@@ -0,0 +1,15 @@
+#ifndef __UTEST_BUFFER__
+#define __UTEST_BUFFER__
+/*
+ * @file   utest_buffer.h
+ *
+ * @brief  Header module for response buffer utests.
+ *
+ */
+
+#include <check.h>
+
+TCase *buffer_tcase_create(void);
+
+
+#endif
@@ -8,9 +8,17 @@
 
 #include "utest_gcal.h"
 #include "gcal.h"
+#include "internal_gcal.h"
 #include "gcal_parser.h"
+#include "gcal_status.h"
+#include "gcontact.h"
+#include "gcalendar.h"
+#include "gcal_transport.h"
 #include "utils.h"
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 
 struct gcal_resource *ptr_gcal = NULL;
 
@@ -70,6 +78,826 @@ START_TEST (test_url_parse)
 }
 END_TEST
 
+START_TEST (test_gcal_share)
+{
+	struct gcal_resource *other;
+	struct gcal_share *share;
+
+	share = gcal_share_new();
+	fail_if(share == NULL, "Failed creating connection context");
+
+	other = gcal_construct(GCONTACT);
+	fail_if(gcal_set_share(ptr_gcal, share) != 0 ||
+		gcal_set_share(other, share) != 0,
+		"Failed setting connection context");
+
+	/* The context can't go away while in use */
+	fail_if(gcal_share_delete(share) == 0,
+		"Context in use must not be deleted");
+
+	gcal_destroy(other);
+	fail_if(gcal_set_share(ptr_gcal, NULL) != 0,
+		"Failed resetting connection context");
+	fail_if(gcal_share_delete(share) != 0,
+		"Failed deleting connection context");
+}
+END_TEST
+
+/* Delays the canned answers, so the requests take a measurable time */
+static int slow_perform(void *data, const struct gcal_request *request,
+			struct gcal_response *response)
+{
+	struct gcal_transport *canned = (struct gcal_transport *)data;
+
+	usleep(40000);
+	return canned->perform(canned->data, request, response);
+}
+
+START_TEST (test_gcal_stats)
+{
+	struct gcal_transport *canned, slow;
+	struct gcal_stats stats;
+	struct gcal_request_stats timing;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char feed[] = "<feed xmlns='http://www.w3.org/2005/Atom'/>";
+	size_t bytes_up;
+
+	fail_if(gcal_set_compression(ptr_gcal, 1) != 0,
+		"Failed enabling compression");
+
+	fail_if(gcal_get_stats(ptr_gcal, &stats) != 0,
+		"Failed getting statistics");
+	fail_if(stats.requests || stats.wire_bytes || stats.decoded_bytes,
+		"A new object must have no transfers");
+
+	canned = gcal_transport_memory_new();
+	fail_if(canned == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(canned, "POST", NULL, 200, NULL,
+					  login, strlen(login)) ||
+		gcal_transport_memory_add(canned, "GET", NULL, 200, NULL,
+					  feed, strlen(feed)),
+		"Failed adding canned responses");
+	slow.perform = slow_perform;
+	slow.destroy = NULL;
+	slow.data = canned;
+	fail_if(gcal_set_transport(ptr_gcal, &slow) != 0,
+		"Failed setting transport");
+
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+	fail_if(gcal_status_last_request(ptr_gcal, &timing) != 0,
+		"Failed getting last request timing");
+	fail_if((timing.requests != 1) || !timing.bytes_up ||
+		(timing.bytes_down != strlen(login)),
+		"Login should send a body and receive the canned one");
+	bytes_up = timing.bytes_up;
+
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 0,
+		"Failed dumping events");
+	fail_if(gcal_status_last_request(ptr_gcal, &timing) != 0,
+		"Failed getting last request timing");
+	fail_if((timing.requests != 1) || timing.bytes_up ||
+		(timing.bytes_down != strlen(feed)),
+		"A GET sends no body");
+	/* Only the whole request is timed by a transport */
+	fail_if(timing.total_time < 0.04, "Request should take 40ms, took %f",
+		timing.total_time);
+	fail_if(timing.dns_time || timing.connect_time || timing.tls_time ||
+		timing.first_byte_time || timing.transfer_time,
+		"Transport requests have no phases");
+
+	/* Nothing is compressed by the transport */
+	fail_if(gcal_get_stats(ptr_gcal, &stats) != 0,
+		"Failed getting statistics");
+	fail_if((stats.requests != 2) ||
+		(stats.wire_bytes != strlen(login) + strlen(feed)) ||
+		(stats.decoded_bytes != stats.wire_bytes),
+		"Statistics should count both requests");
+	fail_if(gcal_status_cumulative(ptr_gcal, &timing) != 0,
+		"Failed getting cumulative timing");
+	fail_if((timing.requests != 2) || (timing.bytes_up != bytes_up) ||
+		(timing.bytes_down != stats.wire_bytes) ||
+		(timing.total_time < 0.08),
+		"Cumulative timing should add up both requests");
+
+	gcal_reset_stats(ptr_gcal);
+	fail_if(gcal_get_stats(ptr_gcal, &stats) != 0 || stats.requests ||
+		stats.wire_bytes || stats.decoded_bytes,
+		"Reset statistics should be zeroed");
+	fail_if(gcal_status_cumulative(ptr_gcal, &timing) != 0 ||
+		timing.requests || timing.bytes_down || timing.total_time,
+		"Reset cumulative timing should be zeroed");
+	fail_if(gcal_get_stats(NULL, &stats) != -1,
+		"Statistics of NULL object must fail");
+
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(canned);
+	fail_if(gcal_set_compression(ptr_gcal, 0) != 0,
+		"Failed disabling compression");
+}
+END_TEST
+
+START_TEST (test_gcal_transport)
+{
+	struct gcal_transport *transport;
+	struct gcal_request_stats timing;
+	struct gcal_event entry;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char moved[] = "<HTML><BODY>The document has moved"
+		"<A HREF=\"http://canned/feed?gsessionid=abc\">here</A>."
+		"</BODY></HTML>\n";
+	char edit_uri[] = "http://www.google.com/calendar/feeds/default"
+		"/private/full/nbnirpc7mkokh59309si20ftu8/63349494687";
+	char *feed = NULL;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &feed))
+		fail_if(1, "Can't load feed file!");
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST",
+					  "https://www.google.com/accounts/",
+					  200, NULL, login,
+					  strlen(login)) ||
+		gcal_transport_memory_add(transport, "GET", "http://canned/",
+					  200, "Content-Type: "
+					  "application/atom+xml\r\n", feed,
+					  strlen(feed)) ||
+		gcal_transport_memory_add(transport, "GET", NULL, 302, NULL,
+					  moved, strlen(moved)) ||
+		gcal_transport_memory_add(transport, "DELETE", NULL, 200,
+					  NULL, NULL, 0),
+		"Failed adding canned responses");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+
+	/* No network at all: login, redirection and feed are canned */
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 0,
+		"Failed dumping events");
+	fail_if(gcal_transport_memory_count(transport) != 3,
+		"Expected login, redirection and feed requests");
+	fail_if(strcmp(gcal_access_buffer(ptr_gcal), feed),
+		"Feed differs from the canned one");
+
+	/* The feed arrived through the redirection */
+	fail_if(gcal_status_last_request(ptr_gcal, &timing) != 0,
+		"Failed getting last request timing");
+	fail_if((timing.requests != 1) || (timing.redirects != 1) ||
+		(timing.bytes_down != strlen(feed)),
+		"Last request should be the redirected feed");
+	fail_if(gcal_status_cumulative(ptr_gcal, &timing) != 0,
+		"Failed getting cumulative timing");
+	fail_if((timing.requests != 3) || (timing.redirects != 1) ||
+		(timing.retries != 0) ||
+		(timing.bytes_down != strlen(login) + strlen(moved) +
+		 strlen(feed)),
+		"Cumulative timing should add up all requests");
+
+	/* The learned session saves the redirection */
+	gcal_init_event(&entry);
+	entry.common.edit_uri = edit_uri;
+	fail_if(gcal_delete_event(ptr_gcal, &entry) != 0,
+		"Failed deleting event");
+	fail_if(gcal_transport_memory_count(transport) != 4,
+		"Delete should be a single request");
+
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+	free(feed);
+}
+END_TEST
+
+/* Answers 'not modified' to requests having the canned validators */
+static int validating_perform(void *data, const struct gcal_request *request,
+			      struct gcal_response *response)
+{
+	struct gcal_transport *canned = (struct gcal_transport *)data;
+	int matches = 0;
+	size_t i;
+
+	for (i = 0; request->headers[i]; ++i)
+		if (!strcmp(request->headers[i], "If-None-Match: \"v1\"") ||
+		    !strcmp(request->headers[i], "If-Modified-Since: "
+			    "Sat, 17 Oct 2026 10:00:00 GMT"))
+			++matches;
+
+	if (matches == 2) {
+		gcal_response_status(response, 304);
+		return 0;
+	}
+
+	return canned->perform(canned->data, request, response);
+}
+
+START_TEST (test_gcal_conditional)
+{
+	struct gcal_transport *canned, validating;
+	struct gcal_event_array events;
+	struct gcal_event *entries;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char validators[] = "ETag: \"v1\"\r\n"
+		"Last-Modified: Sat, 17 Oct 2026 10:00:00 GMT\r\n";
+	char *feed = NULL;
+	size_t length = 0;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &feed))
+		fail_if(1, "Can't load feed file!");
+
+	canned = gcal_transport_memory_new();
+	fail_if(canned == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(canned, "POST", NULL, 200, NULL,
+					  login, strlen(login)) ||
+		gcal_transport_memory_add(canned, "GET", NULL, 200,
+					  validators, feed, strlen(feed)),
+		"Failed adding canned responses");
+	validating.perform = validating_perform;
+	validating.destroy = NULL;
+	validating.data = canned;
+	fail_if(gcal_set_transport(ptr_gcal, &validating) != 0,
+		"Failed setting transport");
+
+	gcal_set_conditional(ptr_gcal, 1);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+
+	/* The first fetch keeps the validators of the feed */
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 0,
+		"First fetch should get the feed");
+	fail_if(strcmp(gcal_access_buffer(ptr_gcal), feed),
+		"Feed differs from the canned one");
+
+	/* ...which are sent back, an unchanged feed keeps the buffer */
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 1,
+		"Second fetch should find the feed unchanged");
+	fail_if(gcal_status_httpcode(ptr_gcal) != 304,
+		"Expected a 'not modified' answer");
+	fail_if(gcal_transport_memory_count(canned) != 2,
+		"An unchanged feed must not be served again");
+	fail_if(strcmp(gcal_access_buffer(ptr_gcal), feed),
+		"Buffer should keep the previous feed");
+	gcal_set_reader(ptr_gcal, 1);
+	entries = gcal_get_entries(ptr_gcal, &length);
+	fail_if(entries == NULL || length != 3,
+		"Expected the 3 previous entries, got %d", (int)length);
+	gcal_destroy_entries(entries, length);
+
+	/* The array of the previous call is left untouched */
+	events.entries = NULL;
+	events.length = 42;
+	fail_if(gcal_get_events(ptr_gcal, &events) != 1,
+		"Events should be unchanged");
+	fail_if(events.entries != NULL || events.length != 42,
+		"Unchanged events must not touch the array");
+
+	/* Without validators, the feed is fetched again */
+	gcal_set_conditional(ptr_gcal, 0);
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 0,
+		"Plain fetch should get the feed");
+	fail_if(gcal_transport_memory_count(canned) != 3,
+		"Plain fetch should be served");
+
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(canned);
+	free(feed);
+}
+END_TEST
+
+START_TEST (test_gcal_batch)
+{
+	struct gcal_transport *transport, slow;
+	gcal_event_t events[250];
+	gcal_batch_op ops[250];
+	struct gcal_batch_result results[250];
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char head[] = "<feed xmlns='http://www.w3.org/2005/Atom' "
+		"xmlns:batch='http://schemas.google.com/gdata/batch'>";
+	char *answer;
+	size_t i, used, size = 16384;
+
+	/* Each batch feed takes 100 entries at most, the canned answer
+	 * has results for all of them */
+	answer = malloc(size);
+	fail_if(answer == NULL, "Failed allocating answer");
+	used = snprintf(answer, size, "%s", head);
+	for (i = 0; i < 100; ++i)
+		used += snprintf(answer + used, size - used,
+				 "<entry><batch:id>%d</batch:id>"
+				 "<batch:status code='200'/></entry>", (int)i);
+	used += snprintf(answer + used, size - used, "</feed>");
+	fail_if(used >= size, "Answer too long");
+
+	for (i = 0; i < 250; ++i) {
+		events[i] = gcal_event_new(NULL);
+		fail_if(events[i] == NULL, "Failed creating event");
+		gcal_event_set_id(events[i], "ID");
+		ops[i] = GCAL_BATCH_DELETE;
+	}
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST",
+					  "https://www.google.com/accounts/",
+					  200, NULL, login, strlen(login)) ||
+		gcal_transport_memory_add(transport, "POST", NULL, 200, NULL,
+					  answer, used),
+		"Failed adding canned responses");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+
+	fail_if(gcal_batch_events(ptr_gcal, events, ops, 150, results) != 0,
+		"Batch should succeed");
+	fail_if(gcal_transport_memory_count(transport) != 3,
+		"Expected login and 2 batch feeds");
+	for (i = 0; i < 150; ++i)
+		fail_if(results[i].status != 200, "Entry %d has no result",
+			(int)i);
+	gcal_batch_results_cleanup(results, 150);
+
+	/* All the batch feeds share the deadline of the call: the third
+	 * one starts past it */
+	slow.perform = slow_perform;
+	slow.destroy = NULL;
+	slow.data = transport;
+	fail_if(gcal_set_transport(ptr_gcal, &slow) != 0,
+		"Failed setting transport");
+	fail_if(gcal_set_deadline(ptr_gcal, 60) != 0, "Failed setting deadline");
+	fail_if(gcal_batch_events(ptr_gcal, events, ops, 250, results) != -1,
+		"Batch past the deadline should fail");
+	fail_if(gcal_status_request(ptr_gcal) != GCAL_REQUEST_TIMEOUT,
+		"Expected a timeout");
+	fail_if(gcal_transport_memory_count(transport) > 5,
+		"No batch feed should be sent past the deadline");
+	fail_if(results[0].status != 200, "First batch feed should be sent");
+	fail_if(results[200].status, "Last batch feed should not be sent");
+	gcal_batch_results_cleanup(results, 250);
+	fail_if(gcal_set_deadline(ptr_gcal, 0) != 0, "Failed removing deadline");
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+
+	/* A batch feed failing as a whole stops the request */
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST", NULL, 500, NULL,
+					  NULL, 0),
+		"Failed adding canned response");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+	fail_if(gcal_batch_events(ptr_gcal, events, ops, 150, results) != -1,
+		"Failed batch should fail");
+	fail_if(gcal_transport_memory_count(transport) != 1,
+		"The second batch feed should not be sent");
+	for (i = 0; i < 150; ++i)
+		fail_if(results[i].status, "Entry %d should have no result",
+			(int)i);
+	gcal_batch_results_cleanup(results, 150);
+
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+	for (i = 0; i < 250; ++i)
+		gcal_event_delete(events[i]);
+	free(answer);
+}
+END_TEST
+
+START_TEST (test_gcal_calendar_list)
+{
+	struct gcal_transport *transport;
+	struct gcal_resource_array calendars;
+	gcal_t calendar;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char *feed = NULL;
+
+	if (find_load_file("/utests/calendar_list.xml", &feed))
+		fail_if(1, "Can't load feed file!");
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST", NULL, 200, NULL,
+					  login, strlen(login)) ||
+		gcal_transport_memory_add(transport, "GET", NULL, 200, NULL,
+					  feed, strlen(feed)),
+		"Failed adding canned responses");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+
+	/* Calendars inherit the configuration of the resource listing them */
+	gcal_set_reader(ptr_gcal, 1);
+	gcal_set_store_xml(ptr_gcal, 1);
+	fail_if(gcal_set_timezone(ptr_gcal, "-03:00") != 0,
+		"Failed setting timezone");
+	fail_if(gcal_set_buffer_size(ptr_gcal, 512, 4096) != 0,
+		"Failed setting buffer policy");
+
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+	fail_if(gcal_calendar_list(ptr_gcal, &calendars) != 0,
+		"Failed listing calendars");
+	fail_if(calendars.length != 2, "Expected 2 calendars, got %d",
+		(int)calendars.length);
+
+	fail_if(gcal_get_calendar_by_index(&calendars, 1, &calendar) != 0,
+		"Failed getting calendar by index");
+	fail_if(gcal_get_calendar(&calendars, "gcalntester", "gmail.com",
+				  &calendar) != 0,
+		"Failed finding own calendar");
+	fail_if(calendar != &calendars.entries[0],
+		"Own calendar should be the first one");
+	fail_if(!calendar->reader_mode || !calendar->store_xml_entry ||
+		(calendar->fout_log != ptr_gcal->fout_log) ||
+		(calendar->buffer_ceiling != 4096) ||
+		(calendar->transport != transport) ||
+		!calendar->timezone || strcmp(calendar->timezone, "-03:00") ||
+		strcmp(calendar->max_results, ptr_gcal->max_results),
+		"Calendar should inherit the configuration");
+
+	gcal_cleanup_calendar(&calendars);
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+	free(feed);
+}
+END_TEST
+
+START_TEST (test_gcal_page_size)
+{
+	struct gcal_transport *transport;
+	struct gcal_event *entries;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char *feed = NULL;
+	size_t length = 0;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &feed))
+		fail_if(1, "Can't load feed file!");
+
+	/* Only the whole feed is canned, a page of it is not */
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST", NULL, 200, NULL,
+					  login, strlen(login)) ||
+		gcal_transport_memory_add(transport, "GET",
+					  "http://www.google.com/calendar/"
+					  "feeds/tester%40gmail.com/private/"
+					  "full?max-results=999999999",
+					  200, NULL, feed, strlen(feed)) ||
+		gcal_transport_memory_add(transport, "GET",
+					  "http://www.google.com/calendar/"
+					  "feeds/tester%40gmail.com/private/"
+					  "full?max-results=1",
+					  200, NULL, feed, strlen(feed)),
+		"Failed adding canned responses");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Authentication should work");
+
+	/* The page size is for paged downloads, a dump gets everything */
+	fail_if(gcal_set_page_size(ptr_gcal, 1) != 0,
+		"Failed setting page size");
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 0,
+		"Dump should fetch the whole feed");
+	fail_if(strcmp(gcal_access_buffer(ptr_gcal), feed),
+		"Feed differs from the canned one");
+	gcal_set_reader(ptr_gcal, 1);
+	entries = gcal_get_entries(ptr_gcal, &length);
+	fail_if(entries == NULL || length != 3,
+		"Expected all the 3 entries, got %d", (int)length);
+	gcal_destroy_entries(entries, length);
+
+	/* Paged downloads ask for pages of that size */
+	entries = gcal_dump_entries(ptr_gcal, NULL, "GData-Version: 2",
+				    &length);
+	fail_if(entries == NULL || length != 3,
+		"Paged download failed, got %d", (int)length);
+	gcal_destroy_entries(entries, length);
+
+	gcal_set_reader(ptr_gcal, 0);
+	fail_if(gcal_set_page_size(ptr_gcal, 0) != 0,
+		"Failed removing page size");
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+	free(feed);
+}
+END_TEST
+
+START_TEST (test_gcal_base_url)
+{
+	struct gcal_transport *transport;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char *feed = NULL;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &feed))
+		fail_if(1, "Can't load feed file!");
+
+	/* Only the local server is canned, Google itself is refused */
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST",
+					  "http://127.0.0.1:1/accounts/",
+					  200, NULL, login,
+					  strlen(login)) ||
+		gcal_transport_memory_add(transport, "GET",
+					  "http://127.0.0.1:1/calendar/",
+					  200, NULL, feed, strlen(feed)) ||
+		gcal_transport_memory_add(transport, NULL, NULL, 403, NULL,
+					  NULL, 0),
+		"Failed adding canned responses");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+
+	fail_if(gcal_set_base_url(ptr_gcal, "") != -1,
+		"Empty base URL should fail");
+	fail_if(gcal_set_base_url(ptr_gcal, "http://127.0.0.1:1/") != 0,
+		"Failed setting base URL");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Login should go to the local server");
+	fail_if(gcal_dump(ptr_gcal, "GData-Version: 2") != 0,
+		"Feed should come from the local server");
+	fail_if(strcmp(gcal_access_buffer(ptr_gcal), feed),
+		"Feed differs from the canned one");
+	fail_if(gcal_transport_memory_count(transport) != 2,
+		"Expected login and feed requests");
+
+	/* Back to Google */
+	fail_if(gcal_set_base_url(ptr_gcal, NULL) != 0,
+		"Failed restoring base URL");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != -1,
+		"Login should go to Google");
+
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+	free(feed);
+}
+END_TEST
+
+/* Lifts the hold of the throttled requests while they wait */
+static void *lift_throttling(void *data)
+{
+	(void)data;
+	usleep(50000);
+	gcal_set_rate_limit(GCALENDAR, 0, 0);
+
+	return NULL;
+}
+
+START_TEST (test_gcal_throttling)
+{
+	struct gcal_transport *transport;
+	struct gcal_request_stats timing;
+	pthread_t thread;
+	time_t start;
+	size_t made;
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, NULL, NULL, 429,
+					  "Retry-After: 4\r\n", NULL, 0),
+		"Failed adding canned response");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+
+	/* The server keeps throttling: one retry, then it fails. Resetting
+	 * the limit makes the retry go on before the 4s asked for.
+	 */
+	fail_if(gcal_set_retries(GCALENDAR, 1) != 0, "Failed setting retries");
+	fail_if(pthread_create(&thread, NULL, lift_throttling, NULL) != 0,
+		"Failed creating thread");
+	start = time(NULL);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != -1,
+		"Throttled login should fail");
+	pthread_join(thread, NULL);
+	fail_if(time(NULL) - start > 2, "New limit should lift the hold");
+	fail_if(gcal_status_httpcode(ptr_gcal) != 429,
+		"Expected the throttling answer");
+	fail_if(gcal_transport_memory_count(transport) != 2,
+		"Throttled request should be made twice");
+	fail_if(gcal_status_last_request(ptr_gcal, &timing) != 0,
+		"Failed getting last request timing");
+	fail_if(timing.retries != 1, "Last request should be a retry");
+
+	fail_if(gcal_set_rate_limit(GCONTACT, -1, 0) != -1,
+		"Negative rate should fail");
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, NULL, NULL, 503,
+					  "Retry-After: 4\r\n", NULL, 0),
+		"Failed adding canned response");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+
+	/* Waiting for the retry still ends at the deadline */
+	fail_if(gcal_set_deadline(ptr_gcal, 300) != 0,
+		"Failed setting deadline");
+	start = time(NULL);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != -1,
+		"Throttled login should fail");
+	fail_if(time(NULL) - start > 2, "Retry wait ignored the deadline");
+	fail_if(gcal_status_request(ptr_gcal) != GCAL_REQUEST_TIMEOUT,
+		"Expected a timeout");
+	fail_if(gcal_set_deadline(ptr_gcal, 0) != 0,
+		"Failed removing deadline");
+
+	/* Without retries nobody waits, as by default */
+	fail_if(gcal_set_retries(GCALENDAR, 0) != 0, "Failed setting retries");
+	made = gcal_transport_memory_count(transport);
+	start = time(NULL);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != -1,
+		"Throttled login should fail");
+	fail_if(time(NULL) - start > 1, "Throttled login should fail at once");
+	fail_if(gcal_transport_memory_count(transport) != made + 1,
+		"Throttled request should be made once");
+
+	/* The limits are global, later tests get the defaults back */
+	fail_if(gcal_set_rate_limit(GCALENDAR, 0, 0) != 0,
+		"Failed restoring rate limit");
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+}
+END_TEST
+
+START_TEST (test_gcal_deadline)
+{
+	struct gcal_transport *transport;
+	struct gcal_cancel *cancel;
+	size_t made;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST", NULL, 200, NULL,
+					  login, strlen(login)),
+		"Failed adding canned response");
+	fail_if(gcal_set_transport(ptr_gcal, transport) != 0,
+		"Failed setting transport");
+	fail_if(gcal_set_timeout(ptr_gcal, -1, 0) != -1,
+		"Negative timeout should fail");
+
+	/* Each call has its own deadline, measured from its start */
+	fail_if(gcal_set_deadline(ptr_gcal, 50) != 0, "Failed setting deadline");
+	usleep(100000);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Deadline of a new call should not have expired");
+
+	/* A call over its deadline stops, even while waiting for the rate
+	 * limit, and the requests of later calls are made again */
+	fail_if(gcal_set_rate_limit(GCALENDAR, 1, 1) != 0,
+		"Failed setting rate limit");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Login should take the only token");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != -1,
+		"Login past the deadline should fail");
+	fail_if(gcal_status_request(ptr_gcal) != GCAL_REQUEST_TIMEOUT,
+		"Expected a timeout");
+	fail_if(gcal_set_rate_limit(GCALENDAR, 0, 0) != 0,
+		"Failed removing rate limit");
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Deadline should not outlive its call");
+	fail_if(gcal_set_deadline(ptr_gcal, 0) != 0, "Failed removing deadline");
+	made = gcal_transport_memory_count(transport);
+
+	cancel = gcal_cancel_new();
+	fail_if(cancel == NULL, "Failed creating cancellation handle");
+	fail_if(gcal_set_cancel(ptr_gcal, cancel) != 0, "Failed setting handle");
+	gcal_cancel_trigger(cancel);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != -1,
+		"Canceled login should fail");
+	fail_if(gcal_status_request(ptr_gcal) != GCAL_REQUEST_CANCELED,
+		"Expected a cancellation");
+	fail_if(gcal_transport_memory_count(transport) != made,
+		"No request should have been made");
+
+	gcal_cancel_reset(cancel);
+	fail_if(gcal_get_authentication(ptr_gcal, "tester", "secret") != 0,
+		"Login should work after reset");
+	fail_if(gcal_status_request(ptr_gcal) != GCAL_REQUEST_DONE,
+		"Expected a completed request");
+
+	fail_if(gcal_set_cancel(ptr_gcal, NULL) != 0, "Failed removing handle");
+	gcal_cancel_delete(cancel);
+	fail_if(gcal_set_transport(ptr_gcal, NULL) != 0,
+		"Failed restoring curl");
+	gcal_transport_delete(transport);
+}
+END_TEST
+
+/* Gives a generated photo, counting the bytes read */
+static long read_photo(char *buffer, size_t size, void *data)
+{
+	size_t *sent = (size_t *)data;
+
+	memset(buffer, 'p', size);
+	*sent += size;
+	return (long)size;
+}
+
+static long read_broken(char *buffer, size_t size, void *data)
+{
+	(void)buffer;
+	(void)size;
+	(void)data;
+
+	return -1;
+}
+
+START_TEST (test_gcal_photo_stream)
+{
+	struct gcal_transport *transport;
+	struct gcal_request_stats timing;
+	gcal_t contacts;
+	gcal_contact_t contact;
+	char login[] = "SID=sid\nLSID=lsid\nAuth=secret\n";
+	char *entry = NULL;
+	size_t sent = 0;
+	const size_t length = 100000;
+
+	if (find_load_file("/utests/with_photo.xml", &entry))
+		fail_if(1, "Can't load contact file!");
+
+	transport = gcal_transport_memory_new();
+	fail_if(transport == NULL, "Failed creating in-memory transport");
+	fail_if(gcal_transport_memory_add(transport, "POST",
+					  "https://www.google.com/accounts/",
+					  200, NULL, login,
+					  strlen(login)) ||
+		gcal_transport_memory_add(transport, "POST", NULL, 201, NULL,
+					  entry, strlen(entry)) ||
+		gcal_transport_memory_add(transport, "PUT",
+					  "http://www.google.com/m8/feeds/"
+					  "contacts/", 200, NULL,
+					  entry, strlen(entry)) ||
+		gcal_transport_memory_add(transport, "PUT", NULL, 200, NULL,
+					  NULL, 0),
+		"Failed adding canned responses");
+
+	contacts = gcal_construct(GCONTACT);
+	fail_if(contacts == NULL, "Failed constructing contacts object");
+	fail_if(gcal_set_transport(contacts, transport) != 0,
+		"Failed setting transport");
+	fail_if(gcal_get_authentication(contacts, "gcalntester@gmail.com",
+					"secret") != 0,
+		"Authentication should work");
+
+	contact = gcal_contact_new(NULL);
+	fail_if(contact == NULL, "Failed creating contact");
+	fail_if(gcal_contact_set_title(contact, "Photo streamed") != 0,
+		"Failed setting title");
+	fail_if(gcal_contact_set_photo_stream(contact, read_photo, &sent, 0)
+		!= -1, "A photo stream needs a length");
+	fail_if(gcal_contact_set_photo_stream(contact, read_photo, &sent,
+					      length) != 0,
+		"Failed setting photo stream");
+
+	/* The photo goes right after the contact, read while sent */
+	fail_if(gcal_add_contact(contacts, contact) != 0,
+		"Failed adding contact");
+	fail_if(gcal_transport_memory_count(transport) != 3,
+		"Expected login, contact and photo requests");
+	fail_if(sent != length, "Photo should be read exactly once");
+	fail_if(gcal_status_last_request(contacts, &timing) != 0,
+		"Failed getting last request timing");
+	fail_if(timing.bytes_up != length, "Photo upload has the wrong size");
+
+	/* The stream was used up, an update only sends the contact */
+	fail_if(gcal_update_contact(contacts, contact) != 0,
+		"Failed updating contact");
+	fail_if(gcal_transport_memory_count(transport) != 4,
+		"Update should not upload the photo again");
+	fail_if(sent != length, "Photo should not be read again");
+
+	/* A failing stream fails the update */
+	fail_if(gcal_contact_set_photo_stream(contact, read_broken, NULL,
+					      length) != 0,
+		"Failed setting photo stream");
+	fail_if(gcal_update_contact(contacts, contact) != -1,
+		"Update with a broken photo should fail");
+	fail_if(gcal_status_request(contacts) != GCAL_REQUEST_FAILED,
+		"Broken photo should fail the request");
+	fail_if(gcal_status_last_request(contacts, &timing) != 0,
+		"Failed getting last request timing");
+	fail_if(timing.bytes_up != 0, "Nothing of the photo was sent");
+
+	gcal_contact_delete(contact);
+	gcal_destroy(contacts);
+	gcal_transport_delete(transport);
+	free(entry);
+}
+END_TEST
+
 START_TEST (test_editurl_parse)
 {
 	char *super_contact = NULL;
@@ -200,6 +1028,17 @@ TCase *gcal_tcase_create(void)
 	tcase_set_timeout (tc, timeout_seconds);
 	tcase_add_test(tc, test_gcal_authenticate);
 	tcase_add_test(tc, test_url_parse);
+	tcase_add_test(tc, test_gcal_share);
+	tcase_add_test(tc, test_gcal_stats);
+	tcase_add_test(tc, test_gcal_transport);
+	tcase_add_test(tc, test_gcal_conditional);
+	tcase_add_test(tc, test_gcal_batch);
+	tcase_add_test(tc, test_gcal_calendar_list);
+	tcase_add_test(tc, test_gcal_page_size);
+	tcase_add_test(tc, test_gcal_base_url);
+	tcase_add_test(tc, test_gcal_throttling);
+	tcase_add_test(tc, test_gcal_deadline);
+	tcase_add_test(tc, test_gcal_photo_stream);
 	tcase_add_test(tc, test_gcal_dump);
 	tcase_add_test(tc, test_gcal_event);
 	tcase_add_test(tc, test_gcal_naive);
@@ -0,0 +1,409 @@
+/*
+ * @file   utest_server.c
+ *
+ * @brief  End to end utests, run against the local stand-in server (see
+ * gdata_server.c) with no network access.
+ *
+ * Every test starts its own server (with 5 events and 3 contacts), so
+ * they don't depend on each other. The asynchronous operations need curl,
+ * so they are only tested here.
+ */
+
+#define _GNU_SOURCE
+#include "utest_server.h"
+#include "gcalendar.h"
+#include "gcontact.h"
+#include "gcal_status.h"
+#include "gcal_async.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#ifndef GDATA_SERVER
+#define GDATA_SERVER "./gdata_server"
+#endif
+
+static gcal_t gcal = NULL;
+static pid_t server = -1;
+static char base_url[64];
+
+/* Outcome of an asynchronous operation */
+struct async_result {
+	int done;
+	int result;
+	int code;
+	size_t length;
+	char *xml;
+};
+
+static struct gcal_loop *loop = NULL;
+static struct async_result async_results[5];
+static const char new_entry[] = "<entry xmlns='http://www.w3.org/2005/Atom'>"
+	"<category scheme='http://schemas.google.com/g/2005#kind' "
+	"term='http://schemas.google.com/g/2005#event'/>"
+	"<title type='text'>Async event</title></entry>";
+
+/* Starts the server on a free port, its first line is the base URL */
+static void start_server(void)
+{
+	int fds[2];
+	FILE *output;
+	char *ptr;
+
+	base_url[0] = '\0';
+	if (pipe(fds))
+		return;
+
+	if (!(server = fork())) {
+#ifdef __linux__
+		/* A failed test exits without its teardown */
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(GDATA_SERVER, "gdata_server", "-p", "0", "-w", "secret",
+		      "-e", "5", "-c", "3", (char *)NULL);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	if (server < 0) {
+		close(fds[0]);
+		return;
+	}
+	if ((output = fdopen(fds[0], "r"))) {
+		if (!fgets(base_url, sizeof(base_url), output))
+			base_url[0] = '\0';
+		fclose(output);
+	} else
+		close(fds[0]);
+
+	if ((ptr = strchr(base_url, '\n')))
+		*ptr = '\0';
+}
+
+static void setup(void)
+{
+	/* A proxy from the environment would not reach the server */
+	setenv("no_proxy", "127.0.0.1", 1);
+	start_server();
+	gcal = gcal_new(GCALENDAR);
+}
+
+static void teardown(void)
+{
+	gcal_delete(gcal);
+	if (server > 0) {
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+	}
+	server = -1;
+}
+
+/* Points 'obj' to the server and logs in */
+static int connect_server(gcal_t obj)
+{
+	if (!base_url[0] || gcal_set_base_url(obj, base_url))
+		return -1;
+
+	return gcal_get_authentication(obj, "tester", "secret");
+}
+
+
+START_TEST (test_server_auth)
+{
+	struct gcal_event_array events;
+
+	fail_if(!base_url[0], "Server didn't start");
+	fail_if(gcal_set_base_url(gcal, base_url) != 0,
+		"Failed setting base URL");
+
+	fail_if(gcal_get_authentication(gcal, "tester", "wrong") != -1,
+		"Wrong password should be refused");
+	fail_if(gcal_status_httpcode(gcal) != 403, "Expected a 403");
+	fail_if(gcal_get_events(gcal, &events) != -1,
+		"Requests without a token should fail");
+
+	fail_if(gcal_get_authentication(gcal, "tester", "secret") != 0,
+		"Right password should be accepted");
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Requests with the token should work");
+	gcal_cleanup_events(&events);
+}
+END_TEST
+
+START_TEST (test_server_events)
+{
+	struct gcal_event_array events;
+	struct gcal_contact_array contacts;
+	gcal_t contacts_obj;
+	size_t i;
+
+	fail_if(connect_server(gcal) != 0, "Failed logging in");
+
+	/* The calendar session redirection is followed */
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Failed downloading events");
+	fail_if(events.length != 5, "Expected 5 events, got %d",
+		(int)events.length);
+	for (i = 0; i < events.length; ++i)
+		fail_if(!gcal_event_get_etag(gcal_event_element(&events, i)),
+			"Event %d has no ETag", (int)i);
+	gcal_cleanup_events(&events);
+
+	/* Small pages make the download follow the 'next' links */
+	fail_if(gcal_set_page_size(gcal, 2) != 0, "Failed setting page size");
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Failed downloading paged events");
+	fail_if(events.length != 5, "Expected 5 paged events, got %d",
+		(int)events.length);
+	gcal_cleanup_events(&events);
+
+	contacts_obj = gcal_new(GCONTACT);
+	fail_if(contacts_obj == NULL, "Failed constructing contacts object");
+	fail_if(connect_server(contacts_obj) != 0,
+		"Failed logging in contacts");
+	fail_if(gcal_get_contacts(contacts_obj, &contacts) != 0,
+		"Failed downloading contacts");
+	fail_if(contacts.length != 3, "Expected 3 contacts, got %d",
+		(int)contacts.length);
+	gcal_cleanup_contacts(&contacts);
+	gcal_delete(contacts_obj);
+}
+END_TEST
+
+START_TEST (test_server_batch)
+{
+	struct gcal_event_array events;
+	gcal_event_t batch[4];
+	gcal_batch_op ops[4];
+	struct gcal_batch_result results[4];
+	char title[32];
+	int i;
+
+	fail_if(connect_server(gcal) != 0, "Failed logging in");
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Failed downloading events");
+
+	for (i = 0; i < 3; ++i) {
+		batch[i] = gcal_event_new(NULL);
+		fail_if(batch[i] == NULL, "Failed creating event");
+		snprintf(title, sizeof(title), "Batch event %d", i);
+		gcal_event_set_title(batch[i], title);
+		gcal_event_set_start(batch[i], "2026-10-17T16:00:00Z");
+		gcal_event_set_end(batch[i], "2026-10-17T18:00:00Z");
+		ops[i] = GCAL_BATCH_INSERT;
+	}
+	/* Deleting needs the ID, edit URL and ETag the feed brought */
+	batch[3] = gcal_event_element(&events, 0);
+	ops[3] = GCAL_BATCH_DELETE;
+
+	fail_if(gcal_batch_events(gcal, batch, ops, 4, results) != 0,
+		"Batch should succeed");
+	for (i = 0; i < 3; ++i) {
+		fail_if(results[i].status != 201, "Insert %d got %d", i,
+			results[i].status);
+		fail_if(!results[i].id || !results[i].etag,
+			"Insert %d has no ID or ETag", i);
+	}
+	fail_if(results[3].status != 200, "Delete got %d", results[3].status);
+	gcal_batch_results_cleanup(results, 4);
+
+	/* The entry is gone, deleting it again fails */
+	fail_if(gcal_batch_events(gcal, batch + 3, ops + 3, 1, results) != -1,
+		"Deleting twice should fail");
+	fail_if(results[0].status != 404, "Expected a 404, got %d",
+		results[0].status);
+	gcal_batch_results_cleanup(results, 1);
+
+	for (i = 0; i < 3; ++i)
+		gcal_event_delete(batch[i]);
+	gcal_cleanup_events(&events);
+
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Failed downloading events");
+	fail_if(events.length != 7, "Expected 7 events, got %d",
+		(int)events.length);
+	gcal_cleanup_events(&events);
+}
+END_TEST
+
+START_TEST (test_server_conditional)
+{
+	struct gcal_event_array events, unchanged;
+	gcal_event_t event;
+
+	fail_if(connect_server(gcal) != 0, "Failed logging in");
+	gcal_set_conditional(gcal, 1);
+
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Failed downloading events");
+	fail_if(events.length != 5, "Expected 5 events, got %d",
+		(int)events.length);
+
+	/* The server answers 304 to the feed ETag, the array is kept */
+	unchanged = events;
+	fail_if(gcal_get_events(gcal, &unchanged) != 1,
+		"Unchanged feed should return 1");
+	fail_if(gcal_status_httpcode(gcal) != 304, "Expected a 304");
+	fail_if((unchanged.entries != events.entries) ||
+		(unchanged.length != events.length),
+		"Unchanged feed should leave the array untouched");
+	gcal_cleanup_events(&events);
+
+	/* A change gives a new ETag, so a full answer */
+	event = gcal_event_new(NULL);
+	fail_if(event == NULL, "Failed creating event");
+	gcal_event_set_title(event, "Changes the feed");
+	gcal_event_set_start(event, "2026-10-17T16:00:00Z");
+	gcal_event_set_end(event, "2026-10-17T18:00:00Z");
+	fail_if(gcal_add_event(gcal, event) != 0, "Failed adding event");
+	gcal_event_delete(event);
+
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Changed feed should be downloaded");
+	fail_if(events.length != 6, "Expected 6 events, got %d",
+		(int)events.length);
+	gcal_cleanup_events(&events);
+}
+END_TEST
+
+static void async_done(struct gcal_async *op, int result,
+		       struct async_result *r)
+{
+	++r->done;
+	r->result = result;
+	r->code = gcal_async_httpcode(op);
+}
+
+static void erased(struct gcal_async *op, int result, void *data)
+{
+	async_done(op, result, (struct async_result *)data);
+}
+
+/* Chains the erase of the new entry */
+static void added(struct gcal_async *op, int result, void *data)
+{
+	struct async_result *r = (struct async_result *)data;
+
+	async_done(op, result, r);
+	if (!result && (r->xml = gcal_async_take_xml(op)))
+		gcal_async_erase_xmlentry(loop, gcal, r->xml, erased,
+					  &async_results[4]);
+}
+
+/* Chains the addition of an entry, once the events are known */
+static void events_done(struct gcal_async *op, int result, void *data)
+{
+	struct async_result *r = (struct async_result *)data;
+	struct gcal_event_array events;
+
+	async_done(op, result, r);
+	if (!result && !gcal_async_take_events(op, &events)) {
+		r->length = events.length;
+		gcal_cleanup_events(&events);
+	}
+	gcal_async_add_xmlentry(loop, gcal, (char *)new_entry, added,
+				&async_results[3]);
+}
+
+static void contacts_done(struct gcal_async *op, int result, void *data)
+{
+	struct async_result *r = (struct async_result *)data;
+	struct gcal_contact_array contacts;
+
+	async_done(op, result, r);
+	if (!result && !gcal_async_take_contacts(op, &contacts)) {
+		r->length = contacts.length;
+		gcal_cleanup_contacts(&contacts);
+	}
+}
+
+START_TEST (test_server_async)
+{
+	struct gcal_event_array events;
+	gcal_t contacts_obj;
+	int pending, i;
+
+	fail_if(connect_server(gcal) != 0, "Failed logging in");
+	contacts_obj = gcal_new(GCONTACT);
+	fail_if(contacts_obj == NULL, "Failed constructing contacts object");
+	fail_if(connect_server(contacts_obj) != 0,
+		"Failed logging in contacts");
+
+	memset(async_results, 0, sizeof(async_results));
+	loop = gcal_loop_new(NULL, NULL, NULL);
+	fail_if(loop == NULL, "Failed creating loop");
+
+	/* The calendar dump (with its redirection), a contacts dump and a
+	 * paged contacts query run at once, the dump then starts an add
+	 * and the add an erase */
+	fail_if(!gcal_async_dump(loop, gcal, events_done, &async_results[0]),
+		"Failed starting events dump");
+	fail_if(!gcal_async_dump(loop, contacts_obj, contacts_done,
+				 &async_results[1]),
+		"Failed starting contacts dump");
+	fail_if(!gcal_async_query(loop, contacts_obj, "max-results=2",
+				  contacts_done, &async_results[2]),
+		"Failed starting contacts query");
+
+	for (i = 0; i < 1000; ++i)
+		if ((pending = gcal_loop_wait(loop, 100)) <= 0)
+			break;
+	fail_if(pending != 0, "Operations should be finished");
+
+	fail_if(async_results[0].result || (async_results[0].length != 5),
+		"Expected 5 events, got %d", (int)async_results[0].length);
+	fail_if(async_results[1].result || (async_results[1].length != 3),
+		"Expected 3 contacts, got %d",
+		(int)async_results[1].length);
+	fail_if(async_results[2].result || (async_results[2].length != 3),
+		"Expected 3 queried contacts, got %d",
+		(int)async_results[2].length);
+	fail_if(async_results[3].result || (async_results[3].code != 201) ||
+		!async_results[3].xml, "Failed adding entry");
+	fail_if(async_results[4].result || (async_results[4].code != 200),
+		"Failed erasing entry");
+	for (i = 0; i < 5; ++i)
+		fail_if(async_results[i].done != 1,
+			"Operation %d done %d times", i,
+			async_results[i].done);
+	free(async_results[3].xml);
+
+	gcal_loop_delete(loop);
+	loop = NULL;
+	gcal_delete(contacts_obj);
+
+	/* The blocking API sees what the operations did */
+	fail_if(gcal_get_events(gcal, &events) != 0,
+		"Failed downloading events");
+	fail_if(events.length != 5, "Expected 5 events, got %d",
+		(int)events.length);
+	gcal_cleanup_events(&events);
+}
+END_TEST
+
+
+
+TCase *server_tcase_create(void)
+{
+	TCase *tc = NULL;
+	int timeout_seconds = 60;
+	tc = tcase_create("server");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_set_timeout(tc, timeout_seconds);
+	tcase_add_test(tc, test_server_auth);
+	tcase_add_test(tc, test_server_events);
+	tcase_add_test(tc, test_server_batch);
+	tcase_add_test(tc, test_server_conditional);
+	tcase_add_test(tc, test_server_async);
+	return tc;
+}
@@ -0,0 +1,15 @@
+#ifndef __UTEST_SERVER__
+#define __UTEST_SERVER__
+/*
+ * @file   utest_server.h
+ *
+ * @brief  Header module for the utests run against the stand-in server.
+ *
+ */
+
+#include <check.h>
+
+TCase *server_tcase_create(void);
+
+
+#endif
@@ -650,6 +650,63 @@ START_TEST (test_contact_photo)
 }
 END_TEST
 
+START_TEST (test_contact_lazy_photo)
+{
+	gcal_t gcal;
+	gcal_contact_t contact, tmp;
+	char *photo_data;
+	struct gcal_contact_array contact_array;
+	int result;
+
+	if (find_load_photo("/utests/images/gromit.jpg",  &photo_data, &result))
+		fail_if(1, "Cannot load photo!");
+
+	contact = gcal_contact_new(NULL);
+	fail_if (!contact, "Cannot construct contact object!");
+	gcal_contact_set_title(contact, "Lazy Gromit");
+	gcal_contact_add_email_address(contact, "lazy@wallace.com", E_OTHER, 1);
+	fail_if(gcal_contact_set_photo(contact, photo_data, result),
+		"Failed copying photo data");
+
+	gcal = gcal_new(GCONTACT);
+	result = gcal_get_authentication(gcal, "gcalntester", "77libgcal");
+	fail_if(result == -1, "Failed getting authentication");
+
+	result = gcal_add_contact(gcal, contact);
+	fail_if(result == -1, "Failed adding a new contact!");
+
+	/* Only the photo link is retrieved with the contacts */
+	gcal_set_lazy_photos(gcal, 1);
+	result = gcal_get_updated_contacts(gcal, &contact_array, NULL);
+	fail_if(result == -1, "Failed downloading updated contacts!");
+
+	tmp = gcal_contact_element(&contact_array, (contact_array.length - 1));
+	fail_if(tmp == NULL, "Last contact must not be NULL!");
+	fail_if(gcal_contact_get_photo(tmp) != NULL,
+		"Photo must not be downloaded in lazy mode!");
+	fail_if(gcal_contact_get_photolength(tmp) != 1,
+		"Contact must have a photo link!");
+
+	/* Then downloaded on demand */
+	result = gcal_contact_fetch_photo(gcal, tmp);
+	fail_if(result == -1, "Failed fetching contact photo!");
+	fail_if(gcal_contact_get_photo(tmp) == NULL,
+		"Fetched contact must have photo: %s",
+		gcal_contact_get_title(tmp));
+	fail_if(gcal_contact_get_photolength(tmp) < 2,
+		"Fetched contact photo length must be bigger");
+
+	result = gcal_erase_contact(gcal, contact);
+	fail_if(result == -1, "Failed deleting contact!");
+
+	gcal_contact_delete(contact);
+	gcal_delete(gcal);
+
+	gcal_cleanup_contacts(&contact_array);
+	free(photo_data);
+}
+END_TEST
+
 START_TEST (test_url_sanity_calendar)
 {
 	gcal_t gcal;
@@ -921,6 +978,7 @@ TCase *gcal_userapi(void)
 	tcase_add_test(tc, test_oper_contact);
 	tcase_add_test(tc, test_query_contact_updated);
 	tcase_add_test(tc, test_contact_photo);
+	tcase_add_test(tc, test_contact_lazy_photo);
 	tcase_add_test(tc, test_url_sanity_calendar);
 	tcase_add_test(tc, test_url_sanity_contact);
 	tcase_add_test(tc, test_contact_new_fields);
@@ -11,7 +11,9 @@
 #include "utest_xpath.h"
 #include "atom_parser.h"
 #include "xml_aux.h"
+#include "gcal_parser.h"
 #include "gcal.h"
+#include "gcalendar.h"
 #include "internal_gcal.h"
 #include <string.h>
 #include <stdio.h>
@@ -335,6 +337,344 @@ START_TEST (test_get_contact_photo)
 }
 END_TEST
 
+/* Feeds the pipeline in small chunks, like a slow network would do */
+static void *feed_pipeline(struct gcal_pipeline *pipe, const char *data,
+			   size_t chunk, size_t *length)
+{
+	size_t sent, size, total = strlen(data);
+
+	for (sent = 0; sent < total; sent += size) {
+		size = total - sent;
+		if (size > chunk)
+			size = chunk;
+		if (pipeline_feed(pipe, data + sent, size))
+			return NULL;
+	}
+
+	return pipeline_finish(pipe, length);
+}
+
+START_TEST (test_pipeline_events)
+{
+	struct gcal_pipeline *pipe;
+	struct gcal_event *streamed, *dom_events;
+	xmlDoc *doc = NULL;
+	char *file_contents = NULL;
+	size_t i, chunks[] = { 1, 7, 4096 }, c, length = 0, count;
+	int res;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &file_contents))
+		fail_if(1, "Cannot load test XML file!");
+
+	res = build_doc_tree(&doc, file_contents);
+	fail_if(res == -1, "failed to build document tree!");
+	res = get_entries_number_xml(doc);
+	fail_if(res != 3, "failed get correct number of entries!");
+	count = res;
+	dom_events = malloc(sizeof(struct gcal_event) * count);
+	for (i = 0; i < count; ++i)
+		gcal_init_event(&dom_events[i]);
+	res = extract_all_entries(doc, dom_events, count);
+	fail_if(res == -1, "failed to extract data from DOM!");
+
+	for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+		pipe = pipeline_create_events(1);
+		fail_if(pipe == NULL, "failed creating pipeline!");
+
+		streamed = feed_pipeline(pipe, file_contents, chunks[c],
+					 &length);
+		fail_if(streamed == NULL, "failed parsing in pipeline!");
+		fail_if(length != count, "wrong number of entries: %d",
+			(int)length);
+		/* Whatever was left must be released */
+		pipeline_destroy(pipe);
+
+		for (i = 0; i < length; ++i) {
+			fail_if(strcmp(streamed[i].common.id,
+				       dom_events[i].common.id),
+				"entries out of order!");
+			fail_if(strcmp(streamed[i].common.title,
+				       dom_events[i].common.title) ||
+				strcmp(streamed[i].common.etag,
+				       dom_events[i].common.etag) ||
+				strcmp(streamed[i].dt_recurrent,
+				       dom_events[i].dt_recurrent) ||
+				strcmp(streamed[i].dt_start,
+				       dom_events[i].dt_start),
+				"pipeline and DOM results differ!");
+			fail_if(!strstr(streamed[i].common.xml,
+					streamed[i].common.id),
+				"failed storing raw XML!");
+		}
+
+		gcal_destroy_entries(streamed, length);
+	}
+
+	gcal_destroy_entries(dom_events, count);
+	clean_doc_tree(&doc);
+	free(file_contents);
+}
+END_TEST
+
+START_TEST (test_pipeline_contacts)
+{
+	struct gcal_pipeline *pipe;
+	struct gcal_contact *streamed;
+	char *file_contents = NULL;
+	size_t length = 0;
+
+	if (find_load_file("/utests/up_new_delete_contact.xml",
+			   &file_contents))
+		fail_if(1, "Cannot load test XML file!");
+
+	pipe = pipeline_create_contacts(0);
+	fail_if(pipe == NULL, "failed creating pipeline!");
+	streamed = feed_pipeline(pipe, file_contents, 13, &length);
+	pipeline_destroy(pipe);
+
+	fail_if(streamed == NULL || length != 1, "failed parsing contacts!");
+	fail_if(streamed[0].common.deleted != 1,
+		"failed parsing deleted contact field!");
+	gcal_destroy_contacts(streamed, length);
+
+	/* Truncated feeds must be reported */
+	pipe = pipeline_create_contacts(0);
+	file_contents[strlen(file_contents) / 2] = '\0';
+	streamed = feed_pipeline(pipe, file_contents, 13, &length);
+	pipeline_destroy(pipe);
+	fail_if(streamed != NULL, "truncated feed should fail!");
+
+	free(file_contents);
+}
+END_TEST
+
+START_TEST (test_pipeline_pages)
+{
+	struct gcal_pipeline *pipe;
+	struct gcal_event *streamed;
+	const char next_link[] = "<link rel='next' type='application/atom+xml' "
+		"href='http://www.google.com/calendar/feeds/default/private/"
+		"full?start-index=4&amp;max-results=3'/>";
+	char *last = NULL, *first, *ptr, *next_url = NULL;
+	size_t length = 0;
+	int res;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &last))
+		fail_if(1, "Cannot load test XML file!");
+
+	/* The first page is the same feed, plus a link to the next one */
+	ptr = strstr(last, "<link");
+	fail_if(ptr == NULL, "feed without links!");
+	first = malloc(strlen(last) + sizeof(next_link));
+	memcpy(first, last, ptr - last);
+	strcpy(first + (ptr - last), next_link);
+	strcat(first, ptr);
+
+	pipe = pipeline_create_events(0);
+	fail_if(pipe == NULL, "failed creating pipeline!");
+
+	res = pipeline_feed(pipe, first, strlen(first));
+	fail_if(res == -1, "failed parsing first page!");
+	res = pipeline_end_page(pipe, &next_url);
+	fail_if(res == -1, "failed ending first page!");
+	fail_if(!next_url || strcmp(next_url, "http://www.google.com/calendar/"
+				    "feeds/default/private/full?"
+				    "start-index=4&max-results=3"),
+		"wrong next page URL!");
+	free(next_url);
+
+	res = pipeline_feed(pipe, last, strlen(last));
+	fail_if(res == -1, "failed parsing last page!");
+	res = pipeline_end_page(pipe, &next_url);
+	fail_if(res == -1, "failed ending last page!");
+	fail_if(next_url != NULL, "last page has no next URL!");
+
+	streamed = pipeline_finish(pipe, &length);
+	pipeline_destroy(pipe);
+	fail_if(streamed == NULL || length != 6,
+		"entries of all pages should be kept!");
+	fail_if(strcmp(streamed[0].common.id, streamed[3].common.id),
+		"failed parsing last page entries!");
+
+	gcal_destroy_entries(streamed, length);
+	free(first);
+	free(last);
+}
+END_TEST
+
+START_TEST (test_batch_feed)
+{
+	gcal_event_t events[2];
+	gcal_batch_op ops[2] = { GCAL_BATCH_INSERT, GCAL_BATCH_DELETE };
+	struct gcal_batch_result results[2];
+	char *xml = NULL;
+	int length, res;
+	char answer[] = "<feed xmlns='http://www.w3.org/2005/Atom' "
+		"xmlns:batch='http://schemas.google.com/gdata/batch' "
+		"xmlns:gd='http://schemas.google.com/g/2005'>"
+		"<entry gd:etag='\"E1\"'><batch:id>1</batch:id>"
+		"<batch:status code='200' reason='Success'/><id>ID1</id>"
+		"<link rel='edit' href='http://server/ID1/1'/></entry>"
+		"<entry><batch:id>0</batch:id>"
+		"<batch:status code='409' reason='Conflict'/></entry>"
+		"<entry><batch:id>7</batch:id>"
+		"<batch:status code='200' reason='Success'/></entry>"
+		"</feed>";
+
+	events[0] = gcal_event_new(NULL);
+	events[1] = gcal_event_new(NULL);
+	fail_if(!events[0] || !events[1], "failed creating events!");
+	gcal_event_set_title(events[0], "a new event");
+	gcal_event_set_id(events[1], "ID1");
+	gcal_event_set_etag(events[1], "\"E0\"");
+
+	res = xmlbatch_events_create(events, ops, 2, &xml, &length);
+	fail_if(res == -1 || !xml, "failed creating batch feed!");
+	fail_if(!strstr(xml, "<batch:id>1</batch:id>") ||
+		!strstr(xml, "<batch:operation type=\"insert\"/>") ||
+		!strstr(xml, "<batch:operation type=\"delete\"/>"),
+		"batch feed misses operations!");
+	fail_if(!strstr(xml, "a new event"), "inserts must be complete!");
+	fail_if(strstr(strstr(xml, "<batch:id>1"), "<category") != NULL,
+		"deletes only need the entry key!");
+	free(xml);
+
+	memset(results, 0, sizeof(results));
+	res = extract_batch_results(answer, strlen(answer), results, 2);
+	fail_if(res == -1, "failed parsing batch answer!");
+	fail_if(results[0].status != 409 || !results[0].reason ||
+		strcmp(results[0].reason, "Conflict"),
+		"wrong result of first entry!");
+	fail_if(results[1].status != 200 || !results[1].id ||
+		strcmp(results[1].id, "ID1") || !results[1].etag ||
+		strcmp(results[1].etag, "\"E1\"") || !results[1].edit_uri ||
+		strcmp(results[1].edit_uri, "http://server/ID1/1"),
+		"wrong result of second entry!");
+
+	gcal_batch_results_cleanup(results, 2);
+	gcal_event_delete(events[0]);
+	gcal_event_delete(events[1]);
+}
+END_TEST
+
+START_TEST (test_xpath_cache)
+{
+	xmlDoc *doc = NULL;
+	xmlXPathObject *cached, *uncached;
+	int res;
+
+	res = build_doc_tree(&doc, xml_data);
+	fail_if(res == -1, "failed to build document tree!");
+
+	cached = execute_xpath_query(doc, XPATH_ENTRIES);
+	uncached = execute_xpath_expression(doc, "//atom:entry", NULL);
+	fail_if(!cached || !cached->nodesetval || !uncached ||
+		!uncached->nodesetval, "failed to evaluate expressions!");
+	fail_if(cached->nodesetval->nodeNr != 4 ||
+		uncached->nodesetval->nodeNr != 4,
+		"compiled and plain expressions should find 4 entries!");
+	xmlXPathFreeObject(cached);
+	xmlXPathFreeObject(uncached);
+
+	fail_if(execute_xpath_query(doc, XPATH_QUERY_NR) != NULL,
+		"there is no such expression!");
+
+	/* Everything is created again after a cleanup */
+	clean_xpath_cache();
+	cached = execute_xpath_query(doc, XPATH_WHEN_REMINDERS);
+	fail_if(!cached || !cached->nodesetval ||
+		cached->nodesetval->nodeNr != 4,
+		"should find 4 reminders after a cache cleanup!");
+	xmlXPathFreeObject(cached);
+
+	clean_doc_tree(&doc);
+}
+END_TEST
+
+START_TEST (test_reader_feed)
+{
+	struct gcal_pipeline *pipe;
+	struct gcal_event *read, *dom_events;
+	struct gcal_contact *contacts;
+	gcal_t gcal;
+	xmlDoc *doc = NULL;
+	char *file_contents = NULL;
+	size_t i, length = 0, count;
+	int res;
+
+	if (find_load_file("/utests/3entries_recurrence.xml", &file_contents))
+		fail_if(1, "Cannot load test XML file!");
+
+	res = build_doc_tree(&doc, file_contents);
+	fail_if(res == -1, "failed to build document tree!");
+	res = get_entries_number_xml(doc);
+	fail_if(res != 3, "failed get correct number of entries!");
+	count = res;
+	dom_events = malloc(sizeof(struct gcal_event) * count);
+	for (i = 0; i < count; ++i) {
+		gcal_init_event(&dom_events[i]);
+		dom_events[i].common.store_xml = 1;
+	}
+	res = extract_all_entries(doc, dom_events, count);
+	fail_if(res == -1, "failed to extract data from DOM!");
+
+	/* A buffered feed, as left by a download */
+	gcal = gcal_new(GCALENDAR);
+	fail_if(gcal == NULL, "failed creating resource!");
+	gcal_set_store_xml(gcal, 1);
+	gcal_set_reader(gcal, 1);
+	free(gcal->buffer);
+	gcal->buffer = strdup(file_contents);
+	gcal->used = gcal->length = strlen(file_contents);
+	gcal->has_xml = 1;
+
+	read = gcal_get_entries(gcal, &length);
+	fail_if(read == NULL, "failed parsing with reader!");
+	fail_if(length != count, "wrong number of entries: %d", (int)length);
+
+	for (i = 0; i < length; ++i) {
+		fail_if(strcmp(read[i].common.id, dom_events[i].common.id),
+			"entries out of order!");
+		fail_if(strcmp(read[i].common.title,
+			       dom_events[i].common.title) ||
+			strcmp(read[i].common.etag,
+			       dom_events[i].common.etag) ||
+			strcmp(read[i].dt_recurrent,
+			       dom_events[i].dt_recurrent) ||
+			strcmp(read[i].common.xml, dom_events[i].common.xml),
+			"reader and DOM results differ!");
+	}
+
+	gcal_destroy_entries(read, length);
+	gcal_destroy_entries(dom_events, count);
+	clean_doc_tree(&doc);
+	gcal_delete(gcal);
+	free(file_contents);
+
+	if (find_load_file("/utests/up_new_delete_contact.xml",
+			   &file_contents))
+		fail_if(1, "Cannot load test XML file!");
+
+	pipe = pipeline_create_contacts(0);
+	fail_if(pipe == NULL, "failed creating pipeline!");
+	res = pipeline_read(pipe, file_contents, strlen(file_contents));
+	fail_if(res == -1, "failed reading contacts!");
+	contacts = pipeline_finish(pipe, &length);
+	pipeline_destroy(pipe);
+	fail_if(contacts == NULL || length != 1, "failed parsing contacts!");
+	fail_if(contacts[0].common.deleted != 1,
+		"failed parsing deleted contact field!");
+	gcal_destroy_contacts(contacts, length);
+
+	/* Truncated feeds must be reported */
+	pipe = pipeline_create_contacts(0);
+	res = pipeline_read(pipe, file_contents, strlen(file_contents) / 2);
+	pipeline_destroy(pipe);
+	fail_if(res != -1, "truncated feed should fail!");
+
+	free(file_contents);
+}
+END_TEST
 
 TCase *xpath_tcase_create(void)
 {
@@ -349,6 +689,12 @@ TCase *xpath_tcase_create(void)
 	tcase_add_test(tc, test_get_contact_nophoto);
 	tcase_add_test(tc, test_get_contact_photo);
 	tcase_add_test(tc, test_normalize_url);
+	tcase_add_test(tc, test_pipeline_events);
+	tcase_add_test(tc, test_pipeline_contacts);
+	tcase_add_test(tc, test_pipeline_pages);
+	tcase_add_test(tc, test_batch_feed);
+	tcase_add_test(tc, test_xpath_cache);
+	tcase_add_test(tc, test_reader_feed);
 	return tc;
 
 }